@@ -8,6 +8,7 @@
 #include "arch/ppc.h"
 #include "common/sctp_crc32.h"
 #include "common/crc32c_intel_fast.h"
+#include "common/crc32c_intel_multi.h"
 #include "common/crc32c_aarch64.h"
 #include "common/crc32c_ppc.h"
 
@@ -52,6 +53,61 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
  */
 ceph_crc32c_func_t ceph_crc32c_func = ceph_choose_crc32();
 
+static void ceph_crc32c_multi_generic(unsigned n, uint32_t *crc,
+				      unsigned char const *const *data,
+				      unsigned const *length)
+{
+  for (unsigned i = 0; i < n; ++i) {
+    crc[i] = ceph_crc32c(crc[i], data[i], length[i]);
+  }
+}
+
+ceph_crc32c_multi_func_t ceph_choose_crc32c_multi(void)
+{
+  ceph_arch_probe();
+
+#if defined(__x86_64__)
+  if (ceph_arch_intel_sse42 && ceph_crc32c_intel_multi_exists()) {
+    return ceph_crc32c_intel_multi;
+  }
+#endif
+  return ceph_crc32c_multi_generic;
+}
+
+ceph_crc32c_multi_func_t ceph_crc32c_multi_func = ceph_choose_crc32c_multi();
+
+/*
+ * crc(c, A || B) == crc(crc(c, A), zeros(|B|)) ^ crc(0, B), so the
+ * segments can be digested independently and folded back together.
+ * the fold costs a ceph_crc32c_zeros() per segment, which is cheap
+ * next to a few KB of data but not next to a few hundred bytes.
+ */
+#define CRC32C_SPLIT_WAYS 4
+#define CRC32C_SPLIT_MIN (16 * 1024)
+
+uint32_t ceph_crc32c_split(uint32_t crc, unsigned char const *data, unsigned length)
+{
+  if (!data || length < CRC32C_SPLIT_MIN ||
+      ceph_crc32c_multi_func == ceph_crc32c_multi_generic) {
+    return ceph_crc32c(crc, data, length);
+  }
+  uint32_t c[CRC32C_SPLIT_WAYS];
+  unsigned char const *d[CRC32C_SPLIT_WAYS];
+  unsigned l[CRC32C_SPLIT_WAYS];
+  unsigned seg = (length / CRC32C_SPLIT_WAYS) & ~7u;
+  for (unsigned i = 0; i < CRC32C_SPLIT_WAYS; ++i) {
+    c[i] = i ? 0 : crc;
+    d[i] = data + i * seg;
+    l[i] = i < CRC32C_SPLIT_WAYS - 1 ? seg : length - i * seg;
+  }
+  ceph_crc32c_multi(CRC32C_SPLIT_WAYS, c, d, l);
+  uint32_t r = c[0];
+  for (unsigned i = 1; i < CRC32C_SPLIT_WAYS; ++i) {
+    r = ceph_crc32c_zeros(r, l[i]) ^ c[i];
+  }
+  return r;
+}
+
 
 /*
  * Look: http://crcutil.googlecode.com/files/crc-doc.1.0.pdf
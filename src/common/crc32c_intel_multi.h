@@ -0,0 +1,33 @@
+#ifndef CEPH_COMMON_CRC32C_INTEL_MULTI_H
+#define CEPH_COMMON_CRC32C_INTEL_MULTI_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* is the multi-buffer version compiled in */
+extern int ceph_crc32c_intel_multi_exists(void);
+
+#ifdef __x86_64__
+
+extern void ceph_crc32c_intel_multi(unsigned n, uint32_t *crc,
+				    unsigned char const *const *data,
+				    unsigned const *length);
+
+#else
+
+static inline void ceph_crc32c_intel_multi(unsigned n, uint32_t *crc,
+					   unsigned char const *const *data,
+					   unsigned const *length)
+{
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -77,6 +77,12 @@ public:
     else
       key = key_;
   }
+  void set_key(std::string&& key_) {
+    if (key_ == oid.name)
+      key.clear();
+    else
+      key = std::move(key_);
+  }
 
   std::string to_str() const;
   
@@ -133,7 +139,7 @@ public:
   hobject_t(object_t oid, const std::string& key, snapid_t snap, uint32_t hash,
 	    int64_t pool, std::string nspace)
     : oid(oid), snap(snap), hash(hash), max(false),
-      pool(pool), nspace(nspace),
+      pool(pool), nspace(std::move(nspace)),
       key(oid.name == key ? std::string() : key) {
     build_hash_cache();
   }
@@ -141,7 +147,7 @@ public:
   hobject_t(const sobject_t &soid, const std::string &key, uint32_t hash,
 	    int64_t pool, std::string nspace)
     : oid(soid.oid), snap(soid.snap), hash(hash), max(false),
-      pool(pool), nspace(nspace),
+      pool(pool), nspace(std::move(nspace)),
       key(soid.oid.name == key ? std::string() : key) {
     build_hash_cache();
   }
@@ -35,6 +35,12 @@ public:
     const std::set<K> &to_remove ///< [in] keys to remove
     ) = 0;
 
+  /// Remove every key in [first, last)
+  virtual void remove_range(
+    const K &first, ///< [in] first key to remove
+    const K &last   ///< [in] first key past the range
+    ) = 0;
+
   /// Add context to fire when data is readable
   virtual void add_callback(
     Context *c ///< [in] Context to fire on readable
@@ -156,6 +162,51 @@ public:
     t->add_callback(new TransHolder(vptrs));
   }
 
+  /**
+   * Adds operation removing keys to Transaction, like remove_keys, but
+   * each run of keys with no other visible key in between is dropped
+   * with a single range removal.  Ranges stop short of bound; the caller
+   * must be the only writer of keys in [*keys.begin(), bound).
+   */
+  void remove_keys_ranged(
+    const set<K> &keys,  ///< [in] keys to remove, all < bound
+    const K &bound,      ///< [in] end of the caller's key space
+    Transaction<K, V> *t ///< [out] transaction to use
+    ) {
+    // mark them first so that get_next() looks past them
+    std::set<VPtr> vptrs;
+    for (typename set<K>::const_iterator i = keys.begin();
+	 i != keys.end();
+	 ++i) {
+      boost::optional<V> empty;
+      VPtr ip = in_progress.lookup_or_create(*i, empty);
+      *ip = empty;
+      vptrs.insert(ip);
+    }
+    set<K> single;
+    typename set<K>::const_iterator i = keys.begin();
+    while (i != keys.end()) {
+      pair<K, V> next;
+      int r = get_next(*i, &next);
+      if (r < 0 && r != -ENOENT) {
+	single.insert(i, keys.end());
+	break;
+      }
+      // anything else still in [*i, end) is already being removed
+      K end = (r == 0 && next.first < bound) ? next.first : bound;
+      typename set<K>::const_iterator j = keys.lower_bound(end);
+      if (std::distance(i, j) > 1) {
+	t->remove_range(*i, end);
+      } else {
+	single.insert(*i);
+      }
+      i = j;
+    }
+    if (!single.empty())
+      t->remove_keys(single);
+    t->add_callback(new TransHolder(vptrs));
+  }
+
   /// Gets keys, uses cached values for unstable keys
   int get_keys(
     const set<K> &keys_to_get, ///< [in] set of keys to fetch
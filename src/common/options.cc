@@ -911,6 +911,24 @@ std::vector<Option> get_global_options() {
     .set_default(0)
     .set_description("Size of TCP socket receive buffer"),
 
+    Option("ms_tcp_zerocopy", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Send large buffers with MSG_ZEROCOPY instead of copying them into the socket")
+    .set_long_description("Only applies to the posix async messenger on Linux 4.14 or later, and to connections established after it is set.  Buffers are kept referenced until the kernel reports their transmission complete.")
+    .add_see_also("ms_tcp_zerocopy_min_size"),
+
+    Option("ms_tcp_zerocopy_min_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_description("Minimum length of a buffer segment to send with MSG_ZEROCOPY")
+    .set_long_description("Smaller segments are copied as usual; pinning pages and handling the completion costs more than copying them.")
+    .add_see_also("ms_tcp_zerocopy"),
+
+    Option("ms_tcp_zerocopy_linger_timeout", Option::TYPE_SECS, Option::LEVEL_ADVANCED)
+    .set_default(30)
+    .set_description("How long a closed connection may wait for its MSG_ZEROCOPY sends to complete")
+    .set_long_description("A connection closed with zero-copy sends in flight is shut down for writing and kept open until the kernel reports them complete.  If that takes longer than this, the connection is reset and the buffers are released.")
+    .add_see_also("ms_tcp_zerocopy"),
+
     Option("ms_tcp_prefetch_max_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(4_K)
     .set_description("Maximum amount of data to prefetch out of the socket receive buffer"),
@@ -1104,6 +1122,68 @@ std::vector<Option> get_global_options() {
     .set_description("Maximum threadpool size of AsyncMessenger")
     .add_see_also("ms_async_op_threads"),
 
+    Option("ms_async_worker_placement", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("connections")
+    .set_enum_allowed({"connections", "load"})
+    .set_description("How AsyncMessenger assigns new connections to worker threads")
+    .set_long_description("'connections' picks the worker with the fewest connections.  'load' picks the worker that spent the least time handling events over the last second, counting each of its connections at the average cost of a connection.")
+    .add_see_also("ms_async_op_threads"),
+
+    Option("ms_async_rebalance_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Seconds between attempts to move a busy connection to a less loaded AsyncMessenger worker")
+    .set_long_description("Each attempt moves at most one established connection per messenger.  0 disables moving connections after they are placed.  Only the posix and shm stacks support it; rdma and dpdk connections stay on their worker.")
+    .add_see_also("ms_async_rebalance_threshold"),
+
+    Option("ms_async_rebalance_threshold", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.2)
+    .set_min_max(0.0, 1.0)
+    .set_description("Minimum difference in busy time share between the busiest and least busy worker to move a connection")
+    .add_see_also("ms_async_rebalance_interval"),
+
+    Option("ms_async_numa_node", Option::TYPE_INT, Option::LEVEL_ADVANCED)
+    .set_default(-1)
+    .set_description("Pin AsyncMessenger worker threads to the CPUs of this numa node")
+    .set_long_description("-1 does not pin them unless ms_async_numa_iface is set.")
+    .add_see_also("ms_async_numa_iface"),
+
+    Option("ms_async_numa_iface", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("")
+    .set_description("Pin AsyncMessenger worker threads to the numa node of this network interface")
+    .set_long_description("Ignored if ms_async_numa_node is set.")
+    .add_see_also("ms_async_numa_node"),
+
+    Option("ms_async_coalesce_latency_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Longest time a small outgoing message may be held back to be sent together with the following ones (microseconds)")
+    .set_long_description("The window adapts to each connection: messages are only held back while they are queued at least twice as often as this, and for about two average gaps between messages. 0 sends every message as soon as the worker gets to it.")
+    .add_see_also("ms_async_coalesce_max_bytes"),
+
+    Option("ms_async_coalesce_max_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_description("Write frames queued behind each other with one send call until this many bytes accumulate")
+    .set_long_description("Also the most message data a connection holds back while coalescing. 0 sends every frame with its own call.")
+    .add_see_also("ms_async_coalesce_latency_us"),
+
+    Option("ms_async_shm_ring_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(1_M)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Size of each direction's ring buffer for shared memory connections")
+    .set_long_description("Only used with ms_type async+shm, which talks to peers on the same host through shared memory and to everybody else over TCP. Rounded up to a power of two. 0 disables shared memory and makes async+shm behave like async+posix.")
+    .add_see_also("ms_type"),
+
+    Option("ms_async_busy_poll_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Longest time an AsyncMessenger worker spins looking for events before it blocks (microseconds)")
+    .set_long_description("Trades cpu for the wakeup latency of lightly loaded workers. The window adapts to each worker: it stays open while spinning catches events and shrinks to nothing while the worker is idle. Also set as SO_BUSY_POLL on sockets where the kernel allows it. 0 disables busy polling.")
+    .add_see_also("ms_async_busy_poll_load_limit"),
+
+    Option("ms_async_busy_poll_load_limit", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.8)
+    .set_description("Stop busy polling while the load average per online cpu is above this")
+    .add_see_also("ms_async_busy_poll_us"),
+
     Option("ms_async_rdma_device_name", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("")
     .set_description(""),
@@ -2754,6 +2834,13 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_STARTUP)
     .add_see_also("osd_op_queue_cut_off"),
 
+    Option("osd_op_queue_cost_write_pressure_scale", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.0)
+    .set_min(0.0)
+    .set_description("Scale the queue cost of write ops with the object store's write pressure")
+    .set_long_description("A write op's queue cost is multiplied by 1 + scale * pressure, where pressure goes from 0 to 1 as the object store approaches a write stall. 0 (the default) disables; 1 doubles the cost of writes at the point of a stall.")
+    .add_see_also("osd_op_queue"),
+
     Option("osd_op_queue_cut_off", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("low")
     .set_enum_allowed( { "low", "high", "debug_random" } )
@@ -3225,6 +3312,20 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("osd_ec_parity_delta_writes", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Update parity from data deltas on small EC overwrites")
+    .set_long_description("When a partial stripe overwrite touches few enough data chunks, read only those chunks and the coding chunks, and write back only them, instead of reading and re-encoding the whole stripe. Requires a plugin that supports it (jerasure reed_sol_van and reed_sol_r6_op, isa).")
+    .add_see_also("osd_pool_erasure_code_stripe_unit"),
+
+    Option("osd_ec_stripe_cache_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Bytes of recently written stripes each EC PG keeps to serve later partial overwrites")
+    .set_long_description("Partial stripe overwrites on pools with allow_ec_overwrites must read the rest of the stripe first.  With this set, each PG keeps up to this many bytes of the most recently committed stripes so that sequential small writes do not read back what they just wrote.  The memory is accounted in the osd_ec_cache mempool.  0 disables it.")
+    .add_see_also("osd_ec_parity_delta_writes"),
+
     Option("osd_recover_clone_overlap_limit", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(10)
     .set_description(""),
@@ -3242,6 +3343,13 @@ std::vector<Option> get_global_options() {
     .set_default(512)
     .set_description(""),
 
+    Option("osd_backfill_scan_digest_objects", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Objects per range in digest based backfill scans")
+    .set_long_description("When scanning a backfill target, the primary sends a digest of the names and versions of its own objects for each range of this many objects.  The target lists each range in one pass and only returns the objects of ranges that differ, so ranges which are already up to date cost no per-object traffic.  0 disables digest scans.")
+    .add_see_also("osd_backfill_scan_max"),
+
     Option("osd_op_thread_timeout", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(15)
     .set_description(""),
@@ -3284,6 +3392,35 @@ std::vector<Option> get_global_options() {
     .set_default(2)
     .set_description("Time in seconds to sleep before next snap trim when data is on HDD and journal is on SSD"),
 
+    Option("osd_snap_trim_client_latency_target", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Client op latency in seconds snap trimming tries not to exceed (0 to use the fixed sleep)")
+    .set_long_description("When set, the snap trim sleep is no longer fixed: it doubles (up to osd_snap_trim_adaptive_sleep_max) every OSD tick while the average latency of client ops is above this target, and halves back towards zero while it is below or the OSD is idle.  The number of clones trimmed per transaction shrinks accordingly.")
+    .add_see_also("osd_snap_trim_sleep")
+    .add_see_also("osd_snap_trim_adaptive_sleep_max"),
+
+    Option("osd_snap_trim_adaptive_sleep_max", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(5)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Upper bound in seconds of the snap trim sleep when adapting to client latency")
+    .add_see_also("osd_snap_trim_client_latency_target"),
+
+    Option("osd_snap_trim_batch_objects", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(16)
+    .set_min(1)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Maximum number of clones trimmed in a single transaction")
+    .set_long_description("Each of the osd_pg_max_concurrent_snap_trims transactions in flight for a PG trims up to this many clones, sharing one log update and one batch of snap mapper key removals.")
+    .add_see_also("osd_pg_max_concurrent_snap_trims"),
+
+    Option("osd_snap_mapper_range_delete", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Remove adjacent snap mapper keys with range deletes")
+    .set_long_description("When a transaction drops the snap mapper entries of several clones, keys that are adjacent in the store are removed with one range delete instead of one tombstone each, which keeps later scans of the mapping cheap.")
+    .add_see_also("osd_snap_trim_batch_objects"),
+
     Option("osd_scrub_invalid_stats", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(true)
     .set_description(""),
@@ -3352,6 +3489,13 @@ std::vector<Option> get_global_options() {
     .set_default(300)
     .set_description(""),
 
+    Option("osd_pg_stats_full_report_interval", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(60)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Send the stats of every primary pg to the mgr once every this many reports")
+    .set_long_description("In between, pgs whose current stats the mgr has already acknowledged on the same session are left out.  0 sends every pg in every report.")
+    .add_see_also("osd_mon_report_interval"),
+
     Option("osd_pg_stat_report_interval_max", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(500)
     .set_description(""),
@@ -3406,6 +3550,27 @@ std::vector<Option> get_global_options() {
     .set_default(1)
     .set_description(""),
 
+    Option("osd_recovery_batch_max_object_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Largest object whose recovery push may share a recovery op with others")
+    .set_long_description("On replicated pools, pushes of objects up to this size, counting their omap keys and values, are batched: they count as a single recovery op against osd_recovery_max_active, go out in one message and are applied in one transaction on the target.  This cuts per-object overhead when recovering or backfilling many small objects.  0 disables batching.")
+    .add_see_also("osd_recovery_batch_max_objects")
+    .add_see_also("osd_recovery_batch_max_bytes"),
+
+    Option("osd_recovery_batch_max_objects", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_min(1)
+    .set_description("Maximum number of small objects in one recovery batch")
+    .add_see_also("osd_recovery_batch_max_object_size"),
+
+    Option("osd_recovery_batch_max_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(4_M)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Maximum total size of the objects in one recovery batch")
+    .add_see_also("osd_recovery_batch_max_object_size"),
+
     Option("osd_recovery_max_chunk", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(8_M)
     .set_description(""),
@@ -3503,6 +3668,34 @@ std::vector<Option> get_global_options() {
     .set_default(0)
     .set_description("Duration to inject a delay during scrubbing"),
 
+    Option("osd_scrub_client_latency_target", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Client op latency (seconds) above which scrub backs off")
+    .set_long_description("While the moving average of client op latency on this OSD is above this target, the delay between scrub chunks doubles every OSD tick up to osd_scrub_adaptive_sleep_max and chunks shrink towards osd_scrub_chunk_min.  Both recover once clients are fast or idle again.  0 disables the adaptation.")
+    .add_see_also("osd_scrub_sleep")
+    .add_see_also("osd_scrub_adaptive_sleep_max"),
+
+    Option("osd_scrub_adaptive_sleep_max", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(1.0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Largest delay added between scrub chunks when clients are slow")
+    .add_see_also("osd_scrub_client_latency_target"),
+
+    Option("osd_scrub_host_max_scrubs", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Maximum number of OSDs on a host scrubbing at once")
+    .set_long_description("OSDs on the same host take one of this many lock files in osd_scrub_host_lock_dir before scrubbing as primary or replica, and decline scrub reservations while none is free.  0 means no host wide limit.  The OSDs must share osd_scrub_host_lock_dir, which needs care with containerized deployments.")
+    .add_see_also("osd_max_scrubs")
+    .add_see_also("osd_scrub_host_lock_dir"),
+
+    Option("osd_scrub_host_lock_dir", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("$run_dir")
+    .set_description("Directory holding the host scrub slot lock files")
+    .set_long_description("Every OSD on the host must see the same directory for the limit to work. Containerized OSDs usually each get a run directory of their own; point this at a host directory mounted into all of their containers, otherwise each OSD only limits itself and osd_scrub_host_max_scrubs has no host wide effect.")
+    .add_see_also("osd_scrub_host_max_scrubs"),
+
     Option("osd_scrub_auto_repair", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description("Automatically repair damaged objects detected during scrub"),
@@ -3529,6 +3722,11 @@ std::vector<Option> get_global_options() {
     .set_default(512_K)
     .set_description("Number of bytes to read from an object at a time during deep scrub"),
 
+    Option("osd_deep_scrub_crc32c_split", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(false)
+    .set_description("Digest deep scrub reads with the 4-way split crc32c")
+    .set_long_description("Each extent of a deep scrub read is cut into four segments that are digested in parallel and folded back together.  The digest is the same as the default path.  The default ceph_crc32c already interleaves three streams where the ISA-L routines are built, so the split is only worth enabling on hosts where the crc32c throughput comparison in unittest_crc32c shows it winning."),
+
     Option("osd_deep_scrub_keys", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(1024)
     .set_description("Number of keys to read from an object at a time during deep scrub"),
@@ -3907,6 +4105,13 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("memdb_index_type", Option::TYPE_STR, Option::LEVEL_DEV)
+    .set_default("map")
+    .set_enum_allowed({"map", "skiplist"})
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Ordered index used by the MemDB key/value store")
+    .set_long_description("'map' is a std::map behind a single mutex. 'skiplist' is a concurrent skiplist whose readers (gets and iterators) never take a lock; writers are still serialized."),
+
     Option("rocksdb_log_to_ceph_log", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(true)
     .set_description(""),
@@ -3956,6 +4161,24 @@ std::vector<Option> get_global_options() {
     .set_description("Delete Range will be called if number of keys exceeded, must enable rocksdb_enable_rmrange first")
     .add_see_also("rocksdb_enable_rmrange"),
 
+    Option("rocksdb_max_items_rmrange_per_txn", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(16384)
+    .set_description("Point deletes range removals may add to one transaction; 0 is unlimited")
+    .set_long_description("Once a transaction holds this many point deletes from range removals, every further non-empty range removal in it is a single Delete Range, however few keys it holds.")
+    .add_see_also("rocksdb_max_items_rmrange"),
+
+    Option("rocksdb_collect_prefix_stats", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Count gets, writes, deletes and iterator seeks per key prefix")
+    .set_long_description("The counters are reported by the dump_objectstore_kv_stats admin socket command."),
+
+    Option("rocksdb_tombstone_compact_threshold", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1000000)
+    .set_description("Compact the key range of a prefix once this many deletes accumulated in it; 0 disables")
+    .set_long_description("Deletes leave tombstones that every iterator over the range has to skip until compaction drops them. Up to 8 separate key ranges are tracked per prefix, and only a range that gathered this many deletes is compacted. A range delete counts as rocksdb_max_items_rmrange + 1 deletes; removals without an end key are not tracked.")
+    .add_see_also("rocksdb_max_items_rmrange"),
+
     Option("rocksdb_bloom_bits_per_key", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(20)
     .set_description("Number of bits per key to use for RocksDB's bloom filters.")
@@ -4673,11 +4896,21 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_rocksdb_cf", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
-    .set_description("Enable use of rocksdb column families for bluestore metadata"),
+    .set_description("Enable use of rocksdb column families for bluestore metadata")
+    .set_long_description("Stores created with this enabled use the layout in bluestore_rocksdb_cfs. Releases that don't know about sharded column families cannot open such a store.")
+    .add_see_also("bluestore_rocksdb_cfs"),
 
     Option("bluestore_rocksdb_cfs", Option::TYPE_STR, Option::LEVEL_DEV)
-    .set_default("M= P= L=")
-    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options"),
+    .set_default("M(3,0-8) P=write_buffer_size=16M;max_write_buffer_number=16;min_write_buffer_number_to_merge=8 L=write_buffer_size=16M;max_write_buffer_number=16;min_write_buffer_number_to_merge=8 O(3,0-13) X b=write_buffer_size=32M")
+    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options")
+    .set_long_description("Each entry is NAME[(SHARDS[,L-H])][=OPTIONS]. With SHARDS > 1 the keys of prefix NAME are hashed (over key bytes L to H) into SHARDS column families. The layout is only applied when the store is created with bluestore_rocksdb_cf enabled; use 'ceph-bluestore-tool reshard' to change an existing store. Options are applied on every open. By default omap (M) is sharded by object and onodes (O) by the placement hash, so they compact independently; pg log (P) and deferred writes (L), which are deleted soon after being written, merge many small memtables so most of their keys never reach L0; shared blobs (X) and the freelist (b) get column families of their own.")
+    .add_see_also("bluestore_rocksdb_cf"),
+
+    Option("bluestore_compact_removed_collections", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Compact the onode key range of a collection once it is removed")
+    .set_long_description("Removing a PG deletes all of its onodes; compacting their key range right away drops the tombstones instead of leaving them for iterators to skip. Every removal queues a compaction, which adds up when many PGs move off an OSD; rocksdb_tombstone_compact_threshold only compacts ranges that gathered many deletes.")
+    .add_see_also("rocksdb_tombstone_compact_threshold"),
 
     Option("bluestore_fsck_on_mount", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
@@ -4717,6 +4950,21 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_RUNTIME)
     .set_description("Maximum bytes in flight before we throttle IO submission"),
 
+    Option("bluestore_throttle_kv_pressure_start", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.5)
+    .set_min_max(0.0, 1.0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("kv write pressure at which the bluestore throttles start to shrink")
+    .set_long_description("Write pressure is reported by the kv store: 0 when idle, 1 when writes are stopped. For rocksdb it follows level 0 files, pending compaction bytes and write stall state.")
+    .add_see_also("bluestore_throttle_kv_pressure_min_ratio"),
+
+    Option("bluestore_throttle_kv_pressure_min_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.1)
+    .set_min_max(0.0, 1.0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Fraction of bluestore_throttle_bytes and bluestore_throttle_deferred_bytes admitted at full kv write pressure")
+    .add_see_also("bluestore_throttle_kv_pressure_start"),
+
     Option("bluestore_throttle_deferred_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(128_M)
     .set_flag(Option::FLAG_RUNTIME)
@@ -359,4 +359,27 @@ int ErasureCode::decode_concat(const map<int, bufferlist> &chunks,
   }
   return r;
 }
+
+void ErasureCode::encode_delta(const bufferptr &old_data,
+			       const bufferptr &new_data,
+			       bufferptr *delta)
+{
+  // every linear code over GF(2^w) uses addition, i.e. xor, for the delta
+  ceph_assert(old_data.length() == new_data.length());
+  if (delta->length() != old_data.length()) {
+    *delta = buffer::create_aligned(old_data.length(), SIMD_ALIGN);
+  }
+  const char *o = old_data.c_str();
+  const char *n = new_data.c_str();
+  char *d = delta->c_str();
+  for (unsigned i = 0; i < old_data.length(); ++i) {
+    d[i] = o[i] ^ n[i];
+  }
+}
+
+int ErasureCode::apply_delta(const map<int, bufferptr> &in,
+			     map<int, bufferptr> &out)
+{
+  return -EOPNOTSUPP;
+}
 }
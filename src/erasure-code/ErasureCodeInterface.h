@@ -459,6 +459,49 @@ namespace ceph {
      */
     virtual int decode_concat(const std::map<int, bufferlist> &chunks,
 			      bufferlist *decoded) = 0;
+
+    /**
+     * Return true if the plugin can update coding chunks in place
+     * from the difference between the old and the new content of a
+     * subset of the data chunks, with **encode_delta** and
+     * **apply_delta**. A partial overwrite can then read and write
+     * only the modified data chunks and the coding chunks instead of
+     * re-encoding the whole stripe.
+     *
+     * @return **true** if **apply_delta** is implemented
+     */
+    virtual bool supports_parity_delta() const = 0;
+
+    /**
+     * Compute the delta between **old_data** and **new_data**, two
+     * versions of the same data chunk, and store it in **delta**.
+     * All three buffers must have the same length; **delta** may
+     * alias **old_data** or **new_data**.
+     *
+     * @param [in] old_data current content of the data chunk
+     * @param [in] new_data content about to be written
+     * @param [out] delta difference suitable for **apply_delta**
+     */
+    virtual void encode_delta(const bufferptr &old_data,
+			      const bufferptr &new_data,
+			      bufferptr *delta) = 0;
+
+    /**
+     * Update the coding chunks in **out** with the deltas in **in**,
+     * as computed by **encode_delta**. The keys of **in** are data
+     * chunk indexes and those of **out** coding chunk indexes; every
+     * coding chunk must be present in **out** and hold its current
+     * content, which is modified in place. All buffers must have the
+     * same length.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] in map data chunk indexes to their delta
+     * @param [in,out] out map coding chunk indexes to their content
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int apply_delta(const std::map<int, bufferptr> &in,
+			    std::map<int, bufferptr> &out) = 0;
   };
 
   typedef std::shared_ptr<ErasureCodeInterface> ErasureCodeInterfaceRef;
@@ -132,6 +132,38 @@ ErasureCodeIsaDefault::isa_encode(char **data,
 
 // -----------------------------------------------------------------------------
 
+int
+ErasureCodeIsaDefault::apply_delta(const map<int, bufferptr> &in,
+                                   map<int, bufferptr> &out)
+{
+  if (out.size() != (unsigned) m)
+    return -EINVAL;
+  unsigned blocksize = in.empty() ? 0 : in.begin()->second.length();
+  unsigned char *coding[m];
+  for (auto &&c : out) {
+    if (c.first < k || c.first >= k + m || c.second.length() != blocksize)
+      return -EINVAL;
+    coding[c.first - k] = (unsigned char*) c.second.c_str();
+  }
+
+  for (auto &&d : in) {
+    if (d.first < 0 || d.first >= k || d.second.length() != blocksize)
+      return -EINVAL;
+    unsigned char *delta = (unsigned char*) d.second.c_str();
+    if (m == 1) {
+      // single parity stripe
+      unsigned char *src[2] = {coding[0], delta};
+      region_xor(src, coding[0], 2, blocksize);
+    } else {
+      ec_encode_data_update(blocksize, k, m, d.first, encode_tbls,
+                            delta, coding);
+    }
+  }
+  return 0;
+}
+
+// -----------------------------------------------------------------------------
+
 bool
 ErasureCodeIsaDefault::erasure_contains(int *erasures, int i)
 {
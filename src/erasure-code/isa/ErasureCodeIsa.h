@@ -141,6 +141,14 @@ public:
                          char **coding,
                          int blocksize) override;
 
+  bool supports_parity_delta() const override
+  {
+    return true;
+  }
+
+  int apply_delta(const std::map<int, ceph::bufferptr> &in,
+                  std::map<int, ceph::bufferptr> &out) override;
+
   unsigned get_alignment() const override;
 
   void prepare() override;
@@ -39,6 +39,7 @@ using std::map;
 using std::set;
 
 using ceph::bufferlist;
+using ceph::bufferptr;
 using ceph::ErasureCodeProfile;
 
 static ostream& _prefix(std::ostream* _dout)
@@ -112,6 +113,48 @@ int ErasureCodeJerasure::encode_chunks(const set<int> &want_to_encode,
   return 0;
 }
 
+int ErasureCodeJerasure::matrix_apply_delta(const int *matrix,
+					    const map<int, bufferptr> &in,
+					    map<int, bufferptr> &out)
+{
+  if (out.size() != (unsigned)m)
+    return -EINVAL;
+  unsigned blocksize = in.empty() ? 0 : in.begin()->second.length();
+  // coding chunk j is the dot product of row j - k of the coding
+  // matrix with the data chunks, so it moves by coef * delta
+  for (auto &&c : out) {
+    if (c.first < k || c.first >= k + m ||
+	c.second.length() != blocksize)
+      return -EINVAL;
+    const int *row = matrix + (c.first - k) * k;
+    for (auto &&d : in) {
+      if (d.first < 0 || d.first >= k ||
+	  d.second.length() != blocksize)
+	return -EINVAL;
+      char *delta = const_cast<char*>(d.second.c_str());
+      int coef = row[d.first];
+      if (coef == 1) {
+	galois_region_xor(delta, c.second.c_str(), blocksize);
+	continue;
+      }
+      switch (w) {
+      case 8:
+	galois_w08_region_multiply(delta, coef, blocksize, c.second.c_str(), 1);
+	break;
+      case 16:
+	galois_w16_region_multiply(delta, coef, blocksize, c.second.c_str(), 1);
+	break;
+      case 32:
+	galois_w32_region_multiply(delta, coef, blocksize, c.second.c_str(), 1);
+	break;
+      default:
+	return -EOPNOTSUPP;
+      }
+    }
+  }
+  return 0;
+}
+
 int ErasureCodeJerasure::decode_chunks(const set<int> &want_to_read,
 				       const map<int, bufferlist> &chunks,
 				       map<int, bufferlist> *decoded)
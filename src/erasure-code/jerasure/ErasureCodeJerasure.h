@@ -77,6 +77,9 @@ public:
   static bool is_prime(int value);
 protected:
   virtual int parse(ceph::ErasureCodeProfile &profile, std::ostream *ss);
+  int matrix_apply_delta(const int *matrix,
+			 const std::map<int, ceph::bufferptr> &in,
+			 std::map<int, ceph::bufferptr> &out);
 };
 class ErasureCodeJerasureReedSolomonVandermonde : public ErasureCodeJerasure {
 public:
@@ -102,6 +105,13 @@ public:
                                char **data,
                                char **coding,
                                int blocksize) override;
+  bool supports_parity_delta() const override {
+    return true;
+  }
+  int apply_delta(const std::map<int, ceph::bufferptr> &in,
+		  std::map<int, ceph::bufferptr> &out) override {
+    return matrix_apply_delta(matrix, in, out);
+  }
   unsigned get_alignment() const override;
   void prepare() override;
 private:
@@ -131,6 +141,13 @@ public:
                                char **data,
                                char **coding,
                                int blocksize) override;
+  bool supports_parity_delta() const override {
+    return true;
+  }
+  int apply_delta(const std::map<int, ceph::bufferptr> &in,
+		  std::map<int, ceph::bufferptr> &out) override {
+    return matrix_apply_delta(matrix, in, out);
+  }
   unsigned get_alignment() const override;
   void prepare() override;
 private:
@@ -50,6 +50,51 @@ static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsi
   return ceph_crc32c_func(crc, data, length);
 }
 
+typedef void (*ceph_crc32c_multi_func_t)(unsigned n, uint32_t *crc,
+					 unsigned char const *const *data,
+					 unsigned const *length);
+
+/*
+ * multi-buffer implementation chosen for the given architecture, see
+ * ceph_crc32c_multi().
+ */
+extern ceph_crc32c_multi_func_t ceph_crc32c_multi_func;
+
+extern ceph_crc32c_multi_func_t ceph_choose_crc32c_multi(void);
+
+/**
+ * calculate crc32c of several independent buffers at once
+ *
+ * Equivalent to crc[i] = ceph_crc32c(crc[i], data[i], length[i]) for
+ * each i < n, but interleaves the streams where the CPU allows it.
+ * Buffers of similar length benefit the most.
+ *
+ * @param n number of buffers
+ * @param crc initial values, replaced by the results
+ * @param data buffer pointers (NULL means zero-filled)
+ * @param length buffer lengths
+ */
+static inline void ceph_crc32c_multi(unsigned n, uint32_t *crc,
+				     unsigned char const *const *data,
+				     unsigned const *length)
+{
+  ceph_crc32c_multi_func(n, crc, data, length);
+}
+
+/**
+ * calculate crc32c of one buffer by splitting it into segments
+ *
+ * The segments are digested with ceph_crc32c_multi() and the results
+ * are combined, so the value is identical to ceph_crc32c().  Only
+ * worth it for buffers that are large compared to the cost of the
+ * combine step; shorter ones are passed straight to ceph_crc32c().
+ *
+ * @param crc initial value
+ * @param data pointer to data buffer
+ * @param length length of buffer
+ */
+uint32_t ceph_crc32c_split(uint32_t crc, unsigned char const *data, unsigned length);
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,8 +31,15 @@ public:
   struct ColumnFamily {
     string name;      //< name of this individual column family
     string option;    //< configure option string for this CF
+    uint32_t shard_cnt = 1;        //< number of CFs the prefix is hashed over
+    uint32_t hash_l = 0;           //< first key byte hashed to pick a shard
+    uint32_t hash_h = UINT32_MAX;  //< one past the last key byte hashed
     ColumnFamily(const string &name, const string &option)
       : name(name), option(option) {}
+    ColumnFamily(const string &name, const string &option,
+		 uint32_t shard_cnt, uint32_t hash_l, uint32_t hash_h)
+      : name(name), option(option), shard_cnt(shard_cnt),
+	hash_l(hash_l), hash_h(hash_h) {}
   };
 
   class TransactionImpl {
@@ -277,7 +284,7 @@ public:
   };
   typedef std::shared_ptr< WholeSpaceIteratorImpl > WholeSpaceIterator;
 
-private:
+protected:
   // This class filters a WholeSpaceIterator by a prefix.
   class PrefixIteratorImpl : public IteratorImpl {
     const std::string prefix;
@@ -371,6 +378,16 @@ public:
     return 0;
   }
 
+  /**
+   * how close the store is to stalling writes
+   *
+   * 0 means writes are not held back, 1 means they are (about to be)
+   * stopped until background work catches up.
+   */
+  virtual double get_write_pressure() {
+    return 0;
+  }
+
   /// compact the underlying store
   virtual void compact() {}
 
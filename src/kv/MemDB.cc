@@ -59,6 +59,12 @@ void MemDB::_encode(mdb_iter_t iter, bufferlist &bl)
   encode(iter->second, bl);
 }
 
+void MemDB::_encode(const MemDBSkipList::Node *n, bufferlist &bl)
+{
+  encode(n->key, bl);
+  encode(n->get_value(), bl);
+}
+
 std::string MemDB::_get_data_fn()
 {
   string fn = m_db_path + "/" + "MemDB.db";
@@ -79,11 +85,18 @@ void MemDB::_save()
     return;
   }
   bufferlist bl;
-  mdb_iter_t iter = m_map.begin();
-  while (iter != m_map.end()) {
-    dout(10) << __func__ << " Key:"<< iter->first << dendl;
-    _encode(iter, bl);
-    ++iter;
+  if (m_skiplist) {
+    for (auto n = m_skiplist->first(); n; n = n->next(0)) {
+      dout(10) << __func__ << " Key:"<< n->key << dendl;
+      _encode(n, bl);
+    }
+  } else {
+    mdb_iter_t iter = m_map.begin();
+    while (iter != m_map.end()) {
+      dout(10) << __func__ << " Key:"<< iter->first << dendl;
+      _encode(iter, bl);
+      ++iter;
+    }
   }
   bl.write_fd(fd);
 
@@ -125,8 +138,13 @@ int MemDB::_load()
     bytes_done += ::decode_file(fd, datap);
 
     dout(10) << __func__ << " Key:"<< key << dendl;
-    m_map[key] = datap;
     m_total_bytes += datap.length();
+    if (m_skiplist) {
+      uint64_t old_len;
+      m_skiplist->insert_or_assign(key, std::move(datap), &old_len);
+    } else {
+      m_map[key] = datap;
+    }
   }
   VOID_TEMP_FAILURE_RETRY(::close(fd));
   return 0;
@@ -174,6 +192,14 @@ int MemDB::do_open(ostream &out, bool create)
   m_total_bytes = 0;
   m_allocated_bytes = 1;
 
+  auto index_type = m_cct->_conf.get_val<std::string>("memdb_index_type");
+  dout(1) << __func__ << " index type " << index_type << dendl;
+  if (index_type == "skiplist") {
+    m_skiplist.reset(new MemDBSkipList);
+  } else {
+    m_skiplist.reset();
+  }
+
   return _init(create);
 }
 
@@ -221,6 +247,12 @@ int MemDB::submit_transaction(KeyValueDB::Transaction t)
     } else if (op.first == MDBTransactionImpl::MERGE) {
       ms_op_t merge_op = op.second;
       _merge(merge_op);
+    } else if (op.first == MDBTransactionImpl::DELETE_RANGE) {
+      ms_op_t rm_op = op.second;
+      _rm_range_keys(rm_op);
+    } else if (op.first == MDBTransactionImpl::DELETE_PREFIX) {
+      ms_op_t rm_op = op.second;
+      _rmkeys_by_prefix(rm_op);
     } else {
       ms_op_t rm_op = op.second;
       ceph_assert(op.first == MDBTransactionImpl::DELETE);
@@ -228,6 +260,11 @@ int MemDB::submit_transaction(KeyValueDB::Transaction t)
     }
   }
 
+  if (m_skiplist) {
+    std::lock_guard<std::mutex> l(m_lock);
+    m_skiplist->reclaim();
+  }
+
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_memdb_txns);
   logger->tinc(l_memdb_submit_latency, lat);
@@ -268,23 +305,20 @@ void MemDB::MDBTransactionImpl::rmkey(const string &prefix,
 
 void MemDB::MDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
-  KeyValueDB::Iterator it = m_db->get_iterator(prefix);
-  for (it->seek_to_first(); it->valid(); it->next()) {
-    rmkey(prefix, it->key());
-  }
+  dtrace << __func__ << " " << prefix << dendl;
+  ops.push_back(make_pair(DELETE_PREFIX,
+                          std::make_pair(std::make_pair(prefix, string()),
+                          bufferlist())));
 }
 
 void MemDB::MDBTransactionImpl::rm_range_keys(const string &prefix, const string &start, const string &end)
 {
-  KeyValueDB::Iterator it = m_db->get_iterator(prefix);
-  it->lower_bound(start);
-  while (it->valid()) {
-    if (it->key() >= end) {
-      break;
-    }
-    rmkey(prefix, it->key());
-    it->next();
-  }
+  dtrace << __func__ << " " << prefix << " " << start << " " << end << dendl;
+  bufferlist end_bl;
+  end_bl.append(end);
+  ops.push_back(make_pair(DELETE_RANGE,
+                          std::make_pair(std::make_pair(prefix, start),
+                          end_bl)));
 }
 
 void MemDB::MDBTransactionImpl::merge(
@@ -304,6 +338,16 @@ int MemDB::_setkey(ms_op_t &op)
 
   m_total_bytes += bl.length();
 
+  if (m_skiplist) {
+    uint64_t old_len = 0;
+    if (m_skiplist->insert_or_assign(
+	  key, bufferptr((char *) bl.c_str(), bl.length()), &old_len)) {
+      ceph_assert(m_total_bytes >= old_len);
+      m_total_bytes -= old_len;
+    }
+    return 0;
+  }
+
   bufferlist bl_old;
   if (_get(op.first.first, op.first.second, &bl_old)) {
     /*
@@ -324,6 +368,14 @@ int MemDB::_rmkey(ms_op_t &op)
   std::lock_guard<std::mutex> l(m_lock);
   std::string key = make_key(op.first.first, op.first.second);
 
+  if (m_skiplist) {
+    uint64_t old_len = 0;
+    bool erased = m_skiplist->erase(key, &old_len);
+    ceph_assert(m_total_bytes >= old_len);
+    m_total_bytes -= old_len;
+    return erased;
+  }
+
   bufferlist bl_old;
   if (_get(op.first.first, op.first.second, &bl_old)) {
     ceph_assert(m_total_bytes >= bl_old.length());
@@ -336,6 +388,56 @@ int MemDB::_rmkey(ms_op_t &op)
   return m_map.erase(key);
 }
 
+/*
+ * Remove raw keys in [start, end).
+ */
+int MemDB::_rm_range_keys(const string &start, const string &end)
+{
+  std::lock_guard<std::mutex> l(m_lock);
+  if (end <= start) {
+    return 0;
+  }
+
+  if (m_skiplist) {
+    uint64_t removed = 0;
+    uint64_t bytes = m_skiplist->erase_range(start, end, &removed);
+    ceph_assert(m_total_bytes >= bytes);
+    m_total_bytes -= bytes;
+    return removed;
+  }
+
+  auto first = m_map.lower_bound(start);
+  auto last = m_map.lower_bound(end);
+  int removed = 0;
+  for (auto p = first; p != last; ++p, ++removed) {
+    ceph_assert(m_total_bytes >= p->second.length());
+    m_total_bytes -= p->second.length();
+  }
+  m_map.erase(first, last);
+  iterator_seq_no++;
+  return removed;
+}
+
+int MemDB::_rm_range_keys(ms_op_t &op)
+{
+  const string &prefix = op.first.first;
+  string end(op.second.c_str(), op.second.length());
+  return _rm_range_keys(make_key(prefix, op.first.second),
+                        make_key(prefix, end));
+}
+
+int MemDB::_rmkeys_by_prefix(ms_op_t &op)
+{
+  /*
+   * All keys of a prefix sort between "prefix\0" and "prefix\1".
+   */
+  string start = op.first.first;
+  start.push_back(KEY_DELIM);
+  string end = op.first.first;
+  end.push_back(KEY_DELIM + 1);
+  return _rm_range_keys(start, end);
+}
+
 std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(const std::string &prefix)
 {
   for (const auto& i : merge_ops) {
@@ -373,14 +475,14 @@ int MemDB::_merge(ms_op_t &op)
      * Merge non existent.
      */
     mop->merge_nonexistent(bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
+    _set_merged(key, new_val);
   } else {
     /*
      * Merge existing.
      */
     std::string new_val;
     mop->merge(bl_old.c_str(), bl_old.length(), bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
+    _set_merged(key, new_val);
     bytes_adjusted -= bl_old.length();
     bl_old.clear();
   }
@@ -394,10 +496,37 @@ int MemDB::_merge(ms_op_t &op)
 /*
  * Caller take btree lock.
  */
+void MemDB::_set_merged(const string &key, const string &new_val)
+{
+  if (m_skiplist) {
+    uint64_t old_len;
+    m_skiplist->insert_or_assign(
+      key, bufferptr(new_val.c_str(), new_val.length()), &old_len);
+  } else {
+    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
+  }
+}
+
+/*
+ * Caller take btree lock (or, with the skiplist index, a ReadGuard).
+ */
 bool MemDB::_get(const string &prefix, const string &k, bufferlist *out)
 {
   string key = make_key(prefix, k);
 
+  if (m_skiplist) {
+    /*
+     * Published values are never modified in place, so hand out a
+     * reference rather than a deep copy.
+     */
+    const bufferptr *v = m_skiplist->find(key);
+    if (!v) {
+      return false;
+    }
+    out->push_back(*v);
+    return true;
+  }
+
   mdb_iter_t iter = m_map.find(key);
   if (iter == m_map.end()) {
     return false;
@@ -409,6 +538,10 @@ bool MemDB::_get(const string &prefix, const string &k, bufferlist *out)
 
 bool MemDB::_get_locked(const string &prefix, const string &k, bufferlist *out)
 {
+  if (m_skiplist) {
+    MemDBSkipList::ReadGuard g(*m_skiplist);
+    return _get(prefix, k, out);
+  }
   std::lock_guard<std::mutex> l(m_lock);
   return _get(prefix, k, out);
 }
@@ -597,14 +730,17 @@ int MemDB::MDBWholeSpaceIteratorImpl::seek_to_last(const std::string &k)
   free_last();
   if (k.empty()) {
     m_iter = m_map_p->end();
-    --m_iter;
   } else {
-    m_iter = m_map_p->lower_bound(k);
+    string limit = k;
+    limit.push_back(KEY_DELIM + 1);
+    m_iter = m_map_p->lower_bound(limit);
   }
 
-  if (m_iter == m_map_p->end()) {
+  if (m_iter == m_map_p->begin()) {
+    m_iter = m_map_p->end();
     return -1;
   }
+  --m_iter;
   fill_current();
   return 0;
 }
@@ -641,3 +777,106 @@ int MemDB::MDBWholeSpaceIteratorImpl::lower_bound(const std::string &prefix,
   }
   return -1;
 }
+
+int MemDB::MDBSkipListIteratorImpl::seek_to_first(const std::string &k)
+{
+  if (k.empty()) {
+    return _set(m_sl.first());
+  }
+  return _set(m_sl.lower_bound(k));
+}
+
+/*
+ * Last key of the given prefix, or the last key overall.
+ */
+int MemDB::MDBSkipListIteratorImpl::seek_to_last(const std::string &k)
+{
+  if (k.empty()) {
+    return _set(m_sl.last());
+  }
+  string limit = k;
+  limit.push_back(KEY_DELIM + 1);
+  return _set(m_sl.find_less_than(limit));
+}
+
+int MemDB::MDBSkipListIteratorImpl::upper_bound(const std::string &prefix,
+    const std::string &after)
+{
+  dtrace << "upper_bound " << prefix.c_str() << after.c_str() << dendl;
+  return _set(m_sl.upper_bound(make_key(prefix, after)));
+}
+
+int MemDB::MDBSkipListIteratorImpl::lower_bound(const std::string &prefix,
+    const std::string &to)
+{
+  dtrace << "lower_bound " << prefix.c_str() << to.c_str() << dendl;
+  return _set(m_sl.lower_bound(make_key(prefix, to)));
+}
+
+int MemDB::MDBSkipListIteratorImpl::next()
+{
+  if (!m_node) {
+    return -1;
+  }
+  if (m_node->removed.load(std::memory_order_acquire)) {
+    /*
+     * Our node was unlinked; its forward pointers may be stale, so
+     * reposition after its key.
+     */
+    return _set(m_sl.upper_bound(m_node->key));
+  }
+  return _set(m_node->next(0));
+}
+
+int MemDB::MDBSkipListIteratorImpl::prev()
+{
+  if (!m_node) {
+    return -1;
+  }
+  return _set(m_sl.find_less_than(m_node->key));
+}
+
+string MemDB::MDBSkipListIteratorImpl::key()
+{
+  string prefix, key;
+  split_key(m_node->key, &prefix, &key);
+  return key;
+}
+
+pair<string,string> MemDB::MDBSkipListIteratorImpl::raw_key()
+{
+  string prefix, key;
+  split_key(m_node->key, &prefix, &key);
+  return make_pair(prefix, key);
+}
+
+bool MemDB::MDBSkipListIteratorImpl::raw_key_is_prefixed(
+    const string &prefix)
+{
+  const string &k = m_node->key;
+  return k.size() > prefix.size() &&
+    k.compare(0, prefix.size(), prefix) == 0 &&
+    k[prefix.size()] == KEY_DELIM;
+}
+
+bufferlist MemDB::MDBSkipListIteratorImpl::value()
+{
+  bufferlist bl;
+  bl.push_back(m_node->get_value());
+  return bl;
+}
+
+bufferptr MemDB::MDBSkipListIteratorImpl::value_as_ptr()
+{
+  return m_node->get_value();
+}
+
+size_t MemDB::MDBSkipListIteratorImpl::key_size()
+{
+  return m_node->key.size() - m_node->key.find(KEY_DELIM) - 1;
+}
+
+size_t MemDB::MDBSkipListIteratorImpl::value_size()
+{
+  return m_node->get_value().length();
+}
@@ -18,6 +18,7 @@
 #include "include/encoding.h"
 #include "include/btree_map.h"
 #include "KeyValueDB.h"
+#include "MemDBSkipList.h"
 #include "osd/osd_types.h"
 
 using std::string;
@@ -47,6 +48,12 @@ class MemDB : public KeyValueDB
 
   mdb_map_t m_map;
 
+  /*
+   * Alternate index selected by memdb_index_type=skiplist.  Readers
+   * (get, iterators) do not take m_lock; writers still do.
+   */
+  std::unique_ptr<MemDBSkipList> m_skiplist;
+
   CephContext *m_cct;
   PerfCounters *logger;
   void* m_priv;
@@ -57,9 +64,11 @@ class MemDB : public KeyValueDB
   int _open(ostream &out);
   void close() override;
   bool _get(const string &prefix, const string &k, bufferlist *out);
+  void _set_merged(const string &key, const string &new_val);
   bool _get_locked(const string &prefix, const string &k, bufferlist *out);
   std::string _get_data_fn();
   void _encode(mdb_iter_t iter, bufferlist &bl);
+  void _encode(const MemDBSkipList::Node *n, bufferlist &bl);
   void _save();
   int _load();
   uint64_t iterator_seq_no;
@@ -83,7 +92,12 @@ public:
 
   class MDBTransactionImpl : public KeyValueDB::TransactionImpl {
     public:
-      enum op_type { WRITE = 1, MERGE = 2, DELETE = 3};
+      /*
+       * DELETE_RANGE carries the end key in the value; DELETE_PREFIX
+       * only uses the prefix.  Both are resolved at submit time.
+       */
+      enum op_type { WRITE = 1, MERGE = 2, DELETE = 3, DELETE_RANGE = 4,
+		     DELETE_PREFIX = 5 };
     private:
 
       std::vector<std::pair<op_type, ms_op_t>> ops;
@@ -125,6 +139,9 @@ private:
   int _merge(ms_op_t &op);
   int _setkey(ms_op_t &op);
   int _rmkey(ms_op_t &op);
+  int _rm_range_keys(const string &start, const string &end);
+  int _rm_range_keys(ms_op_t &op);
+  int _rmkeys_by_prefix(ms_op_t &op);
 
 public:
 
@@ -198,6 +215,48 @@ public:
     ~MDBWholeSpaceIteratorImpl() override;
   };
 
+  /*
+   * Whole-space iterator over the skiplist index.  It pins the nodes it
+   * has seen for its lifetime, so a long-lived iterator delays reclaiming
+   * memory from deletes and overwrites.
+   */
+  class MDBSkipListIteratorImpl : public KeyValueDB::WholeSpaceIteratorImpl {
+    const MemDBSkipList &m_sl;
+    MemDBSkipList::ReadGuard m_guard;
+    const MemDBSkipList::Node *m_node = nullptr;
+
+    int _set(const MemDBSkipList::Node *n) {
+      m_node = n;
+      return m_node ? 0 : -1;
+    }
+
+  public:
+    explicit MDBSkipListIteratorImpl(const MemDBSkipList &sl)
+      : m_sl(sl), m_guard(sl) {}
+
+    int seek_to_first(const std::string &k) override;
+    int seek_to_last(const std::string &k) override;
+
+    int seek_to_first() override { return seek_to_first(std::string()); };
+    int seek_to_last() override { return seek_to_last(std::string()); };
+
+    int upper_bound(const std::string &prefix, const std::string &after) override;
+    int lower_bound(const std::string &prefix, const std::string &to) override;
+    bool valid() override { return m_node != nullptr; }
+
+    int next() override;
+    int prev() override;
+    int status() override { return 0; };
+
+    std::string key() override;
+    std::pair<std::string,std::string> raw_key() override;
+    bool raw_key_is_prefixed(const std::string &prefix) override;
+    bufferlist value() override;
+    bufferptr value_as_ptr() override;
+    size_t key_size() override;
+    size_t value_size() override;
+  };
+
   uint64_t get_estimated_size(std::map<std::string,uint64_t> &extra) override {
       std::lock_guard<std::mutex> l(m_lock);
       return m_allocated_bytes;
@@ -213,6 +272,9 @@ public:
   }
 
   WholeSpaceIterator get_wholespace_iterator() override {
+    if (m_skiplist) {
+      return std::make_shared<MDBSkipListIteratorImpl>(*m_skiplist);
+    }
     return std::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
       new MDBWholeSpaceIteratorImpl(&m_map, &m_lock, &iterator_seq_no, m_using_btree));
   }
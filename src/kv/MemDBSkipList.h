@@ -0,0 +1,319 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ordered in-memory index for MemDB with lock-free readers.
+ *
+ * Writers are serialized by the caller (MemDB::m_lock); readers never
+ * block.  Nodes and values that are unlinked or replaced by a writer are
+ * retired and only freed once every reader that might still reference
+ * them has finished.  Reader tracking uses two counters selected by the
+ * parity of a grace-period epoch: a writer frees the batch retired during
+ * the previous period once that period's counter drains, then flips the
+ * epoch.
+ */
+
+#ifndef CEPH_KV_MEMDB_SKIPLIST_H
+#define CEPH_KV_MEMDB_SKIPLIST_H
+
+#include <atomic>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "include/buffer.h"
+#include "include/ceph_assert.h"
+
+class MemDBSkipList {
+public:
+  struct Node {
+    const std::string key;
+    std::atomic<ceph::bufferptr*> value;
+    std::atomic<bool> removed;
+    const int height;
+  private:
+    // over-allocated to 'height' entries, see new_node()
+    std::atomic<Node*> next_[1];
+  public:
+    Node(const std::string& k, ceph::bufferptr* v, int h)
+      : key(k), value(v), removed(false), height(h) {}
+
+    Node* next(int n) const {
+      return next_[n].load(std::memory_order_acquire);
+    }
+    void set_next(int n, Node* x) {
+      next_[n].store(x, std::memory_order_release);
+    }
+    void init_next(int n, Node* x) {
+      new (&next_[n]) std::atomic<Node*>(x);
+    }
+    const ceph::bufferptr& get_value() const {
+      return *value.load(std::memory_order_acquire);
+    }
+  };
+
+  /// pins every node/value visible at construction time until destroyed
+  class ReadGuard {
+    const MemDBSkipList *sl;
+    unsigned idx;
+  public:
+    explicit ReadGuard(const MemDBSkipList &s)
+      : sl(&s), idx(s.epoch.load() & 1) {
+      sl->readers[idx]++;
+    }
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+    ~ReadGuard() {
+      sl->readers[idx]--;
+    }
+  };
+
+private:
+  static constexpr int MAX_HEIGHT = 12;
+  static constexpr unsigned BRANCHING = 4;
+
+  Node *head;
+  std::atomic<int> max_height;
+  std::minstd_rand rng;   ///< writer only
+  uint64_t num_nodes = 0; ///< writer only
+
+  mutable std::atomic<uint64_t> epoch;
+  mutable std::atomic<int64_t> readers[2];
+  std::vector<Node*> retired_nodes[2];
+  std::vector<ceph::bufferptr*> retired_values[2];
+
+  static Node* new_node(const std::string& key, ceph::bufferptr* v,
+			int height) {
+    void *mem = ::operator new(
+      sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
+    Node *x = new (mem) Node(key, v, height);
+    for (int i = 0; i < height; ++i) {
+      x->init_next(i, nullptr);
+    }
+    return x;
+  }
+  static void free_node(Node *x) {
+    delete x->value.load(std::memory_order_relaxed);
+    x->~Node();
+    ::operator delete(x);
+  }
+
+  int random_height() {
+    int h = 1;
+    while (h < MAX_HEIGHT && (rng() % BRANCHING) == 0) {
+      ++h;
+    }
+    return h;
+  }
+
+  static bool key_is_after_node(const std::string& key, const Node *n) {
+    return n != nullptr && n->key < key;
+  }
+
+  /// first node >= key, filling prev[] with the predecessor at each level
+  Node* find_greater_or_equal(const std::string& key, Node **prev) const {
+    Node *x = head;
+    int level = max_height.load(std::memory_order_relaxed) - 1;
+    while (true) {
+      Node *next = x->next(level);
+      if (key_is_after_node(key, next)) {
+	x = next;
+      } else {
+	if (prev) {
+	  prev[level] = x;
+	}
+	if (level == 0) {
+	  return next;
+	}
+	--level;
+      }
+    }
+  }
+
+  void retire(Node *x) {
+    retired_nodes[epoch.load() & 1].push_back(x);
+  }
+  void retire(ceph::bufferptr *v) {
+    retired_values[epoch.load() & 1].push_back(v);
+  }
+
+public:
+  MemDBSkipList()
+    : head(new_node(std::string(), nullptr, MAX_HEIGHT)),
+      max_height(1), epoch(0) {
+    readers[0] = 0;
+    readers[1] = 0;
+  }
+  MemDBSkipList(const MemDBSkipList&) = delete;
+  MemDBSkipList& operator=(const MemDBSkipList&) = delete;
+
+  ~MemDBSkipList() {
+    ceph_assert(readers[0] == 0 && readers[1] == 0);
+    Node *x = head->next(0);
+    while (x) {
+      Node *next = x->next(0);
+      free_node(x);
+      x = next;
+    }
+    free_node(head);
+    for (unsigned i = 0; i < 2; ++i) {
+      for (auto n : retired_nodes[i]) {
+	free_node(n);
+      }
+      for (auto v : retired_values[i]) {
+	delete v;
+      }
+    }
+  }
+
+  uint64_t size() const {
+    return num_nodes;
+  }
+
+  // -- readers; caller must hold a ReadGuard --
+
+  Node* first() const {
+    return head->next(0);
+  }
+
+  Node* last() const {
+    Node *x = head;
+    int level = max_height.load(std::memory_order_relaxed) - 1;
+    while (true) {
+      Node *next = x->next(level);
+      if (next) {
+	x = next;
+      } else if (level == 0) {
+	return x == head ? nullptr : x;
+      } else {
+	--level;
+      }
+    }
+  }
+
+  Node* lower_bound(const std::string& key) const {
+    return find_greater_or_equal(key, nullptr);
+  }
+
+  Node* upper_bound(const std::string& key) const {
+    Node *x = find_greater_or_equal(key, nullptr);
+    if (x && x->key == key) {
+      x = x->next(0);
+    }
+    return x;
+  }
+
+  /// last node < key, or nullptr
+  Node* find_less_than(const std::string& key) const {
+    Node *x = head;
+    int level = max_height.load(std::memory_order_relaxed) - 1;
+    while (true) {
+      Node *next = x->next(level);
+      if (key_is_after_node(key, next)) {
+	x = next;
+      } else if (level == 0) {
+	return x == head ? nullptr : x;
+      } else {
+	--level;
+      }
+    }
+  }
+
+  const ceph::bufferptr* find(const std::string& key) const {
+    Node *x = lower_bound(key);
+    if (x && x->key == key) {
+      return &x->get_value();
+    }
+    return nullptr;
+  }
+
+  // -- writers; caller serializes --
+
+  /// insert or replace; returns the length of the replaced value, if any
+  bool insert_or_assign(const std::string& key, ceph::bufferptr&& v,
+			uint64_t *old_len) {
+    Node *prev[MAX_HEIGHT];
+    Node *x = find_greater_or_equal(key, prev);
+    auto nv = new ceph::bufferptr(std::move(v));
+    if (x && x->key == key) {
+      auto ov = x->value.exchange(nv, std::memory_order_acq_rel);
+      *old_len = ov->length();
+      retire(ov);
+      return true;
+    }
+    int height = random_height();
+    int cur_height = max_height.load(std::memory_order_relaxed);
+    if (height > cur_height) {
+      for (int i = cur_height; i < height; ++i) {
+	prev[i] = head;
+      }
+      // readers seeing the new height before the links just descend
+      // through head's null pointers
+      max_height.store(height, std::memory_order_relaxed);
+    }
+    x = new_node(key, nv, height);
+    for (int i = 0; i < height; ++i) {
+      x->init_next(i, prev[i]->next(i));
+      prev[i]->set_next(i, x);
+    }
+    ++num_nodes;
+    return false;
+  }
+
+  /// unlink [start, end); returns total value bytes removed
+  uint64_t erase_range(const std::string& start, const std::string& end,
+		       uint64_t *removed = nullptr) {
+    Node *prev[MAX_HEIGHT];
+    Node *x = find_greater_or_equal(start, prev);
+    uint64_t bytes = 0, count = 0;
+    while (x && x->key < end) {
+      Node *next = x->next(0);
+      x->removed.store(true, std::memory_order_release);
+      for (int i = x->height - 1; i >= 0; --i) {
+	ceph_assert(prev[i]->next(i) == x);
+	prev[i]->set_next(i, x->next(i));
+      }
+      bytes += x->get_value().length();
+      retire(x);
+      ++count;
+      x = next;
+    }
+    num_nodes -= count;
+    if (removed) {
+      *removed = count;
+    }
+    return bytes;
+  }
+
+  bool erase(const std::string& key, uint64_t *old_len) {
+    uint64_t n = 0;
+    std::string end = key;
+    end.push_back('\0');
+    *old_len = erase_range(key, end, &n);
+    return n > 0;
+  }
+
+  /**
+   * free what was retired before the last epoch flip if no reader from
+   * that period is left, then start a new period.  cheap enough to call
+   * after every transaction.
+   */
+  void reclaim() {
+    unsigned cur = epoch.load() & 1;
+    unsigned old = cur ^ 1;
+    if (readers[old].load() != 0) {
+      return;
+    }
+    for (auto x : retired_nodes[old]) {
+      free_node(x);
+    }
+    for (auto v : retired_values[old]) {
+      delete v;
+    }
+    retired_nodes[old].clear();
+    retired_values[old].clear();
+    epoch++;
+  }
+};
+
+#endif
@@ -18,6 +18,7 @@
 #include "rocksdb/filter_policy.h"
 #include "rocksdb/utilities/convenience.h"
 #include "rocksdb/merge_operator.h"
+#include "rocksdb/listener.h"
 
 using std::string;
 #include "common/perf_counters.h"
@@ -25,6 +26,8 @@ using std::string;
 #include "include/str_list.h"
 #include "include/stringify.h"
 #include "include/str_map.h"
+#include "include/ceph_hash.h"
+#include "common/strtol.h"
 #include "KeyValueDB.h"
 #include "RocksDBStore.h"
 
@@ -77,6 +80,9 @@ public:
     for (auto& p : store.cf_handles) {
       names.erase(p.first);
     }
+    for (auto& p : store.cf_shards) {
+      names.erase(p.first);
+    }
     for (auto& p : names) {
       store.assoc_name += '.';
       store.assoc_name += p.first;
@@ -310,6 +316,333 @@ int RocksDBStore::install_cf_mergeop(
   return 0;
 }
 
+//
+// Follows flushes, compactions and write stalls so that callers can see
+// a stall coming, see get_write_pressure().  Runs on rocksdb background
+// threads.
+//
+class RocksDBStore::StallListener : public rocksdb::EventListener {
+  RocksDBStore& store;
+public:
+  explicit StallListener(RocksDBStore &_store) : store(_store) {}
+
+  void OnFlushCompleted(rocksdb::DB* db,
+			const rocksdb::FlushJobInfo& info) override {
+    store.update_write_pressure(db);
+  }
+  void OnCompactionCompleted(rocksdb::DB* db,
+			     const rocksdb::CompactionJobInfo& info) override {
+    store.update_write_pressure(db);
+  }
+  void OnStallConditionsChanged(const rocksdb::WriteStallInfo& info) override {
+    int cond = STALL_NONE;
+    if (info.condition.cur == rocksdb::WriteStallCondition::kDelayed) {
+      cond = STALL_DELAYED;
+    } else if (info.condition.cur == rocksdb::WriteStallCondition::kStopped) {
+      cond = STALL_STOPPED;
+    }
+    store.set_stall_condition(info.cf_name, cond);
+  }
+};
+
+void RocksDBStore::set_stall_condition(const string& cf_name, int cond)
+{
+  std::lock_guard l(stall_lock);
+  if (cond == STALL_NONE) {
+    stalled_cfs.erase(cf_name);
+  } else {
+    stalled_cfs[cf_name] = cond;
+  }
+  int worst = STALL_NONE;
+  for (auto& p : stalled_cfs) {
+    worst = std::max(worst, p.second);
+  }
+  if (worst != stall_state) {
+    dout(1) << __func__ << " column family " << cf_name << " "
+	    << (cond == STALL_STOPPED ? "stopped" :
+		cond == STALL_DELAYED ? "delayed" : "normal")
+	    << ", writes are "
+	    << (worst == STALL_STOPPED ? "stopped" :
+		worst == STALL_DELAYED ? "delayed" : "normal")
+	    << dendl;
+  }
+  stall_state = worst;
+}
+
+void RocksDBStore::update_write_pressure(rocksdb::DB *_db)
+{
+  uint64_t pending = 0, l0 = 0;
+  if (_db->GetAggregatedIntProperty("rocksdb.estimate-pending-compaction-bytes",
+				    &pending)) {
+    pending_compaction_bytes = pending;
+  }
+  // the stall triggers apply to each column family on its own, so the
+  // fullest level 0 is the one that matters
+  std::lock_guard l(stall_lock);
+  for (auto cf : pressure_cfs) {
+    uint64_t n = 0;
+    if (_db->GetIntProperty(cf, "rocksdb.num-files-at-level0", &n)) {
+      l0 = std::max(l0, n);
+    }
+  }
+  l0_files = l0;
+}
+
+double RocksDBStore::get_write_pressure()
+{
+  int stall = stall_state.load();
+  if (stall == STALL_STOPPED) {
+    return 1.0;
+  }
+  double p = 0;
+  // L0 files between the compaction and the stop trigger, and pending
+  // compaction bytes up to the hard limit, both predict a stall
+  uint64_t l0 = l0_files.load();
+  if (l0_stop_trigger > l0_compaction_trigger && l0 > l0_compaction_trigger) {
+    p = std::max(p, double(l0 - l0_compaction_trigger) /
+		 (l0_stop_trigger - l0_compaction_trigger));
+  }
+  if (hard_pending_compaction_bytes) {
+    p = std::max(p, double(pending_compaction_bytes.load()) /
+		 hard_pending_compaction_bytes);
+  }
+  if (stall == STALL_DELAYED) {
+    // rocksdb already slows writes down
+    p = std::max(p, 0.75);
+  }
+  return std::min(p, 1.0);
+}
+
+int RocksDBStore::create_cf(const ColumnFamily& cf,
+			    const rocksdb::Options& base)
+{
+  // copy default CF settings, block cache, merge operators as
+  // the base for new CF
+  rocksdb::ColumnFamilyOptions cf_opt(base);
+  // user input options will override the base options
+  rocksdb::Status status = rocksdb::GetColumnFamilyOptionsFromString(
+    cf_opt, cf.option, &cf_opt);
+  if (!status.ok()) {
+    derr << __func__ << " invalid db column family option string for CF: "
+	 << cf.name << dendl;
+    return -EINVAL;
+  }
+  install_cf_mergeop(cf.name, &cf_opt);
+  if (cf.shard_cnt <= 1) {
+    rocksdb::ColumnFamilyHandle *h;
+    status = db->CreateColumnFamily(cf_opt, cf.name, &h);
+    if (!status.ok()) {
+      derr << __func__ << " Failed to create rocksdb column family: "
+	   << cf.name << dendl;
+      return -EINVAL;
+    }
+    // store the new CF handle
+    add_column_family(cf.name, static_cast<void*>(h));
+    return 0;
+  }
+  prefix_shards& shards = cf_shards[cf.name];
+  shards.hash_l = cf.hash_l;
+  shards.hash_h = cf.hash_h;
+  for (uint32_t i = 0; i < cf.shard_cnt; ++i) {
+    string name = cf.name + "-" + stringify(i);
+    rocksdb::ColumnFamilyHandle *h;
+    status = db->CreateColumnFamily(cf_opt, name, &h);
+    if (!status.ok()) {
+      derr << __func__ << " Failed to create rocksdb column family: "
+	   << name << dendl;
+      return -EINVAL;
+    }
+    shards.handles.push_back(h);
+  }
+  return 0;
+}
+
+rocksdb::ColumnFamilyHandle *RocksDBStore::get_cf_handle(
+  const string& prefix, const char *key, size_t keylen)
+{
+  auto iter = cf_shards.find(prefix);
+  if (iter == cf_shards.end()) {
+    return get_cf_handle(prefix);
+  }
+  const prefix_shards& shards = iter->second;
+  size_t l = std::min<size_t>(shards.hash_l, keylen);
+  size_t h = std::min<size_t>(shards.hash_h, keylen);
+  uint32_t hash = ceph_str_hash_rjenkins(key + l, h - l);
+  return shards.handles[hash % shards.handles.size()];
+}
+
+int RocksDBStore::parse_sharding_def(const string& def,
+				     vector<ColumnFamily> *cfs,
+				     ostream *err)
+{
+  list<string> items;
+  get_str_list(def, " \t\n", items);
+  for (auto& item : items) {
+    string spec = item;
+    string options;
+    size_t eq = item.find('=');
+    if (eq != string::npos) {
+      spec = item.substr(0, eq);
+      options = item.substr(eq + 1);
+    }
+    string name = spec;
+    uint32_t shard_cnt = 1;
+    uint32_t hash_l = 0;
+    uint32_t hash_h = UINT32_MAX;
+    size_t paren = spec.find('(');
+    if (paren != string::npos) {
+      name = spec.substr(0, paren);
+      if (spec.back() != ')') {
+	if (err)
+	  *err << "missing ')' in column family definition '" << item << "'";
+	return -EINVAL;
+      }
+      string args = spec.substr(paren + 1, spec.size() - paren - 2);
+      string range;
+      size_t comma = args.find(',');
+      if (comma != string::npos) {
+	range = args.substr(comma + 1);
+	args = args.substr(0, comma);
+      }
+      string e;
+      long n = strict_strtol(args.c_str(), 10, &e);
+      if (!e.empty() || n < 1) {
+	if (err)
+	  *err << "invalid shard count in column family definition '"
+	       << item << "'";
+	return -EINVAL;
+      }
+      shard_cnt = n;
+      if (!range.empty()) {
+	size_t dash = range.find('-');
+	if (dash == string::npos) {
+	  if (err)
+	    *err << "invalid hash range in column family definition '"
+		 << item << "'";
+	  return -EINVAL;
+	}
+	string l = range.substr(0, dash);
+	string h = range.substr(dash + 1);
+	hash_l = strict_strtol(l.c_str(), 10, &e);
+	if (e.empty() && !h.empty()) {
+	  hash_h = strict_strtol(h.c_str(), 10, &e);
+	}
+	if (!e.empty() || hash_l >= hash_h) {
+	  if (err)
+	    *err << "invalid hash range in column family definition '"
+		 << item << "'";
+	  return -EINVAL;
+	}
+      }
+    }
+    if (name.empty() || name == rocksdb::kDefaultColumnFamilyName) {
+      if (err)
+	*err << "invalid column family name in '" << item << "'";
+      return -EINVAL;
+    }
+    for (auto& cf : *cfs) {
+      if (cf.name == name) {
+	if (err)
+	  *err << "duplicate column family '" << name << "'";
+	return -EINVAL;
+      }
+    }
+    cfs->push_back(ColumnFamily(name, options, shard_cnt, hash_l, hash_h));
+  }
+  return 0;
+}
+
+string RocksDBStore::get_sharding_def(const vector<ColumnFamily>& cfs)
+{
+  string out;
+  for (auto& cf : cfs) {
+    if (!out.empty()) {
+      out += ' ';
+    }
+    out += cf.name;
+    if (cf.shard_cnt > 1) {
+      out += "(" + stringify(cf.shard_cnt);
+      if (cf.hash_l != 0 || cf.hash_h != UINT32_MAX) {
+	out += "," + stringify(cf.hash_l) + "-";
+	if (cf.hash_h != UINT32_MAX) {
+	  out += stringify(cf.hash_h);
+	}
+      }
+      out += ")";
+    }
+  }
+  return out;
+}
+
+// the layout of a DB with column families is kept next to it; while a
+// reshard is in progress it is prefixed by this marker, and followed by
+// one line per earlier layout whose column families may still exist.
+static const string RESHARDING_MARKER = "resharding:";
+
+string RocksDBStore::sharding_def_fn() const
+{
+  return path + "/sharding_def";
+}
+
+int RocksDBStore::read_sharding_def(string *def)
+{
+  rocksdb::Env *e = env ? env : rocksdb::Env::Default();
+  std::unique_ptr<rocksdb::SequentialFile> f;
+  rocksdb::Status status = e->NewSequentialFile(
+    sharding_def_fn(), &f, rocksdb::EnvOptions());
+  def->clear();
+  if (status.IsNotFound()) {
+    return 0;
+  }
+  if (!status.ok()) {
+    derr << __func__ << " " << sharding_def_fn() << ": " << status.ToString()
+	 << dendl;
+    return -EIO;
+  }
+  char buf[4096];
+  while (true) {
+    rocksdb::Slice result;
+    status = f->Read(sizeof(buf), &result, buf);
+    if (!status.ok()) {
+      derr << __func__ << " " << sharding_def_fn() << ": "
+	   << status.ToString() << dendl;
+      return -EIO;
+    }
+    if (result.size() == 0) {
+      break;
+    }
+    def->append(result.data(), result.size());
+  }
+  return 0;
+}
+
+int RocksDBStore::write_sharding_def(const string &def)
+{
+  rocksdb::Env *e = env ? env : rocksdb::Env::Default();
+  string tmp = sharding_def_fn() + ".tmp";
+  std::unique_ptr<rocksdb::WritableFile> f;
+  rocksdb::Status status = e->NewWritableFile(tmp, &f, rocksdb::EnvOptions());
+  if (status.ok()) {
+    status = f->Append(rocksdb::Slice(def));
+  }
+  if (status.ok()) {
+    status = f->Sync();
+  }
+  if (status.ok()) {
+    status = f->Close();
+  }
+  if (status.ok()) {
+    status = e->RenameFile(tmp, sharding_def_fn());
+  }
+  if (!status.ok()) {
+    derr << __func__ << " " << sharding_def_fn() << ": " << status.ToString()
+	 << dendl;
+    return -EIO;
+  }
+  dout(10) << __func__ << " " << def << dendl;
+  return 0;
+}
+
 int RocksDBStore::create_and_open(ostream &out,
 				  const vector<ColumnFamily>& cfs)
 {
@@ -460,6 +793,11 @@ int RocksDBStore::load_rocksdb_options(bool create_if_missing, rocksdb::Options&
 
   opt.merge_operator.reset(new MergeOperatorRouter(*this));
 
+  opt.listeners.push_back(std::make_shared<StallListener>(*this));
+  l0_compaction_trigger = opt.level0_file_num_compaction_trigger;
+  l0_stop_trigger = opt.level0_stop_writes_trigger;
+  hard_pending_compaction_bytes = opt.hard_pending_compaction_bytes_limit;
+
   return 0;
 }
 
@@ -483,29 +821,16 @@ int RocksDBStore::do_open(ostream &out,
       return -EINVAL;
     }
     // create and open column families
-    if (cfs) {
+    if (cfs && !cfs->empty()) {
       for (auto& p : *cfs) {
-	// copy default CF settings, block cache, merge operators as
-	// the base for new CF
-	rocksdb::ColumnFamilyOptions cf_opt(opt);
-	// user input options will override the base options
-	status = rocksdb::GetColumnFamilyOptionsFromString(
-	  cf_opt, p.option, &cf_opt);
-	if (!status.ok()) {
-	  derr << __func__ << " invalid db column family option string for CF: "
-	       << p.name << dendl;
-	  return -EINVAL;
+	r = create_cf(p, opt);
+	if (r < 0) {
+	  return r;
 	}
-	install_cf_mergeop(p.name, &cf_opt);
-	rocksdb::ColumnFamilyHandle *cf;
-	status = db->CreateColumnFamily(cf_opt, p.name, &cf);
-	if (!status.ok()) {
-	  derr << __func__ << " Failed to create rocksdb column family: "
-	       << p.name << dendl;
-	  return -EINVAL;
-	}
-	// store the new CF handle
-	add_column_family(p.name, static_cast<void*>(cf));
+      }
+      r = write_sharding_def(get_sharding_def(*cfs));
+      if (r < 0) {
+	return r;
       }
     }
     default_cf = db->DefaultColumnFamily();
@@ -529,6 +854,45 @@ int RocksDBStore::do_open(ostream &out,
       }
       default_cf = db->DefaultColumnFamily();
     } else {
+      // the persisted layout tells which column families are shards of
+      // a prefix; without one every column family is a whole prefix.
+      string def;
+      r = read_sharding_def(&def);
+      if (r < 0) {
+	return r;
+      }
+      if (def.compare(0, RESHARDING_MARKER.size(), RESHARDING_MARKER) == 0) {
+	if (!kv_options.count("resharding")) {
+	  derr << __func__ << " an interrupted reshard to '"
+	       << def.substr(RESHARDING_MARKER.size(),
+			     def.find('\n') - RESHARDING_MARKER.size())
+	       << "' must be completed first" << dendl;
+	  return -EBUSY;
+	}
+	// open every column family as-is; reshard() folds them back
+	def.clear();
+      }
+      vector<ColumnFamily> layout;
+      r = parse_sharding_def(def, &layout, &out);
+      if (r < 0) {
+	derr << __func__ << " invalid persisted sharding '" << def << "'"
+	     << dendl;
+	return r;
+      }
+      // cf name -> (prefix, shard)
+      map<string, pair<string, uint32_t>> shard_names;
+      for (auto& l : layout) {
+	if (l.shard_cnt > 1) {
+	  prefix_shards& shards = cf_shards[l.name];
+	  shards.hash_l = l.hash_l;
+	  shards.hash_h = l.hash_h;
+	  shards.handles.resize(l.shard_cnt, nullptr);
+	  for (uint32_t i = 0; i < l.shard_cnt; ++i) {
+	    shard_names[l.name + "-" + stringify(i)] = make_pair(l.name, i);
+	  }
+	}
+      }
+
       // we cannot change column families for a created database.  so, map
       // what options we are given to whatever cf's already exist.
       std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
@@ -537,9 +901,11 @@ int RocksDBStore::do_open(ostream &out,
 	// the base for new CF
 	rocksdb::ColumnFamilyOptions cf_opt(opt);
 	bool found = false;
+	auto shard = shard_names.find(n);
+	const string& prefix = shard == shard_names.end() ? n : shard->second.first;
 	if (cfs) {
 	  for (auto& i : *cfs) {
-	    if (i.name == n) {
+	    if (i.name == prefix) {
 	      found = true;
 	      status = rocksdb::GetColumnFamilyOptionsFromString(
 		cf_opt, i.option, &cf_opt);
@@ -552,7 +918,7 @@ int RocksDBStore::do_open(ostream &out,
 	  }
 	}
 	if (n != rocksdb::kDefaultColumnFamilyName) {
-	  install_cf_mergeop(n, &cf_opt);
+	  install_cf_mergeop(prefix, &cf_opt);
 	}
 	column_families.push_back(rocksdb::ColumnFamilyDescriptor(n, cf_opt));
 	if (!found && n != rocksdb::kDefaultColumnFamilyName) {
@@ -574,17 +940,47 @@ int RocksDBStore::do_open(ostream &out,
 	return -EINVAL;
       }
       for (unsigned i = 0; i < existing_cfs.size(); ++i) {
+	auto shard = shard_names.find(existing_cfs[i]);
 	if (existing_cfs[i] == rocksdb::kDefaultColumnFamilyName) {
 	  default_cf = handles[i];
 	  must_close_default_cf = true;
+	} else if (shard != shard_names.end()) {
+	  cf_shards[shard->second.first].handles[shard->second.second] =
+	    handles[i];
 	} else {
 	  add_column_family(existing_cfs[i], static_cast<void*>(handles[i]));
 	}
       }
+      for (auto& p : cf_shards) {
+	for (auto h : p.second.handles) {
+	  if (!h) {
+	    derr << __func__ << " missing column family shard for prefix "
+		 << p.first << dendl;
+	    return -EINVAL;
+	  }
+	}
+      }
     }
   }
   ceph_assert(default_cf != nullptr);
   
+  // latency axis of the submit histograms, values are in nanoseconds
+  PerfHistogramCommon::axis_config_d lat_axis_config{
+    "Latency (usec)",
+    PerfHistogramCommon::SCALE_LOG2,
+    0,
+    10000,                            ///< 10usec buckets
+    24,
+  };
+  // transaction size axis, values are in bytes
+  PerfHistogramCommon::axis_config_d size_axis_config{
+    "Transaction size (bytes)",
+    PerfHistogramCommon::SCALE_LOG2,
+    0,
+    256,
+    24,
+  };
+
   PerfCountersBuilder plb(g_ceph_context, "rocksdb", l_rocksdb_first, l_rocksdb_last);
   plb.add_u64_counter(l_rocksdb_gets, "get", "Gets");
   plb.add_u64_counter(l_rocksdb_txns, "submit_transaction", "Submit transactions");
@@ -592,10 +988,23 @@ int RocksDBStore::do_open(ostream &out,
   plb.add_time_avg(l_rocksdb_get_latency, "get_latency", "Get latency");
   plb.add_time_avg(l_rocksdb_submit_latency, "submit_latency", "Submit Latency");
   plb.add_time_avg(l_rocksdb_submit_sync_latency, "submit_sync_latency", "Submit Sync Latency");
+  plb.add_u64_counter_histogram(
+    l_rocksdb_submit_latency_size_hist, "submit_latency_size_histogram",
+    lat_axis_config, size_axis_config,
+    "Histogram of transaction submit latency vs transaction size");
+  plb.add_u64_counter_histogram(
+    l_rocksdb_submit_sync_latency_size_hist, "submit_sync_latency_size_histogram",
+    lat_axis_config, size_axis_config,
+    "Histogram of sync transaction submit latency vs transaction size");
   plb.add_u64_counter(l_rocksdb_compact, "compact", "Compactions");
   plb.add_u64_counter(l_rocksdb_compact_range, "compact_range", "Compactions by range");
   plb.add_u64_counter(l_rocksdb_compact_queue_merge, "compact_queue_merge", "Mergings of ranges in compaction queue");
   plb.add_u64(l_rocksdb_compact_queue_len, "compact_queue_len", "Length of compaction queue");
+  plb.add_u64_counter(l_rocksdb_compact_tombstones, "compact_tombstones", "Range compactions triggered by deletes");
+  plb.add_u64_counter(l_rocksdb_rmrange, "rmrange", "Range removals written as a range tombstone");
+  plb.add_u64(l_rocksdb_pending_compaction_bytes, "pending_compaction_bytes", "Estimated bytes compaction has to rewrite", NULL, 0, unit_t(UNIT_BYTES));
+  plb.add_u64(l_rocksdb_l0_files, "l0_files", "Level 0 files of the fullest column family");
+  plb.add_u64(l_rocksdb_write_stall, "write_stall", "Write stall state (0 normal, 1 delayed, 2 stopped)");
   plb.add_time_avg(l_rocksdb_write_wal_time, "rocksdb_write_wal_time", "Rocksdb write wal time");
   plb.add_time_avg(l_rocksdb_write_memtable_time, "rocksdb_write_memtable_time", "Rocksdb write memtable time");
   plb.add_time_avg(l_rocksdb_write_delay_time, "rocksdb_write_delay_time", "Rocksdb write delay time");
@@ -603,6 +1012,19 @@ int RocksDBStore::do_open(ostream &out,
       "rocksdb_write_pre_and_post_time", "total time spent on writing a record, excluding write process");
   logger = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
+  {
+    std::lock_guard l(stall_lock);
+    pressure_cfs.push_back(default_cf);
+    for (auto& p : cf_handles) {
+      pressure_cfs.push_back(
+	static_cast<rocksdb::ColumnFamilyHandle*>(p.second));
+    }
+    for (auto& p : cf_shards) {
+      pressure_cfs.insert(pressure_cfs.end(), p.second.handles.begin(),
+			  p.second.handles.end());
+    }
+  }
+  update_write_pressure(db);
 
   if (compact_on_mount) {
     derr << "Compacting rocksdb store..." << dendl;
@@ -627,6 +1049,11 @@ RocksDBStore::~RocksDBStore()
 {
   close();
   delete logger;
+  {
+    // background flushes must not look at the handles destroyed below
+    std::lock_guard l(stall_lock);
+    pressure_cfs.clear();
+  }
 
   // Ensure db is destroyed before dependent db_cache and filterpolicy
   for (auto& p : cf_handles) {
@@ -634,6 +1061,14 @@ RocksDBStore::~RocksDBStore()
       static_cast<rocksdb::ColumnFamilyHandle*>(p.second));
     p.second = nullptr;
   }
+  for (auto& p : cf_shards) {
+    for (auto h : p.second.handles) {
+      if (h) {
+	db->DestroyColumnFamilyHandle(h);
+      }
+    }
+  }
+  cf_shards.clear();
   if (must_close_default_cf) {
     db->DestroyColumnFamilyHandle(default_cf);
     must_close_default_cf = false;
@@ -698,11 +1133,20 @@ int64_t RocksDBStore::estimate_prefix_size(const string& prefix)
   uint8_t flags =
     //rocksdb::DB::INCLUDE_MEMTABLES |  // do not include memtables...
     rocksdb::DB::INCLUDE_FILES;
-  if (cf) {
+  auto shards = get_cf_shards(prefix);
+  if (cf || shards) {
     string start(1, '\x00');
     string limit("\xff\xff\xff\xff");
     rocksdb::Range r(start, limit);
-    db->GetApproximateSizes(cf, &r, 1, &size, flags);
+    if (cf) {
+      db->GetApproximateSizes(cf, &r, 1, &size, flags);
+    } else {
+      for (auto h : shards->handles) {
+	uint64_t s = 0;
+	db->GetApproximateSizes(h, &r, 1, &s, flags);
+	size += s;
+      }
+    }
   } else {
     string limit = prefix + "\xff\xff\xff\xff";
     rocksdb::Range r(prefix, limit);
@@ -714,6 +1158,9 @@ int64_t RocksDBStore::estimate_prefix_size(const string& prefix)
 
 void RocksDBStore::get_statistics(Formatter *f)
 {
+  if (collect_prefix_stats) {
+    dump_prefix_stats(f);
+  }
   if (!g_conf()->rocksdb_perf)  {
     dout(20) << __func__ << " RocksDB perf is disabled, can't probe for stats"
 	     << dendl;
@@ -793,6 +1240,19 @@ int RocksDBStore::submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Tra
     _t->bat.Iterate(&rocks_txc);
     derr << __func__ << " error: " << s.ToString() << " code = " << s.code()
          << " Rocksdb transaction: " << rocks_txc.seen << dendl;
+  } else {
+    logger->set(l_rocksdb_pending_compaction_bytes, pending_compaction_bytes);
+    logger->set(l_rocksdb_l0_files, l0_files);
+    logger->set(l_rocksdb_write_stall, stall_state);
+    if (_t->delete_ranges) {
+      logger->inc(l_rocksdb_rmrange, _t->delete_ranges);
+    }
+    if (!_t->tombstones.empty()) {
+      account_tombstones(_t->tombstones);
+    }
+    if (!_t->stats.empty()) {
+      account_prefix_stats(_t->stats);
+    }
   }
 
   if (g_conf()->rocksdb_perf) {
@@ -822,12 +1282,14 @@ int RocksDBStore::submit_transaction(KeyValueDB::Transaction t)
   utime_t start = ceph_clock_now();
   rocksdb::WriteOptions woptions;
   woptions.sync = false;
+  size_t bytes = static_cast<RocksDBTransactionImpl*>(t.get())->bat.GetDataSize();
 
   int result = submit_common(woptions, t);
 
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_txns);
   logger->tinc(l_rocksdb_submit_latency, lat);
+  logger->hinc(l_rocksdb_submit_latency_size_hist, lat.to_nsec(), bytes);
   
   return result;
 }
@@ -838,12 +1300,14 @@ int RocksDBStore::submit_transaction_sync(KeyValueDB::Transaction t)
   rocksdb::WriteOptions woptions;
   // if disableWAL, sync can't set
   woptions.sync = !disableWAL;
+  size_t bytes = static_cast<RocksDBTransactionImpl*>(t.get())->bat.GetDataSize();
   
   int result = submit_common(woptions, t);
   
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_txns_sync);
   logger->tinc(l_rocksdb_submit_sync_latency, lat);
+  logger->hinc(l_rocksdb_submit_sync_latency_size_hist, lat.to_nsec(), bytes);
 
   return result;
 }
@@ -879,7 +1343,12 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  if (db->collect_prefix_stats) {
+    auto& ps = stats[prefix];
+    ps.sets++;
+    ps.set_bytes += k.size() + to_set_bl.length();
+  }
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     put_bat(bat, cf, k, to_set_bl);
   } else {
@@ -893,7 +1362,12 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const char *k, size_t keylen,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  if (db->collect_prefix_stats) {
+    auto& ps = stats[prefix];
+    ps.sets++;
+    ps.set_bytes += keylen + to_set_bl.length();
+  }
+  auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     string key(k, keylen);  // fixme?
     put_bat(bat, cf, key, to_set_bl);
@@ -907,7 +1381,10 @@ void RocksDBStore::RocksDBTransactionImpl::set(
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const string &k)
 {
-  auto cf = db->get_cf_handle(prefix);
+  if (db->collect_prefix_stats) {
+    stats[prefix].rmkeys++;
+  }
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k));
   } else {
@@ -919,7 +1396,10 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const char *k,
 						 size_t keylen)
 {
-  auto cf = db->get_cf_handle(prefix);
+  if (db->collect_prefix_stats) {
+    stats[prefix].rmkeys++;
+  }
+  auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k, keylen));
   } else {
@@ -932,7 +1412,10 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 					                 const string &k)
 {
-  auto cf = db->get_cf_handle(prefix);
+  if (db->collect_prefix_stats) {
+    stats[prefix].rmkeys++;
+  }
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.SingleDelete(cf, k);
   } else {
@@ -940,160 +1423,118 @@ void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
   }
 }
 
-void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
+void RocksDBStore::RocksDBTransactionImpl::note_tombstones(
+  const string &prefix,
+  const string &start,
+  const string &end,
+  uint64_t count)
 {
+  // an unbounded removal (e.g. rmkeys_by_prefix) would make us compact
+  // the rest of the prefix; leave those to rocksdb
+  if (end.empty() || !count) {
+    return;
+  }
+  add_tombstone_range(tombstones[prefix], tombstone_range{start, end, count});
+}
+
+void RocksDBStore::RocksDBTransactionImpl::rm_range(
+  const string &prefix,
+  const string &start,
+  const string &end)
+{
+  if (db->collect_prefix_stats) {
+    stats[prefix].rm_ranges++;
+  }
+  auto shards = db->get_cf_shards(prefix);
   auto cf = db->get_cf_handle(prefix);
-  if (cf) {
-    if (db->enable_rmrange) {
-      string endprefix("\xff\xff\xff\xff");  // FIXME: this is cheating...
-      if (db->max_items_rmrange) {
-        uint64_t cnt = db->max_items_rmrange;
-        bat.SetSavePoint();
-        auto it = db->get_iterator(prefix);
-        for (it->seek_to_first();
-        it->valid();
-        it->next()) {
-          if (!cnt) {
-            bat.RollbackToSavePoint();
-            bat.DeleteRange(cf, string(), endprefix);
-            return;
-          }
-          bat.Delete(cf, rocksdb::Slice(it->key()));
-          --cnt;
-        }
-        bat.PopSavePoint();
-      } else {
-        bat.DeleteRange(cf, string(), endprefix);
-      }
-    } else {
-      auto it = db->get_iterator(prefix);
-      for (it->seek_to_first();
-	   it->valid();
-	   it->next()) {
-	bat.Delete(cf, rocksdb::Slice(it->key()));
-      }
+  bool own_cf = shards || cf;
+  // keys of a prefix without its own column family are "prefix\0key"
+  // in the default one
+  auto handle = [&](const string& k) {
+    return shards ? db->get_cf_handle(prefix, k) : (cf ? cf : db->default_cf);
+  };
+  auto raw = [&](const string& k) {
+    return own_cf ? k : combine_strings(prefix, k);
+  };
+
+  uint64_t n = 0;
+  // not a seek the user asked for; keep it out of the prefix stats
+  auto it = db->_get_iterator(prefix, false);
+  if (!db->enable_rmrange) {
+    for (it->lower_bound(start);
+	 it->valid() && (end.empty() || it->key() < end);
+	 it->next()) {
+      string k = it->key();
+      bat.Delete(handle(k), raw(k));
+      ++n;
     }
-  } else {
-    if (db->enable_rmrange) {
-      string endprefix = prefix;
-      endprefix.push_back('\x01');
-      if (db->max_items_rmrange) {
-        uint64_t cnt = db->max_items_rmrange;
-        bat.SetSavePoint();
-        auto it = db->get_iterator(prefix);
-        for (it->seek_to_first();
-             it->valid();
-             it->next()) {
-          if (!cnt) {
-            bat.RollbackToSavePoint();
-            bat.DeleteRange(db->default_cf,
-                combine_strings(prefix, string()),
-                combine_strings(endprefix, string()));
-            return;
-          }
-          bat.Delete(db->default_cf, combine_strings(prefix, it->key()));
-          --cnt;
-        }
-        bat.PopSavePoint();
-      } else {
-        bat.DeleteRange(db->default_cf,
-            combine_strings(prefix, string()),
-            combine_strings(endprefix, string()));
+    note_tombstones(prefix, start, end, n);
+    return;
+  }
+
+  // Point deletes are cheaper for readers than a range tombstone, so
+  // only a range holding more than max_items_rmrange keys becomes a
+  // single DeleteRange.  Once the transaction holds
+  // max_items_rmrange_per_txn point deletes from range removals, any
+  // further non-empty range does too, which keeps e.g. a PG removal
+  // dropping many small omaps at a bounded size.
+  uint64_t limit = db->max_items_rmrange;
+  if (db->max_items_rmrange_per_txn) {
+    limit = std::min(limit, db->max_items_rmrange_per_txn -
+		     std::min(rm_range_items, db->max_items_rmrange_per_txn));
+  }
+  bat.SetSavePoint();
+  for (it->lower_bound(start);
+       it->valid() && (end.empty() || it->key() < end);
+       it->next()) {
+    if (n == limit) {
+      break;
+    }
+    string k = it->key();
+    bat.Delete(handle(k), raw(k));
+    ++n;
+  }
+  if (n < limit ||
+      !it->valid() || (!end.empty() && it->key() >= end)) {
+    bat.PopSavePoint();
+    rm_range_items += n;
+    note_tombstones(prefix, start, end, n);
+    return;
+  }
+  bat.RollbackToSavePoint();
+  if (own_cf) {
+    string limit = end.empty() ? string("\xff\xff\xff\xff") : end;  // FIXME: this is cheating...
+    if (shards) {
+      for (auto h : shards->handles) {
+	bat.DeleteRange(h, rocksdb::Slice(start), rocksdb::Slice(limit));
       }
     } else {
-      auto it = db->get_iterator(prefix);
-      for (it->seek_to_first();
-	   it->valid();
-	   it->next()) {
-	bat.Delete(db->default_cf, combine_strings(prefix, it->key()));
-      }
+      bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(limit));
     }
-  }
+  } else {
+    string limit = end.empty() ?
+      combine_strings(past_prefix(prefix), string()) :
+      combine_strings(prefix, end);
+    bat.DeleteRange(db->default_cf,
+		    rocksdb::Slice(combine_strings(prefix, start)),
+		    rocksdb::Slice(limit));
+  }
+  ++delete_ranges;
+  // the range tombstone hides more than max_items_rmrange keys
+  note_tombstones(prefix, start, end, db->max_items_rmrange + 1);
+}
+
+void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
+{
+  rm_range(prefix, string(), string());
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
                                                          const string &start,
                                                          const string &end)
 {
-  auto cf = db->get_cf_handle(prefix);
-  if (cf) {
-    if (db->enable_rmrange) {
-      if (db->max_items_rmrange) {
-        uint64_t cnt = db->max_items_rmrange;
-        auto it = db->get_iterator(prefix);
-        bat.SetSavePoint();
-        it->lower_bound(start);
-        while (it->valid()) {
-          if (it->key() >= end) {
-            break;
-          }
-          if (!cnt) {
-            bat.RollbackToSavePoint();
-            bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
-            return;
-          }
-          bat.Delete(cf, rocksdb::Slice(it->key()));
-          it->next();
-          --cnt;
-        }
-        bat.PopSavePoint();
-      } else {
-        bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
-      }
-    } else {
-      auto it = db->get_iterator(prefix);
-      it->lower_bound(start);
-      while (it->valid()) {
-	if (it->key() >= end) {
-	  break;
-	}
-	bat.Delete(cf, rocksdb::Slice(it->key()));
-	it->next();
-      }
-    }
-  } else {
-    if (db->enable_rmrange) {
-      if (db->max_items_rmrange) {
-        uint64_t cnt = db->max_items_rmrange;
-        auto it = db->get_iterator(prefix);
-        bat.SetSavePoint();
-        it->lower_bound(start);
-        while (it->valid()) {
-          if (it->key() >= end) {
-            break;
-          }
-          if (!cnt) {
-            bat.RollbackToSavePoint();
-            bat.DeleteRange(
-                db->default_cf,
-                rocksdb::Slice(combine_strings(prefix, start)),
-                rocksdb::Slice(combine_strings(prefix, end)));
-            return;
-          }
-          bat.Delete(db->default_cf,
-          combine_strings(prefix, it->key()));
-          it->next();
-          --cnt;
-        }
-        bat.PopSavePoint();
-      } else {
-        bat.DeleteRange(
-            db->default_cf,
-            rocksdb::Slice(combine_strings(prefix, start)),
-            rocksdb::Slice(combine_strings(prefix, end)));
-      }
-    } else {
-      auto it = db->get_iterator(prefix);
-      it->lower_bound(start);
-      while (it->valid()) {
-	if (it->key() >= end) {
-	  break;
-	}
-	bat.Delete(db->default_cf,
-		   combine_strings(prefix, it->key()));
-	it->next();
-      }
-    }
+  if (start < end) {
+    rm_range(prefix, start, end);
   }
 }
 
@@ -1102,7 +1543,12 @@ void RocksDBStore::RocksDBTransactionImpl::merge(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  if (db->collect_prefix_stats) {
+    auto& ps = stats[prefix];
+    ps.merges++;
+    ps.set_bytes += k.size() + to_set_bl.length();
+  }
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     // bufferlist::c_str() is non-constant, so we can't call c_str()
     if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
@@ -1143,14 +1589,14 @@ int RocksDBStore::get(
     std::map<string, bufferlist> *out)
 {
   utime_t start = ceph_clock_now();
-  auto cf = get_cf_handle(prefix);
-  if (cf) {
+  if (get_cf_handle(prefix) || get_cf_shards(prefix)) {
     for (auto& key : keys) {
       std::string value;
       auto status = db->Get(rocksdb::ReadOptions(),
-			    cf,
+			    get_cf_handle(prefix, key),
 			    rocksdb::Slice(key),
 			    &value);
+      note_get(prefix, value.size());
       if (status.ok()) {
 	(*out)[key].append(value);
       } else if (status.IsIOError()) {
@@ -1165,6 +1611,7 @@ int RocksDBStore::get(
 			    default_cf,
 			    rocksdb::Slice(k),
 			    &value);
+      note_get(prefix, value.size());
       if (status.ok()) {
 	(*out)[key].append(value);
       } else if (status.IsIOError()) {
@@ -1188,7 +1635,7 @@ int RocksDBStore::get(
   int r = 0;
   string value;
   rocksdb::Status s;
-  auto cf = get_cf_handle(prefix);
+  auto cf = get_cf_handle(prefix, key);
   if (cf) {
     s = db->Get(rocksdb::ReadOptions(),
 		cf,
@@ -1208,6 +1655,7 @@ int RocksDBStore::get(
   } else {
     ceph_abort_msg(s.getState());
   }
+  note_get(prefix, value.size());
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_gets);
   logger->tinc(l_rocksdb_get_latency, lat);
@@ -1225,7 +1673,7 @@ int RocksDBStore::get(
   int r = 0;
   string value;
   rocksdb::Status s;
-  auto cf = get_cf_handle(prefix);
+  auto cf = get_cf_handle(prefix, key, keylen);
   if (cf) {
     s = db->Get(rocksdb::ReadOptions(),
 		cf,
@@ -1246,6 +1694,7 @@ int RocksDBStore::get(
   } else {
     ceph_abort_msg(s.getState());
   }
+  note_get(prefix, value.size());
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_gets);
   logger->tinc(l_rocksdb_get_latency, lat);
@@ -1283,8 +1732,196 @@ void RocksDBStore::compact()
       static_cast<rocksdb::ColumnFamilyHandle*>(cf.second),
       nullptr, nullptr);
   }
+  for (auto& p : cf_shards) {
+    for (auto h : p.second.handles) {
+      db->CompactRange(options, h, nullptr, nullptr);
+    }
+  }
+}
+
+
+RocksDBStore::tombstone_range& RocksDBStore::add_tombstone_range(
+  vector<tombstone_range>& ranges,
+  const tombstone_range& r)
+{
+  tombstone_range merged = r;
+  for (auto p = ranges.begin(); p != ranges.end(); ) {
+    if (p->start <= merged.end && merged.start <= p->end) {
+      merged.start = std::min(merged.start, p->start);
+      merged.end = std::max(merged.end, p->end);
+      merged.count += p->count;
+      p = ranges.erase(p);
+    } else {
+      ++p;
+    }
+  }
+  if (ranges.size() == MAX_TOMBSTONE_RANGES) {
+    auto fewest = std::min_element(
+      ranges.begin(), ranges.end(),
+      [](const tombstone_range& a, const tombstone_range& b) {
+	return a.count < b.count;
+      });
+    ranges.erase(fewest);
+  }
+  ranges.push_back(std::move(merged));
+  return ranges.back();
+}
+
+void RocksDBStore::account_tombstones(
+  const map<string, vector<tombstone_range>>& added)
+{
+  if (!tombstone_compact_threshold) {
+    return;
+  }
+  vector<pair<string, tombstone_range>> to_compact;
+  {
+    std::lock_guard l(tombstone_lock);
+    for (auto& p : added) {
+      auto& ranges = tombstones[p.first];
+      for (auto& r : p.second) {
+	auto& q = add_tombstone_range(ranges, r);
+	if (q.count >= tombstone_compact_threshold) {
+	  to_compact.emplace_back(p.first, std::move(q));
+	  ranges.pop_back();
+	}
+      }
+      if (ranges.empty()) {
+	tombstones.erase(p.first);
+      }
+    }
+  }
+  for (auto& p : to_compact) {
+    const tombstone_range& r = p.second;
+    dout(10) << __func__ << " " << r.count << " tombstones in prefix "
+	     << p.first << ", compacting" << dendl;
+    logger->inc(l_rocksdb_compact_tombstones);
+    compact_range_async(p.first, r.start, r.end);
+  }
+}
+
+void RocksDBStore::prefix_stats_t::add(const prefix_stats_t& o)
+{
+  gets += o.gets;
+  get_bytes += o.get_bytes;
+  sets += o.sets;
+  merges += o.merges;
+  set_bytes += o.set_bytes;
+  rmkeys += o.rmkeys;
+  rm_ranges += o.rm_ranges;
+  seeks += o.seeks;
+}
+
+void RocksDBStore::prefix_stats_t::dump(Formatter *f) const
+{
+  f->dump_unsigned("gets", gets);
+  f->dump_unsigned("get_bytes", get_bytes);
+  f->dump_unsigned("sets", sets);
+  f->dump_unsigned("merges", merges);
+  f->dump_unsigned("set_bytes", set_bytes);
+  f->dump_unsigned("rmkeys", rmkeys);
+  f->dump_unsigned("rm_ranges", rm_ranges);
+  f->dump_unsigned("seeks", seeks);
+}
+
+void RocksDBStore::prefix_counters_t::add(const prefix_stats_t& o)
+{
+  gets += o.gets;
+  get_bytes += o.get_bytes;
+  sets += o.sets;
+  merges += o.merges;
+  set_bytes += o.set_bytes;
+  rmkeys += o.rmkeys;
+  rm_ranges += o.rm_ranges;
+  seeks += o.seeks;
+}
+
+RocksDBStore::prefix_stats_t RocksDBStore::prefix_counters_t::get() const
+{
+  prefix_stats_t s;
+  s.gets = gets;
+  s.get_bytes = get_bytes;
+  s.sets = sets;
+  s.merges = merges;
+  s.set_bytes = set_bytes;
+  s.rmkeys = rmkeys;
+  s.rm_ranges = rm_ranges;
+  s.seeks = seeks;
+  return s;
+}
+
+RocksDBStore::prefix_counters_t& RocksDBStore::get_prefix_counters(
+  const string& prefix)
+{
+  size_t h = std::hash<string>()(prefix);
+  for (size_t i = 0; i < PREFIX_STATS_SLOTS; ++i) {
+    prefix_counters_t& c = prefix_stats[(h + i) % PREFIX_STATS_SLOTS];
+    string *p = c.prefix.load(std::memory_order_acquire);
+    if (!p) {
+      string *mine = new string(prefix);
+      if (c.prefix.compare_exchange_strong(p, mine,
+					   std::memory_order_acq_rel)) {
+	return c;
+      }
+      // somebody else claimed the slot first
+      delete mine;
+    }
+    if (*p == prefix) {
+      return c;
+    }
+  }
+  return prefix_stats_overflow;
+}
+
+void RocksDBStore::account_prefix_stats(
+  const map<string, prefix_stats_t>& added)
+{
+  for (auto& p : added) {
+    get_prefix_counters(p.first).add(p.second);
+  }
 }
 
+void RocksDBStore::note_get(const string& prefix, uint64_t bytes)
+{
+  if (!collect_prefix_stats) {
+    return;
+  }
+  auto& c = get_prefix_counters(prefix);
+  c.gets++;
+  c.get_bytes += bytes;
+}
+
+void RocksDBStore::note_seek(const string& prefix)
+{
+  if (!collect_prefix_stats) {
+    return;
+  }
+  get_prefix_counters(prefix).seeks++;
+}
+
+void RocksDBStore::dump_prefix_stats(Formatter *f)
+{
+  map<string, prefix_stats_t> stats;
+  for (size_t i = 0; collect_prefix_stats && i < PREFIX_STATS_SLOTS; ++i) {
+    string *p = prefix_stats[i].prefix.load(std::memory_order_acquire);
+    if (p) {
+      stats[*p] = prefix_stats[i].get();
+    }
+  }
+  prefix_stats_t overflow = prefix_stats_overflow.get();
+  f->open_object_section("rocksdb_prefix_statistics");
+  for (auto& p : stats) {
+    f->open_object_section(p.first.c_str());
+    p.second.dump(f);
+    f->close_section();
+  }
+  if (overflow.gets || overflow.sets || overflow.merges || overflow.rmkeys ||
+      overflow.rm_ranges || overflow.seeks) {
+    f->open_object_section("<other>");
+    overflow.dump(f);
+    f->close_section();
+  }
+  f->close_section();
+}
 
 void RocksDBStore::compact_thread_entry()
 {
@@ -1364,6 +2001,37 @@ bool RocksDBStore::check_omap_dir(string &omap_dir)
 void RocksDBStore::compact_range(const string& start, const string& end)
 {
   rocksdb::CompactRangeOptions options;
+  // ranges are given in the default column family's "prefix\0key" space
+  // (or as [prefix, past_prefix) for a whole prefix); a prefix with its
+  // own column families is compacted there instead.
+  if (!cf_handles.empty() || !cf_shards.empty()) {
+    string prefix = start.substr(0, start.find('\0'));
+    auto cf = get_cf_handle(prefix);
+    auto shards = get_cf_shards(prefix);
+    if (cf || shards) {
+      string kstart, kend;
+      bool bounded = false;
+      if (prefix.size() < start.size()) {
+	kstart = start.substr(prefix.size() + 1);
+      }
+      if (end.size() > prefix.size() &&
+	  end.compare(0, prefix.size(), prefix) == 0 &&
+	  end[prefix.size()] == '\0') {
+	kend = end.substr(prefix.size() + 1);
+	bounded = true;
+      }
+      rocksdb::Slice cstart(kstart);
+      rocksdb::Slice cend(kend);
+      if (cf) {
+	db->CompactRange(options, cf, &cstart, bounded ? &cend : nullptr);
+      } else {
+	for (auto h : shards->handles) {
+	  db->CompactRange(options, h, &cstart, bounded ? &cend : nullptr);
+	}
+      }
+      return;
+    }
+  }
   rocksdb::Slice cstart(start);
   rocksdb::Slice cend(end);
   db->CompactRange(options, &cstart, &cend);
@@ -1381,6 +2049,8 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first()
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first(const string &prefix)
 {
+  if (store)
+    store->note_seek(prefix);
   rocksdb::Slice slice_prefix(prefix);
   dbiter->Seek(slice_prefix);
   ceph_assert(!dbiter->status().IsIOError());
@@ -1394,6 +2064,8 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last()
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last(const string &prefix)
 {
+  if (store)
+    store->note_seek(prefix);
   string limit = past_prefix(prefix);
   rocksdb::Slice slice_limit(limit);
   dbiter->Seek(slice_limit);
@@ -1417,6 +2089,8 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::upper_bound(const string &prefi
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::lower_bound(const string &prefix, const string &to)
 {
+  if (store)
+    store->note_seek(prefix);
   string bound = combine_strings(prefix, to);
   rocksdb::Slice slice_bound(bound);
   dbiter->Seek(slice_bound);
@@ -1501,26 +2175,33 @@ string RocksDBStore::past_prefix(const string &prefix)
 RocksDBStore::WholeSpaceIterator RocksDBStore::get_wholespace_iterator()
 {
   return std::make_shared<RocksDBWholeSpaceIteratorImpl>(
-    db->NewIterator(rocksdb::ReadOptions(), default_cf));
+    db->NewIterator(rocksdb::ReadOptions(), default_cf),
+    collect_prefix_stats ? this : nullptr);
 }
 
 class CFIteratorImpl : public KeyValueDB::IteratorImpl {
 protected:
   string prefix;
   rocksdb::Iterator *dbiter;
+  RocksDBStore *store;  ///< for seek accounting, may be null
 public:
   explicit CFIteratorImpl(const std::string& p,
-				 rocksdb::Iterator *iter)
-    : prefix(p), dbiter(iter) { }
+				 rocksdb::Iterator *iter,
+				 RocksDBStore *s = nullptr)
+    : prefix(p), dbiter(iter), store(s) { }
   ~CFIteratorImpl() {
     delete dbiter;
   }
 
   int seek_to_first() override {
+    if (store)
+      store->note_seek(prefix);
     dbiter->SeekToFirst();
     return dbiter->status().ok() ? 0 : -1;
   }
   int seek_to_last() override {
+    if (store)
+      store->note_seek(prefix);
     dbiter->SeekToLast();
     return dbiter->status().ok() ? 0 : -1;
   }
@@ -1532,6 +2213,8 @@ public:
     return dbiter->status().ok() ? 0 : -1;
   }
   int lower_bound(const string &to) override {
+    if (store)
+      store->note_seek(prefix);
     rocksdb::Slice slice_bound(to);
     dbiter->Seek(slice_bound);
     return dbiter->status().ok() ? 0 : -1;
@@ -1569,15 +2252,344 @@ public:
   }
 };
 
-KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix)
+//
+// Iterates a prefix hashed over several column families by merging the
+// per-shard iterators in key order.  Each key lives in exactly one shard.
+//
+class ShardMergeIteratorImpl : public KeyValueDB::IteratorImpl {
+  string prefix;
+  std::vector<rocksdb::Iterator*> iters;
+  rocksdb::Iterator *cur = nullptr;  ///< shard positioned on the current key
+  bool forward = true;
+  RocksDBStore *store;  ///< for seek accounting, may be null
+
+  void pick_smallest() {
+    cur = nullptr;
+    for (auto i : iters) {
+      if (i->Valid() && (!cur || i->key().compare(cur->key()) < 0)) {
+	cur = i;
+      }
+    }
+    forward = true;
+  }
+  void pick_largest() {
+    cur = nullptr;
+    for (auto i : iters) {
+      if (i->Valid() && (!cur || i->key().compare(cur->key()) > 0)) {
+	cur = i;
+      }
+    }
+    forward = false;
+  }
+public:
+  ShardMergeIteratorImpl(const std::string& p,
+			 std::vector<rocksdb::Iterator*>&& i,
+			 RocksDBStore *s = nullptr)
+    : prefix(p), iters(std::move(i)), store(s) { }
+  ~ShardMergeIteratorImpl() {
+    for (auto i : iters) {
+      delete i;
+    }
+  }
+
+  int seek_to_first() override {
+    if (store)
+      store->note_seek(prefix);
+    for (auto i : iters) {
+      i->SeekToFirst();
+    }
+    pick_smallest();
+    return status();
+  }
+  int seek_to_last() override {
+    if (store)
+      store->note_seek(prefix);
+    for (auto i : iters) {
+      i->SeekToLast();
+    }
+    pick_largest();
+    return status();
+  }
+  int upper_bound(const string &after) override {
+    lower_bound(after);
+    if (valid() && (key() == after)) {
+      next();
+    }
+    return status();
+  }
+  int lower_bound(const string &to) override {
+    if (store)
+      store->note_seek(prefix);
+    rocksdb::Slice slice_bound(to);
+    for (auto i : iters) {
+      i->Seek(slice_bound);
+    }
+    pick_smallest();
+    return status();
+  }
+  int next() override {
+    if (valid()) {
+      if (!forward) {
+	// the other shards sit before the current key; move them past it
+	string k = cur->key().ToString();
+	for (auto i : iters) {
+	  if (i != cur) {
+	    i->Seek(k);
+	  }
+	}
+      }
+      cur->Next();
+      pick_smallest();
+    }
+    return status();
+  }
+  int prev() override {
+    if (valid()) {
+      if (forward) {
+	string k = cur->key().ToString();
+	for (auto i : iters) {
+	  if (i != cur) {
+	    i->SeekForPrev(k);
+	  }
+	}
+      }
+      cur->Prev();
+      pick_largest();
+    }
+    return status();
+  }
+  bool valid() override {
+    return cur != nullptr && cur->Valid();
+  }
+  string key() override {
+    return cur->key().ToString();
+  }
+  std::pair<std::string, std::string> raw_key() override {
+    return make_pair(prefix, key());
+  }
+  bufferlist value() override {
+    return to_bufferlist(cur->value());
+  }
+  bufferptr value_as_ptr() override {
+    rocksdb::Slice val = cur->value();
+    return bufferptr(val.data(), val.size());
+  }
+  int status() override {
+    for (auto i : iters) {
+      if (!i->status().ok()) {
+	return -1;
+      }
+    }
+    return 0;
+  }
+};
+
+KeyValueDB::Iterator RocksDBStore::_get_iterator(const std::string& prefix,
+						 bool count_seeks)
 {
+  RocksDBStore *stats = count_seeks && collect_prefix_stats ? this : nullptr;
+  auto shards = get_cf_shards(prefix);
+  if (shards) {
+    std::vector<rocksdb::Iterator*> iters;
+    for (auto h : shards->handles) {
+      iters.push_back(db->NewIterator(rocksdb::ReadOptions(), h));
+    }
+    return std::make_shared<ShardMergeIteratorImpl>(
+      prefix, std::move(iters), stats);
+  }
   rocksdb::ColumnFamilyHandle *cf_handle =
     static_cast<rocksdb::ColumnFamilyHandle*>(get_cf_handle(prefix));
   if (cf_handle) {
     return std::make_shared<CFIteratorImpl>(
       prefix,
-      db->NewIterator(rocksdb::ReadOptions(), cf_handle));
+      db->NewIterator(rocksdb::ReadOptions(), cf_handle),
+      stats);
   } else {
-    return KeyValueDB::get_iterator(prefix);
+    return std::make_shared<PrefixIteratorImpl>(
+      prefix,
+      std::make_shared<RocksDBWholeSpaceIteratorImpl>(
+	db->NewIterator(rocksdb::ReadOptions(), default_cf), stats));
   }
 }
+
+bool RocksDBStore::is_resharding()
+{
+  string def;
+  return read_sharding_def(&def) == 0 &&
+    def.compare(0, RESHARDING_MARKER.size(), RESHARDING_MARKER) == 0;
+}
+
+int RocksDBStore::reshard(const std::string& new_def, std::ostream& out)
+{
+  // bound the size of each write batch while moving keys
+  const uint64_t max_batch_keys = 10000;
+  const uint64_t max_batch_bytes = 64 << 20;
+
+  vector<ColumnFamily> new_cfs;
+  int r = parse_sharding_def(new_def, &new_cfs, &out);
+  if (r < 0) {
+    return r;
+  }
+  out << "resharding to '" << get_sharding_def(new_cfs) << "'" << std::endl;
+
+  // remember every layout whose column families may still exist, so that
+  // an interrupted run can tell which prefix each of them holds.
+  string cur_def;
+  r = read_sharding_def(&cur_def);
+  if (r < 0) {
+    return r;
+  }
+  vector<string> old_defs;
+  if (cur_def.compare(0, RESHARDING_MARKER.size(), RESHARDING_MARKER) == 0) {
+    get_str_vec(cur_def.substr(RESHARDING_MARKER.size()), "\n", old_defs);
+  } else if (!cur_def.empty()) {
+    old_defs.push_back(cur_def);
+  }
+  // cf name -> prefix for the shards of every old layout
+  map<string, string> shard_prefix;
+  for (auto& d : old_defs) {
+    vector<ColumnFamily> layout;
+    r = parse_sharding_def(d, &layout, &out);
+    if (r < 0) {
+      derr << "reshard: invalid persisted sharding '" << d << "'" << dendl;
+      return r;
+    }
+    for (auto& l : layout) {
+      for (uint32_t i = 0; l.shard_cnt > 1 && i < l.shard_cnt; ++i) {
+	shard_prefix[l.name + "-" + stringify(i)] = l.name;
+      }
+    }
+  }
+  string marker = RESHARDING_MARKER + get_sharding_def(new_cfs);
+  for (auto& d : old_defs) {
+    marker += "\n" + d;
+  }
+  r = write_sharding_def(marker);
+  if (r < 0) {
+    return r;
+  }
+
+  rocksdb::WriteBatch bat;
+  uint64_t bat_bytes = 0;
+  uint64_t moved = 0;
+  auto flush = [&]() {
+    if (bat.Count() == 0) {
+      return 0;
+    }
+    rocksdb::WriteOptions woptions;
+    woptions.sync = true;
+    rocksdb::Status s = db->Write(woptions, &bat);
+    if (!s.ok()) {
+      derr << "reshard: write failed: " << s.ToString() << dendl;
+      return -EIO;
+    }
+    bat.Clear();
+    bat_bytes = 0;
+    return 0;
+  };
+  auto add = [&](rocksdb::ColumnFamilyHandle *h, const rocksdb::Slice& k,
+		 const rocksdb::Slice& v) {
+    bat.Put(h, k, v);
+    bat_bytes += k.size() + v.size();
+    ++moved;
+    if (bat.Count() >= max_batch_keys || bat_bytes >= max_batch_bytes) {
+      return flush();
+    }
+    return 0;
+  };
+
+  // 1. fold every column family back into the default one.  after an
+  // interrupted reshard the shards were opened as plain column families.
+  {
+    std::lock_guard l(stall_lock);
+    pressure_cfs.assign(1, default_cf);
+  }
+  vector<pair<string, rocksdb::ColumnFamilyHandle*>> old_cfs;
+  for (auto& p : cf_handles) {
+    auto sp = shard_prefix.find(p.first);
+    old_cfs.emplace_back(
+      sp == shard_prefix.end() ? p.first : sp->second,
+      static_cast<rocksdb::ColumnFamilyHandle*>(p.second));
+  }
+  for (auto& p : cf_shards) {
+    for (auto h : p.second.handles) {
+      old_cfs.emplace_back(p.first, h);
+    }
+  }
+  for (auto& p : old_cfs) {
+    out << " folding column family " << p.second->GetName()
+	<< " into default" << std::endl;
+    std::unique_ptr<rocksdb::Iterator> it(
+      db->NewIterator(rocksdb::ReadOptions(), p.second));
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+      string k = combine_strings(p.first, it->key().ToString());
+      r = add(default_cf, rocksdb::Slice(k), it->value());
+      if (r < 0) {
+	return r;
+      }
+    }
+    if (!it->status().ok()) {
+      derr << "reshard: iteration failed: " << it->status().ToString() << dendl;
+      return -EIO;
+    }
+    it.reset();
+    r = flush();
+    if (r < 0) {
+      return r;
+    }
+    rocksdb::Status s = db->DropColumnFamily(p.second);
+    if (!s.ok()) {
+      derr << "reshard: failed to drop " << p.second->GetName() << ": "
+	   << s.ToString() << dendl;
+      return -EIO;
+    }
+    db->DestroyColumnFamilyHandle(p.second);
+  }
+  cf_handles.clear();
+  cf_shards.clear();
+
+  // 2. create the new layout and move each prefix out of the default CF
+  rocksdb::Options base = db->GetOptions(default_cf);
+  for (auto& cf : new_cfs) {
+    r = create_cf(cf, base);
+    if (r < 0) {
+      return r;
+    }
+    out << " moving prefix " << cf.name << " into " << cf.shard_cnt
+	<< " column families" << std::endl;
+    string start = combine_strings(cf.name, string());
+    string end = combine_strings(past_prefix(cf.name), string());
+    std::unique_ptr<rocksdb::Iterator> it(
+      db->NewIterator(rocksdb::ReadOptions(), default_cf));
+    for (it->Seek(start);
+	 it->Valid() && it->key().compare(rocksdb::Slice(end)) < 0;
+	 it->Next()) {
+      rocksdb::Slice k = it->key();
+      k.remove_prefix(cf.name.size() + 1);
+      r = add(get_cf_handle(cf.name, k.data(), k.size()), k, it->value());
+      if (r < 0) {
+	return r;
+      }
+    }
+    if (!it->status().ok()) {
+      derr << "reshard: iteration failed: " << it->status().ToString() << dendl;
+      return -EIO;
+    }
+    it.reset();
+    bat.DeleteRange(default_cf, rocksdb::Slice(start), rocksdb::Slice(end));
+    r = flush();
+    if (r < 0) {
+      return r;
+    }
+    rocksdb::Slice cstart(start), cend(end);
+    db->CompactRange(rocksdb::CompactRangeOptions(), default_cf,
+		     &cstart, &cend);
+  }
+
+  r = write_sharding_def(get_sharding_def(new_cfs));
+  if (r < 0) {
+    return r;
+  }
+  out << "reshard done, " << moved << " keys moved" << std::endl;
+  return 0;
+}
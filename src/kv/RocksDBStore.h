@@ -10,6 +10,7 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <atomic>
 #include <boost/scoped_ptr.hpp>
 #include "rocksdb/write_batch.h"
 #include "rocksdb/perf_context.h"
@@ -36,10 +37,17 @@ enum {
   l_rocksdb_get_latency,
   l_rocksdb_submit_latency,
   l_rocksdb_submit_sync_latency,
+  l_rocksdb_submit_latency_size_hist,
+  l_rocksdb_submit_sync_latency_size_hist,
   l_rocksdb_compact,
   l_rocksdb_compact_range,
   l_rocksdb_compact_queue_merge,
   l_rocksdb_compact_queue_len,
+  l_rocksdb_compact_tombstones,
+  l_rocksdb_rmrange,
+  l_rocksdb_pending_compaction_bytes,
+  l_rocksdb_l0_files,
+  l_rocksdb_write_stall,
   l_rocksdb_write_wal_time,
   l_rocksdb_write_memtable_time,
   l_rocksdb_write_delay_time,
@@ -87,9 +95,21 @@ class RocksDBStore : public KeyValueDB {
   bool must_close_default_cf = false;
   rocksdb::ColumnFamilyHandle *default_cf = nullptr;
 
+  /// a prefix hashed across several column families named "prefix-N"
+  struct prefix_shards {
+    uint32_t hash_l = 0;
+    uint32_t hash_h = UINT32_MAX;
+    std::vector<rocksdb::ColumnFamilyHandle*> handles;
+  };
+  std::unordered_map<std::string, prefix_shards> cf_shards;
+
   int submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t);
   int install_cf_mergeop(const string &cf_name, rocksdb::ColumnFamilyOptions *cf_opt);
+  int create_cf(const ColumnFamily& cf, const rocksdb::Options& base);
   int create_db_dir();
+  string sharding_def_fn() const;
+  int read_sharding_def(string *def);
+  int write_sharding_def(const string &def);
   int do_open(ostream &out, bool create_if_missing, bool open_readonly,
 	      const vector<ColumnFamily>* cfs = nullptr);
   int load_rocksdb_options(bool create_if_missing, rocksdb::Options& opt);
@@ -115,12 +135,90 @@ class RocksDBStore : public KeyValueDB {
   void compact_range(const string& start, const string& end);
   void compact_range_async(const string& start, const string& end);
 
+  /// a range of keys deleted since it was last compacted
+  struct tombstone_range {
+    string start;       ///< lowest key removed
+    string end;         ///< end of removed keys
+    uint64_t count = 0; ///< tombstones written
+  };
+  /// ranges tracked per prefix; past that the one with the fewest
+  /// tombstones is forgotten and left to rocksdb's own compaction
+  static constexpr size_t MAX_TOMBSTONE_RANGES = 8;
+  /// add r to ranges, merging it with the ranges it overlaps or touches
+  static tombstone_range& add_tombstone_range(vector<tombstone_range>& ranges,
+					      const tombstone_range& r);
+  const uint64_t tombstone_compact_threshold;
+  Mutex tombstone_lock;
+  map<string, vector<tombstone_range>> tombstones;
+  /// compact the ranges that gathered too many tombstones
+  void account_tombstones(const map<string, vector<tombstone_range>>& added);
+
+  /// per prefix kv traffic, see rocksdb_collect_prefix_stats
+  struct prefix_stats_t {
+    uint64_t gets = 0;
+    uint64_t get_bytes = 0;
+    uint64_t sets = 0;
+    uint64_t merges = 0;
+    uint64_t set_bytes = 0;   ///< key and value bytes of sets and merges
+    uint64_t rmkeys = 0;
+    uint64_t rm_ranges = 0;
+    uint64_t seeks = 0;       ///< iterator positioning
+    void add(const prefix_stats_t& o);
+    void dump(Formatter *f) const;
+  };
+  /// the shared counters of one prefix; a slot keeps the prefix it was
+  /// claimed for until the store goes away
+  struct prefix_counters_t {
+    std::atomic<string*> prefix = {nullptr};
+    std::atomic<uint64_t> gets = {0};
+    std::atomic<uint64_t> get_bytes = {0};
+    std::atomic<uint64_t> sets = {0};
+    std::atomic<uint64_t> merges = {0};
+    std::atomic<uint64_t> set_bytes = {0};
+    std::atomic<uint64_t> rmkeys = {0};
+    std::atomic<uint64_t> rm_ranges = {0};
+    std::atomic<uint64_t> seeks = {0};
+    ~prefix_counters_t() {
+      delete prefix.load();
+    }
+    void add(const prefix_stats_t& o);
+    prefix_stats_t get() const;
+  };
+  /// open addressed by prefix hash, so that readers never take a lock
+  static constexpr size_t PREFIX_STATS_SLOTS = 128;
+  const bool collect_prefix_stats;
+  std::unique_ptr<prefix_counters_t[]> prefix_stats;
+  prefix_counters_t prefix_stats_overflow;  ///< once every slot is taken
+  prefix_counters_t& get_prefix_counters(const string& prefix);
+  void account_prefix_stats(const map<string, prefix_stats_t>& added);
+
+  // write stall tracking, fed by StallListener
+  class StallListener;
+  enum {
+    STALL_NONE = 0,
+    STALL_DELAYED = 1,
+    STALL_STOPPED = 2,
+  };
+  uint64_t l0_compaction_trigger = 0;
+  uint64_t l0_stop_trigger = 0;
+  uint64_t hard_pending_compaction_bytes = 0;
+  std::atomic<uint64_t> pending_compaction_bytes = {0};
+  std::atomic<uint64_t> l0_files = {0};
+  std::atomic<int> stall_state = {STALL_NONE};
+  Mutex stall_lock;
+  map<string, int> stalled_cfs;  ///< cf name -> STALL_*
+  /// every column family, for update_write_pressure; set once open
+  vector<rocksdb::ColumnFamilyHandle*> pressure_cfs;
+  void update_write_pressure(rocksdb::DB *db);
+  void set_stall_condition(const string& cf_name, int cond);
+
 public:
   /// compact the underlying rocksdb store
   bool compact_on_mount;
   bool disableWAL;
   bool enable_rmrange;
   const uint64_t max_items_rmrange;
+  const uint64_t max_items_rmrange_per_txn;
   void compact() override;
 
   void compact_async() override {
@@ -158,10 +256,20 @@ public:
     compact_queue_lock("RocksDBStore::compact_thread_lock"),
     compact_queue_stop(false),
     compact_thread(this),
+    tombstone_compact_threshold(
+      cct->_conf.get_val<uint64_t>("rocksdb_tombstone_compact_threshold")),
+    tombstone_lock("RocksDBStore::tombstone_lock"),
+    collect_prefix_stats(
+      cct->_conf.get_val<bool>("rocksdb_collect_prefix_stats")),
+    prefix_stats(collect_prefix_stats ?
+		 new prefix_counters_t[PREFIX_STATS_SLOTS] : nullptr),
+    stall_lock("RocksDBStore::stall_lock"),
     compact_on_mount(false),
     disableWAL(false),
     enable_rmrange(cct->_conf->rocksdb_enable_rmrange),
-    max_items_rmrange(cct->_conf.get_val<uint64_t>("rocksdb_max_items_rmrange"))
+    max_items_rmrange(cct->_conf.get_val<uint64_t>("rocksdb_max_items_rmrange")),
+    max_items_rmrange_per_txn(
+      cct->_conf.get_val<uint64_t>("rocksdb_max_items_rmrange_per_txn"))
   {}
 
   ~RocksDBStore() override;
@@ -188,7 +296,49 @@ public:
     else
       return static_cast<rocksdb::ColumnFamilyHandle*>(iter->second);
   }
+  /// CF holding prefix/key, or nullptr if the prefix lives in the default CF
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix,
+					     const char *key, size_t keylen);
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix,
+					     const std::string& key) {
+    return get_cf_handle(prefix, key.data(), key.size());
+  }
+  const prefix_shards *get_cf_shards(const std::string& prefix) const {
+    auto iter = cf_shards.find(prefix);
+    return iter == cf_shards.end() ? nullptr : &iter->second;
+  }
+
+  /**
+   * parse a column family definition
+   *
+   * Whitespace separated items NAME[(SHARDS[,L-H])][=OPTIONS].  NAME is
+   * the prefix stored in the column family; with SHARDS > 1 the prefix is
+   * spread over column families NAME-0 .. NAME-(SHARDS-1) by a hash of
+   * key bytes [L, H) (the whole key by default).  OPTIONS is a rocksdb
+   * column family option string.  e.g. "M(4) P L=write_buffer_size=16M"
+   */
+  static int parse_sharding_def(const std::string& def,
+				std::vector<ColumnFamily> *cfs,
+				std::ostream *err = nullptr);
+  /// inverse of parse_sharding_def, without the options
+  static std::string get_sharding_def(const std::vector<ColumnFamily>& cfs);
+
+  /**
+   * move every key to the column family layout described by new_def
+   *
+   * Offline operation; the store must be open and idle.  It is restartable:
+   * if interrupted, the store only opens with the "resharding" kv option
+   * until reshard is run again.
+   */
+  int reshard(const std::string& new_def, std::ostream& out);
+  /// true if an earlier reshard was interrupted and must be rerun
+  bool is_resharding();
   int repair(std::ostream &out) override;
+  double get_write_pressure() override;
+  /// account a point read / an iterator seek in prefix
+  void note_get(const string& prefix, uint64_t bytes);
+  void note_seek(const string& prefix);
+  void dump_prefix_stats(Formatter *f);
   void split_stats(const std::string &s, char delim, std::vector<std::string> &elems);
   void get_statistics(Formatter *f) override;
 
@@ -294,6 +444,13 @@ public:
   public:
     rocksdb::WriteBatch bat;
     RocksDBStore *db;
+    /// range removals written as a single range tombstone
+    uint64_t delete_ranges = 0;
+    /// point deletes written by range removals
+    uint64_t rm_range_items = 0;
+    /// per prefix, the bounded ranges this transaction deletes
+    map<string, vector<tombstone_range>> tombstones;
+    map<string, prefix_stats_t> stats;
 
     explicit RocksDBTransactionImpl(RocksDBStore *_db);
   private:
@@ -302,6 +459,16 @@ public:
       rocksdb::ColumnFamilyHandle *cf,
       const string &k,
       const bufferlist &to_set_bl);
+    /// remove [start, end) of a prefix; empty end is unbounded
+    void rm_range(
+      const string &prefix,
+      const string &start,
+      const string &end);
+    void note_tombstones(
+      const string &prefix,
+      const string &start,
+      const string &end,
+      uint64_t count);
   public:
     void set(
       const string &prefix,
@@ -362,9 +529,11 @@ public:
     public KeyValueDB::WholeSpaceIteratorImpl {
   protected:
     rocksdb::Iterator *dbiter;
+    RocksDBStore *store;  ///< for seek accounting, may be null
   public:
-    explicit RocksDBWholeSpaceIteratorImpl(rocksdb::Iterator *iter) :
-      dbiter(iter) { }
+    explicit RocksDBWholeSpaceIteratorImpl(rocksdb::Iterator *iter,
+					   RocksDBStore *s = nullptr) :
+      dbiter(iter), store(s) { }
     //virtual ~RocksDBWholeSpaceIteratorImpl() { }
     ~RocksDBWholeSpaceIteratorImpl() override;
 
@@ -387,7 +556,12 @@ public:
     size_t value_size() override;
   };
 
-  Iterator get_iterator(const std::string& prefix) override;
+  Iterator get_iterator(const std::string& prefix) override {
+    return _get_iterator(prefix, true);
+  }
+  /// with count_seeks false the seeks don't show in the per prefix
+  /// stats; for iterators we only use internally
+  Iterator _get_iterator(const std::string& prefix, bool count_seeks);
 
   /// Utility
   static string combine_strings(const string &prefix, const string &value) {
@@ -52,6 +52,7 @@ public:
   void shutdown();
 
   bool ms_can_fast_dispatch_any() const override { return true; }
+  bool ms_fast_dispatch_by_type() const override { return true; }
   bool ms_can_fast_dispatch2(const cref_t<Message>& m) const override;
   void ms_fast_dispatch2(const ref_t<Message>& m) override;
   bool ms_dispatch2(const ref_t<Message> &m) override;
@@ -513,8 +513,8 @@ struct ceph_osd_request_head {
 	reqid = osd_reqid_t();
 
       hobj.pool = pgid.pgid.pool();
-      hobj.set_key(oloc.key);
-      hobj.nspace = oloc.nspace;
+      hobj.set_key(std::move(oloc.key));
+      hobj.nspace = std::move(oloc.nspace);
       hobj.set_hash(pgid.pgid.ps());
 
       OSDOp::split_osd_op_vector_in_data(ops, data);
@@ -558,8 +558,9 @@ struct ceph_osd_request_head {
     decode(features, p);
 
     hobj.pool = pgid.pgid.pool();
-    hobj.set_key(oloc.key);
-    hobj.nspace = oloc.nspace;
+    // oloc is scratch; hand its strings over instead of copying them
+    hobj.set_key(std::move(oloc.key));
+    hobj.nspace = std::move(oloc.nspace);
 
     OSDOp::split_osd_op_vector_in_data(ops, data);
 
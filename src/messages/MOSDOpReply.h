@@ -133,7 +133,7 @@ public:
   MOSDOpReply(const MOSDOp *req, int r, epoch_t e, int acktype,
 	      bool ignore_out_data)
     : Message{CEPH_MSG_OSD_OPREPLY, HEAD_VERSION, COMPAT_VERSION},
-      oid(req->hobj.oid), pgid(req->pgid.pgid), ops(req->ops),
+      oid(req->hobj.oid), pgid(req->pgid.pgid), ops(req->ops.size()),
       bdata_encode(false) {
 
     set_tid(req->get_tid());
@@ -145,11 +145,14 @@ public:
     retry_attempt = req->get_retry_attempt();
     do_redirect = false;
 
-    // zero out ops payload_len and possibly out data
+    // only take what goes on the wire: copying the request's indata
+    // (and soid) would cost a buffer node per op for nothing
     for (unsigned i = 0; i < ops.size(); i++) {
+      ops[i].op = req->ops[i].op;
       ops[i].op.payload_len = 0;
-      if (ignore_out_data)
-	ops[i].outdata.clear();
+      ops[i].rval = req->ops[i].rval;
+      if (!ignore_out_data)
+	ops[i].outdata = req->ops[i].outdata;
     }
   }
 private:
@@ -19,7 +19,7 @@
 
 class MOSDPGScan : public MOSDFastDispatchOp {
 private:
-  static constexpr int HEAD_VERSION = 2;
+  static constexpr int HEAD_VERSION = 3;
   static constexpr int COMPAT_VERSION = 2;
 
 public:
@@ -41,6 +41,19 @@ public:
   spg_t pgid;
   hobject_t begin, end;
 
+  /**
+   * digest based scan
+   *
+   * get_digest: [digest_begin, range_digests.back().first) is split into
+   * consecutive ranges, each given by its upper bound and the digest of
+   * the objects and versions the primary has in it.  The peer only
+   * lists the objects of ranges whose digest doesn't match its own.
+   *
+   * digest: the ranges from the request which matched.
+   */
+  hobject_t digest_begin;
+  std::vector<std::pair<hobject_t, sha1_digest_t>> range_digests;
+
   epoch_t get_map_epoch() const override {
     return map_epoch;
   }
@@ -68,6 +81,10 @@ public:
 
     decode(from, p);
     decode(pgid.shard, p);
+    if (header.version >= 3) {
+      decode(digest_begin, p);
+      decode(range_digests, p);
+    }
   }
 
   void encode_payload(uint64_t features) override {
@@ -85,6 +102,8 @@ public:
     encode(end, payload);
     encode(from, payload);
     encode(pgid.shard, payload);
+    encode(digest_begin, payload);
+    encode(range_digests, payload);
   }
 
   MOSDPGScan()
@@ -107,8 +126,11 @@ public:
     out << "pg_scan(" << get_op_name(op)
 	<< " " << pgid
 	<< " " << begin << "-" << end
-	<< " e " << map_epoch << "/" << query_epoch
-	<< ")";
+	<< " e " << map_epoch << "/" << query_epoch;
+    if (!range_digests.empty()) {
+      out << " digests " << digest_begin << "+" << range_digests.size();
+    }
+    out << ")";
   }
 private:
   template<class T, typename... Args>
@@ -19,7 +19,8 @@
 #include "messages/PaxosServiceMessage.h"
 
 class MPGStats : public PaxosServiceMessage {
-  static constexpr int HEAD_VERSION = 2;
+  // v3 adds no fields; it tells the mgr the sender handles MPGStatsAck
+  static constexpr int HEAD_VERSION = 3;
   static constexpr int COMPAT_VERSION = 1;
 
 public:
@@ -40,6 +41,11 @@ private:
   ~MPGStats() override {}
 
 public:
+  /// older osds don't expect an MPGStatsAck from the mgr and would leak it
+  bool wants_ack() const {
+    return header.version >= 3;
+  }
+
   std::string_view get_type_name() const override { return "pg_stats"; }
   void print(std::ostream& out) const override {
     out << "pg_stats(" << pg_stat.size() << " pgs tid " << get_tid() << " v " << version << ")";
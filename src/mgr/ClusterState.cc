@@ -14,6 +14,7 @@
 #include "messages/MMgrDigest.h"
 #include "messages/MMonMgrReport.h"
 #include "messages/MPGStats.h"
+#include "messages/MPGStatsAck.h"
 
 #include "mgr/ClusterState.h"
 
@@ -64,16 +65,16 @@ void ClusterState::load_digest(MMgrDigest *m)
   mon_status_json = std::move(m->mon_status_json);
 }
 
-void ClusterState::ingest_pgstats(ref_t<MPGStats> stats)
+void ClusterState::ingest_pgstats(ref_t<MPGStats> stats, MPGStatsAck *ack)
 {
   std::lock_guard l(lock);
 
   const int from = stats->get_orig_source().num();
   pending_inc.update_stat(from, std::move(stats->osd_stat));
 
-  for (auto p : stats->pg_stat) {
+  for (auto& p : stats->pg_stat) {
     pg_t pgid = p.first;
-    const auto &pg_stats = p.second;
+    auto &pg_stats = p.second;
 
     // In case we're hearing about a PG that according to last
     // OSDMap update should not exist
@@ -96,6 +97,13 @@ void ClusterState::ingest_pgstats(ref_t<MPGStats> stats)
                << dendl;
       continue;
     }
+    // Anything past here is taken or superseded; the OSD won't resend
+    // it until it changes.  PGs skipped above are left out of the ack.
+    if (ack) {
+      ack->pg_stat[pgid] = std::make_pair(pg_stats.reported_seq,
+					  pg_stats.reported_epoch);
+    }
+
     // In case we already heard about more recent stats from this PG
     // from another OSD
     const auto q = pg_map.pg_stat.find(pgid);
@@ -107,7 +115,7 @@ void ClusterState::ingest_pgstats(ref_t<MPGStats> stats)
       continue;
     }
 
-    pending_inc.pg_stat_updates[pgid] = pg_stats;
+    pending_inc.pg_stat_updates[pgid] = std::move(pg_stats);
   }
   for (auto p : stats->pool_stat) {
     pending_inc.pool_statfs_updates[std::make_pair(p.first, from)] = p.second;
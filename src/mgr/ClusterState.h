@@ -26,6 +26,7 @@
 class MMgrDigest;
 class MMonMgrReport;
 class MPGStats;
+class MPGStatsAck;
 
 
 /**
@@ -53,7 +54,8 @@ protected:
 public:
 
   void load_digest(MMgrDigest *m);
-  void ingest_pgstats(ceph::ref_t<MPGStats> stats);
+  /// ack, if not null, is filled with the pgs taken or already newer
+  void ingest_pgstats(ceph::ref_t<MPGStats> stats, MPGStatsAck *ack);
 
   void update_delta_stats();
 
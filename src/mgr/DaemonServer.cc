@@ -31,6 +31,7 @@
 #include "messages/MCommand.h"
 #include "messages/MCommandReply.h"
 #include "messages/MPGStats.h"
+#include "messages/MPGStatsAck.h"
 #include "messages/MOSDScrub.h"
 #include "messages/MOSDScrub2.h"
 #include "messages/MOSDForceRecovery.h"
@@ -239,9 +240,20 @@ bool DaemonServer::ms_dispatch2(const ref_t<Message>& m)
   // to take whatever locks it needs.
   switch (m->get_type()) {
     case MSG_PGSTATS:
-      cluster_state.ingest_pgstats(ref_cast<MPGStats>(m));
-      maybe_ready(m->get_source().num());
-      return true;
+      {
+	auto stats = ref_cast<MPGStats>(m);
+	ref_t<MPGStatsAck> ack;
+	if (stats->wants_ack()) {
+	  ack = make_message<MPGStatsAck>();
+	  ack->set_tid(m->get_tid());
+	}
+	cluster_state.ingest_pgstats(stats, ack.get());
+	if (ack) {
+	  m->get_connection()->send_message2(std::move(ack));
+	}
+	maybe_ready(m->get_source().num());
+	return true;
+      }
     case MSG_MGR_REPORT:
       return handle_report(ref_cast<MMgrReport>(m));
     case MSG_MGR_OPEN:
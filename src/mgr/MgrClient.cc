@@ -25,6 +25,7 @@
 #include "messages/MCommand.h"
 #include "messages/MCommandReply.h"
 #include "messages/MPGStats.h"
+#include "messages/MPGStatsAck.h"
 
 using std::string;
 using std::vector;
@@ -104,6 +105,12 @@ bool MgrClient::ms_dispatch2(const ref_t<Message>& m)
     } else {
       return false;
     }
+  case MSG_PGSTATSACK:
+    if (m->get_source().type() == CEPH_ENTITY_TYPE_MGR) {
+      return handle_pgstats_ack(ref_cast<MPGStatsAck>(m));
+    } else {
+      return false;
+    }
   default:
     ldout(cct, 30) << "Not handling " << *m << dendl; 
     return false;
@@ -370,8 +377,25 @@ void MgrClient::send_pgstats()
 void MgrClient::_send_pgstats()
 {
   if (pgstats_cb && session) {
-    session->con->send_message(pgstats_cb());
+    session->con->send_message(pgstats_cb(!session->pgstats_synced));
+  }
+}
+
+bool MgrClient::handle_pgstats_ack(ref_t<MPGStatsAck> m)
+{
+  ceph_assert(lock.is_locked_by_me());
+
+  ldout(cct, 20) << *m << dendl;
+  // acks from an earlier session describe what a previous mgr saw
+  if (!session || m->get_connection() != session->con) {
+    ldout(cct, 10) << "dropping stale " << *m << dendl;
+    return true;
+  }
+  session->pgstats_synced = true;
+  if (pgstats_ack_cb) {
+    pgstats_ack_cb(*m);
   }
+  return true;
 }
 
 bool MgrClient::handle_mgr_configure(ref_t<MMgrConfigure> m)
@@ -32,6 +32,7 @@ class MMgrClose;
 class Messenger;
 class MCommandReply;
 class MPGStats;
+class MPGStatsAck;
 
 class MgrSessionState
 {
@@ -41,6 +42,9 @@ class MgrSessionState
 
   // Our connection to the mgr
   ConnectionRef con;
+
+  // Has the mgr acknowledged a pg stats report on this session yet?
+  bool pgstats_synced = false;
 };
 
 class MgrCommand : public CommandOp
@@ -77,8 +81,10 @@ protected:
   Context *connect_retry_callback = nullptr;
 
   // If provided, use this to compose an MPGStats to send with
-  // our reports (hook for use by OSD)
-  std::function<MPGStats*()> pgstats_cb;
+  // our reports (hook for use by OSD).  The argument is true when
+  // the report must include every pg, e.g. on a new session.
+  std::function<MPGStats*(bool)> pgstats_cb;
+  std::function<void(const MPGStatsAck&)> pgstats_ack_cb;
   std::function<void(const std::map<OSDPerfMetricQuery,
                                     OSDPerfMetricLimits> &)> set_perf_queries_cb;
   std::function<void(std::map<OSDPerfMetricQuery,
@@ -118,6 +124,7 @@ public:
   bool handle_mgr_configure(ceph::ref_t<MMgrConfigure> m);
   bool handle_mgr_close(ceph::ref_t<MMgrClose> m);
   bool handle_command_reply(ceph::ref_t<MCommandReply> m);
+  bool handle_pgstats_ack(ceph::ref_t<MPGStatsAck> m);
 
   void set_perf_metric_query_cb(
     std::function<void(const std::map<OSDPerfMetricQuery,
@@ -131,11 +138,16 @@ public:
   }
 
   void send_pgstats();
-  void set_pgstats_cb(std::function<MPGStats*()>&& cb_)
+  void set_pgstats_cb(std::function<MPGStats*(bool)>&& cb_)
   {
     std::lock_guard l(lock);
     pgstats_cb = std::move(cb_);
   }
+  void set_pgstats_ack_cb(std::function<void(const MPGStatsAck&)>&& cb_)
+  {
+    std::lock_guard l(lock);
+    pgstats_ack_cb = std::move(cb_);
+  }
 
   int start_command(const std::vector<std::string>& cmd, const ceph::buffer::list& inbl,
 		    ceph::buffer::list *outbl, std::string *outs,
@@ -13412,7 +13412,7 @@ int OSDMonitor::_prepare_remove_pool(
     }
   }
   // remove any pg_upmap mappings for this pool
-  for (auto& p : osdmap.pg_upmap) {
+  for (auto& p : *osdmap.pg_upmap) {
     if (p.first.pool() == pool) {
       dout(10) << __func__ << " " << pool
                << " removing obsolete pg_upmap "
@@ -13435,7 +13435,7 @@ int OSDMonitor::_prepare_remove_pool(
     }
   }
   // remove any pg_upmap_items mappings for this pool
-  for (auto& p : osdmap.pg_upmap_items) {
+  for (auto& p : *osdmap.pg_upmap_items) {
     if (p.first.pool() == pool) {
       dout(10) << __func__ << " " << pool
                << " removing obsolete pg_upmap_items " << p.first
@@ -70,6 +70,12 @@ public:
    * fast dispatch; false otherwise.
    */
   virtual bool ms_can_fast_dispatch_any() const { return false; }
+  /**
+   * Return true if ms_can_fast_dispatch() looks at nothing but the
+   * message type. The Messenger then asks only once per type and
+   * routes later messages of that type straight to this Dispatcher.
+   */
+  virtual bool ms_fast_dispatch_by_type() const { return false; }
   /**
    * Perform a "fast dispatch" on a given message. See
    * ms_can_fast_dispatch() for the requirements.
@@ -50,6 +50,7 @@ Messenger::Messenger(CephContext *cct_, entity_name_t w)
     crcflags(get_default_crc_flags(cct->_conf)),
     auth_registry(cct)
 {
+  reset_fast_routes();
   auth_registry.refresh_config();
 }
 
@@ -19,6 +19,8 @@
 
 #include <map>
 #include <deque>
+#include <array>
+#include <atomic>
 
 #include <errno.h>
 #include <sstream>
@@ -71,6 +73,47 @@ private:
   std::deque<Dispatcher*> fast_dispatchers;
   ZTracer::Endpoint trace_endpoint;
 
+  /// fast dispatcher by message type, learned on first use. 0 means not
+  /// known yet, FAST_ROUTE_NONE that the type isn't fast dispatched.
+  static constexpr unsigned FAST_ROUTE_TYPES = 2048;
+  static constexpr uintptr_t FAST_ROUTE_NONE = 1;
+  std::array<std::atomic<uintptr_t>, FAST_ROUTE_TYPES> fast_routes;
+
+  void reset_fast_routes() {
+    for (auto& r : fast_routes) {
+      r.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  Dispatcher *get_fast_dispatcher(const cref_t<Message>& m) {
+    const auto type = m->get_type();
+    if (type < FAST_ROUTE_TYPES) {
+      const auto r = fast_routes[type].load(std::memory_order_acquire);
+      if (r == FAST_ROUTE_NONE) {
+	return nullptr;
+      } else if (r) {
+	return reinterpret_cast<Dispatcher*>(r);
+      }
+    }
+    // only remember the answer if every dispatcher asked decides by
+    // type alone
+    bool by_type = true;
+    Dispatcher *found = nullptr;
+    for (const auto &dispatcher : fast_dispatchers) {
+      by_type = by_type && dispatcher->ms_fast_dispatch_by_type();
+      if (dispatcher->ms_can_fast_dispatch2(m)) {
+	found = dispatcher;
+	break;
+      }
+    }
+    if (by_type && type < FAST_ROUTE_TYPES) {
+      fast_routes[type].store(
+	found ? reinterpret_cast<uintptr_t>(found) : FAST_ROUTE_NONE,
+	std::memory_order_release);
+    }
+    return found;
+  }
+
 protected:
   void set_endpoint_addr(const entity_addr_t& a,
                          const entity_name_t &name);
@@ -383,6 +426,7 @@ public:
     dispatchers.push_front(d);
     if (d->ms_can_fast_dispatch_any())
       fast_dispatchers.push_front(d);
+    reset_fast_routes();
     if (first)
       ready();
   }
@@ -398,6 +442,7 @@ public:
     dispatchers.push_back(d);
     if (d->ms_can_fast_dispatch_any())
       fast_dispatchers.push_back(d);
+    reset_fast_routes();
     if (first)
       ready();
   }
@@ -644,16 +689,13 @@ public:
   /**
    * Determine whether a message can be fast-dispatched. We will
    * query each Dispatcher in sequence to determine if they are
-   * capable of handling a particular message via "fast dispatch".
+   * capable of handling a particular message via "fast dispatch",
+   * unless the answer for this message type is already known.
    *
    * @param m The Message we are testing.
    */
   bool ms_can_fast_dispatch(const cref_t<Message>& m) {
-    for (const auto &dispatcher : fast_dispatchers) {
-      if (dispatcher->ms_can_fast_dispatch2(m))
-	return true;
-    }
-    return false;
+    return get_fast_dispatcher(m) != nullptr;
   }
 
   /**
@@ -664,13 +706,11 @@ public:
    */
   void ms_fast_dispatch(const ref_t<Message> &m) {
     m->set_dispatch_stamp(ceph_clock_now());
-    for (const auto &dispatcher : fast_dispatchers) {
-      if (dispatcher->ms_can_fast_dispatch2(m)) {
-	dispatcher->ms_fast_dispatch2(m);
-	return;
-      }
+    Dispatcher *dispatcher = get_fast_dispatcher(m);
+    if (!dispatcher) {
+      ceph_abort();
     }
-    ceph_abort();
+    dispatcher->ms_fast_dispatch2(m);
   }
   void ms_fast_dispatch(Message *m) {
     return ms_fast_dispatch(ref_t<Message>(m, false)); /* consume ref */
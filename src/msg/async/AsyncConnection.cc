@@ -110,6 +110,16 @@ class C_tick_wakeup : public EventCallback {
   }
 };
 
+class C_handle_coalesce : public EventCallback {
+  AsyncConnectionRef conn;
+
+ public:
+  explicit C_handle_coalesce(AsyncConnectionRef c): conn(c) {}
+  void do_request(uint64_t id) override {
+    conn->handle_coalesce_flush(id);
+  }
+};
+
 
 AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, DispatchQueue *q,
                                  Worker *w, bool m2, bool local)
@@ -122,6 +132,10 @@ AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, DispatchQu
     last_active(ceph::coarse_mono_clock::now()),
     connect_timeout_us(cct->_conf->ms_connection_ready_timeout*1000*1000),
     inactive_timeout_us(cct->_conf->ms_connection_idle_timeout*1000*1000),
+    coalesce_latency_us(
+      cct->_conf.get_val<uint64_t>("ms_async_coalesce_latency_us")),
+    coalesce_max_bytes(
+      cct->_conf.get_val<Option::size_t>("ms_async_coalesce_max_bytes")),
     msgr2(m2), state_offset(0),
     worker(w), center(&w->center),read_buffer(nullptr)
 {
@@ -133,6 +147,7 @@ AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, DispatchQu
   write_callback_handler = new C_handle_write_callback(this);
   wakeup_handler = new C_time_wakeup(this);
   tick_handler = new C_tick_wakeup(this);
+  coalesce_handler = new C_handle_coalesce(this);
   // double recv_max_prefetch see "read_until"
   recv_buf = new char[2*recv_max_prefetch];
   if (local) {
@@ -219,6 +234,7 @@ ssize_t AsyncConnection::read_until(unsigned len, char *p)
   if (recv_end > recv_start) {
     uint64_t to_read = std::min<uint64_t>(recv_end - recv_start, left);
     memcpy(p, recv_buf+recv_start, to_read);
+    logger->inc(l_msgr_recv_copied_bytes, to_read);
     recv_start += to_read;
     left -= to_read;
     ldout(async_msgr->cct, 25) << __func__ << " got " << to_read << " in buffer "
@@ -233,14 +249,22 @@ ssize_t AsyncConnection::read_until(unsigned len, char *p)
   recv_end = recv_start = 0;
   /* nothing left in the prefetch buffer */
   if (left > (uint64_t)recv_max_prefetch) {
-    /* this was a large read, we don't prefetch for these */
+    /* this was a large read, it goes straight into the caller's buffer.
+     * whatever follows it (epilogue, next preamble) is scattered into the
+     * prefetch buffer by the same syscall */
     do {
-      r = read_bulk(p+state_offset, left);
+      struct iovec iov[2];
+      iov[0].iov_base = p + state_offset;
+      iov[0].iov_len = left;
+      iov[1].iov_base = recv_buf;
+      iov[1].iov_len = recv_max_prefetch;
+      r = read_bulk(iov, 2);
       ldout(async_msgr->cct, 25) << __func__ << " read_bulk left is " << left << " got " << r << dendl;
       if (r < 0) {
         ldout(async_msgr->cct, 1) << __func__ << " read failed" << dendl;
         return -1;
-      } else if (r == static_cast<int>(left)) {
+      } else if (r >= static_cast<int>(left)) {
+        recv_end = r - left;
         state_offset = 0;
         return 0;
       }
@@ -260,12 +284,14 @@ ssize_t AsyncConnection::read_until(unsigned len, char *p)
       if (r >= static_cast<int>(left)) {
         recv_start = len - state_offset;
         memcpy(p+state_offset, recv_buf, recv_start);
+        logger->inc(l_msgr_recv_copied_bytes, recv_start);
         state_offset = 0;
         return 0;
       }
       left -= r;
     } while (r > 0);
     memcpy(p+state_offset, recv_buf, recv_end-recv_start);
+    logger->inc(l_msgr_recv_copied_bytes, recv_end - recv_start);
     state_offset += (recv_end - recv_start);
     recv_end = recv_start = 0;
   }
@@ -277,10 +303,20 @@ ssize_t AsyncConnection::read_until(unsigned len, char *p)
 /* return -1 means `fd` occurs error or closed, it should be closed
  * return 0 means EAGAIN or EINTR */
 ssize_t AsyncConnection::read_bulk(char *buf, unsigned len)
+{
+  struct iovec iov;
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  return read_bulk(&iov, 1);
+}
+
+ssize_t AsyncConnection::read_bulk(const struct iovec *iov, int iovcnt)
 {
   ssize_t nread;
  again:
-  nread = cs.read(buf, len);
+  nread = iovcnt == 1 ? cs.read(static_cast<char*>(iov[0].iov_base),
+                                iov[0].iov_len)
+                      : cs.readv(iov, iovcnt);
   if (nread < 0) {
     if (nread == -EAGAIN) {
       nread = 0;
@@ -295,6 +331,9 @@ ssize_t AsyncConnection::read_bulk(char *buf, unsigned len)
     ldout(async_msgr->cct, 1) << __func__ << " peer close file descriptor "
                               << cs.fd() << dendl;
     return -1;
+  } else if (async_msgr->rebalance_enabled) {
+    traffic_bytes += nread;
+    traffic_worker.store(worker->id, std::memory_order_relaxed);
   }
   return nread;
 }
@@ -324,6 +363,7 @@ ssize_t AsyncConnection::_try_send(bool more)
   }
 
   ceph_assert(center->in_thread());
+  cs.zero_copy_reap();
   ldout(async_msgr->cct, 25) << __func__ << " cs.send " << outcoming_bl.length()
                              << " bytes" << dendl;
   ssize_t r = cs.send(outcoming_bl, more);
@@ -331,6 +371,10 @@ ssize_t AsyncConnection::_try_send(bool more)
     ldout(async_msgr->cct, 1) << __func__ << " send error: " << cpp_strerror(r) << dendl;
     return r;
   }
+  if (r > 0 && async_msgr->rebalance_enabled) {
+    traffic_bytes += r;
+    traffic_worker.store(worker->id, std::memory_order_relaxed);
+  }
 
   ldout(async_msgr->cct, 10) << __func__ << " sent bytes " << r
                              << " remaining bytes " << outcoming_bl.length() << dendl;
@@ -363,6 +407,11 @@ void AsyncConnection::inject_delay() {
 
 void AsyncConnection::process() {
   std::lock_guard<std::mutex> l(lock);
+  if (!center->in_thread()) {
+    // queued to our previous worker before migrate()
+    center->dispatch_event_external(read_handler);
+    return;
+  }
   last_active = ceph::coarse_mono_clock::now();
   recv_start_time = ceph::mono_clock::now();
 
@@ -447,6 +496,8 @@ void AsyncConnection::process() {
     }
 
     case STATE_CONNECTION_ESTABLISHED: {
+      // zero-copy send completions wake us through the error queue
+      cs.zero_copy_reap();
       if (pendingReadLen) {
         ssize_t r = read(*pendingReadLen, read_buffer, readCallback);
         if (r <= 0) { // read all bytes, or an error occured
@@ -696,6 +747,61 @@ void AsyncConnection::DelayedDelivery::flush() {
   }, true);
 }
 
+void AsyncConnection::migrate(Worker *from, Worker *to)
+{
+  // file and time events can only be touched from their own thread, so
+  // drop them in the old worker and recreate them in the new one
+  AsyncConnectionRef self(this);
+  from->center.submit_to(from->center.get_id(), [self, from, to]() {
+    self->_migrate_out(from, to);
+  }, true);
+}
+
+void AsyncConnection::_migrate_out(Worker *from, Worker *to)
+{
+  std::lock_guard<std::mutex> l(lock);
+  if (worker != from || state != STATE_CONNECTION_ESTABLISHED ||
+      !protocol->is_connected() || delay_state ||
+      !register_time_events.empty() || open_write || coalesce_timer_id) {
+    return;
+  }
+  ldout(async_msgr->cct, 5) << __func__ << " worker " << from->id
+                            << " -> " << to->id << dendl;
+  center->delete_file_event(cs.fd(), EVENT_READABLE | EVENT_WRITABLE);
+  bool had_tick = last_tick_id;
+  if (last_tick_id) {
+    center->delete_time_event(last_tick_id);
+    last_tick_id = 0;
+  }
+  {
+    // center only changes under both locks; events queued to the old
+    // worker in between bounce to the new one
+    std::lock_guard<std::mutex> wl(write_lock);
+    from->references--;
+    to->references++;
+    logger = to->get_perf_counter();
+    worker = to;
+    center = &to->center;
+  }
+  AsyncConnectionRef self(this);
+  to->center.submit_to(to->center.get_id(), [self, to, had_tick]() {
+    self->_migrate_in(to, had_tick);
+  }, true);
+}
+
+void AsyncConnection::_migrate_in(Worker *to, bool had_tick)
+{
+  std::lock_guard<std::mutex> l(lock);
+  if (worker != to || state != STATE_CONNECTION_ESTABLISHED) {
+    return;
+  }
+  center->create_file_event(cs.fd(), EVENT_READABLE, read_handler);
+  if (had_tick && !last_tick_id) {
+    last_tick_id = center->create_time_event(inactive_timeout_us,
+                                             tick_handler);
+  }
+}
+
 void AsyncConnection::send_keepalive()
 {
   protocol->send_keepalive();
@@ -711,11 +817,23 @@ void AsyncConnection::mark_down()
 void AsyncConnection::handle_write()
 {
   ldout(async_msgr->cct, 10) << __func__ << dendl;
+  {
+    std::lock_guard<std::mutex> l(write_lock);
+    if (!center->in_thread()) {
+      // queued to our previous worker before migrate()
+      center->dispatch_event_external(write_handler);
+      return;
+    }
+  }
   protocol->write_event();
 }
 
 void AsyncConnection::handle_write_callback() {
   std::lock_guard<std::mutex> l(lock);
+  if (!center->in_thread()) {
+    center->dispatch_event_external(write_callback_handler);
+    return;
+  }
   last_active = ceph::coarse_mono_clock::now();
   recv_start_time = ceph::mono_clock::now();
   write_lock.lock();
@@ -739,17 +857,38 @@ void AsyncConnection::stop(bool queue_reset) {
 
 void AsyncConnection::cleanup() {
   shutdown_socket();
+  {
+    std::lock_guard<std::mutex> l(write_lock);
+    if (coalesce_timer_id) {
+      center->delete_time_event(coalesce_timer_id);
+      coalesce_timer_id = 0;
+    }
+  }
   delete read_handler;
   delete write_handler;
   delete write_callback_handler;
   delete wakeup_handler;
   delete tick_handler;
+  delete coalesce_handler;
   if (delay_state) {
     delete delay_state;
     delay_state = NULL;
   }
 }
 
+void AsyncConnection::handle_coalesce_flush(uint64_t id)
+{
+  {
+    std::lock_guard<std::mutex> l(write_lock);
+    if (id != coalesce_timer_id) {
+      return;
+    }
+    coalesce_timer_id = 0;
+    coalesce_due = true;
+  }
+  protocol->write_event();
+}
+
 void AsyncConnection::wakeup_from(uint64_t id)
 {
   lock.lock();
@@ -56,6 +56,7 @@ class AsyncConnection : public Connection {
                std::function<void(char *, ssize_t)> callback);
   ssize_t read_until(unsigned needed, char *p);
   ssize_t read_bulk(char *buf, unsigned len);
+  ssize_t read_bulk(const struct iovec *iov, int iovcnt);
 
   ssize_t write(bufferlist &bl, std::function<void(ssize_t)> callback,
                 bool more=false);
@@ -69,6 +70,9 @@ class AsyncConnection : public Connection {
   bool is_queued() const;
   void shutdown_socket();
 
+  void _migrate_out(Worker *from, Worker *to);
+  void _migrate_in(Worker *to, bool had_tick);
+
    /**
    * The DelayedDelivery is for injecting delays into Message delivery off
    * the socket. It is only enabled if delays are requested, and if they
@@ -138,6 +142,20 @@ class AsyncConnection : public Connection {
 
   int get_con_mode() const override;
 
+  /**
+   * Move an established connection from one worker to another.
+   *
+   * Does nothing if the connection is no longer on \p from or is not
+   * in a steady state (handshaking, throttled, writes blocked).
+   */
+  void migrate(Worker *from, Worker *to);
+
+  // bytes moved since AsyncMessenger::rebalance_workers() last looked,
+  // and the id of the worker that moved them; only kept while
+  // AsyncMessenger::rebalance_enabled
+  std::atomic<uint64_t> traffic_bytes = {0};
+  std::atomic<unsigned> traffic_worker = {0};
+
  private:
   enum {
     STATE_NONE,
@@ -181,6 +199,7 @@ class AsyncConnection : public Connection {
   EventCallbackRef write_callback_handler;
   EventCallbackRef wakeup_handler;
   EventCallbackRef tick_handler;
+  EventCallbackRef coalesce_handler;
   char *recv_buf;
   uint32_t recv_max_prefetch;
   uint32_t recv_start;
@@ -192,6 +211,12 @@ class AsyncConnection : public Connection {
   uint64_t last_tick_id = 0;
   const uint64_t connect_timeout_us;
   const uint64_t inactive_timeout_us;
+  const uint64_t coalesce_latency_us;
+  const uint64_t coalesce_max_bytes;
+  // the protocol is holding back small messages until this timer fires;
+  // only touched from the center thread
+  uint64_t coalesce_timer_id = 0;
+  bool coalesce_due = false;
 
   // Tis section are temp variables used by state transition
 
@@ -221,6 +246,7 @@ class AsyncConnection : public Connection {
   void process();
   void wakeup_from(uint64_t id);
   void tick(uint64_t id);
+  void handle_coalesce_flush(uint64_t id);
   void local_deliver();
   void stop(bool queue_reset);
   void cleanup();
@@ -270,6 +270,16 @@ class C_handle_reap : public EventCallback {
   }
 };
 
+class C_handle_rebalance : public EventCallback {
+  AsyncMessenger *msgr;
+
+  public:
+  explicit C_handle_rebalance(AsyncMessenger *m): msgr(m) {}
+  void do_request(uint64_t id) override {
+    msgr->rebalance_workers();
+  }
+};
+
 /*******************
  * AsyncMessenger
  */
@@ -288,6 +298,8 @@ AsyncMessenger::AsyncMessenger(CephContext *cct, entity_name_t name,
     transport_type = "rdma";
   else if (type.find("dpdk") != std::string::npos)
     transport_type = "dpdk";
+  else if (type.find("shm") != std::string::npos)
+    transport_type = "shm";
 
   auto single = &cct->lookup_or_create_singleton_object<StackSingleton>(
     "AsyncMessenger::NetworkStack::" + transport_type, true, cct);
@@ -295,10 +307,15 @@ AsyncMessenger::AsyncMessenger(CephContext *cct, entity_name_t name,
   stack = single->stack.get();
   stack->start();
   local_worker = stack->get_worker();
+  rebalance_enabled =
+    cct->_conf.get_val<double>("ms_async_rebalance_interval") > 0 &&
+    stack->get_num_worker() > 1 &&
+    stack->support_connection_migration();
   local_connection = new AsyncConnection(cct, this, &dispatch_queue,
 					 local_worker, true, true);
   init_local_connection();
   reap_handler = new C_handle_reap(this);
+  rebalance_handler = new C_handle_rebalance(this);
   unsigned processor_num = 1;
   if (stack->support_local_listen_table())
     processor_num = stack->get_num_worker();
@@ -313,6 +330,7 @@ AsyncMessenger::AsyncMessenger(CephContext *cct, entity_name_t name,
 AsyncMessenger::~AsyncMessenger()
 {
   delete reap_handler;
+  delete rebalance_handler;
   ceph_assert(!did_bind); // either we didn't bind or we shut down the Processor
   local_connection->mark_down();
   for (auto &&p : processors)
@@ -336,6 +354,61 @@ void AsyncMessenger::ready()
   for (auto &&p : processors)
     p->start();
   dispatch_queue.start();
+  local_worker->center.submit_to(
+    local_worker->center.get_id(),
+    [this]() {
+      last_rebalance = ceph::mono_clock::now();
+      schedule_rebalance();
+    }, true);
+}
+
+void AsyncMessenger::schedule_rebalance()
+{
+  if (rebalance_enabled) {
+    auto interval = cct->_conf.get_val<double>("ms_async_rebalance_interval");
+    rebalance_timer_id = local_worker->center.create_time_event(
+      interval * 1000000, rebalance_handler);
+  }
+}
+
+void AsyncMessenger::rebalance_workers()
+{
+  rebalance_timer_id = 0;
+  auto now = ceph::mono_clock::now();
+  double elapsed = std::max(
+    std::chrono::duration<double>(now - last_rebalance).count(), 0.001);
+  last_rebalance = now;
+
+  Worker *from = nullptr, *to = nullptr;
+  uint64_t byte_rate_gap = 0;
+  bool imbalanced = stack->get_rebalance(&from, &to, &byte_rate_gap);
+
+  // pick the busiest connection on the hot worker that carries less
+  // than half of the traffic gap, so that the imbalance doesn't just
+  // move to the other worker
+  AsyncConnectionRef best;
+  uint64_t best_rate = 0;
+  {
+    Mutex::Locker l(lock);
+    for (auto& p : conns) {
+      auto& c = p.second;
+      uint64_t rate = c->traffic_bytes.exchange(0) / elapsed;
+      if (!imbalanced || c->traffic_worker.load() != from->id) {
+        continue;
+      }
+      if (rate > best_rate && rate <= byte_rate_gap / 2) {
+        best = c;
+        best_rate = rate;
+      }
+    }
+  }
+  if (best) {
+    ldout(cct, 5) << __func__ << " moving " << best << " (" << best_rate
+                  << " bytes/sec) from worker " << from->id << " to "
+                  << to->id << dendl;
+    best->migrate(from, to);
+  }
+  schedule_rebalance();
 }
 
 int AsyncMessenger::shutdown()
@@ -353,6 +426,14 @@ int AsyncMessenger::shutdown()
   stop_cond.Signal();
   stopped = true;
   lock.Unlock();
+  local_worker->center.submit_to(
+    local_worker->center.get_id(),
+    [this]() {
+      if (rebalance_timer_id) {
+        local_worker->center.delete_time_event(rebalance_timer_id);
+        rebalance_timer_id = 0;
+      }
+    });
   stack->drain();
   return 0;
 }
@@ -299,6 +299,12 @@ private:
 
   EventCallbackRef reap_handler;
 
+  EventCallbackRef rebalance_handler;
+  // only touched in local_worker's thread
+  uint64_t rebalance_timer_id = 0;
+  ceph::mono_time last_rebalance;
+  void schedule_rebalance();
+
   /// internal cluster protocol version, if any, for talking to entities of the same type.
   int cluster_protocol;
 
@@ -421,6 +427,19 @@ public:
    */
   int reap_dead();
 
+  /**
+   * Move one connection off the busiest worker if workers are unevenly
+   * loaded, see ms_async_rebalance_interval.  Runs in local_worker's
+   * thread.
+   */
+  void rebalance_workers();
+
+  /**
+   * Whether rebalance_workers() runs at all.  Connections only keep
+   * their traffic counts when it does.  Fixed at construction.
+   */
+  bool rebalance_enabled = false;
+
   /**
    * @} // AsyncMessenger Internals
    */
@@ -14,6 +14,9 @@
  *
  */
 
+#include <stdlib.h>
+#include <unistd.h>
+
 #include "include/compat.h"
 #include "common/errno.h"
 #include "Event.h"
@@ -138,6 +141,13 @@ int EventCenter::init(int n, unsigned i, const std::string &t)
   file_events.resize(n);
   nevent = n;
 
+  // dpdk polls anyway
+  if (t != "dpdk") {
+    busy_poll_max_us = cct->_conf.get_val<uint64_t>("ms_async_busy_poll_us");
+    busy_poll_us = busy_poll_max_us;
+    busy_poll_load_limit = cct->_conf.get_val<double>("ms_async_busy_poll_load_limit");
+  }
+
   if (!driver->need_wakeup())
     return 0;
 
@@ -361,7 +371,8 @@ int EventCenter::process_time_events()
   return processed;
 }
 
-int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *working_dur)
+int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *working_dur,
+                                wait_stats_t *wait)
 {
   struct timeval tv;
   int numevents;
@@ -398,8 +409,48 @@ int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *
 
   ldout(cct, 30) << __func__ << " wait second " << tv.tv_sec << " usec " << tv.tv_usec << dendl;
   vector<FiredFileEvent> fired_events;
-  numevents = driver->event_wait(fired_events, &tv);
+  wait_result_t result = WAIT_NONBLOCKING;
+  auto wait_start = ceph::mono_clock::now();
+  ceph::timespan spun = ceph::timespan::zero();
+  if (blocking && busy_poll_max_us)
+    check_cpu_pressure(now);
+  if (blocking && busy_poll_us && !busy_poll_paused && timeout_microseconds) {
+    // spin a little first; a request that shows up now is handled
+    // without paying for a wakeup
+    numevents = busy_poll(fired_events, std::min(busy_poll_us, timeout_microseconds));
+    spun = ceph::mono_clock::now() - wait_start;
+    if (numevents || external_num_events.load()) {
+      result = WAIT_SPIN_HIT;
+    } else {
+      auto spun_us = std::chrono::duration_cast<std::chrono::microseconds>(spun).count();
+      timeout_microseconds -= std::min<uint64_t>(spun_us, timeout_microseconds);
+      tv.tv_sec = timeout_microseconds / 1000000;
+      tv.tv_usec = timeout_microseconds % 1000000;
+      numevents = driver->event_wait(fired_events, &tv);
+    }
+  } else {
+    numevents = driver->event_wait(fired_events, &tv);
+  }
   auto working_start = ceph::mono_clock::now();
+  if (blocking && result != WAIT_SPIN_HIT)
+    result = numevents > 0 ? WAIT_BLOCK_HIT : WAIT_TIMEOUT;
+  if (busy_poll_max_us && blocking) {
+    // keep spinning while it catches events, or would have, and back
+    // off while it doesn't, so idle workers stop burning cpu
+    if (result == WAIT_SPIN_HIT) {
+      busy_poll_us = busy_poll_max_us;
+    } else if (result == WAIT_BLOCK_HIT &&
+               working_start - wait_start < std::chrono::microseconds(busy_poll_max_us)) {
+      busy_poll_us = std::min(busy_poll_max_us, std::max(busy_poll_us * 2, 1u));
+    } else {
+      busy_poll_us /= 2;
+    }
+  }
+  if (wait) {
+    wait->result = result;
+    wait->waited = working_start - wait_start;
+    wait->spun = spun;
+  }
   for (int j = 0; j < numevents; j++) {
     int rfired = 0;
     FileEvent *event;
@@ -453,6 +504,40 @@ int EventCenter::process_events(unsigned timeout_microseconds,  ceph::timespan *
   return numevents;
 }
 
+int EventCenter::busy_poll(vector<FiredFileEvent> &fired_events, unsigned us)
+{
+  struct timeval tv = {0, 0};
+  auto end = ceph::mono_clock::now() + std::chrono::microseconds(us);
+  int numevents = 0;
+  busy_polling = true;
+  do {
+    numevents = driver->event_wait(fired_events, &tv);
+  } while (!numevents && !external_num_events.load() &&
+           ceph::mono_clock::now() < end);
+  // pairs with dispatch_event_external(): either it sees us spinning, or
+  // we see its event here and don't go to sleep on it
+  busy_polling = false;
+  return numevents;
+}
+
+void EventCenter::check_cpu_pressure(clock_type::time_point now)
+{
+  if (now < busy_poll_next_check)
+    return;
+  busy_poll_next_check = now + std::chrono::seconds(1);
+
+  double load;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  bool paused = getloadavg(&load, 1) == 1 && cpus > 0 &&
+                load >= busy_poll_load_limit * cpus;
+  if (paused != busy_poll_paused) {
+    ldout(cct, 10) << __func__ << " load " << load << " on " << cpus
+                   << " cpus, busy polling " << (paused ? "paused" : "resumed")
+                   << dendl;
+    busy_poll_paused = paused;
+  }
+}
+
 void EventCenter::dispatch_event_external(EventCallbackRef e)
 {
   uint64_t num = 0;
@@ -464,7 +549,7 @@ void EventCenter::dispatch_event_external(EventCallbackRef e)
     external_events.push_back(e);
     num = ++external_num_events;
   }
-  if (num == 1 && !in_thread())
+  if (num == 1 && !in_thread() && !busy_polling.load())
     wakeup();
 
   ldout(cct, 30) << __func__ << " " << e << " pending " << num << dendl;
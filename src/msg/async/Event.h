@@ -175,7 +175,18 @@ class EventCenter {
   unsigned idx;
   AssociatedCenters *global_centers = nullptr;
 
+  // adaptive busy polling, see ms_async_busy_poll_us
+  unsigned busy_poll_max_us = 0;  ///< configured spin budget, 0 if off
+  unsigned busy_poll_us = 0;      ///< current spin window
+  double busy_poll_load_limit = 0;
+  bool busy_poll_paused = false;  ///< host is short on cpu, don't spin
+  clock_type::time_point busy_poll_next_check;
+  /// set while spinning; external events need no wakeup then
+  std::atomic<bool> busy_polling = {false};
+
   int process_time_events();
+  int busy_poll(vector<FiredFileEvent> &fired_events, unsigned us);
+  void check_cpu_pressure(clock_type::time_point now);
   FileEvent *_get_file_event(int fd) {
     ceph_assert(fd < nevent);
     return &file_events[fd];
@@ -191,6 +202,21 @@ class EventCenter {
   ~EventCenter();
   ostream& _event_prefix(std::ostream *_dout);
 
+  /// How process_events() got its events
+  enum wait_result_t {
+    WAIT_SPIN_HIT = 0,  ///< found them while busy polling
+    WAIT_BLOCK_HIT,     ///< woken up by them in the event driver
+    WAIT_TIMEOUT,       ///< none arrived before the timeout
+    WAIT_NONBLOCKING,   ///< pollers or pending events, did not wait
+  };
+  struct wait_stats_t {
+    wait_result_t result = WAIT_NONBLOCKING;
+    /// from starting to wait until events showed up or the timeout
+    ceph::timespan waited = ceph::timespan::zero();
+    /// the part of waited spent busy polling
+    ceph::timespan spun = ceph::timespan::zero();
+  };
+
   int init(int nevent, unsigned idx, const std::string &t);
   void set_owner();
   pthread_t get_owner() const { return owner; }
@@ -203,7 +229,8 @@ class EventCenter {
   uint64_t create_time_event(uint64_t milliseconds, EventCallbackRef ctxt);
   void delete_file_event(int fd, int mask);
   void delete_time_event(uint64_t id);
-  int process_events(unsigned timeout_microseconds, ceph::timespan *working_dur = nullptr);
+  int process_events(unsigned timeout_microseconds, ceph::timespan *working_dur = nullptr,
+                     wait_stats_t *wait = nullptr);
   void wakeup();
 
   // Used by external thread
@@ -21,6 +21,12 @@
 #include <errno.h>
 
 #include <algorithm>
+#include <deque>
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#define HAVE_MSG_ZEROCOPY
+#endif
 
 #include "PosixStack.h"
 
@@ -37,15 +43,72 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "PosixStack "
 
+// drop the buffers of the zero-copy sends on fd the kernel reports done
+static void zc_reap(int fd, zc_pending_t &pending, PerfCounters *logger)
+{
+#ifdef HAVE_MSG_ZEROCOPY
+  while (!pending.empty()) {
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err)) * 2];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+      // EAGAIN: nothing completed yet.  anything else is a socket
+      // error that the next read or send, or the linger deadline, deals
+      // with.
+      return;
+    }
+    for (auto cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+	  !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+	continue;
+      }
+      auto serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+      if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+	continue;
+      }
+      // ids [ee_info, ee_data] are done; usually a prefix of pending
+      uint32_t lo = serr->ee_info, hi = serr->ee_data;
+      uint64_t done = 0;
+      for (auto p = pending.begin(); p != pending.end(); ) {
+	if ((uint32_t)(p->first - lo) <= (uint32_t)(hi - lo)) {
+	  p = pending.erase(p);
+	  ++done;
+	} else {
+	  ++p;
+	}
+      }
+      // e.g. over loopback, the kernel had to copy after all
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+	logger->inc(l_msgr_send_zerocopy_copied, done);
+      }
+      logger->dec(l_msgr_send_zerocopy_pending, done);
+    }
+  }
+#endif
+}
+
 class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   NetHandler &handler;
+  PosixWorker *worker;
+  PerfCounters *logger;
   int _fd;
   entity_addr_t sa;
   bool connected;
 
+  // segments at least this long are sent with MSG_ZEROCOPY, 0 if disabled
+  uint64_t zc_min_size;
+  // id the kernel will give our next successful zero-copy sendmsg
+  uint32_t zc_next_id = 0;
+  // buffers pinned until the kernel reports the given send id complete
+  zc_pending_t zc_pending;
+
  public:
-  explicit PosixConnectedSocketImpl(NetHandler &h, const entity_addr_t &sa, int f, bool connected)
-      : handler(h), _fd(f), sa(sa), connected(connected) {}
+  explicit PosixConnectedSocketImpl(NetHandler &h, PosixWorker *w,
+				    const entity_addr_t &sa, int f, bool connected)
+      : handler(h), worker(w), logger(w->get_perf_counter()), _fd(f), sa(sa),
+	connected(connected), zc_min_size(h.set_zerocopy(f)) {}
 
   int is_connected() override {
     if (connected)
@@ -73,24 +136,47 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
     return r;
   }
 
+  ssize_t readv(const struct iovec *iov, int iovcnt) override {
+    ssize_t r = ::readv(_fd, iov, iovcnt);
+    if (r < 0)
+      r = -errno;
+    return r;
+  }
+
   // return the sent length
   // < 0 means error occurred
-  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more)
+  // if zc_calls is set, send with MSG_ZEROCOPY and count the calls that
+  // consumed a completion id
+  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more,
+			    unsigned *zc_calls = nullptr)
   {
     size_t sent = 0;
     while (1) {
       MSGR_SIGPIPE_STOPPER;
       ssize_t r;
-      r = ::sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+      int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+#ifdef HAVE_MSG_ZEROCOPY
+      if (zc_calls) {
+        flags |= MSG_ZEROCOPY;
+      }
+#endif
+      r = ::sendmsg(fd, &msg, flags);
       if (r < 0) {
         if (errno == EINTR) {
           continue;
         } else if (errno == EAGAIN) {
           break;
+        } else if (errno == ENOBUFS && zc_calls) {
+          // out of optmem for pinning pages, copy this one instead
+          zc_calls = nullptr;
+          continue;
         }
         return -errno;
       }
 
+      if (zc_calls && r > 0) {
+        ++*zc_calls;
+      }
       sent += r;
       if (len == sent) break;
 
@@ -118,21 +204,42 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
       struct msghdr msg;
       struct iovec msgvec[IOV_MAX];
       uint64_t size = std::min<uint64_t>(left_pbrs, IOV_MAX);
-      left_pbrs -= size;
+      // with zero-copy enabled, large and small segments go out in
+      // separate sendmsg calls so that only the large ones are pinned
+      bool zc = zc_min_size && pb->length() >= zc_min_size;
       memset(&msg, 0, sizeof(msg));
-      msg.msg_iovlen = size;
       msg.msg_iov = msgvec;
       unsigned msglen = 0;
-      for (auto iov = msgvec; iov != msgvec + size; iov++) {
+      auto iov = msgvec;
+      for (; iov != msgvec + size; iov++) {
+	if (zc_min_size && (pb->length() >= zc_min_size) != zc)
+	  break;
 	iov->iov_base = (void*)(pb->c_str());
 	iov->iov_len = pb->length();
 	msglen += pb->length();
 	++pb;
       }
-      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more);
+      size = iov - msgvec;
+      left_pbrs -= size;
+      msg.msg_iovlen = size;
+      unsigned zc_calls = 0;
+      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more,
+			     zc ? &zc_calls : nullptr);
       if (r < 0)
         return r;
 
+      if (zc_calls) {
+	// the kernel references these pages until it reports the sends
+	// complete, see zero_copy_reap()
+	bufferlist pinned;
+	pinned.substr_of(bl, sent_bytes, r);
+	for (unsigned i = 0; i < zc_calls; ++i) {
+	  zc_pending.emplace_back(zc_next_id++, pinned);
+	}
+	logger->inc(l_msgr_send_zerocopy, zc_calls);
+	logger->inc(l_msgr_send_zerocopy_pending, zc_calls);
+      }
+
       // "r" is the remaining length
       sent_bytes += r;
       if (static_cast<unsigned>(r) < msglen)
@@ -152,11 +259,30 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
 
     return static_cast<ssize_t>(sent_bytes);
   }
+  void zero_copy_reap() override {
+    zc_reap(_fd, zc_pending, logger);
+  }
   void shutdown() override {
     ::shutdown(_fd, SHUT_RDWR);
   }
   void close() override {
-    ::close(_fd);
+    zero_copy_reap();
+    if (zc_pending.empty()) {
+      ::close(_fd);
+      return;
+    }
+    // The kernel may still transmit from the pinned pages, and once the
+    // fd is closed it can no longer tell us when it is done.  Let the
+    // queued data go out followed by a FIN, and leave the fd and the
+    // buffers to the worker until the completions arrive.
+    ::shutdown(_fd, SHUT_WR);
+    auto w = worker;
+    w->center.submit_to(
+      w->center.get_id(),
+      [w, fd = _fd, pending = std::move(zc_pending)]() mutable {
+	w->zc_linger(fd, std::move(pending));
+      }, true);
+    zc_pending.clear();
   }
   int fd() const override {
     return _fd;
@@ -214,7 +340,7 @@ int PosixServerSocketImpl::accept(ConnectedSocket *sock, const SocketOptions &op
   out->set_sockaddr((sockaddr*)&ss);
   handler.set_priority(sd, opt.priority, out->get_family());
 
-  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(handler, *out, sd, true));
+  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(handler, static_cast<PosixWorker*>(w), *out, sd, true));
   *sock = ConnectedSocket(std::move(csi));
   return 0;
 }
@@ -283,10 +409,90 @@ int PosixWorker::connect(const entity_addr_t &addr, const SocketOptions &opts, C
 
   net.set_priority(sd, opts.priority, addr.get_family());
   *socket = ConnectedSocket(
-      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock)));
+      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, this, addr, sd, !opts.nonblock)));
   return 0;
 }
 
+class C_handle_zc_linger : public EventCallback {
+  PosixWorker *worker;
+
+ public:
+  explicit C_handle_zc_linger(PosixWorker *w): worker(w) {}
+  void do_request(uint64_t id) override {
+    worker->zc_linger_tick();
+  }
+};
+
+// completions usually arrive within a round trip
+static const uint64_t ZC_LINGER_POLL_US = 10000;
+
+PosixWorker::~PosixWorker()
+{
+  delete zc_linger_handler;
+}
+
+void PosixWorker::destroy()
+{
+  // the event loop has stopped, nothing will reap these any more
+  if (zc_linger_timer) {
+    center.delete_time_event(zc_linger_timer);
+    zc_linger_timer = 0;
+  }
+  for (auto &l : zc_lingering) {
+    net.set_reset_on_close(l.fd);
+    ::close(l.fd);
+    perf_logger->dec(l_msgr_send_zerocopy_pending, l.pending.size());
+  }
+  zc_lingering.clear();
+}
+
+void PosixWorker::zc_linger(int fd, zc_pending_t &&pending)
+{
+  ceph_assert(center.in_thread());
+  auto timeout =
+    cct->_conf.get_val<std::chrono::seconds>("ms_tcp_zerocopy_linger_timeout");
+  ldout(cct, 10) << __func__ << " fd " << fd << " with " << pending.size()
+		 << " zero-copy sends pending" << dendl;
+  zc_lingering.push_back(
+    zc_lingering_t{fd, std::move(pending), ceph::coarse_mono_clock::now() + timeout});
+  if (!zc_linger_handler) {
+    zc_linger_handler = new C_handle_zc_linger(this);
+  }
+  if (!zc_linger_timer) {
+    zc_linger_timer = center.create_time_event(ZC_LINGER_POLL_US,
+					       zc_linger_handler);
+  }
+}
+
+void PosixWorker::zc_linger_tick()
+{
+  zc_linger_timer = 0;
+  auto now = ceph::coarse_mono_clock::now();
+  for (auto l = zc_lingering.begin(); l != zc_lingering.end(); ) {
+    zc_reap(l->fd, l->pending, perf_logger);
+    if (!l->pending.empty()) {
+      if (now < l->deadline) {
+	++l;
+	continue;
+      }
+      // The peer stopped acking.  Reset the connection: close() then
+      // frees the unsent and unacked data before it returns, so nothing
+      // reads these buffers after we let them go.
+      ldout(cct, 1) << __func__ << " fd " << l->fd << " still has "
+		    << l->pending.size() << " zero-copy sends pending, resetting"
+		    << dendl;
+      net.set_reset_on_close(l->fd);
+      perf_logger->dec(l_msgr_send_zerocopy_pending, l->pending.size());
+    }
+    ::close(l->fd);
+    l = zc_lingering.erase(l);
+  }
+  if (!zc_lingering.empty()) {
+    zc_linger_timer = center.create_time_event(ZC_LINGER_POLL_US,
+					       zc_linger_handler);
+  }
+}
+
 PosixNetworkStack::PosixNetworkStack(CephContext *c, const string &t)
     : NetworkStack(c, t)
 {
@@ -17,24 +17,48 @@
 #ifndef CEPH_MSG_ASYNC_POSIXSTACK_H
 #define CEPH_MSG_ASYNC_POSIXSTACK_H
 
+#include <deque>
+#include <list>
 #include <thread>
 
+#include "common/ceph_time.h"
 #include "msg/msg_types.h"
 #include "msg/async/net_handler.h"
 
 #include "Stack.h"
 
+// MSG_ZEROCOPY send ids and the buffers pinned until each completes
+typedef std::deque<std::pair<uint32_t, bufferlist>> zc_pending_t;
+
 class PosixWorker : public Worker {
   NetHandler net;
+
+  // sockets closed while zero-copy sends were still pending; the fd is
+  // kept open until the kernel reports them complete or the deadline
+  struct zc_lingering_t {
+    int fd;
+    zc_pending_t pending;
+    ceph::coarse_mono_time deadline;
+  };
+  std::list<zc_lingering_t> zc_lingering;
+  EventCallbackRef zc_linger_handler = nullptr;
+  uint64_t zc_linger_timer = 0;
+
   void initialize() override;
  public:
   PosixWorker(CephContext *c, unsigned i)
       : Worker(c, i), net(c) {}
+  ~PosixWorker() override;
   int listen(entity_addr_t &sa,
 	     unsigned addr_slot,
 	     const SocketOptions &opt,
 	     ServerSocket *socks) override;
   int connect(const entity_addr_t &addr, const SocketOptions &opts, ConnectedSocket *socket) override;
+  void destroy() override;
+
+  // take over a closed socket's fd and its pending zero-copy sends
+  void zc_linger(int fd, zc_pending_t &&pending);
+  void zc_linger_tick();
 };
 
 class PosixNetworkStack : public NetworkStack {
@@ -43,6 +67,10 @@ class PosixNetworkStack : public NetworkStack {
  public:
   explicit PosixNetworkStack(CephContext *c, const string &t);
 
+  // also covers shm: its sockets only expose a private epoll fd, and
+  // the rings are not tied to any worker
+  bool support_connection_migration() const override { return true; }
+
   void spawn_worker(unsigned i, std::function<void ()> &&func) override {
     threads.resize(i+1);
     threads[i] = std::thread(func);
@@ -1047,6 +1047,7 @@ CtPtr ProtocolV1::handle_message_footer(char *buffer, int r) {
                              connection->recv_start_time - fast_dispatch_time);
     connection->lock.lock();
   } else {
+    connection->logger->inc(l_msgr_recv_queued_messages);
     connection->dispatch_queue->enqueue(message, message->get_priority(),
                                         connection->conn_id);
   }
@@ -419,6 +419,14 @@ void ProtocolV2::send_message(Message *m) {
                   << " type=" << m->get_type() << " " << *m << dendl;
     m->queue_start = ceph::mono_clock::now();
     m->trace.event("async enqueueing message");
+    if (connection->coalesce_latency_us) {
+      const uint64_t gap = std::min<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+          m->queue_start - last_enqueue).count(),
+        1000000);
+      enqueue_gap_us = (enqueue_gap_us * 7 + gap) / 8;
+      last_enqueue = m->queue_start;
+    }
     out_queue[m->get_priority()].emplace_back(
       out_queue_entry_t{is_prepared, m});
     ldout(cct, 15) << __func__ << " inline write is denied, reschedule m=" << m
@@ -519,6 +527,13 @@ ssize_t ProtocolV2::write_message(Message *m, bool more) {
                  << " off=" << header2.data_off
                  << dendl;
   ssize_t total_send_size = connection->outcoming_bl.length();
+  if (more && static_cast<uint64_t>(total_send_size) <
+      connection->coalesce_max_bytes) {
+    // the next frame is right behind, let it go out in the same call
+    connection->logger->inc(l_msgr_send_coalesced_messages);
+    m->put();
+    return 0;
+  }
   ssize_t rc = connection->_try_send(more);
   if (rc < 0) {
     ldout(cct, 1) << __func__ << " error sending " << m << ", "
@@ -541,6 +556,57 @@ ssize_t ProtocolV2::write_message(Message *m, bool more) {
   return rc;
 }
 
+/*
+ * Hold back a burst of small messages for a moment so they leave in one
+ * send call. Only done while messages keep coming much faster than
+ * ms_async_coalesce_latency_us, and never for longer than that.
+ * Must hold write_lock.
+ */
+bool ProtocolV2::maybe_coalesce_writes() {
+  if (connection->coalesce_due) {
+    connection->coalesce_due = false;
+    return false;
+  }
+  if (connection->coalesce_timer_id) {
+    // woken up by something else (keepalive, socket became writable),
+    // the held back messages go out right away
+    connection->center->delete_time_event(connection->coalesce_timer_id);
+    connection->coalesce_timer_id = 0;
+    return false;
+  }
+
+  const uint64_t budget = connection->coalesce_latency_us;
+  if (!budget || keepalive || out_queue.empty() || connection->is_queued() ||
+      enqueue_gap_us * 2 > budget) {
+    return false;
+  }
+  uint64_t bytes = 0;
+  ceph::mono_time oldest = ceph::mono_clock::now();
+  for (auto& [ prio, entries ] : out_queue) {
+    static_cast<void>(prio);
+    for (auto& entry : entries) {
+      bytes += entry.m->get_payload().length() +
+	       entry.m->get_middle().length() + entry.m->get_data().length();
+      oldest = std::min(oldest, entry.m->queue_start);
+    }
+  }
+  if (bytes >= connection->coalesce_max_bytes) {
+    return false;
+  }
+  const uint64_t window = std::min(budget, enqueue_gap_us * 2);
+  const uint64_t waited =
+    std::chrono::duration_cast<std::chrono::microseconds>(
+      ceph::mono_clock::now() - oldest).count();
+  if (waited >= window) {
+    return false;
+  }
+  ldout(cct, 20) << __func__ << " holding " << bytes << " bytes for "
+		 << window - waited << "us" << dendl;
+  connection->coalesce_timer_id = connection->center->create_time_event(
+    window - waited, connection->coalesce_handler);
+  return true;
+}
+
 void ProtocolV2::append_keepalive() {
   ldout(cct, 10) << __func__ << dendl;
   auto keepalive_frame = KeepAliveFrame::Encode();
@@ -586,6 +652,11 @@ void ProtocolV2::write_event() {
 
   connection->write_lock.lock();
   if (can_write) {
+    if (maybe_coalesce_writes()) {
+      connection->write_lock.unlock();
+      return;
+    }
+
     if (keepalive) {
       append_keepalive();
       keepalive = false;
@@ -1186,9 +1257,11 @@ CtPtr ProtocolV2::handle_read_frame_segment(rx_buffer_t &&rx_buffer, int r) {
 
     auto& new_seg = rx_segments_data.back();
     if (new_seg.length()) {
-      auto padded = session_stream_handlers.rx->authenticated_decrypt_update(
-          std::move(new_seg), segment_t::DEFAULT_ALIGNMENT);
+      // keep the sender's alignment (page aligned for message data) so
+      // the plaintext can go to O_DIRECT without being realigned
       const auto idx = rx_segments_data.size() - 1;
+      auto padded = session_stream_handlers.rx->authenticated_decrypt_update(
+          std::move(new_seg), rx_segments_desc[idx].alignment);
       new_seg.clear();
       padded.splice(0, rx_segments_desc[idx].length, &new_seg);
 
@@ -1530,6 +1603,7 @@ CtPtr ProtocolV2::handle_message() {
       return nullptr;
     }
   } else {
+    connection->logger->inc(l_msgr_recv_queued_messages);
     connection->dispatch_queue->enqueue(message, message->get_priority(),
                                         connection->conn_id);
   }
@@ -114,6 +114,9 @@ private:
 
   bool keepalive;
   bool write_in_progress = false;
+  // average gap between queued messages, drives write coalescing
+  ceph::mono_time last_enqueue;
+  uint64_t enqueue_gap_us = 1000000;
 
   ostream &_conn_prefix(std::ostream *_dout);
   void run_continuation(Ct<ProtocolV2> *pcontinuation);
@@ -139,6 +142,7 @@ private:
   void prepare_send_message(uint64_t features, Message *m);
   out_queue_entry_t _get_next_outgoing();
   ssize_t write_message(Message *m, bool more);
+  bool maybe_coalesce_writes();
   void append_keepalive();
   void append_keepalive_ack(utime_t &timestamp);
   void handle_message_ack(uint64_t seq);
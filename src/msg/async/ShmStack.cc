@@ -0,0 +1,794 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+
+#include "ShmStack.h"
+
+#include "include/buffer.h"
+#include "include/intarith.h"
+#include "common/ceph_time.h"
+#include "common/errno.h"
+#include "common/dout.h"
+#include "include/compat.h"
+#include "include/sock_compat.h"
+
+#define dout_subsys ceph_subsys_ms
+#undef dout_prefix
+#define dout_prefix *_dout << "ShmStack "
+
+namespace {
+
+constexpr uint32_t SHM_MAGIC = 0x63736d31;
+constexpr uint64_t SHM_MIN_RING = 4096;
+constexpr uint64_t SHM_MAX_RING = 1ull << 30;
+// each ring header gets its own slot ahead of the data areas
+constexpr size_t SHM_HEADER_SIZE = 256;
+// how long a connected client may take to send its hello
+constexpr auto SHM_HELLO_TIMEOUT = std::chrono::seconds(5);
+// connected clients whose hello we are still waiting for
+constexpr size_t SHM_MAX_PENDING_HELLOS = 128;
+
+/*
+ * One direction of a connection. head and tail are free running byte
+ * counts; only the reader moves head and only the writer moves tail.
+ * Both live in memory the peer can scribble on, so every value read
+ * back is checked before it is used.
+ */
+struct ShmRing {
+  alignas(64) std::atomic<uint64_t> head;
+  alignas(64) std::atomic<uint64_t> tail;
+  /// set by a writer that found the ring full; the reader then rings
+  /// the writer's doorbell after consuming
+  alignas(64) std::atomic<uint32_t> writer_waiting;
+  /// only used in ring 0: the ring size the server settled on, at most
+  /// the one the client allocated. 0 until the server accepted the
+  /// client; nobody moves data before that
+  alignas(64) std::atomic<uint64_t> size;
+};
+static_assert(sizeof(ShmRing) <= SHM_HEADER_SIZE, "ring header too large");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+	      "shared rings need lock free 64 bit atomics");
+
+/// sent by the client together with the memfd and both eventfds
+struct shm_hello_t {
+  uint32_t magic;
+  uint32_t pad;
+  /// size of each ring in the memfd; the server may use less of it
+  uint64_t ring_size;
+  /// the address the client dialed; the server reports it as the peer
+  /// address, which is what it would have seen as source over TCP
+  sockaddr_storage peer_addr;
+};
+
+enum {
+  SHM_FD_MAP,
+  SHM_FD_CLIENT_EFD,  // rung to wake the client
+  SHM_FD_SERVER_EFD,  // rung to wake the server
+  SHM_NUM_FDS
+};
+
+size_t shm_map_len(uint64_t ring_size)
+{
+  return 2 * (SHM_HEADER_SIZE + ring_size);
+}
+
+uint64_t shm_ring_size(CephContext *cct)
+{
+  uint64_t v = cct->_conf.get_val<Option::size_t>("ms_async_shm_ring_size");
+  if (!v)
+    return 0;
+  v = std::clamp(v, SHM_MIN_RING, SHM_MAX_RING);
+  return 1ull << cbits(v - 1);
+}
+
+// The abstract namespace has no permissions, so anybody on the host
+// could bind our name first, or connect to it.  Both ends only talk to
+// a peer running with the same effective uid.
+int check_peer_cred(int sd)
+{
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if (::getsockopt(sd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+    return -errno;
+  if (cred.uid != ::geteuid())
+    return -EPERM;
+  return 0;
+}
+
+// abstract namespace, so nothing is left behind when the listener dies
+socklen_t shm_socket_name(const entity_addr_t &addr, bool any, sockaddr_un *un)
+{
+  std::string name = "ceph-msgr-shm/";
+  name += any ? std::string("any") : addr.ip_only_to_str();
+  name += ":" + std::to_string(addr.get_port());
+  memset(un, 0, sizeof(*un));
+  un->sun_family = AF_UNIX;
+  size_t len = std::min(name.size(), sizeof(un->sun_path) - 1);
+  memcpy(un->sun_path + 1, name.data(), len);
+  return offsetof(sockaddr_un, sun_path) + 1 + len;
+}
+
+bool is_local_ip(const entity_addr_t &addr)
+{
+  if (addr.get_family() == AF_INET) {
+    if ((ntohl(addr.in4_addr().sin_addr.s_addr) >> 24) == 127)
+      return true;
+  } else if (addr.get_family() == AF_INET6) {
+    if (IN6_IS_ADDR_LOOPBACK(&addr.in6_addr().sin6_addr))
+      return true;
+  } else {
+    return false;
+  }
+
+  struct ifaddrs *ifa;
+  if (getifaddrs(&ifa) < 0)
+    return false;
+  bool found = false;
+  for (auto p = ifa; p && !found; p = p->ifa_next) {
+    if (!p->ifa_addr || p->ifa_addr->sa_family != addr.get_family())
+      continue;
+    if (addr.get_family() == AF_INET) {
+      auto sin = reinterpret_cast<const sockaddr_in*>(p->ifa_addr);
+      found = sin->sin_addr.s_addr == addr.in4_addr().sin_addr.s_addr;
+    } else {
+      auto sin6 = reinterpret_cast<const sockaddr_in6*>(p->ifa_addr);
+      found = IN6_ARE_ADDR_EQUAL(&sin6->sin6_addr,
+				 &addr.in6_addr().sin6_addr);
+    }
+  }
+  freeifaddrs(ifa);
+  return found;
+}
+
+} // anonymous namespace
+
+class ShmConnectedSocketImpl final : public ConnectedSocketImpl {
+  CephContext *cct;
+  int sd;      ///< unix socket, only used to notice the peer going away
+  int rx_efd;  ///< our doorbell
+  int tx_efd;  ///< the peer's doorbell
+  int ep_fd = -1;
+  void *map;
+  size_t map_len;
+  /// ring size the memfd was laid out for
+  const uint64_t map_ring_size;
+  /// ring size in use; 0 on the client until the server accepted it
+  uint64_t ring_size;
+  ShmRing *rx, *tx;
+  ShmRing *control;  ///< ring 0, which holds the agreed size
+  char *rx_data, *tx_data;
+  bool is_shutdown = false;
+  // bytes accepted by send() that did not fit in the ring yet
+  bufferlist pending;
+
+  // 1 once the ring size is agreed on, 0 while the server hasn't
+  // accepted us yet
+  int ring_ready() {
+    if (ring_size)
+      return 1;
+    uint64_t v = control->size.load(std::memory_order_acquire);
+    if (!v)
+      return 0;
+    if (v < SHM_MIN_RING || v > map_ring_size || (v & (v - 1))) {
+      lderr(cct) << __func__ << " peer picked a bad ring size " << v << dendl;
+      return -EIO;
+    }
+    ring_size = v;
+    return 1;
+  }
+
+  int flush() {
+    int r = ring_ready();
+    if (r <= 0)
+      return r;
+    bool wrote = false;
+    while (pending.length()) {
+      uint64_t tail = tx->tail.load(std::memory_order_relaxed);
+      uint64_t used = tail - tx->head.load();
+      if (used > ring_size) {
+	lderr(cct) << __func__ << " peer corrupted the ring (used " << used
+		   << ")" << dendl;
+	return -EIO;
+      }
+      if (used == ring_size) {
+	tx->writer_waiting.store(1);
+	// the reader may have drained the ring before it could see the flag
+	if (tail - tx->head.load() < ring_size)
+	  continue;
+	break;
+      }
+      uint64_t n = std::min<uint64_t>(ring_size - used, pending.length());
+      uint64_t off = tail & (ring_size - 1);
+      uint64_t first = std::min(n, ring_size - off);
+      auto p = pending.cbegin();
+      p.copy(first, tx_data + off);
+      p.copy(n - first, tx_data);
+      tx->tail.store(tail + n, std::memory_order_release);
+      pending.splice(0, n);
+      wrote = true;
+    }
+    if (wrote)
+      ::eventfd_write(tx_efd, 1);
+    return 0;
+  }
+
+  // 0 if the peer closed its end, -EAGAIN while it is still there
+  int peer_state() {
+    char c;
+    ssize_t r = ::recv(sd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (r == 0)
+      return 0;
+    if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+      return -errno;
+    return -EAGAIN;
+  }
+
+ public:
+  // ring_size is 0 on the client, which learns it from the server
+  ShmConnectedSocketImpl(CephContext *cct, int sd, int rx_efd, int tx_efd,
+			 void *map, uint64_t map_ring_size, uint64_t ring_size,
+			 bool server)
+    : cct(cct), sd(sd), rx_efd(rx_efd), tx_efd(tx_efd),
+      map(map), map_len(shm_map_len(map_ring_size)),
+      map_ring_size(map_ring_size), ring_size(ring_size) {
+    auto base = static_cast<char*>(map);
+    // ring 0 carries client to server, ring 1 server to client
+    auto r0 = reinterpret_cast<ShmRing*>(base);
+    auto r1 = reinterpret_cast<ShmRing*>(base + SHM_HEADER_SIZE);
+    char *d0 = base + 2 * SHM_HEADER_SIZE;
+    char *d1 = d0 + map_ring_size;
+    control = r0;
+    rx = server ? r0 : r1;
+    rx_data = server ? d0 : d1;
+    tx = server ? r1 : r0;
+    tx_data = server ? d1 : d0;
+  }
+  ~ShmConnectedSocketImpl() override {
+    close();
+  }
+
+  // the event center watches a single fd, so put both wakeup sources
+  // behind one
+  int init() {
+    ep_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (ep_fd < 0)
+      return -errno;
+    struct epoll_event ee;
+    memset(&ee, 0, sizeof(ee));
+    ee.events = EPOLLIN;
+    if (::epoll_ctl(ep_fd, EPOLL_CTL_ADD, rx_efd, &ee) < 0)
+      return -errno;
+    ee.events = EPOLLIN | EPOLLRDHUP;
+    if (::epoll_ctl(ep_fd, EPOLL_CTL_ADD, sd, &ee) < 0)
+      return -errno;
+    return 0;
+  }
+
+  // server side: let the client start, using ring_size bytes of each ring
+  void accept_rings() {
+    control->size.store(ring_size, std::memory_order_release);
+    ::eventfd_write(tx_efd, 1);
+  }
+
+  int is_connected() override {
+    return 1;
+  }
+
+  ssize_t read(char *buf, size_t len) override {
+    struct iovec iov = { buf, len };
+    return readv(&iov, 1);
+  }
+
+  ssize_t readv(const struct iovec *iov, int iovcnt) override {
+    if (is_shutdown)
+      return 0;
+    eventfd_t v;
+    ::eventfd_read(rx_efd, &v);
+    // the doorbell also tells us the peer made room in our tx ring
+    int r = flush();
+    if (r < 0)
+      return r;
+    r = ring_ready();
+    if (r < 0)
+      return r;
+    if (r == 0)
+      return peer_state();
+
+    uint64_t head = rx->head.load(std::memory_order_relaxed);
+    uint64_t avail = rx->tail.load(std::memory_order_acquire) - head;
+    if (!avail) {
+      // check for EOF before looking again, so bytes written just ahead
+      // of a close are not lost
+      r = peer_state();
+      avail = rx->tail.load(std::memory_order_acquire) - head;
+      if (!avail)
+	return r;
+    }
+    if (avail > ring_size) {
+      lderr(cct) << __func__ << " peer corrupted the ring (avail " << avail
+		 << ")" << dendl;
+      return -EIO;
+    }
+
+    size_t copied = 0;
+    for (int i = 0; i < iovcnt && avail; ++i) {
+      uint64_t n = std::min<uint64_t>(iov[i].iov_len, avail);
+      uint64_t off = head & (ring_size - 1);
+      uint64_t first = std::min(n, ring_size - off);
+      char *dst = static_cast<char*>(iov[i].iov_base);
+      memcpy(dst, rx_data + off, first);
+      memcpy(dst + first, rx_data, n - first);
+      head += n;
+      avail -= n;
+      copied += n;
+      if (n < iov[i].iov_len)
+	break;
+    }
+    rx->head.store(head);
+    if (rx->writer_waiting.load()) {
+      rx->writer_waiting.store(0);
+      ::eventfd_write(tx_efd, 1);
+    }
+    return copied;
+  }
+
+  ssize_t zero_copy_read(bufferptr&) override {
+    return -EOPNOTSUPP;
+  }
+
+  // like the rdma stack, take everything and keep what the ring cannot
+  // hold yet; it is pushed out whenever the peer rings our doorbell
+  ssize_t send(bufferlist &bl, bool more) override {
+    if (is_shutdown)
+      return -EPIPE;
+    size_t bytes = bl.length();
+    pending.claim_append(bl);
+    int r = flush();
+    if (r < 0)
+      return r;
+    return bytes;
+  }
+
+  void zero_copy_reap() override {
+    if (!is_shutdown)
+      flush();
+  }
+
+  void shutdown() override {
+    is_shutdown = true;
+    if (sd >= 0)
+      ::shutdown(sd, SHUT_RDWR);
+  }
+
+  void close() override {
+    for (int *fd : { &ep_fd, &rx_efd, &tx_efd, &sd }) {
+      if (*fd >= 0) {
+	::close(*fd);
+	*fd = -1;
+      }
+    }
+    if (map) {
+      ::munmap(map, map_len);
+      map = nullptr;
+    }
+    pending.clear();
+  }
+
+  int fd() const override {
+    return ep_fd;
+  }
+  int socket_fd() const override {
+    return sd;
+  }
+};
+
+class ShmServerSocketImpl : public ServerSocketImpl {
+  CephContext *cct;
+  ServerSocket tcp;
+  int unix_sd;
+  int ep_fd;
+  const uint64_t ring_size;
+  /// accepted unix sockets waiting for their hello, and since when.
+  /// They sit in ep_fd too, so a hello arriving wakes accept() up
+  /// rather than accept() waiting for it.
+  std::map<int, ceph::mono_time> pending_hellos;
+
+  void accept_unix();
+  void drop_pending(int sd);
+  int recv_hello(int sd, shm_hello_t *hello, int *fds);
+  int accept_shm(int sd, ConnectedSocket *sock, entity_addr_t *out);
+
+ public:
+  ShmServerSocketImpl(CephContext *cct, ServerSocket &&tcp, int unix_sd,
+		      int ep_fd, uint64_t ring_size,
+		      const entity_addr_t& listen_addr, unsigned slot)
+    : ServerSocketImpl(listen_addr.get_type(), slot),
+      cct(cct), tcp(std::move(tcp)), unix_sd(unix_sd), ep_fd(ep_fd),
+      ring_size(ring_size) {}
+  int accept(ConnectedSocket *sock, const SocketOptions &opts,
+	     entity_addr_t *out, Worker *w) override;
+  void abort_accept() override {
+    if (tcp)
+      tcp.abort_accept();
+    for (auto& p : pending_hellos)
+      ::close(p.first);
+    pending_hellos.clear();
+    for (int *fd : { &ep_fd, &unix_sd }) {
+      if (*fd >= 0) {
+	::close(*fd);
+	*fd = -1;
+      }
+    }
+  }
+  int fd() const override {
+    return ep_fd;
+  }
+};
+
+void ShmServerSocketImpl::drop_pending(int sd)
+{
+  ::epoll_ctl(ep_fd, EPOLL_CTL_DEL, sd, nullptr);
+  ::close(sd);
+  pending_hellos.erase(sd);
+}
+
+// take every client waiting on the unix listener; their hellos are
+// read once they arrive
+void ShmServerSocketImpl::accept_unix()
+{
+  auto now = ceph::mono_clock::now();
+  for (auto p = pending_hellos.begin(); p != pending_hellos.end(); ) {
+    auto [sd, since] = *p++;
+    if (now - since > SHM_HELLO_TIMEOUT) {
+      ldout(cct, 1) << __func__ << " client sent no hello, dropping" << dendl;
+      drop_pending(sd);
+    }
+  }
+
+  while (true) {
+    int sd = accept_cloexec(unix_sd, nullptr, nullptr);
+    if (sd < 0)
+      return;
+    int r = check_peer_cred(sd);
+    if (r < 0) {
+      ldout(cct, 1) << __func__ << " rejecting client: " << cpp_strerror(r)
+		    << dendl;
+      ::close(sd);
+      continue;
+    }
+    if (pending_hellos.size() >= SHM_MAX_PENDING_HELLOS) {
+      ldout(cct, 1) << __func__ << " too many clients without a hello"
+		    << dendl;
+      ::close(sd);
+      continue;
+    }
+    struct epoll_event ee;
+    memset(&ee, 0, sizeof(ee));
+    ee.events = EPOLLIN;
+    ee.data.fd = sd;
+    if (::fcntl(sd, F_SETFL, ::fcntl(sd, F_GETFL) | O_NONBLOCK) < 0 ||
+	::epoll_ctl(ep_fd, EPOLL_CTL_ADD, sd, &ee) < 0) {
+      r = -errno;
+      ldout(cct, 1) << __func__ << " unable to wait for hello: "
+		    << cpp_strerror(r) << dendl;
+      ::close(sd);
+      continue;
+    }
+    pending_hellos[sd] = now;
+  }
+}
+
+int ShmServerSocketImpl::recv_hello(int sd, shm_hello_t *hello, int *fds)
+{
+  struct iovec iov = { hello, sizeof(*hello) };
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * SHM_NUM_FDS)];
+    struct cmsghdr align;
+  } cmsgbuf;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cmsgbuf.buf;
+  msg.msg_controllen = sizeof(cmsgbuf.buf);
+
+  ssize_t r = ::recvmsg(sd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+  if (r < 0)
+    return -errno;
+
+  int nfds = 0;
+  for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * std::min(nfds, (int)SHM_NUM_FDS));
+    break;
+  }
+  if (nfds != SHM_NUM_FDS || (msg.msg_flags & MSG_CTRUNC) ||
+      r != sizeof(*hello)) {
+    for (int i = 0; i < std::min(nfds, (int)SHM_NUM_FDS); ++i)
+      ::close(fds[i]);
+    return -EINVAL;
+  }
+  return 0;
+}
+
+int ShmServerSocketImpl::accept_shm(int sd, ConnectedSocket *sock,
+				    entity_addr_t *out)
+{
+  shm_hello_t hello;
+  int fds[SHM_NUM_FDS];
+  int r = recv_hello(sd, &hello, fds);
+  if (r == -EAGAIN || r == -EWOULDBLOCK)
+    return r;
+  // it either becomes a connection or goes away
+  ::epoll_ctl(ep_fd, EPOLL_CTL_DEL, sd, nullptr);
+  pending_hellos.erase(sd);
+  if (r < 0) {
+    ldout(cct, 1) << __func__ << " no usable hello: " << cpp_strerror(r)
+		  << dendl;
+    ::close(sd);
+    return -ECONNABORTED;
+  }
+
+  void *map = MAP_FAILED;
+  size_t map_len = shm_map_len(hello.ring_size);
+  struct stat st;
+  // without F_SEAL_SHRINK the client could truncate the file under us
+  // and turn our ring accesses into SIGBUS
+  int seals = ::fcntl(fds[SHM_FD_MAP], F_GET_SEALS);
+  bool valid = hello.magic == SHM_MAGIC &&
+    hello.ring_size >= SHM_MIN_RING && hello.ring_size <= SHM_MAX_RING &&
+    (hello.ring_size & (hello.ring_size - 1)) == 0 &&
+    (hello.peer_addr.ss_family == AF_INET ||
+     hello.peer_addr.ss_family == AF_INET6) &&
+    seals >= 0 && (seals & F_SEAL_SHRINK) &&
+    ::fstat(fds[SHM_FD_MAP], &st) == 0 && (size_t)st.st_size >= map_len;
+  if (valid)
+    map = ::mmap(nullptr, map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		 fds[SHM_FD_MAP], 0);
+  ::close(fds[SHM_FD_MAP]);
+  if (map == MAP_FAILED) {
+    ldout(cct, 1) << __func__ << " rejecting client with "
+		  << (valid ? "unmappable" : "invalid") << " rings" << dendl;
+    ::close(fds[SHM_FD_CLIENT_EFD]);
+    ::close(fds[SHM_FD_SERVER_EFD]);
+    ::close(sd);
+    return -ECONNABORTED;
+  }
+
+  // the client sized the memfd, but we don't use more of it than we
+  // would have allocated ourselves
+  auto csi = std::make_unique<ShmConnectedSocketImpl>(
+    cct, sd, fds[SHM_FD_SERVER_EFD], fds[SHM_FD_CLIENT_EFD], map,
+    hello.ring_size, std::min(hello.ring_size, ring_size), true);
+  if (csi->init() < 0)
+    return -ECONNABORTED;
+  csi->accept_rings();
+
+  out->set_type(addr_type);
+  out->set_sockaddr(reinterpret_cast<sockaddr*>(&hello.peer_addr));
+  out->set_port(0);
+  ldout(cct, 10) << __func__ << " shm connection from " << *out
+		 << " ring " << std::min(hello.ring_size, ring_size) << dendl;
+  *sock = ConnectedSocket(std::move(csi));
+  return 0;
+}
+
+int ShmServerSocketImpl::accept(ConnectedSocket *sock, const SocketOptions &opts,
+				entity_addr_t *out, Worker *w)
+{
+  ceph_assert(sock);
+  ceph_assert(NULL != out);
+  if (unix_sd >= 0) {
+    accept_unix();
+    for (auto p = pending_hellos.begin(); p != pending_hellos.end(); ) {
+      int sd = (p++)->first;
+      int r = accept_shm(sd, sock, out);
+      if (r != -EAGAIN && r != -EWOULDBLOCK)
+	return r;
+    }
+  }
+  return tcp.accept(sock, opts, out, w);
+}
+
+ShmWorker::ShmWorker(CephContext *c, unsigned i)
+  : PosixWorker(c, i), ring_size(shm_ring_size(c))
+{
+}
+
+int ShmWorker::listen(entity_addr_t &sa,
+		      unsigned addr_slot,
+		      const SocketOptions &opt,
+		      ServerSocket *sock)
+{
+  ServerSocket tcp;
+  int r = PosixWorker::listen(sa, addr_slot, opt, &tcp);
+  if (r < 0)
+    return r;
+  if (!ring_size ||
+      (sa.get_family() != AF_INET && sa.get_family() != AF_INET6)) {
+    *sock = std::move(tcp);
+    return 0;
+  }
+
+  // a listener that cannot offer shm still works, just over tcp
+  sockaddr_un un;
+  socklen_t len = shm_socket_name(sa, sa.is_blank_ip(), &un);
+  int unix_sd = socket_cloexec(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (unix_sd < 0 ||
+      ::bind(unix_sd, reinterpret_cast<sockaddr*>(&un), len) < 0 ||
+      ::listen(unix_sd, cct->_conf->ms_tcp_listen_backlog) < 0) {
+    r = -errno;
+    ldout(cct, 1) << __func__ << " no shm listener for " << sa << ": "
+		  << cpp_strerror(r) << dendl;
+    if (unix_sd >= 0)
+      ::close(unix_sd);
+    *sock = std::move(tcp);
+    return 0;
+  }
+
+  int ep_fd = ::epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event ee;
+  memset(&ee, 0, sizeof(ee));
+  ee.events = EPOLLIN;
+  if (ep_fd < 0 ||
+      ::epoll_ctl(ep_fd, EPOLL_CTL_ADD, tcp.fd(), &ee) < 0 ||
+      ::epoll_ctl(ep_fd, EPOLL_CTL_ADD, unix_sd, &ee) < 0) {
+    r = -errno;
+    lderr(cct) << __func__ << " unable to watch listeners: "
+	       << cpp_strerror(r) << dendl;
+    if (ep_fd >= 0)
+      ::close(ep_fd);
+    ::close(unix_sd);
+    *sock = std::move(tcp);
+    return 0;
+  }
+
+  ldout(cct, 10) << __func__ << " shm listener for " << sa << dendl;
+  *sock = ServerSocket(
+    std::make_unique<ShmServerSocketImpl>(cct, std::move(tcp), unix_sd,
+					  ep_fd, ring_size, sa, addr_slot));
+  return 0;
+}
+
+int ShmWorker::shm_connect(const entity_addr_t &addr, ConnectedSocket *socket)
+{
+  if (addr.get_family() != AF_INET && addr.get_family() != AF_INET6)
+    return -EOPNOTSUPP;
+
+  // a listener bound to a specific ip, then one bound to all of them;
+  // the latter only counts if the ip is ours
+  int sd = -1;
+  for (bool any : { false, true }) {
+    if (any && !is_local_ip(addr))
+      break;
+    sockaddr_un un;
+    socklen_t len = shm_socket_name(addr, any, &un);
+    sd = socket_cloexec(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (sd < 0)
+      return -errno;
+    if (::connect(sd, reinterpret_cast<sockaddr*>(&un), len) == 0) {
+      // the credentials the listener had when it called listen()
+      int r = check_peer_cred(sd);
+      if (r == 0)
+	break;
+      ldout(cct, 1) << __func__ << " not using shm listener for " << addr
+		    << ": " << cpp_strerror(r) << dendl;
+    }
+    ::close(sd);
+    sd = -1;
+  }
+  if (sd < 0)
+    return -ENOENT;
+
+  size_t map_len = shm_map_len(ring_size);
+  void *map = MAP_FAILED;
+  int fds[SHM_NUM_FDS] = { -1, -1, -1 };
+  int r = 0;
+  fds[SHM_FD_MAP] = ::memfd_create("ceph-msgr-shm",
+				   MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fds[SHM_FD_MAP] < 0 ||
+      ::ftruncate(fds[SHM_FD_MAP], map_len) < 0 ||
+      ::fcntl(fds[SHM_FD_MAP], F_ADD_SEALS,
+	      F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0 ||
+      (map = ::mmap(nullptr, map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fds[SHM_FD_MAP], 0)) == MAP_FAILED ||
+      (fds[SHM_FD_CLIENT_EFD] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+      (fds[SHM_FD_SERVER_EFD] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+    r = -errno;
+  }
+
+  if (r == 0) {
+    shm_hello_t hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.magic = SHM_MAGIC;
+    hello.ring_size = ring_size;
+    memcpy(&hello.peer_addr, addr.get_sockaddr(), addr.get_sockaddr_len());
+
+    struct iovec iov = { &hello, sizeof(hello) };
+    union {
+      char buf[CMSG_SPACE(sizeof(fds))];
+      struct cmsghdr align;
+    } cmsgbuf;
+    memset(&cmsgbuf, 0, sizeof(cmsgbuf));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf.buf;
+    msg.msg_controllen = sizeof(cmsgbuf.buf);
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    ssize_t n = ::sendmsg(sd, &msg, MSG_NOSIGNAL);
+    if (n < 0)
+      r = -errno;
+    else if (n != sizeof(hello))
+      r = -EIO;
+  }
+
+  // the server holds its own references now
+  if (fds[SHM_FD_MAP] >= 0)
+    ::close(fds[SHM_FD_MAP]);
+  if (r < 0) {
+    if (map != MAP_FAILED)
+      ::munmap(map, map_len);
+    for (int i : { SHM_FD_CLIENT_EFD, SHM_FD_SERVER_EFD }) {
+      if (fds[i] >= 0)
+	::close(fds[i]);
+    }
+    ::close(sd);
+    return r;
+  }
+
+  auto csi = std::make_unique<ShmConnectedSocketImpl>(
+    cct, sd, fds[SHM_FD_CLIENT_EFD], fds[SHM_FD_SERVER_EFD], map,
+    ring_size, 0, false);
+  r = csi->init();
+  if (r < 0)
+    return r;
+  ldout(cct, 10) << __func__ << " shm connection to " << addr
+		 << " ring " << ring_size << dendl;
+  *socket = ConnectedSocket(std::move(csi));
+  return 0;
+}
+
+int ShmWorker::connect(const entity_addr_t &addr, const SocketOptions &opts,
+		       ConnectedSocket *socket)
+{
+  if (ring_size) {
+    int r = shm_connect(addr, socket);
+    if (r == 0)
+      return 0;
+    ldout(cct, 20) << __func__ << " using tcp for " << addr << ": "
+		   << cpp_strerror(r) << dendl;
+  }
+  return PosixWorker::connect(addr, opts, socket);
+}
@@ -0,0 +1,52 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_ASYNC_SHMSTACK_H
+#define CEPH_MSG_ASYNC_SHMSTACK_H
+
+#include "PosixStack.h"
+
+/**
+ * Shared memory transport for peers on the same host.
+ *
+ * Listening sockets are ordinary TCP sockets plus an abstract unix
+ * socket named after the listen address. A client that finds such a
+ * socket for the address it connects to hands the server a sealed memfd
+ * holding two single producer/single consumer byte rings, one per
+ * direction, and a pair of eventfds used as doorbells. Both ends check
+ * that the other runs with the same effective uid, and the server uses
+ * no more of each ring than its own ms_async_shm_ring_size. Everything
+ * else (remote peers, peers running the posix stack or as another
+ * user, setup failures) falls back to TCP, so the two can be mixed
+ * freely.
+ */
+class ShmWorker : public PosixWorker {
+  const uint64_t ring_size;
+
+  int shm_connect(const entity_addr_t &addr, ConnectedSocket *socket);
+
+ public:
+  ShmWorker(CephContext *c, unsigned i);
+  int listen(entity_addr_t &sa,
+	     unsigned addr_slot,
+	     const SocketOptions &opt,
+	     ServerSocket *socks) override;
+  int connect(const entity_addr_t &addr, const SocketOptions &opts, ConnectedSocket *socket) override;
+};
+
+class ShmNetworkStack : public PosixNetworkStack {
+ public:
+  explicit ShmNetworkStack(CephContext *c, const string &t)
+    : PosixNetworkStack(c, t) {}
+};
+
+#endif //CEPH_MSG_ASYNC_SHMSTACK_H
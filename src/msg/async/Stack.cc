@@ -19,7 +19,12 @@
 #include "include/compat.h"
 #include "common/Cond.h"
 #include "common/errno.h"
+#include "common/numa.h"
+#include "common/pick_address.h"
 #include "PosixStack.h"
+#ifdef __linux__
+#include "ShmStack.h"
+#endif
 #ifdef HAVE_RDMA
 #include "rdma/RDMAStack.h"
 #endif
@@ -41,6 +46,14 @@ std::function<void ()> NetworkStack::add_thread(unsigned i)
       char tp_name[16];
       sprintf(tp_name, "msgr-worker-%u", w->id);
       ceph_pthread_setname(pthread_self(), tp_name);
+      if (numa_cpu_set_size) {
+        int r = sched_setaffinity(0, numa_cpu_set_size, &numa_cpu_set);
+        if (r < 0) {
+          r = -errno;
+          lderr(cct) << __func__ << " failed to set numa affinity: "
+                     << cpp_strerror(r) << dendl;
+        }
+      }
       const unsigned EventMaxWaitUs = 30000000;
       w->center.set_owner();
       ldout(cct, 10) << __func__ << " starting" << dendl;
@@ -50,13 +63,21 @@ std::function<void ()> NetworkStack::add_thread(unsigned i)
         ldout(cct, 30) << __func__ << " calling event process" << dendl;
 
         ceph::timespan dur;
-        int r = w->center.process_events(EventMaxWaitUs, &dur);
+        EventCenter::wait_stats_t wait;
+        int r = w->center.process_events(EventMaxWaitUs, &dur, &wait);
         if (r < 0) {
           ldout(cct, 20) << __func__ << " process events failed: "
                          << cpp_strerror(errno) << dendl;
           // TODO do something?
         }
         w->perf_logger->tinc(l_msgr_running_total_time, dur);
+        w->busy_ns += std::chrono::nanoseconds(dur).count();
+        if (wait.result != EventCenter::WAIT_NONBLOCKING) {
+          w->perf_logger->hinc(l_msgr_event_wait_histogram,
+                               std::chrono::duration_cast<std::chrono::microseconds>(wait.waited).count(),
+                               wait.result);
+          w->perf_logger->tinc(l_msgr_busy_poll_time, wait.spun);
+        }
       }
       w->reset();
       w->destroy();
@@ -67,6 +88,10 @@ std::shared_ptr<NetworkStack> NetworkStack::create(CephContext *c, const string
 {
   if (t == "posix")
     return std::make_shared<PosixNetworkStack>(c, t);
+#ifdef __linux__
+  else if (t == "shm")
+    return std::make_shared<ShmNetworkStack>(c, t);
+#endif
 #ifdef HAVE_RDMA
   else if (t == "rdma")
     return std::make_shared<RDMAStack>(c, t);
@@ -86,6 +111,10 @@ Worker* NetworkStack::create_worker(CephContext *c, const string &type, unsigned
 {
   if (type == "posix")
     return new PosixWorker(c, i);
+#ifdef __linux__
+  else if (type == "shm")
+    return new ShmWorker(c, i);
+#endif
 #ifdef HAVE_RDMA
   else if (type == "rdma")
     return new RDMAWorker(c, i);
@@ -120,6 +149,37 @@ NetworkStack::NetworkStack(CephContext *c, const string &t): type(t), started(fa
     w->center.init(InitEventNumber, i, type);
     workers.push_back(w);
   }
+  worker_loads.resize(num_workers);
+  last_load_sample = ceph::mono_clock::now();
+  init_numa_affinity();
+}
+
+void NetworkStack::init_numa_affinity()
+{
+  int node = cct->_conf.get_val<int64_t>("ms_async_numa_node");
+  if (node < 0) {
+    auto iface = cct->_conf.get_val<std::string>("ms_async_numa_iface");
+    if (iface.empty()) {
+      return;
+    }
+    int r = get_iface_numa_node(iface, &node);
+    if (r < 0) {
+      lderr(cct) << __func__ << " unable to identify interface '" << iface
+                 << "' numa node: " << cpp_strerror(r) << dendl;
+      return;
+    }
+  }
+  int r = get_numa_node_cpu_set(node, &numa_cpu_set_size, &numa_cpu_set);
+  if (r < 0) {
+    lderr(cct) << __func__ << " unable to determine numa node " << node
+               << " CPUs: " << cpp_strerror(r) << dendl;
+    numa_cpu_set_size = 0;
+    return;
+  }
+  ldout(cct, 1) << __func__ << " pinning workers to numa node " << node
+                << " cpus " << cpu_set_to_str_list(numa_cpu_set_size,
+                                                   &numa_cpu_set)
+                << dendl;
 }
 
 void NetworkStack::start()
@@ -143,20 +203,61 @@ void NetworkStack::start()
     workers[i]->wait_for_init();
 }
 
+// must hold pool_spin
+void NetworkStack::_sample_load()
+{
+  auto now = ceph::mono_clock::now();
+  auto elapsed = now - last_load_sample;
+  if (elapsed < std::chrono::seconds(1)) {
+    return;
+  }
+  last_load_sample = now;
+  uint64_t elapsed_ns = std::chrono::nanoseconds(elapsed).count();
+  for (unsigned i = 0; i < num_workers; ++i) {
+    auto& l = worker_loads[i];
+    uint64_t busy = workers[i]->busy_ns.load();
+    uint64_t bytes = workers[i]->perf_logger->get(l_msgr_recv_bytes) +
+                     workers[i]->perf_logger->get(l_msgr_send_bytes);
+    l.busy_permille = std::min<uint64_t>(
+      1000, (busy - l.busy_ns) * 1000 / elapsed_ns);
+    l.byte_rate = (bytes - l.bytes) * 1000000000ull / elapsed_ns;
+    l.busy_ns = busy;
+    l.bytes = bytes;
+  }
+}
+
 Worker* NetworkStack::get_worker()
 {
   ldout(cct, 30) << __func__ << dendl;
 
    // start with some reasonably large number
-  unsigned min_load = std::numeric_limits<int>::max();
+  uint64_t min_load = std::numeric_limits<uint64_t>::max();
   Worker* current_best = nullptr;
+  bool by_load =
+    cct->_conf.get_val<std::string>("ms_async_worker_placement") == "load";
 
   pool_spin.lock();
-  // find worker with least references
+  // charge each connection the average busy time of a connection so
+  // that a burst of new connections doesn't all land on the worker
+  // that happened to be idle during the last sample
+  uint64_t conn_cost = 1;
+  if (by_load) {
+    _sample_load();
+    uint64_t busy = 0, refs = 0;
+    for (unsigned i = 0; i < num_workers; ++i) {
+      busy += worker_loads[i].busy_permille;
+      refs += workers[i]->references.load();
+    }
+    conn_cost = std::max<uint64_t>(1, refs ? busy / refs : 0);
+  }
+  // find worker with least load, or least references
   // tempting case is returning on references == 0, but in reality
   // this will happen so rarely that there's no need for special case.
   for (unsigned i = 0; i < num_workers; ++i) {
-    unsigned worker_load = workers[i]->references.load();
+    uint64_t worker_load = workers[i]->references.load() * conn_cost;
+    if (by_load) {
+      worker_load += worker_loads[i].busy_permille;
+    }
     if (worker_load < min_load) {
       current_best = workers[i];
       min_load = worker_load;
@@ -169,6 +270,39 @@ Worker* NetworkStack::get_worker()
   return current_best;
 }
 
+bool NetworkStack::get_rebalance(Worker **from, Worker **to,
+                                 uint64_t *byte_rate_gap)
+{
+  std::lock_guard<decltype(pool_spin)> lk(pool_spin);
+  if (num_workers < 2) {
+    return false;
+  }
+  _sample_load();
+  unsigned hot = 0, cold = 0;
+  for (unsigned i = 1; i < num_workers; ++i) {
+    if (worker_loads[i].busy_permille > worker_loads[hot].busy_permille) {
+      hot = i;
+    }
+    if (worker_loads[i].busy_permille < worker_loads[cold].busy_permille) {
+      cold = i;
+    }
+  }
+  auto threshold = cct->_conf.get_val<double>("ms_async_rebalance_threshold");
+  unsigned gap = worker_loads[hot].busy_permille -
+                 worker_loads[cold].busy_permille;
+  if (gap <= threshold * 1000) {
+    return false;
+  }
+  *from = workers[hot];
+  *to = workers[cold];
+  *byte_rate_gap = worker_loads[hot].byte_rate > worker_loads[cold].byte_rate ?
+    worker_loads[hot].byte_rate - worker_loads[cold].byte_rate : 0;
+  ldout(cct, 10) << __func__ << " worker " << hot << " busy "
+                 << worker_loads[hot].busy_permille << "/1000, worker " << cold
+                 << " busy " << worker_loads[cold].busy_permille << "/1000" << dendl;
+  return true;
+}
+
 void NetworkStack::stop()
 {
   std::lock_guard<decltype(pool_spin)> lk(pool_spin);
@@ -17,7 +17,12 @@
 #ifndef CEPH_MSG_ASYNC_STACK_H
 #define CEPH_MSG_ASYNC_STACK_H
 
+#include <sched.h>
+#include <sys/uio.h>
+
+#include "include/compat.h"
 #include "include/spinlock.h"
+#include "common/ceph_time.h"
 #include "common/perf_counters.h"
 #include "msg/msg_types.h"
 #include "msg/async/Event.h"
@@ -28,8 +33,13 @@ class ConnectedSocketImpl {
   virtual ~ConnectedSocketImpl() {}
   virtual int is_connected() = 0;
   virtual ssize_t read(char*, size_t) = 0;
+  // backends without scatter reads only fill the first buffer
+  virtual ssize_t readv(const struct iovec *iov, int iovcnt) {
+    return read(static_cast<char*>(iov[0].iov_base), iov[0].iov_len);
+  }
   virtual ssize_t zero_copy_read(bufferptr&) = 0;
   virtual ssize_t send(bufferlist &bl, bool more) = 0;
+  virtual void zero_copy_reap() {}
   virtual void shutdown() = 0;
   virtual void close() = 0;
   virtual int fd() const = 0;
@@ -95,6 +105,12 @@ class ConnectedSocket {
   ssize_t read(char* buf, size_t len) {
     return _csi->read(buf, len);
   }
+  /// Read the input stream into several buffers with copy.
+  ///
+  /// Fills the buffers in order; may stop after the first one.
+  ssize_t readv(const struct iovec *iov, int iovcnt) {
+    return _csi->readv(iov, iovcnt);
+  }
   /// Gets the input stream.
   ///
   /// Gets an object returning data sent from the remote endpoint.
@@ -107,6 +123,14 @@ class ConnectedSocket {
   ssize_t send(bufferlist &bl, bool more) {
     return _csi->send(bl, more);
   }
+  /// Releases buffers of zero-copy sends the kernel has completed.
+  ///
+  /// Buffers handed to send() may stay referenced after send() returns
+  /// if the stack transmits them in place; this drops the references
+  /// to those the stack reports done with.
+  void zero_copy_reap() {
+    _csi->zero_copy_reap();
+  }
   /// Disables output to the socket.
   ///
   /// Current or future writes that have not been successfully flushed
@@ -214,6 +238,15 @@ enum {
   l_msgr_send_messages_queue_lat,
   l_msgr_handle_ack_lat,
 
+  l_msgr_recv_copied_bytes,
+  l_msgr_send_coalesced_messages,
+  l_msgr_recv_queued_messages,
+  l_msgr_event_wait_histogram,
+  l_msgr_busy_poll_time,
+  l_msgr_send_zerocopy,
+  l_msgr_send_zerocopy_copied,
+  l_msgr_send_zerocopy_pending,
+
   l_msgr_last,
 };
 
@@ -230,6 +263,9 @@ class Worker {
   unsigned id;
 
   std::atomic_uint references;
+  // time spent handling events, sampled by NetworkStack to place and
+  // rebalance connections
+  std::atomic<uint64_t> busy_ns = {0};
   EventCenter center;
 
   Worker(const Worker&) = delete;
@@ -257,6 +293,32 @@ class Worker {
     plb.add_time_avg(l_msgr_send_messages_queue_lat, "msgr_send_messages_queue_lat", "Network sent messages lat");
     plb.add_time_avg(l_msgr_handle_ack_lat, "msgr_handle_ack_lat", "Connection handle ack lat");
 
+    plb.add_u64_counter(l_msgr_recv_copied_bytes, "msgr_recv_copied_bytes", "Network received bytes copied out of the prefetch buffer", NULL, 0, unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_msgr_send_coalesced_messages, "msgr_send_coalesced_messages", "Network sent messages that shared a send call with the next one");
+    plb.add_u64_counter(l_msgr_recv_queued_messages, "msgr_recv_queued_messages", "Network received messages handed off to the dispatch thread instead of fast dispatched");
+
+    PerfHistogramCommon::axis_config_d wait_x_axis_config{
+      "Wait time (usec)",
+      PerfHistogramCommon::SCALE_LOG2,
+      0,                             ///< Start at 0
+      1,                             ///< Quantization unit is 1usec
+      28,                            ///< Beyond the longest wait of the worker loop
+    };
+    PerfHistogramCommon::axis_config_d wait_y_axis_config{
+      "Woken up by (0 = busy poll, 1 = event, 2 = timeout)",
+      PerfHistogramCommon::SCALE_LINEAR,
+      0,                             ///< Start at 0
+      1,                             ///< One bucket per EventCenter::wait_result_t
+      4,                             ///< Below 0, and the three results
+    };
+    plb.add_u64_counter_histogram(l_msgr_event_wait_histogram, "msgr_event_wait_histogram",
+                                  wait_x_axis_config, wait_y_axis_config,
+                                  "Histogram of event loop waits by how they ended");
+    plb.add_time(l_msgr_busy_poll_time, "msgr_busy_poll_time", "The total time spent busy polling for events");
+    plb.add_u64_counter(l_msgr_send_zerocopy, "msgr_send_zerocopy", "Network send calls made with MSG_ZEROCOPY");
+    plb.add_u64_counter(l_msgr_send_zerocopy_copied, "msgr_send_zerocopy_copied", "MSG_ZEROCOPY send calls the kernel completed with a copy");
+    plb.add_u64(l_msgr_send_zerocopy_pending, "msgr_send_zerocopy_pending", "MSG_ZEROCOPY send calls whose buffers are still pinned");
+
     perf_logger = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perf_logger);
   }
@@ -309,7 +371,23 @@ class NetworkStack {
   ceph::spinlock pool_spin;
   bool started = false;
 
+  // cpus of the numa node worker threads are pinned to, if any
+  size_t numa_cpu_set_size = 0;
+  cpu_set_t numa_cpu_set;
+
+  struct WorkerLoad {
+    uint64_t busy_ns = 0;       ///< Worker::busy_ns at the last sample
+    uint64_t bytes = 0;         ///< bytes sent and received at the last sample
+    unsigned busy_permille = 0; ///< share of time spent handling events
+    uint64_t byte_rate = 0;     ///< bytes/sec
+  };
+  // protected by pool_spin
+  std::vector<WorkerLoad> worker_loads;
+  ceph::mono_time last_load_sample;
+
   std::function<void ()> add_thread(unsigned i);
+  void init_numa_affinity();
+  void _sample_load();
 
  protected:
   CephContext *cct;
@@ -339,6 +417,10 @@ class NetworkStack {
   // need to let each thread do binding port.
   virtual bool support_local_listen_table() const { return false; }
   virtual bool nonblock_connect_need_writable_event() const { return true; }
+  // backend need to override this method if an established connection can
+  // be moved to another worker. Kernel sockets only need their fd to be
+  // re-registered, but dpdk and rdma keep per-worker connection state.
+  virtual bool support_connection_migration() const { return false; }
 
   void start();
   void stop();
@@ -346,6 +428,16 @@ class NetworkStack {
   Worker *get_worker(unsigned i) {
     return workers[i];
   }
+  /**
+   * pick a pair of workers to move traffic between
+   *
+   * @param from          the busiest worker
+   * @param to            the least busy worker
+   * @param byte_rate_gap difference of their traffic in bytes/sec
+   * @return true if their busy time differs by more than
+   *         ms_async_rebalance_threshold
+   */
+  bool get_rebalance(Worker **from, Worker **to, uint64_t *byte_rate_gap);
   void drain();
   unsigned get_num_worker() const {
     return num_workers;
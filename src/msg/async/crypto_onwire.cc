@@ -17,6 +17,8 @@ static constexpr const std::size_t AESGCM_KEY_LEN{16};
 static constexpr const std::size_t AESGCM_IV_LEN{12};
 static constexpr const std::size_t AESGCM_TAG_LEN{16};
 static constexpr const std::size_t AESGCM_BLOCK_LEN{16};
+// plaintext buffers shorter than this are batched into one cipher update
+static constexpr const std::size_t AESGCM_COALESCE_LEN{4096};
 
 struct nonce_t {
   std::uint32_t random_seq;
@@ -37,6 +39,8 @@ class AES128GCM_OnWireTxHandler : public ceph::crypto::onwire::TxHandler {
   nonce_t nonce;
   static_assert(sizeof(nonce) == AESGCM_IV_LEN);
 
+  void encrypt_in_place(char* buf, std::size_t len);
+
 public:
   AES128GCM_OnWireTxHandler(CephContext* const cct,
 			    const key_t& key,
@@ -88,14 +92,45 @@ void AES128GCM_OnWireTxHandler::reset_tx_handler(
   ++nonce.random_seq;
 }
 
+void AES128GCM_OnWireTxHandler::encrypt_in_place(char* const buf,
+						 const std::size_t len)
+{
+  int update_len = 0;
+  if(1 != EVP_EncryptUpdate(ectx.get(),
+      reinterpret_cast<unsigned char*>(buf),
+      &update_len,
+      reinterpret_cast<const unsigned char*>(buf),
+      len)) {
+    throw std::runtime_error("EVP_EncryptUpdate failed");
+  }
+  ceph_assert_always(update_len >= 0);
+  ceph_assert(static_cast<unsigned>(update_len) == len);
+}
+
 void AES128GCM_OnWireTxHandler::authenticated_encrypt_update(
   const ceph::bufferlist& plaintext)
 {
   auto filler = buffer.append_hole(plaintext.length());
 
+  // messages usually carry a lot of tiny buffers (encoded headers, front
+  // fields) before the bulk data. Every EVP_EncryptUpdate() has a fixed
+  // cost, so runs of small buffers are first gathered into the output
+  // hole and then encrypted in place with a single call. GCM is a stream
+  // mode, so this doesn't change the ciphertext.
+  char* run_start = filler.c_str();
+  std::size_t run_len = 0;
   for (const auto& plainbuf : plaintext.buffers()) {
-    int update_len = 0;
+    if (plainbuf.length() < AESGCM_COALESCE_LEN) {
+      filler.copy_in(plainbuf.length(), plainbuf.c_str());
+      run_len += plainbuf.length();
+      continue;
+    }
+    if (run_len) {
+      encrypt_in_place(run_start, run_len);
+      run_len = 0;
+    }
 
+    int update_len = 0;
     if(1 != EVP_EncryptUpdate(ectx.get(),
 	reinterpret_cast<unsigned char*>(filler.c_str()),
 	&update_len,
@@ -106,6 +141,10 @@ void AES128GCM_OnWireTxHandler::authenticated_encrypt_update(
     ceph_assert_always(update_len >= 0);
     ceph_assert(static_cast<unsigned>(update_len) == plainbuf.length());
     filler.advance(update_len);
+    run_start = filler.c_str();
+  }
+  if (run_len) {
+    encrypt_in_place(run_start, run_len);
   }
 
   ldout(cct, 15) << __func__
@@ -200,8 +239,28 @@ ceph::bufferlist AES128GCM_OnWireRxHandler::authenticated_decrypt_update(
   ceph_assert(ciphertext.length() > 0);
   //ceph_assert(ciphertext.length() % AESGCM_BLOCK_LEN == 0);
 
-  // NOTE: we might consider in-place transformations in the future. AFAIK
-  // OpenSSL's might sustain that but lack of clear confirmation postpones.
+  // the common case: the messenger read the segment into a single buffer
+  // allocated with the segment's alignment and nobody else references it.
+  // GCM is a stream mode and OpenSSL allows in == out, so the plaintext
+  // can simply overwrite the ciphertext.
+  if (ciphertext.get_num_buffers() == 1 &&
+      ciphertext.front().raw_nref() == 1 &&
+      ciphertext.front().is_aligned(alignment)) {
+    int update_len = 0;
+    auto* buf = reinterpret_cast<unsigned char*>(ciphertext.c_str());
+    if (1 != EVP_DecryptUpdate(ectx.get(),
+	buf,
+	&update_len,
+	buf,
+	ciphertext.length())) {
+      throw std::runtime_error("EVP_DecryptUpdate failed");
+    }
+    ceph_assert_always(update_len >= 0);
+    ceph_assert(ciphertext.length() == static_cast<unsigned>(update_len));
+    ciphertext.invalidate_crc();
+    return std::move(ciphertext);
+  }
+
   auto plainnode = ceph::buffer::ptr_node::create(buffer::create_aligned(
     ciphertext.length(), alignment));
   auto* plainbuf = reinterpret_cast<unsigned char*>(plainnode->c_str());
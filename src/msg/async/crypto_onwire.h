@@ -91,6 +91,9 @@ public:
   virtual void reset_rx_handler() = 0;
 
   // Perform decryption ciphertext must be ALWAYS aligned to 16 bytes.
+  // Implementation may decrypt in place and hand back the very same
+  // memory if the ciphertext is contiguous, unshared and already has
+  // the requested alignment.
   // TODO: switch to always_aligned_t
   virtual ceph::bufferlist authenticated_decrypt_update(
     ceph::bufferlist&& ciphertext,
@@ -104,6 +104,20 @@ int NetHandler::set_socket_options(int sd, bool nodelay, int size)
     }
   }
 
+#ifdef SO_BUSY_POLL
+  // let the kernel poll the device queue in recv instead of waiting for
+  // the interrupt; needs CAP_NET_ADMIN above net.core.busy_read
+  int busy_poll = cct->_conf.get_val<uint64_t>("ms_async_busy_poll_us");
+  if (busy_poll) {
+    r = ::setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL, (void*)&busy_poll, sizeof(busy_poll));
+    if (r < 0) {
+      r = errno;
+      ldout(cct, 5) << "couldn't set SO_BUSY_POLL to " << busy_poll << ": " << cpp_strerror(r) << dendl;
+      r = 0;
+    }
+  }
+#endif
+
   // block ESIGPIPE
 #ifdef CEPH_USE_SO_NOSIGPIPE
   int val = 1;
@@ -116,6 +130,37 @@ int NetHandler::set_socket_options(int sd, bool nodelay, int size)
   return -r;
 }
 
+uint64_t NetHandler::set_zerocopy(int sd)
+{
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+  if (!cct->_conf.get_val<bool>("ms_tcp_zerocopy")) {
+    return 0;
+  }
+  int on = 1;
+  int r = ::setsockopt(sd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on));
+  if (r < 0) {
+    r = errno;
+    ldout(cct, 0) << __func__ << " couldn't set SO_ZEROCOPY: "
+		  << cpp_strerror(r) << dendl;
+    return 0;
+  }
+  return std::max<uint64_t>(
+    1, cct->_conf.get_val<Option::size_t>("ms_tcp_zerocopy_min_size"));
+#else
+  return 0;
+#endif	// SO_ZEROCOPY
+}
+
+void NetHandler::set_reset_on_close(int sd)
+{
+  struct linger l = { 1, 0 };
+  if (::setsockopt(sd, SOL_SOCKET, SO_LINGER, &l, sizeof(l)) < 0) {
+    int r = errno;
+    ldout(cct, 0) << __func__ << " couldn't set SO_LINGER: "
+		  << cpp_strerror(r) << dendl;
+  }
+}
+
 void NetHandler::set_priority(int sd, int prio, int domain)
 {
 #ifdef SO_PRIORITY
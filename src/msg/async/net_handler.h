@@ -40,6 +40,20 @@ namespace ceph {
     int reconnect(const entity_addr_t &addr, int sd);
     int nonblock_connect(const entity_addr_t &addr, const entity_addr_t& bind_addr);
     void set_priority(int sd, int priority, int domain);
+    /**
+     * Enable SO_ZEROCOPY on the socket if ms_tcp_zerocopy is set.
+     *
+     * @return    the minimum segment length to send with MSG_ZEROCOPY,
+     *            or 0 if zero-copy send is not enabled
+     */
+    uint64_t set_zerocopy(int sd);
+    /**
+     * Make close() reset the connection and drop any data the kernel
+     * still holds for it, instead of sending it out in the background
+     *
+     * @param sd socket
+     */
+    void set_reset_on_close(int sd);
   };
 }
 
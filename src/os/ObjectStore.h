@@ -292,6 +292,11 @@ public:
     return true;
   }
 
+  /// 0..1, how close the backend is to stalling writes
+  virtual double get_write_pressure() {
+    return 0;
+  }
+
   /**
    * is_rotational
    *
@@ -36,6 +36,7 @@
 #include "FreelistManager.h"
 #include "BlueFS.h"
 #include "BlueRocksEnv.h"
+#include "kv/RocksDBStore.h"
 #include "auth/Crypto.h"
 #include "common/EventTrace.h"
 #include "perfglue/heap_profiler.h"
@@ -4157,15 +4158,55 @@ void BlueStore::handle_conf_change(const ConfigProxy& conf,
       _set_throttle_params();
     }
   }
-  if (changed.count("bluestore_throttle_bytes")) {
-    throttle_bytes.reset_max(conf->bluestore_throttle_bytes);
-    throttle_deferred_bytes.reset_max(
-      conf->bluestore_throttle_bytes + conf->bluestore_throttle_deferred_bytes);
+  if (changed.count("bluestore_throttle_bytes") ||
+      changed.count("bluestore_throttle_deferred_bytes")) {
+    _set_throttle_max();
   }
-  if (changed.count("bluestore_throttle_deferred_bytes")) {
-    throttle_deferred_bytes.reset_max(
-      conf->bluestore_throttle_bytes + conf->bluestore_throttle_deferred_bytes);
+}
+
+void BlueStore::_set_throttle_max()
+{
+  double ratio = kv_throttle_ratio;
+  auto scale = [ratio](uint64_t v) {
+    // 0 disables a throttle; never turn a scaled one into that
+    return v ? std::max<uint64_t>(1, v * ratio) : 0;
+  };
+  uint64_t bytes = scale(cct->_conf->bluestore_throttle_bytes);
+  throttle_bytes.reset_max(bytes);
+  throttle_deferred_bytes.reset_max(
+    bytes + scale(cct->_conf->bluestore_throttle_deferred_bytes));
+}
+
+double BlueStore::kv_pressure_throttle_ratio(double pressure, double start,
+					     double min_ratio)
+{
+  double ratio = 1.0;
+  if (pressure > start && start < 1.0) {
+    ratio -= (1.0 - min_ratio) * (std::min(pressure, 1.0) - start) /
+      (1.0 - start);
+  }
+  return ratio;
+}
+
+void BlueStore::_update_kv_throttle()
+{
+  // shrink the throttles as rocksdb approaches a write stall so that
+  // admission slows down gradually instead of the kv sync thread
+  // blocking in a stall with a full pipeline behind it
+  double start = cct->_conf.get_val<double>("bluestore_throttle_kv_pressure_start");
+  double min_ratio = cct->_conf.get_val<double>("bluestore_throttle_kv_pressure_min_ratio");
+  double pressure = db->get_write_pressure();
+  double ratio = kv_pressure_throttle_ratio(pressure, start, min_ratio);
+  double old_ratio = kv_throttle_ratio;
+  if (std::abs(ratio - old_ratio) < 0.01) {
+    return;
   }
+  dout(5) << __func__ << " kv write pressure " << pressure
+	  << ", throttle ratio " << old_ratio << " -> " << ratio
+	  << dendl;
+  kv_throttle_ratio = ratio;
+  logger->set(l_bluestore_kv_throttle_pct, ratio * 100);
+  _set_throttle_max();
 }
 
 void BlueStore::_set_compression()
@@ -4394,6 +4435,8 @@ void BlueStore::_init_logger()
   b.add_time_avg(l_bluestore_kv_final_lat, "kv_final_lat",
 		 "Average kv_finalize thread latency",
 		 "kf_l", PerfCountersBuilder::PRIO_INTERESTING);
+  b.add_u64(l_bluestore_kv_throttle_pct, "kv_throttle_pct",
+	    "Percentage of the configured throttle admitted under kv write pressure");
   b.add_time_avg(l_bluestore_state_prepare_lat, "state_prepare_lat",
     "Average prepare state latency");
   b.add_time_avg(l_bluestore_state_aio_wait_lat, "state_aio_wait_lat",
@@ -4536,6 +4579,7 @@ void BlueStore::_init_logger()
   b.add_time_avg(l_bluestore_clist_lat, "clist_lat",
     "Average collection listing latency");
   logger = b.create_perf_counters();
+  logger->set(l_bluestore_kv_throttle_pct, 100);
   cct->get_perfcounters_collection()->add(logger);
 }
 
@@ -5468,6 +5512,9 @@ int BlueStore::_open_db(bool create, bool to_repair_db, bool read_only)
   map<string,string> kv_options;
   // force separate wal dir for all new deployments.
   kv_options["separate_wal_dir"] = 1;
+  if (resharding) {
+    kv_options["resharding"] = "1";
+  }
   rocksdb::Env *env = NULL;
   if (do_bluefs) {
     dout(10) << __func__ << " initializing bluefs" << dendl;
@@ -5480,7 +5527,10 @@ int BlueStore::_open_db(bool create, bool to_repair_db, bool read_only)
     if (r < 0) {
       return r;
     }
-    bluefs->set_slow_device_expander(this);
+    // reshard() opens the allocator, if it can, only after the db
+    if (!resharding) {
+      bluefs->set_slow_device_expander(this);
+    }
 
     if (cct->_conf->bluestore_bluefs_env_mirror) {
       rocksdb::Env *a = new BlueRocksEnv(bluefs);
@@ -5583,14 +5633,17 @@ int BlueStore::_open_db(bool create, bool to_repair_db, bool read_only)
   if (kv_backend == "rocksdb") {
     options = cct->_conf->bluestore_rocksdb_options;
 
-    map<string,string> cf_map;
-    cct->_conf.with_val<string>("bluestore_rocksdb_cfs",
-                                 get_str_map,
-                                 &cf_map,
-                                 " \t");
-    for (auto& i : cf_map) {
-      dout(10) << "column family " << i.first << ": " << i.second << dendl;
-      cfs.push_back(KeyValueDB::ColumnFamily(i.first, i.second));
+    r = RocksDBStore::parse_sharding_def(
+      cct->_conf.get_val<string>("bluestore_rocksdb_cfs"), &cfs, &err);
+    if (r < 0) {
+      derr << __func__ << " invalid bluestore_rocksdb_cfs: " << err.str()
+	   << dendl;
+      _close_db();
+      return r;
+    }
+    for (auto& i : cfs) {
+      dout(10) << "column family " << i.name << " (" << i.shard_cnt
+	       << " shards): " << i.option << dendl;
     }
   }
 
@@ -5620,6 +5673,84 @@ int BlueStore::_open_db(bool create, bool to_repair_db, bool read_only)
   return 0;
 }
 
+int BlueStore::reshard(const string& new_sharding, ostream& out)
+{
+  dout(1) << __func__ << " " << new_sharding << dendl;
+  ceph_assert(!mounted);
+  int r = _open_path();
+  if (r < 0)
+    return r;
+  string kv_backend;
+  r = read_meta("kv_backend", &kv_backend);
+  if (r < 0 || kv_backend != "rocksdb") {
+    derr << __func__ << " only supported for rocksdb, kv_backend is '"
+	 << kv_backend << "'" << dendl;
+    r = -EOPNOTSUPP;
+    goto out_path;
+  }
+  r = _open_fsid(false);
+  if (r < 0)
+    goto out_path;
+  r = _read_fsid(&fsid);
+  if (r < 0)
+    goto out_fsid;
+  r = _lock_fsid();
+  if (r < 0)
+    goto out_fsid;
+  r = _open_bdev(false);
+  if (r < 0)
+    goto out_fsid;
+
+  // allow opening a db left behind by an interrupted reshard
+  resharding = true;
+  r = _open_db(false);
+  if (r < 0)
+    goto out_bdev;
+
+  // rewriting every key may need more space than bluefs owns, so give it
+  // the allocator to grow from.  fm and alloc must not see a half moved
+  // db though; a resumed reshard runs with what bluefs has.
+  if (!static_cast<RocksDBStore*>(db)->is_resharding()) {
+    r = _open_super_meta();
+    if (r < 0)
+      goto out_db;
+    r = _open_fm(nullptr);
+    if (r < 0)
+      goto out_db;
+    r = _open_alloc();
+    if (r < 0) {
+      _close_fm();
+      goto out_db;
+    }
+    if (bluefs) {
+      bluefs->set_slow_device_expander(this);
+    }
+  } else {
+    dout(1) << __func__ << " resuming an interrupted reshard; bluefs can't "
+	    << "take more space from the main device" << dendl;
+  }
+
+  r = static_cast<RocksDBStore*>(db)->reshard(new_sharding, out);
+  if (r < 0) {
+    derr << __func__ << " failed: " << cpp_strerror(r) << dendl;
+  }
+
+  if (fm) {
+    _close_db_and_around();
+    goto out_bdev;
+  }
+ out_db:
+  _close_db();
+ out_bdev:
+  resharding = false;
+  _close_bdev();
+ out_fsid:
+  _close_fsid();
+ out_path:
+  _close_path();
+  return r;
+}
+
 void BlueStore::_close_db()
 {
   ceph_assert(db);
@@ -10245,6 +10376,22 @@ void BlueStore::_txc_finish(TransContext *txc)
   }
   txc->shared_blobs_written.clear();
 
+  if (!txc->removed_collections.empty() &&
+      cct->_conf.get_val<bool>("bluestore_compact_removed_collections")) {
+    // the onodes of a removed pg leave a dense run of tombstones that
+    // every later listing in that key range would have to skip
+    for (auto& c : txc->removed_collections) {
+      string temp_start, temp_end, start, end;
+      get_coll_key_range(c->cid, c->cnode.bits, &temp_start, &temp_end,
+			 &start, &end);
+      dout(10) << __func__ << " compacting onodes of removed " << c->cid
+	       << dendl;
+      db->compact_range_async(PREFIX_OBJ, start, end);
+      if (temp_start != temp_end) {
+	db->compact_range_async(PREFIX_OBJ, temp_start, temp_end);
+      }
+    }
+  }
   while (!txc->removed_collections.empty()) {
     _queue_reap_collection(txc->removed_collections.front());
     txc->removed_collections.pop_front();
@@ -10678,6 +10825,7 @@ void BlueStore::_kv_sync_thread()
       // end up going to sleep, and then wake up when the very first
       // transaction is ready for commit.
       throttle_bytes.put(costs);
+      _update_kv_throttle();
 
       if (bluefs &&
 	  after_flush - bluefs_last_balance >
@@ -128,6 +128,7 @@ enum {
   l_bluestore_omap_lower_bound_lat,
   l_bluestore_omap_next_lat,
   l_bluestore_clist_lat,
+  l_bluestore_kv_throttle_pct,
   l_bluestore_last
 };
 
@@ -150,6 +151,8 @@ public:
   void _set_csum();
   void _set_compression();
   void _set_throttle_params();
+  void _set_throttle_max();
+  void _update_kv_throttle();
   int _set_cache_sizes();
 
   class TransContext;
@@ -1851,6 +1854,9 @@ private:
   ///< approx cost per io, in bytes
   std::atomic<uint64_t> throttle_cost_per_io = {0};
 
+  ///< share of the configured throttles admitted under kv write pressure
+  std::atomic<double> kv_throttle_ratio = {1.0};
+
   std::atomic<Compressor::CompressionMode> comp_mode =
     {Compressor::COMP_NONE}; ///< compression mode
   CompressorRef compressor;
@@ -1882,6 +1888,7 @@ private:
   osd_pools_map osd_pools; // protected by vstatfs_lock as well
 
   bool per_pool_stat_collection = true;
+  bool resharding = false;  ///< let _open_db open an interrupted reshard
 
   struct MempoolThread : public Thread {
   public:
@@ -2254,6 +2261,13 @@ public:
 
   int get_devices(set<string> *ls) override;
 
+  double get_write_pressure() override {
+    return db ? db->get_write_pressure() : 0;
+  }
+  /// share of the throttles to admit at the given kv write pressure
+  static double kv_pressure_throttle_ratio(double pressure, double start,
+					   double min_ratio);
+
   bool is_rotational() override;
   bool is_journal_rotational() override;
 
@@ -2306,6 +2320,9 @@ public:
   }
   int _fsck(bool deep, bool repair);
 
+  /// offline: move rocksdb keys to the column family layout new_sharding
+  int reshard(const std::string& new_sharding, std::ostream& out);
+
   void set_cache_shards(unsigned num) override;
   void dump_cache_stats(Formatter *f) override {
     int onode_count = 0, buffers_bytes = 0;
@@ -224,6 +224,7 @@ int main(int argc, char **argv)
   string action;
   string log_file;
   string key, value;
+  string new_sharding;
   int log_level = 30;
   bool fsck_deep = false;
   po::options_description po_options("Options");
@@ -239,10 +240,11 @@ int main(int argc, char **argv)
     ("deep", po::value<bool>(&fsck_deep), "deep fsck (read all data)")
     ("key,k", po::value<string>(&key), "label metadata key name")
     ("value,v", po::value<string>(&value), "label metadata value")
+    ("sharding", po::value<string>(&new_sharding), "new rocksdb column family sharding for reshard, e.g. \"M(4) P L\"")
     ;
   po::options_description po_positional("Positional options");
   po_positional.add_options()
-    ("command", po::value<string>(&action), "fsck, repair, bluefs-export, bluefs-bdev-sizes, bluefs-bdev-expand, bluefs-bdev-new-db, bluefs-bdev-new-wal, bluefs-bdev-migrate, show-label, set-label-key, rm-label-key, prime-osd-dir, bluefs-log-dump")
+    ("command", po::value<string>(&action), "fsck, repair, bluefs-export, bluefs-bdev-sizes, bluefs-bdev-expand, bluefs-bdev-new-db, bluefs-bdev-new-wal, bluefs-bdev-migrate, show-label, set-label-key, rm-label-key, prime-osd-dir, bluefs-log-dump, reshard")
     ;
   po::options_description po_all("All options");
   po_all.add(po_options).add(po_positional);
@@ -357,6 +359,16 @@ int main(int argc, char **argv)
       exit(EXIT_FAILURE);
     }
   }
+  if (action == "reshard") {
+    if (path.empty()) {
+      cerr << "must specify bluestore path" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (!vm.count("sharding")) {
+      cerr << "must specify new sharding with --sharding" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
 
   vector<const char*> args;
   if (log_file.size()) {
@@ -792,6 +804,15 @@ int main(int argc, char **argv)
       }
       return r;
     }
+  } else if (action == "reshard") {
+    validate_path(cct.get(), path, false);
+    BlueStore bluestore(cct.get(), path);
+    int r = bluestore.reshard(new_sharding, cout);
+    if (r < 0) {
+      cerr << "error resharding: " << cpp_strerror(r) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    cout << action << " success" << std::endl;
   } else {
     cerr << "unrecognized action " << action << std::endl;
     return 1;
@@ -155,6 +155,7 @@ ostream &operator<<(ostream &lhs, const ECBackend::Op &rhs)
       << " pending_commit=" << rhs.pending_commit
       << " plan.to_read=" << rhs.plan.to_read
       << " plan.will_write=" << rhs.plan.will_write
+      << " plan.delta_stripes=" << rhs.plan.delta_stripes
       << ")";
   return lhs;
 }
@@ -1427,7 +1428,9 @@ void ECBackend::on_change()
   for (auto &&op: tid_to_op_map) {
     cache.release_write_pin(op.second.pin);
   }
+  cache.clear_retained();
   tid_to_op_map.clear();
+  delta_writes_in_flight.clear();
 
   for (map<ceph_tid_t, ReadOp>::iterator i = tid_to_read_map.begin();
        i != tid_to_read_map.end();
@@ -1831,6 +1834,23 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
 {
   ceph_assert(op);
 
+  // the delta path pays off while it touches fewer shards than a full
+  // stripe read, i.e. for at most k - m data chunks
+  unsigned delta_max_chunks = 0;
+  if (get_parent()->get_pool().allows_ecoverwrites() &&
+      cct->_conf.get_val<bool>("osd_ec_parity_delta_writes") &&
+      ec_impl->supports_parity_delta() &&
+      ec_impl->get_chunk_mapping().empty() &&
+      ec_impl->get_sub_chunk_count() == 1 &&
+      ec_impl->get_data_chunk_count() > ec_impl->get_coding_chunk_count()) {
+    delta_max_chunks =
+      ec_impl->get_data_chunk_count() - ec_impl->get_coding_chunk_count();
+  }
+  // only overwrites ever read back what was written
+  cache.set_retain_limit(
+    get_parent()->get_pool().allows_ecoverwrites() ?
+    cct->_conf.get_val<Option::size_t>("osd_ec_stripe_cache_size") : 0);
+
   op->plan = ECTransaction::get_write_plan(
     sinfo,
     std::move(t),
@@ -1845,7 +1865,8 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
       }
       return ref;
     },
-    get_parent()->get_dpp());
+    get_parent()->get_dpp(),
+    delta_max_chunks);
 
   dout(10) << __func__ << ": " << *op << dendl;
 
@@ -1853,12 +1874,209 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
   check_ops();
 }
 
+bool ECBackend::can_write_delta(const Op &op)
+{
+  // keep it to the single object case, every other object written by
+  // the op would have to bypass the cache as well
+  if (!op.plan.to_read.empty() ||
+      op.plan.delta_stripes.size() != 1 ||
+      op.plan.will_write.size() != 1)
+    return false;
+  const hobject_t &hoid = op.plan.delta_stripes.begin()->first;
+  if (!op.plan.will_write.count(hoid))
+    return false;
+
+  // a plain rmw needs no reads at all if the stripes are retained
+  extent_set stripes;
+  for (auto &&i : op.plan.delta_stripes.begin()->second) {
+    stripes.union_insert(i.first, sinfo.get_stripe_width());
+  }
+  if (cache.is_retained(hoid, stripes)) {
+    dout(20) << __func__ << ": " << hoid << " stripes are cached" << dendl;
+    return false;
+  }
+
+  for (auto &&l : {&waiting_reads, &waiting_commit}) {
+    for (auto &&i : *l) {
+      if (i.plan.will_write.count(hoid)) {
+	dout(20) << __func__ << ": " << hoid << " has writes in flight"
+		 << dendl;
+	return false;
+      }
+    }
+  }
+
+  set<int> have;
+  map<shard_id_t, pg_shard_t> shards;
+  get_all_avail_shards(hoid, set<pg_shard_t>(), have, shards, false);
+  if (have.size() < ec_impl->get_chunk_count()) {
+    dout(20) << __func__ << ": " << hoid << " is degraded" << dendl;
+    return false;
+  }
+  return true;
+}
+
+struct FinishDeltaRead :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  ECBackend *ec;
+  ECBackend::Op *op;
+  hobject_t hoid;
+  FinishDeltaRead(ECBackend *ec, ECBackend::Op *op, const hobject_t &hoid)
+    : ec(ec), op(op), hoid(hoid) {}
+  void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override {
+    ec->handle_delta_read(op, hoid, in.second);
+  }
+};
+
+void ECBackend::start_delta_reads(Op *op)
+{
+  map<hobject_t, set<int>> obj_want_to_read;
+  map<hobject_t, read_request_t> for_read_op;
+  for (auto &&hpair: op->plan.delta_stripes) {
+    set<int> want;
+    list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+    for (auto &&stripe: hpair.second) {
+      want.insert(stripe.second.begin(), stripe.second.end());
+      to_read.push_back(
+	boost::make_tuple(stripe.first, sinfo.get_stripe_width(), 0));
+    }
+    for (unsigned i = ec_impl->get_data_chunk_count();
+	 i < ec_impl->get_chunk_count();
+	 ++i) {
+      want.insert(i);
+    }
+
+    set<int> have;
+    map<shard_id_t, pg_shard_t> shards;
+    get_all_avail_shards(hpair.first, set<pg_shard_t>(), have, shards, false);
+    map<pg_shard_t, vector<pair<int, int>>> need;
+    for (auto i: want) {
+      ceph_assert(shards.count(shard_id_t(i)));
+      need[shards[shard_id_t(i)]].push_back(
+	make_pair(0, ec_impl->get_sub_chunk_count()));
+    }
+
+    for_read_op.insert(
+      make_pair(
+	hpair.first,
+	read_request_t(
+	  to_read,
+	  need,
+	  false,
+	  new FinishDeltaRead(this, op, hpair.first))));
+    obj_want_to_read.insert(make_pair(hpair.first, want));
+    ++op->delta_reads_pending;
+  }
+
+  start_read_op(
+    CEPH_MSG_PRIO_DEFAULT,
+    obj_want_to_read,
+    for_read_op,
+    op->client_op,
+    false, false);
+}
+
+void ECBackend::handle_delta_read(
+  Op *op,
+  const hobject_t &hoid,
+  read_result_t &res)
+{
+  ceph_assert(op->delta_reads_pending);
+  --op->delta_reads_pending;
+
+  const auto &stripes = op->plan.delta_stripes.at(hoid);
+  auto &result = op->delta_read_result[hoid];
+  bool ok = res.r == 0 && res.returned.size() == stripes.size();
+  for (auto &&stripe: stripes) {
+    if (!ok)
+      break;
+    ceph_assert(res.returned.front().get<0>() == stripe.first);
+    auto &chunks = result[stripe.first];
+    for (auto &&i: res.returned.front().get<2>()) {
+      chunks[i.first.shard].claim(i.second);
+    }
+    res.returned.pop_front();
+
+    set<int> want(stripe.second);
+    for (unsigned i = ec_impl->get_data_chunk_count();
+	 i < ec_impl->get_chunk_count();
+	 ++i) {
+      want.insert(i);
+    }
+    for (auto i: want) {
+      auto c = chunks.find(i);
+      if (c == chunks.end() || c->second.length() != sinfo.get_chunk_size()) {
+	ok = false;
+	break;
+      }
+    }
+  }
+  if (!ok) {
+    dout(10) << __func__ << ": " << hoid << " r=" << res.r
+	     << " errors=" << res.errors << dendl;
+    op->delta_read_failed = true;
+  }
+  if (op->delta_reads_pending)
+    return;
+
+  if (op->delta_read_failed) {
+    // the op keeps its delta_write hold, the cache has not seen any of
+    // these stripes
+    dout(10) << __func__ << ": falling back to full stripe reads for "
+	     << *op << dendl;
+    op->delta_read_result.clear();
+    op->plan.revert_delta_stripes(sinfo);
+    op->remote_read = op->plan.to_read;
+    objects_read_async_no_cache(
+      op->remote_read,
+      [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
+	for (auto &&i: results) {
+	  op->remote_read_result.emplace(i.first, i.second.second);
+	}
+	check_ops();
+      });
+    return;
+  }
+  check_ops();
+}
+
+void ECBackend::invalidate_retained_stripes(const Op &op)
+{
+  if (!op.plan.t || !cache.get_retained_bytes())
+    return;
+  if (op.invalidates_cache()) {
+    // clones and renames, not worth tracking which objects are affected
+    cache.clear_retained();
+    return;
+  }
+  for (auto &&i : op.plan.t->op_map) {
+    if (!op.using_cache || !i.second.is_none() || i.second.truncate) {
+      dout(20) << __func__ << ": dropping " << i.first << dendl;
+      cache.invalidate_retained(i.first);
+    }
+  }
+}
+
 bool ECBackend::try_state_to_reads()
 {
   if (waiting_state.empty())
     return false;
 
   Op *op = &(waiting_state.front());
+  for (auto &&hpair: op->plan.will_write) {
+    if (delta_writes_in_flight.count(hpair.first)) {
+      dout(20) << __func__ << ": blocking " << *op
+	       << " behind a delta write to " << hpair.first
+	       << dendl;
+      return false;
+    }
+  }
+
+  if (!op->plan.delta_stripes.empty() && !can_write_delta(*op)) {
+    dout(20) << __func__ << ": no delta write for " << *op << dendl;
+    op->plan.revert_delta_stripes(sinfo);
+  }
+
   if (op->requires_rmw() && pipeline_state.cache_invalid()) {
     ceph_assert(get_parent()->get_pool().allows_ecoverwrites());
     dout(20) << __func__ << ": blocking " << *op
@@ -1879,6 +2097,19 @@ bool ECBackend::try_state_to_reads()
   waiting_state.pop_front();
   waiting_reads.push_back(*op);
 
+  if (!op->plan.delta_stripes.empty()) {
+    op->using_cache = false;
+    invalidate_retained_stripes(*op);
+    op->delta_write = true;
+    for (auto &&hpair: op->plan.will_write) {
+      ++delta_writes_in_flight[hpair.first];
+    }
+    dout(10) << __func__ << ": delta write " << *op << dendl;
+    start_delta_reads(op);
+    return true;
+  }
+
+  invalidate_retained_stripes(*op);
   if (op->using_cache) {
     cache.open_write_pin(op->pin);
 
@@ -1975,6 +2206,7 @@ bool ECBackend::try_reads_to_commit()
       get_parent()->get_info().pgid.pgid,
       sinfo,
       op->remote_read_result,
+      op->delta_read_result,
       op->log_entries,
       &written,
       &trans,
@@ -2013,6 +2245,7 @@ bool ECBackend::try_reads_to_commit()
   }
   op->remote_read.clear();
   op->remote_read_result.clear();
+  op->delta_read_result.clear();
 
   ObjectStore::Transaction empty;
   bool should_write_local = false;
@@ -2122,6 +2355,16 @@ bool ECBackend::try_finish_rmw()
   if (op->using_cache) {
     cache.release_write_pin(op->pin);
   }
+  // ops ahead of this one may have retained stripes it overwrote
+  invalidate_retained_stripes(*op);
+  if (op->delta_write) {
+    for (auto &&hpair: op->plan.will_write) {
+      auto p = delta_writes_in_flight.find(hpair.first);
+      ceph_assert(p != delta_writes_in_flight.end());
+      if (--p->second == 0)
+	delta_writes_in_flight.erase(p);
+    }
+  }
   tid_to_op_map.erase(op->tid);
 
   if (waiting_reads.empty() &&
@@ -2507,7 +2750,8 @@ int ECBackend::be_deep_scrub(
     return 0;
   }
   if (r > 0) {
-    pos.data_hash << bl;
+    pos.data_hash = bufferhash(
+      be_scrub_crc32c(pos.data_hash.digest(), bl));
   }
   pos.data_pos += r;
   if (r == (int)stride) {
@@ -475,18 +475,30 @@ public:
     set<hobject_t> temp_cleared;
 
     ECTransaction::WritePlan plan;
-    bool requires_rmw() const { return !plan.to_read.empty(); }
+    bool requires_rmw() const {
+      return !plan.to_read.empty() || !plan.delta_stripes.empty();
+    }
     bool invalidates_cache() const { return plan.invalidates_cache; }
 
     // must be true if requires_rmw(), must be false if invalidates_cache()
+    // or delta_write
     bool using_cache = true;
 
     /// In progress read state;
     map<hobject_t,extent_set> pending_read; // subset already being read
     map<hobject_t,extent_set> remote_read;  // subset we must read
     map<hobject_t,extent_map> remote_read_result;
+
+    /// Parity delta state, @see start_delta_reads
+    bool delta_write = false;  // holds delta_writes_in_flight
+    unsigned delta_reads_pending = 0;
+    bool delta_read_failed = false;
+    /// object -> stripe offset -> shard -> chunk
+    map<hobject_t,map<uint64_t,map<int,bufferlist>>> delta_read_result;
+
     bool read_in_progress() const {
-      return !remote_read.empty() && remote_read_result.empty();
+      return delta_reads_pending ||
+	(!remote_read.empty() && remote_read_result.empty());
     }
 
     /// In progress write state.
@@ -565,6 +577,33 @@ public:
   eversion_t completed_to;
   eversion_t committed_to;
   void start_rmw(Op *op, PGTransactionUPtr &&t);
+
+  /**
+   * Retained stripes
+   *
+   * With osd_ec_stripe_cache_size set, cache keeps the stripes of
+   * committed writes so that the next rmw on them needn't read them back
+   * from the shards.  Writes which don't go through cache, deletes,
+   * truncates and clones drop what is retained for the objects they
+   * touch, on_change drops everything.
+   */
+  void invalidate_retained_stripes(const Op &op);
+
+  /**
+   * Parity delta writes
+   *
+   * A small overwrite planned with delta_stripes reads the touched data
+   * chunks and the coding chunks straight from the shards, bypassing
+   * the extent cache, and only rewrites those.  Since the cache knows
+   * nothing about these stripes, a delta write is only started when
+   * no other in flight write touches the object, and later writes to
+   * the object wait in waiting_state until it completes.
+   */
+  map<hobject_t, unsigned> delta_writes_in_flight;
+  bool can_write_delta(const Op &op);
+  void start_delta_reads(Op *op);
+  friend struct FinishDeltaRead;
+  void handle_delta_read(Op *op, const hobject_t &hoid, read_result_t &res);
   bool try_state_to_reads();
   bool try_reads_to_commit();
   bool try_finish_rmw();
@@ -100,6 +100,7 @@ void ECTransaction::generate_transactions(
   pg_t pgid,
   const ECUtil::stripe_info_t &sinfo,
   const map<hobject_t,extent_map> &partial_extents,
+  const map<hobject_t,map<uint64_t,map<int,bufferlist>>> &delta_chunks,
   vector<pg_log_entry_t> &entries,
   map<hobject_t,extent_map> *written_map,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -538,6 +539,95 @@ void ECTransaction::generate_transactions(
 			   << dendl;
       }
 
+      auto dsiter = plan.delta_stripes.find(oid);
+      if (dsiter != plan.delta_stripes.end()) {
+	auto dciter = delta_chunks.find(oid);
+	ceph_assert(dciter != delta_chunks.end());
+	const uint64_t chunk_size = sinfo.get_chunk_size();
+	const unsigned k = ecimpl->get_data_chunk_count();
+	for (auto &&stripe: dsiter->second) {
+	  const uint64_t off = stripe.first;
+	  const uint64_t chunk_off =
+	    sinfo.aligned_logical_offset_to_chunk_offset(off);
+	  ceph_assert(off + sinfo.get_stripe_width() <= append_after);
+	  auto updates = to_write.intersect(off, sinfo.get_stripe_width());
+	  to_write.erase(off, sinfo.get_stripe_width());
+	  const auto &old_chunks = dciter->second.at(off);
+	  ldpp_dout(dpp, 20) << __func__ << ": delta update of stripe "
+			     << off << " chunks " << stripe.second
+			     << dendl;
+
+	  if (entry) {
+	    if (rollback_extents.empty()) {
+	      for (auto &&st : *transactions) {
+		st.second.touch(
+		  coll_t(spg_t(pgid, st.first)),
+		  ghobject_t(oid, entry->version.version, st.first));
+	      }
+	    }
+	    rollback_extents.emplace_back(make_pair(chunk_off, chunk_size));
+	    for (auto &&st : *transactions) {
+	      st.second.clone_range(
+		coll_t(spg_t(pgid, st.first)),
+		ghobject_t(oid, ghobject_t::NO_GEN, st.first),
+		ghobject_t(oid, entry->version.version, st.first),
+		chunk_off,
+		chunk_size,
+		chunk_off);
+	    }
+	  }
+
+	  auto copy_chunk = [&](int chunk) {
+	    bufferptr p = buffer::create_page_aligned(chunk_size);
+	    const bufferlist &bl = old_chunks.at(chunk);
+	    ceph_assert(bl.length() == chunk_size);
+	    bl.begin().copy(chunk_size, p.c_str());
+	    return p;
+	  };
+
+	  map<int, bufferptr> deltas;
+	  map<int, bufferptr> new_chunks;
+	  for (int chunk: stripe.second) {
+	    bufferptr old_data = copy_chunk(chunk);
+	    bufferptr new_data = copy_chunk(chunk);
+	    const uint64_t start = off + chunk * chunk_size;
+	    const uint64_t end = start + chunk_size;
+	    for (auto &&u: updates) {
+	      uint64_t lo = std::max(start, u.get_off());
+	      uint64_t hi = std::min(end, u.get_off() + u.get_len());
+	      if (lo >= hi)
+		continue;
+	      auto p = u.get_val().begin();
+	      p.seek(lo - u.get_off());
+	      p.copy(hi - lo, new_data.c_str() + (lo - start));
+	    }
+	    ecimpl->encode_delta(old_data, new_data, &deltas[chunk]);
+	    new_chunks[chunk] = new_data;
+	  }
+	  map<int, bufferptr> parity;
+	  for (unsigned i = k; i < ecimpl->get_chunk_count(); ++i) {
+	    parity[i] = copy_chunk(i);
+	  }
+	  int r = ecimpl->apply_delta(deltas, parity);
+	  ceph_assert(r == 0);
+	  new_chunks.insert(parity.begin(), parity.end());
+
+	  for (auto &&c: new_chunks) {
+	    auto st = transactions->find(shard_id_t(c.first));
+	    ceph_assert(st != transactions->end());
+	    bufferlist bl;
+	    bl.append(c.second);
+	    st->second.write(
+	      coll_t(spg_t(pgid, st->first)),
+	      ghobject_t(oid, ghobject_t::NO_GEN, st->first),
+	      chunk_off,
+	      bl.length(),
+	      bl,
+	      fadvise_flags);
+	  }
+	}
+      }
+
       set<int> want;
       for (unsigned i = 0; i < ecimpl->get_chunk_count(); ++i) {
 	want.insert(i);
@@ -29,19 +29,42 @@ namespace ECTransaction {
     map<hobject_t,extent_set> to_read;
     map<hobject_t,extent_set> will_write; // superset of to_read
 
+    /// partial stripes updated with parity deltas rather than a full
+    /// stripe rmw: stripe offset -> data chunks touched.  disjoint from
+    /// to_read and will_write.
+    map<hobject_t,map<uint64_t,set<int>>> delta_stripes;
+
     map<hobject_t,ECUtil::HashInfoRef> hash_infos;
+
+    /// fall back to reading and rewriting the delta stripes in full
+    void revert_delta_stripes(const ECUtil::stripe_info_t &sinfo) {
+      for (auto &&hpair: delta_stripes) {
+	for (auto &&stripe: hpair.second) {
+	  to_read[hpair.first].union_insert(
+	    stripe.first, sinfo.get_stripe_width());
+	  will_write[hpair.first].union_insert(
+	    stripe.first, sinfo.get_stripe_width());
+	}
+      }
+      delta_stripes.clear();
+    }
   };
 
   bool requires_overwrite(
     uint64_t prev_size,
     const PGTransaction::ObjectOperation &op);
 
+  /**
+   * delta_max_chunks: partial stripe overwrites touching at most this
+   * many data chunks are planned as delta_stripes, 0 disables.
+   */
   template <typename F>
   WritePlan get_write_plan(
     const ECUtil::stripe_info_t &sinfo,
     PGTransactionUPtr &&t,
     F &&get_hinfo,
-    DoutPrefixProvider *dpp) {
+    DoutPrefixProvider *dpp,
+    unsigned delta_max_chunks = 0) {
     WritePlan plan;
     t->safe_create_traverse(
       [&](pair<const hobject_t, PGTransaction::ObjectOperation> &i) {
@@ -162,6 +185,56 @@ namespace ECTransaction {
 	  projected_size = truncating_to;
 	}
 
+	auto to_read_iter = plan.to_read.find(i.first);
+	if (delta_max_chunks &&
+	    to_read_iter != plan.to_read.end() &&
+	    i.second.is_none() &&
+	    !i.second.truncate) {
+	  // every stripe we would have to read must qualify, so that the
+	  // object is either entirely rmw or entirely delta
+	  map<uint64_t, set<int>> touched;
+	  for (auto rextent = to_read_iter->second.begin();
+	       rextent != to_read_iter->second.end();
+	       ++rextent) {
+	    for (uint64_t stripe = rextent.get_start();
+		 stripe < rextent.get_end();
+		 stripe += sinfo.get_stripe_width()) {
+	      extent_set stripe_set, in_stripe;
+	      stripe_set.insert(stripe, sinfo.get_stripe_width());
+	      in_stripe.intersection_of(raw_write_set, stripe_set);
+	      auto &chunks = touched[stripe];
+	      for (auto wextent = in_stripe.begin();
+		   wextent != in_stripe.end();
+		   ++wextent) {
+		for (uint64_t c = (wextent.get_start() - stripe) /
+		       sinfo.get_chunk_size();
+		     c <= (wextent.get_end() - 1 - stripe) /
+		       sinfo.get_chunk_size();
+		     ++c) {
+		  chunks.insert(c);
+		}
+	      }
+	    }
+	  }
+	  bool use_delta = true;
+	  for (auto &&stripe: touched) {
+	    if (stripe.second.empty() ||
+		stripe.second.size() > delta_max_chunks) {
+	      use_delta = false;
+	      break;
+	    }
+	  }
+	  if (use_delta) {
+	    ldpp_dout(dpp, 20) << __func__ << ": delta stripes " << touched
+			       << dendl;
+	    for (auto &&stripe: touched) {
+	      will_write.erase(stripe.first, sinfo.get_stripe_width());
+	    }
+	    plan.to_read.erase(to_read_iter);
+	    plan.delta_stripes[i.first] = std::move(touched);
+	  }
+	}
+
 	ldpp_dout(dpp, 20) << __func__ << ": " << i.first
 			   << " projected size "
 			   << projected_size
@@ -188,6 +261,7 @@ namespace ECTransaction {
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
     const map<hobject_t,extent_map> &partial_extents,
+    const map<hobject_t,map<uint64_t,map<int,bufferlist>>> &delta_chunks,
     vector<pg_log_entry_t> &entries,
     map<hobject_t,extent_map> *written,
     map<shard_id_t, ObjectStore::Transaction> *transactions,
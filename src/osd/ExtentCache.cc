@@ -20,6 +20,7 @@ void ExtentCache::extent::_link_pin_state(pin_state &pin_state)
   ceph_assert(!parent_pin_state);
   parent_pin_state = &pin_state;
   pin_state.pin_list.push_back(*this);
+  pin_state.bytes += length;
 }
 
 void ExtentCache::extent::_unlink_pin_state()
@@ -28,6 +29,8 @@ void ExtentCache::extent::_unlink_pin_state()
   ceph_assert(parent_pin_state);
   auto liter = pin_state::list::s_iterator_to(*this);
   parent_pin_state->pin_list.erase(liter);
+  ceph_assert(parent_pin_state->bytes >= length);
+  parent_pin_state->bytes -= length;
   parent_pin_state = nullptr;
 }
 
@@ -216,6 +219,73 @@ void ExtentCache::present_rmw_update(
   }
 }
 
+void ExtentCache::retain_pin(pin_state &p)
+{
+  for (auto iter = p.pin_list.begin(); iter != p.pin_list.end(); ) {
+    extent *ext = &*iter;
+    iter++; // move will invalidate
+    if (ext->is_pending()) {
+      continue;
+    }
+    ext->bl->reassign_to_mempool(mempool::mempool_osd_ec_cache);
+    ext->move(retained);
+  }
+}
+
+void ExtentCache::trim_retained(uint64_t target)
+{
+  while (retained.bytes > target) {
+    unique_ptr<extent> ext(&retained.pin_list.front());
+    auto &eset = *(ext->parent_extent_set);
+    ext->unlink();
+    remove_and_destroy_if_empty(eset);
+  }
+}
+
+bool ExtentCache::is_retained(
+  const hobject_t &oid,
+  const extent_set &to_check)
+{
+  if (to_check.empty()) {
+    return true;
+  }
+  auto *eset = get_if_exists(oid);
+  if (!eset) {
+    return false;
+  }
+  for (auto &&res: to_check) {
+    uint64_t cur = res.first;
+    auto range = eset->get_containing_range(res.first, res.second);
+    for (auto p = range.first; p != range.second; ++p) {
+      if (p->offset > cur || !p->parent_pin_state->is_retained()) {
+	return false;
+      }
+      cur = p->offset + p->get_length();
+    }
+    if (cur < res.first + res.second) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ExtentCache::invalidate_retained(const hobject_t &oid)
+{
+  auto *eset = get_if_exists(oid);
+  if (!eset) {
+    return;
+  }
+  for (auto p = eset->extent_set.begin(); p != eset->extent_set.end(); ) {
+    extent *ext = &*p;
+    ++p;
+    if (ext->parent_pin_state->is_retained()) {
+      ext->unlink();
+      delete ext;
+    }
+  }
+  remove_and_destroy_if_empty(*eset);
+}
+
 ostream &ExtentCache::print(ostream &out) const
 {
   out << "ExtentCache(" << std::endl;
@@ -228,10 +298,13 @@ ostream &ExtentCache::print(ostream &out) const
 	 ++exiter) {
       out << "    Extent(" << exiter->offset
 	  << "~" << exiter->get_length()
-	  << ":" << exiter->pin_tid()
+	  << ":" << (exiter->parent_pin_state->is_retained() ?
+		     "retained" : std::to_string(exiter->pin_tid()))
 	  << ")" << std::endl;
     }
   }
+  out << "  retained " << retained.bytes << "/" << retain_limit
+      << std::endl;
   return out << ")" << std::endl;
 }
 
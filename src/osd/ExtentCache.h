@@ -25,6 +25,7 @@
 #include "include/interval_set.h"
 #include "common/interval_map.h"
 #include "include/buffer.h"
+#include "include/mempool.h"
 #include "common/hobject.h"
 
 /**
@@ -89,6 +90,17 @@
         state (all are possible).  Reads are not possible
 	in this state (or the others) due to 2).
 
+   3) Retained:
+      - This extent has the committed data of the last write to cover it
+      - No op pins it; it is owned by the cache's retained pin, which
+        keeps extents in lru order and is trimmed to a byte limit
+      - Only kept if set_retain_limit() was given a non-zero limit.  The
+        user must call invalidate_retained()/clear_retained() whenever the
+        object changes behind the cache's back (writes not using the
+        cache, deletes, interval change).
+      - reserve_extents_for_rmw treats it like Write Pinned, so a later
+        rmw covering it need not read it again
+
    All of the above suggests that there are 3 things users can
    ask of the cache corresponding to the 3 Write pipelines
    states.
@@ -351,9 +363,12 @@ private:
     enum pin_type_t {
       NONE,
       WRITE,
+      RETAINED,
     };
     pin_type_t pin_type = NONE;
     bool is_write() const { return pin_type == WRITE; }
+    bool is_retained() const { return pin_type == RETAINED; }
+    uint64_t bytes = 0; ///< sum of the lengths of extents in pin_list
 
     pin_state(const pin_state &other) = delete;
     pin_state &operator=(const pin_state &other) = delete;
@@ -368,6 +383,7 @@ private:
     list pin_list;
     ~pin_state() {
       ceph_assert(pin_list.empty());
+      ceph_assert(bytes == 0);
       ceph_assert(tid == 0);
       ceph_assert(pin_type == NONE);
     }
@@ -392,7 +408,22 @@ private:
     p.pin_type = pin_state::NONE;
   }
 
+  /// committed extents no longer pinned by any op, oldest first
+  pin_state retained;
+  uint64_t retain_limit = 0;
+
+  void retain_pin(pin_state &p);
+  void trim_retained(uint64_t target);
+
 public:
+  ExtentCache() {
+    retained.pin_type = pin_state::RETAINED;
+  }
+  ~ExtentCache() {
+    trim_retained(0);
+    retained.pin_type = pin_state::NONE;
+  }
+
   class write_pin : private pin_state {
     friend class ExtentCache;
   private:
@@ -419,6 +450,7 @@ public:
    * - Empty -> Write Pending pin.reqid
    * - Write Pending N -> Write Pending pin.reqid
    * - Write Pinned N -> Write Pinned pin.reqid
+   * - Retained -> Write Pinned pin.reqid
    *
    * @param oid [in] object undergoing rmw
    * @param pin [in,out] pin to use (obtained from create_write_pin)
@@ -476,10 +508,42 @@ public:
 
   /**
    * Release all buffers pinned by pin
+   *
+   * Buffers with data move to the retained lru if retention is enabled,
+   * after which it is trimmed back to the limit.
    */
   void release_write_pin(
     write_pin &pin) {
+    if (retain_limit) {
+      retain_pin(pin);
+    }
     release_pin(pin);
+    trim_retained(retain_limit);
+  }
+
+  /**
+   * Sets the byte limit for retained extents, 0 disables retention
+   */
+  void set_retain_limit(uint64_t limit) {
+    retain_limit = limit;
+    trim_retained(retain_limit);
+  }
+
+  uint64_t get_retained_bytes() const {
+    return retained.bytes;
+  }
+
+  /// true if every extent in to_check is present in the retained lru
+  bool is_retained(
+    const hobject_t &oid,
+    const extent_set &to_check);
+
+  /// drop retained extents for oid, extents pinned by ops are untouched
+  void invalidate_retained(const hobject_t &oid);
+
+  /// drop all retained extents
+  void clear_retained() {
+    trim_retained(0);
   }
 
   ostream &print(
@@ -21,6 +21,7 @@
 #include <iterator>
 
 #include <unistd.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <signal.h>
 #include <boost/scoped_ptr.hpp>
@@ -1191,7 +1192,8 @@ bool OSDService::inc_scrubs_pending()
   bool result = false;
 
   sched_scrub_lock.Lock();
-  if (scrubs_pending + scrubs_active < cct->_conf->osd_max_scrubs) {
+  if (scrubs_pending + scrubs_active < cct->_conf->osd_max_scrubs &&
+      _get_host_scrub_slot()) {
     dout(20) << "inc_scrubs_pending " << scrubs_pending << " -> " << (scrubs_pending+1)
 	     << " (max " << cct->_conf->osd_max_scrubs << ", active " << scrubs_active << ")" << dendl;
     result = true;
@@ -1211,12 +1213,18 @@ void OSDService::dec_scrubs_pending()
 	   << " (max " << cct->_conf->osd_max_scrubs << ", active " << scrubs_active << ")" << dendl;
   --scrubs_pending;
   ceph_assert(scrubs_pending >= 0);
+  if (scrubs_pending + scrubs_active == 0)
+    _put_host_scrub_slot();
   sched_scrub_lock.Unlock();
 }
 
 void OSDService::inc_scrubs_active(bool reserved)
 {
   sched_scrub_lock.Lock();
+  if (!reserved) {
+    // not reserved means we must scrub, slot or not
+    _get_host_scrub_slot();
+  }
   ++(scrubs_active);
   if (reserved) {
     --(scrubs_pending);
@@ -1239,9 +1247,102 @@ void OSDService::dec_scrubs_active()
 	   << " (max " << cct->_conf->osd_max_scrubs << ", pending " << scrubs_pending << ")" << dendl;
   --scrubs_active;
   ceph_assert(scrubs_active >= 0);
+  if (scrubs_pending + scrubs_active == 0)
+    _put_host_scrub_slot();
   sched_scrub_lock.Unlock();
 }
 
+bool OSDService::_get_host_scrub_slot()
+{
+  ceph_assert(sched_scrub_lock.is_locked_by_me());
+  if (scrub_host_slot_fd >= 0)
+    return true;
+  auto slots = cct->_conf.get_val<uint64_t>("osd_scrub_host_max_scrubs");
+  if (!slots)
+    return true;
+
+  // every osd on the host competes for the same slot files, the kernel
+  // drops our lock if we die.  that only holds for osds sharing the lock
+  // dir, which containers don't do unless it is mounted into each.
+  auto dir = cct->_conf.get_val<std::string>("osd_scrub_host_lock_dir");
+  for (uint64_t i = 0; i < slots; ++i) {
+    string path = dir + "/" + cct->_conf->cluster + "-scrub-slot." +
+      stringify(i);
+    int fd = ::open(path.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, 0600);
+    if (fd < 0) {
+      int r = -errno;
+      derr << __func__ << " unable to open " << path << ": "
+	   << cpp_strerror(r) << ", not limiting scrubs per host" << dendl;
+      return true;
+    }
+    if (::flock(fd, LOCK_EX|LOCK_NB) == 0) {
+      dout(20) << __func__ << " got " << path << dendl;
+      scrub_host_slot_fd = fd;
+      return true;
+    }
+    VOID_TEMP_FAILURE_RETRY(::close(fd));
+  }
+  dout(20) << __func__ << " all " << slots << " host scrub slots are busy"
+	   << dendl;
+  return false;
+}
+
+void OSDService::_put_host_scrub_slot()
+{
+  ceph_assert(sched_scrub_lock.is_locked_by_me());
+  if (scrub_host_slot_fd >= 0) {
+    dout(20) << __func__ << dendl;
+    VOID_TEMP_FAILURE_RETRY(::close(scrub_host_slot_fd));
+    scrub_host_slot_fd = -1;
+  }
+}
+
+void OSDService::update_adaptive_sleeps()
+{
+  uint64_t ops = client_op_count.load();
+  double lat = client_op_lat_avg.load();
+  auto target = cct->_conf.get_val<double>("osd_scrub_client_latency_target");
+  auto max = cct->_conf.get_val<double>("osd_scrub_adaptive_sleep_max");
+  scrub_adaptive_sleep.update(ops, lat, target, max);
+  dout(20) << __func__ << " client latency " << lat
+	   << " scrub target " << target
+	   << " sleep " << scrub_adaptive_sleep.get() << dendl;
+
+  target = cct->_conf.get_val<double>("osd_snap_trim_client_latency_target");
+  max = cct->_conf.get_val<double>("osd_snap_trim_adaptive_sleep_max");
+  snap_trim_adaptive_sleep.update(ops, lat, target, max);
+  dout(20) << __func__ << " snap trim target " << target
+	   << " sleep " << snap_trim_adaptive_sleep.get() << dendl;
+}
+
+double OSDService::get_scrub_sleep()
+{
+  return cct->_conf->osd_scrub_sleep + scrub_adaptive_sleep.get();
+}
+
+double OSDService::get_scrub_chunk_scale()
+{
+  if (cct->_conf.get_val<double>("osd_scrub_client_latency_target") <= 0)
+    return 1;
+  return scrub_adaptive_sleep.get_scale(
+    cct->_conf.get_val<double>("osd_scrub_adaptive_sleep_max"));
+}
+
+double OSDService::get_snap_trim_sleep()
+{
+  if (cct->_conf.get_val<double>("osd_snap_trim_client_latency_target") <= 0)
+    return osd->get_osd_snap_trim_sleep();
+  return snap_trim_adaptive_sleep.get();
+}
+
+double OSDService::get_snap_trim_batch_scale()
+{
+  if (cct->_conf.get_val<double>("osd_snap_trim_client_latency_target") <= 0)
+    return 1;
+  return snap_trim_adaptive_sleep.get_scale(
+    cct->_conf.get_val<double>("osd_snap_trim_adaptive_sleep_max"));
+}
+
 void OSDService::retrieve_epochs(epoch_t *_boot_epoch, epoch_t *_up_epoch,
                                  epoch_t *_bind_epoch) const
 {
@@ -2091,6 +2192,8 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
   asok_hook(NULL),
   m_osd_pg_epoch_max_lag_factor(cct->_conf.get_val<double>(
 				  "osd_pg_epoch_max_lag_factor")),
+  m_osd_op_queue_cost_write_pressure_scale(cct->_conf.get_val<double>(
+    "osd_op_queue_cost_write_pressure_scale")),
   osd_compat(get_osd_compat_set()),
   osd_op_tp(cct, "OSD::osd_op_tp", "tp_osd_tp",
 	    get_num_op_threads()),
@@ -2972,7 +3075,10 @@ int OSD::init()
   if (r < 0)
     goto out;
 
-  mgrc.set_pgstats_cb([this](){ return collect_pg_stats(); });
+  mgrc.set_pgstats_cb([this](bool full){ return collect_pg_stats(full); });
+  mgrc.set_pgstats_ack_cb([this](const MPGStatsAck& m) {
+      handle_pg_stats_ack(m);
+    });
   mgrc.set_perf_metric_query_cb(
     [this](const std::map<OSDPerfMetricQuery, OSDPerfMetricLimits> &queries) {
         set_perf_queries(queries);
@@ -4989,6 +5095,8 @@ void OSD::tick_without_osd_lock()
   ceph_assert(r == 0);
   service.set_statfs(stbuf, alerts);
 
+  service.update_adaptive_sleeps();
+
   // osd_lock is not being held, which means the OSD state
   // might change when doing the monitor report
   if (is_active() || is_waiting_for_healthy()) {
@@ -7385,14 +7493,29 @@ void OSD::resched_all_scrubs()
   dout(10) << __func__ << ": done" << dendl;
 }
 
-MPGStats* OSD::collect_pg_stats()
+MPGStats* OSD::collect_pg_stats(bool full)
 {
-  // This implementation unconditionally sends every is_primary PG's
-  // stats every time we're called.  This has equivalent cost to the
-  // previous implementation's worst case where all PGs are busy and
-  // their stats are always enqueued for sending.
+  // PGs whose current stats the mgr has acknowledged on this session
+  // are left out; the mgr keeps what it already has for them.  Anything
+  // sent but not acknowledged yet, or dropped by the mgr (e.g. a pg of a
+  // pool it did not know about yet), goes out again in the next report.
+  // A complete report goes out on every new session, until the mgr acks
+  // one, and every osd_pg_stats_full_report_interval reports.  A mgr that
+  // predates MPGStatsAck never acks, so it only ever gets full reports.
   RWLock::RLocker l(map_lock);
 
+  if (full) {
+    pg_stats_acked.clear();
+  }
+  auto full_interval =
+    cct->_conf.get_val<uint64_t>("osd_pg_stats_full_report_interval");
+  if (full || full_interval == 0 ||
+      ++pg_stats_reports_since_full >= full_interval) {
+    full = true;
+    pg_stats_reports_since_full = 0;
+  }
+  std::set<pg_t> reported;
+
   osd_stat_t cur_stat = service.get_osd_stat();
   cur_stat.os_perf_stat = store->get_cur_stats();
 
@@ -7413,7 +7536,11 @@ MPGStats* OSD::collect_pg_stats()
       continue;
     }
     pg->get_pg_stats([&](const pg_stat_t& s, epoch_t lec) {
-	m->pg_stat[pg->pg_id.pgid] = s;
+	const pg_t& pgid = pg->pg_id.pgid;
+	reported.insert(pgid);
+	if (full || pg_stats_acked.need_report(pgid, s.get_version_pair())) {
+	  m->pg_stat[pgid] = s;
+	}
 	min_last_epoch_clean = min(min_last_epoch_clean, lec);
 	min_last_epoch_clean_pgs.push_back(pg->pg_id.pgid);
       });
@@ -7435,9 +7562,18 @@ MPGStats* OSD::collect_pg_stats()
   m->osd_stat.num_osds = 1;
   m->osd_stat.num_per_pool_osds = per_pool_stats ? 1 : 0;
 
+  dout(20) << __func__ << (full ? " full" : " incremental") << " report of "
+	   << m->pg_stat.size() << "/" << reported.size() << " pgs" << dendl;
+  pg_stats_acked.prune(reported);
   return m;
 }
 
+void OSD::handle_pg_stats_ack(const MPGStatsAck& m)
+{
+  dout(20) << __func__ << " " << m << dendl;
+  pg_stats_acked.ack(m.pg_stat);
+}
+
 vector<DaemonHealthMetric> OSD::get_health_metrics()
 {
   vector<DaemonHealthMetric> metrics;
@@ -7751,7 +7887,20 @@ void OSD::handle_osd_map(MOSDMap *m)
       t.write(coll_t::meta(), oid, 0, bl.length(), bl);
 
       OSDMap *o = new OSDMap;
-      if (e > 1) {
+      OSDMapRef prev;
+      if (e > 1 && cct->_conf->osd_map_dedup) {
+	auto q = added_maps.find(e - 1);
+	if (q != added_maps.end()) {
+	  prev = q->second;
+	} else if (osdmap && osdmap->get_epoch() == e - 1) {
+	  prev = osdmap;
+	}
+      }
+      if (prev) {
+	// share the unchanged tables with the previous epoch;
+	// apply_incremental clones whatever it modifies.
+	o->shared_copy_from(*prev);
+      } else if (e > 1) {
 	bufferlist obl;
         bool got = get_map_bl(e - 1, obl);
 	if (!got) {
@@ -9492,9 +9641,29 @@ void OSD::enqueue_op(spg_t pg, OpRequestRef&& op, epoch_t epoch)
   const utime_t stamp = op->get_req()->get_recv_stamp();
   const utime_t latency = ceph_clock_now() - stamp;
   const unsigned priority = op->get_req()->get_priority();
-  const int cost = op->get_req()->get_cost();
+  int cost = op->get_req()->get_cost();
   const uint64_t owner = op->get_req()->get_source().num();
 
+  // writes cost more while the store backs up, so the queue lets other
+  // work through before the store has to stall
+  const double pressure_scale = m_osd_op_queue_cost_write_pressure_scale;
+  if (pressure_scale > 0) {
+    const Message *m = op->get_req();
+    bool write = false;
+    switch (m->get_type()) {
+    case CEPH_MSG_OSD_OP:
+      write = static_cast<const MOSDOp*>(m)->get_flags() & CEPH_OSD_FLAG_WRITE;
+      break;
+    case MSG_OSD_REPOP:
+    case MSG_OSD_EC_WRITE:
+      write = true;
+      break;
+    }
+    if (write) {
+      cost = write_op_cost(cost, pressure_scale, store->get_write_pressure());
+    }
+  }
+
   dout(15) << "enqueue_op " << op << " prio " << priority
 	   << " cost " << cost
 	   << " latency " << latency
@@ -9671,6 +9840,7 @@ const char** OSD::get_tracked_conf_keys() const
     "osd_object_clean_region_max_num_intervals",
     "osd_scrub_min_interval",
     "osd_scrub_max_interval",
+    "osd_op_queue_cost_write_pressure_scale",
     NULL
   };
   return KEYS;
@@ -9729,6 +9899,10 @@ void OSD::handle_conf_change(const ConfigProxy& conf,
     m_osd_pg_epoch_max_lag_factor = conf.get_val<double>(
       "osd_pg_epoch_max_lag_factor");
   }
+  if (changed.count("osd_op_queue_cost_write_pressure_scale")) {
+    m_osd_op_queue_cost_write_pressure_scale = conf.get_val<double>(
+      "osd_op_queue_cost_write_pressure_scale");
+  }
 
 #ifdef HAVE_LIBFUSE
   if (changed.count("osd_objectstore_fuse")) {
@@ -10070,6 +10244,39 @@ void OSD::get_perf_reports(
 #undef dout_prefix
 #define dout_prefix *_dout << "osd." << osd->get_nodeid() << ":" << shard_id << "." << __func__ << " "
 
+unsigned OSDShard::_drain_ingress(unsigned cutoff)
+{
+  ceph_assert(ceph_mutex_is_locked_by_me(shard_lock));
+  auto i = ingress.exchange(nullptr, std::memory_order_acquire);
+  if (!i) {
+    return 0;
+  }
+  // the stack is newest-first
+  ingress_item_t *fifo = nullptr;
+  while (i) {
+    auto next = i->next;
+    i->next = fifo;
+    fifo = i;
+    i = next;
+  }
+  unsigned n = 0;
+  while (fifo) {
+    auto next = fifo->next;
+    unsigned priority = fifo->item.get_priority();
+    unsigned cost = fifo->item.get_cost();
+    if (priority >= cutoff)
+      pqueue->enqueue_strict(
+	fifo->item.get_owner(), priority, std::move(fifo->item));
+    else
+      pqueue->enqueue(
+	fifo->item.get_owner(), priority, cost, std::move(fifo->item));
+    delete fifo;
+    fifo = next;
+    ++n;
+  }
+  return n;
+}
+
 void OSDShard::_attach_pg(OSDShardPGSlot *slot, PG *pg)
 {
   dout(10) << pg->pg_id << " " << pg << dendl;
@@ -10504,12 +10711,17 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
 
   // peek at spg_t
   sdata->shard_lock.lock();
+  _drain_shard_ingress(sdata);
   if (sdata->pqueue->empty() &&
       (!is_smallest_thread_index || sdata->context_queue.empty())) {
     std::unique_lock wait_lock{sdata->sdata_wait_lock};
     if (is_smallest_thread_index && !sdata->context_queue.empty()) {
       // we raced with a context_queue addition, don't wait
       wait_lock.unlock();
+    } else if (!sdata->ingress_empty()) {
+      // we raced with an enqueue, don't wait
+      wait_lock.unlock();
+      _drain_shard_ingress(sdata);
     } else if (!sdata->stop_waiting) {
       dout(20) << __func__ << " empty q, waiting" << dendl;
       osd->cct->get_heartbeat_map()->clear_timeout(hb);
@@ -10517,6 +10729,7 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
       sdata->sdata_cond.wait(wait_lock);
       wait_lock.unlock();
       sdata->shard_lock.lock();
+      _drain_shard_ingress(sdata);
       if (sdata->pqueue->empty() &&
          !(is_smallest_thread_index && !sdata->context_queue.empty())) {
 	sdata->shard_lock.unlock();
@@ -10784,27 +10997,28 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
   handle_oncommits(oncommits);
 }
 
+void OSD::ShardedOpWQ::_drain_shard_ingress(OSDShard *sdata)
+{
+  unsigned n = sdata->_drain_ingress(osd->op_prio_cutoff);
+  if (n > 1) {
+    // the producers coalesced their wakeups; hand the rest of the batch
+    // to another worker on this shard.
+    dout(20) << __func__ << " drained " << n << dendl;
+    std::lock_guard l{sdata->sdata_wait_lock};
+    sdata->sdata_cond.notify_one();
+  }
+}
+
 void OSD::ShardedOpWQ::_enqueue(OpQueueItem&& item) {
   uint32_t shard_index =
     item.get_ordering_token().hash_to_shard(osd->shards.size());
 
   OSDShard* sdata = osd->shards[shard_index];
   assert (NULL != sdata);
-  unsigned priority = item.get_priority();
-  unsigned cost = item.get_cost();
-  sdata->shard_lock.lock();
-
   dout(20) << __func__ << " " << item << dendl;
-  bool empty = sdata->pqueue->empty();
-  if (priority >= osd->op_prio_cutoff)
-    sdata->pqueue->enqueue_strict(
-      item.get_owner(), priority, std::move(item));
-  else
-    sdata->pqueue->enqueue(
-      item.get_owner(), priority, cost, std::move(item));
-  sdata->shard_lock.unlock();
-
-  if (empty) {
+  // only the push that finds the ingress empty wakes a worker; whoever
+  // drains it picks up everything pushed behind it.
+  if (sdata->push_ingress(std::move(item))) {
     std::lock_guard l{sdata->sdata_wait_lock};
     sdata->sdata_cond.notify_one();
   }
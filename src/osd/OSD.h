@@ -102,9 +102,92 @@ class MOSDPGInfo;
 class MOSDPGRemove;
 class MOSDForceRecovery;
 class MMonGetPurgedSnapsReply;
+class MPGStatsAck;
 
 class OSD;
 
+/**
+ * AdaptiveSleep
+ *
+ * Backs background work off while client ops are slow.  update() is
+ * called once per OSD tick: the sleep doubles (up to max) while the
+ * average client op latency is above target, and halves back towards
+ * zero while it is below or no client op completed since the last tick.
+ * Callers only read the current value.
+ */
+class AdaptiveSleep {
+  std::atomic<double> sleep = {0};
+  uint64_t last_ops = 0;  ///< client op count at the last update
+public:
+  void update(uint64_t ops, double lat, double target, double max) {
+    // no client op since the last tick counts as idle
+    if (ops == last_ops)
+      lat = 0;
+    last_ops = ops;
+    double cur = sleep;
+    if (target <= 0 || max <= 0) {
+      cur = 0;
+    } else if (lat > target) {
+      cur = std::min(max, std::max(cur * 2, max / 64));
+    } else {
+      cur /= 2;
+      if (cur < max / 64)
+	cur = 0;
+    }
+    sleep = cur;
+  }
+  double get() const {
+    return sleep;
+  }
+  /// 1 while not sleeping, shrinking to 0 as the sleep reaches max
+  double get_scale(double max) const {
+    if (max <= 0)
+      return 1;
+    return 1.0 - std::min(get() / max, 1.0);
+  }
+};
+
+/**
+ * PGStatsAcks
+ *
+ * Versions (reported_epoch, reported_seq) of the pg stats the mgr has
+ * acknowledged on the current session.  A primary pg is left out of a
+ * report only while the mgr has confirmed its current version, so stats
+ * that were sent but dropped or lost are sent again.
+ */
+class PGStatsAcks {
+  std::map<pg_t, std::pair<epoch_t, version_t>> acked;
+public:
+  void clear() {
+    acked.clear();
+  }
+  size_t size() const {
+    return acked.size();
+  }
+  /// true unless the mgr has acknowledged version v of pgid
+  bool need_report(const pg_t& pgid,
+		   const std::pair<epoch_t, version_t>& v) const {
+    auto p = acked.find(pgid);
+    return p == acked.end() || p->second != v;
+  }
+  /// record an MPGStatsAck, which lists (reported_seq, reported_epoch)
+  void ack(const std::map<pg_t, std::pair<version_t, epoch_t>>& pg_stat) {
+    for (auto& [pgid, v] : pg_stat) {
+      acked[pgid] = std::make_pair(v.second, v.first);
+    }
+  }
+  /// forget the pgs this osd no longer reports
+  void prune(const std::set<pg_t>& reported) {
+    for (auto p = acked.begin(); p != acked.end(); ) {
+      if (reported.count(p->first)) {
+	++p;
+      } else {
+	p = acked.erase(p);
+      }
+    }
+  }
+};
+
 class OSDService {
 public:
   OSD *osd;
@@ -277,6 +360,17 @@ private:
   int scrubs_pending;
   int scrubs_active;
 
+  // -- scrub throttling --
+  /// ewma of client op latency, updated racily from log_op_stats
+  std::atomic<double> client_op_lat_avg = {0};
+  std::atomic<uint64_t> client_op_count = {0};
+  /// added to osd_scrub_sleep while clients are slow
+  AdaptiveSleep scrub_adaptive_sleep;
+  /// flock'ed host scrub slot held while scrubbing, sched_scrub_lock
+  int scrub_host_slot_fd = -1;
+  bool _get_host_scrub_slot();
+  void _put_host_scrub_slot();
+
 public:
   struct ScrubJob {
     CephContext* cct;
@@ -356,6 +450,19 @@ public:
   void dec_scrubs_pending();
   void dec_scrubs_active();
 
+  void record_client_op_latency(const utime_t &lat) {
+    double avg = client_op_lat_avg.load(std::memory_order_relaxed);
+    client_op_lat_avg.store(avg + ((double)lat - avg) / 16,
+			    std::memory_order_relaxed);
+    client_op_count.fetch_add(1, std::memory_order_relaxed);
+  }
+  /// step the adaptive sleeps, once per tick
+  void update_adaptive_sleeps();
+  /// delay before the next scrub chunk, adapted to client op latency
+  double get_scrub_sleep();
+  /// fraction of osd_scrub_chunk_max to use, shrinks with the adaptive sleep
+  double get_scrub_chunk_scale();
+
   void reply_op_error(OpRequestRef op, int err);
   void reply_op_error(OpRequestRef op, int err, eversion_t v, version_t uv);
   void handle_misdirected_op(PG *pg, OpRequestRef op);
@@ -538,6 +645,16 @@ public:
   Mutex sleep_lock;
   SafeTimer sleep_timer;
 
+  // -- snap trim throttling --
+private:
+  /// snap trim sleep while adapting to client latency
+  AdaptiveSleep snap_trim_adaptive_sleep;
+public:
+  /// delay before the next snap trim batch
+  double get_snap_trim_sleep();
+  /// fraction of osd_snap_trim_batch_objects to use, shrinks with the sleep
+  double get_snap_trim_batch_scale();
+
   // -- tids --
   // for ops i issue
   std::atomic<unsigned int> last_tid{0};
@@ -1022,6 +1139,38 @@ struct OSDShard {
 
   ContextQueue context_queue;
 
+  /**
+   * lock-free ingress for new items
+   *
+   * Producers push onto a singly linked stack without taking shard_lock.
+   * Workers take the whole stack at once under shard_lock and move it
+   * into pqueue oldest-first, so items from a single producer (and hence
+   * for a single spg_t from a single connection) keep their order, and
+   * everything in the ingress is newer than anything already in pqueue.
+   */
+  struct ingress_item_t {
+    OpQueueItem item;
+    ingress_item_t *next = nullptr;
+    explicit ingress_item_t(OpQueueItem&& i) : item(std::move(i)) {}
+  };
+  std::atomic<ingress_item_t*> ingress = {nullptr};
+
+  /// returns true if the ingress was empty, i.e. a worker should be woken
+  bool push_ingress(OpQueueItem&& item) {
+    auto i = new ingress_item_t(std::move(item));
+    i->next = ingress.load(std::memory_order_relaxed);
+    while (!ingress.compare_exchange_weak(i->next, i,
+					  std::memory_order_release,
+					  std::memory_order_relaxed))
+      ;
+    return i->next == nullptr;
+  }
+  bool ingress_empty() const {
+    return ingress.load(std::memory_order_acquire) == nullptr;
+  }
+  /// move everything pushed so far into pqueue; returns the number moved
+  unsigned _drain_ingress(unsigned cutoff);
+
   void _enqueue_front(OpQueueItem&& item, unsigned cutoff) {
     unsigned priority = item.get_priority();
     unsigned cost = item.get_cost();
@@ -1095,6 +1244,14 @@ struct OSDShard {
       pqueue = std::make_unique<ceph::mClockClientQueue>(cct);
     }
   }
+  ~OSDShard() {
+    auto i = ingress.exchange(nullptr);
+    while (i) {
+      auto next = i->next;
+      delete i;
+      i = next;
+    }
+  }
 };
 
 class OSD : public Dispatcher,
@@ -1254,6 +1411,7 @@ private:
 
   // -- config settings --
   float m_osd_pg_epoch_max_lag_factor;
+  std::atomic<double> m_osd_op_queue_cost_write_pressure_scale;
 
   // -- superblock --
   OSDSuperblock superblock;
@@ -1496,6 +1654,7 @@ public:
     explicit HeartbeatDispatcher(OSD *o) : Dispatcher(o->cct), osd(o) {}
 
     bool ms_can_fast_dispatch_any() const override { return true; }
+    bool ms_fast_dispatch_by_type() const override { return true; }
     bool ms_can_fast_dispatch(const Message *m) const override {
       switch (m->get_type()) {
       case CEPH_MSG_PING:
@@ -1552,13 +1711,15 @@ protected:
   /*
    * The ordered op delivery chain is:
    *
-   *   fast dispatch -> pqueue back
-   *                    pqueue front <-> to_process back
-   *                                     to_process front  -> RunVis(item)
-   *                                                      <- queue_front()
+   *   fast dispatch -> ingress -> pqueue back
+   *                               pqueue front <-> to_process back
+   *                                                to_process front  -> RunVis(item)
+   *                                                                 <- queue_front()
    *
-   * The pqueue is per-shard, and to_process is per pg_slot.  Items can be
-   * pushed back up into to_process and/or pqueue while order is preserved.
+   * The ingress and pqueue are per-shard, and to_process is per pg_slot.
+   * The ingress is drained into pqueue before pqueue is looked at.  Items
+   * can be pushed back up into to_process and/or pqueue while order is
+   * preserved.
    *
    * Multiple worker threads can operate on each shard.
    *
@@ -1593,6 +1754,9 @@ protected:
       OSDShardPGSlot *slot,
       OpQueueItem&& qi);
 
+    /// move a shard's ingress into its pqueue; requires shard_lock
+    void _drain_shard_ingress(OSDShard *sdata);
+
     /// try to do some work
     void _process(uint32_t thread_index, heartbeat_handle_d *hb) override;
 
@@ -1630,6 +1794,7 @@ protected:
 	ceph_assert(NULL != sdata);
 
 	std::scoped_lock l{sdata->shard_lock};
+	sdata->_drain_ingress(osd->op_prio_cutoff);
 	f->open_object_section(queue_name);
 	sdata->pqueue->dump(f);
 	f->close_section();
@@ -1641,6 +1806,9 @@ protected:
       auto &&sdata = osd->shards[shard_index];
       ceph_assert(sdata);
       std::lock_guard l(sdata->shard_lock);
+      if (!sdata->ingress_empty()) {
+	return false;
+      }
       if (thread_index < osd->num_shards) {
 	return sdata->pqueue->empty() && sdata->context_queue.empty();
       } else {
@@ -1996,12 +2164,19 @@ protected:
   bool scrub_time_permit(utime_t now);
 
   // -- status reporting --
-  MPGStats *collect_pg_stats();
+  // only touched by collect_pg_stats() and handle_pg_stats_ack(), which
+  // MgrClient serializes
+  PGStatsAcks pg_stats_acked;
+  uint64_t pg_stats_reports_since_full = 0;
+
+  MPGStats *collect_pg_stats(bool full);
+  void handle_pg_stats_ack(const MPGStatsAck& m);
   std::vector<DaemonHealthMetric> get_health_metrics();
 
 
 private:
   bool ms_can_fast_dispatch_any() const override { return true; }
+  bool ms_fast_dispatch_by_type() const override { return true; }
   bool ms_can_fast_dispatch(const Message *m) const override {
     switch (m->get_type()) {
     case CEPH_MSG_PING:
@@ -2168,6 +2343,15 @@ public:
   /// check if we can throw out op from a disconnected client
   static bool op_is_discardable(const MOSDOp *m);
 
+public:
+  /// queue cost of a write op under the object store's write pressure
+  static int write_op_cost(int cost, double scale, double pressure) {
+    if (scale > 0 && pressure > 0) {
+      cost *= 1.0 + scale * pressure;
+    }
+    return cost;
+  }
+
 public:
   OSDService service;
   friend class OSDService;
@@ -1332,6 +1332,28 @@ void OSDMap::get_blacklist(std::set<entity_addr_t> *bl) const
   }
 }
 
+void OSDMap::_drop_shared_tables()
+{
+  if (osd_addrs.use_count() > 1)
+    osd_addrs = std::make_shared<addrs_s>();
+  if (pg_temp.use_count() > 1)
+    pg_temp = std::make_shared<PGTempMap>();
+  if (primary_temp.use_count() > 1)
+    primary_temp = std::make_shared<mempool::osdmap::map<pg_t,int32_t>>();
+  if (osd_primary_affinity.use_count() > 1)
+    osd_primary_affinity.reset();
+  if (pg_upmap.use_count() > 1)
+    pg_upmap = std::make_shared<
+      mempool::osdmap::map<pg_t,mempool::osdmap::vector<int32_t>>>();
+  if (pg_upmap_items.use_count() > 1)
+    pg_upmap_items = std::make_shared<
+      mempool::osdmap::map<pg_t,mempool::osdmap::vector<std::pair<int32_t,int32_t>>>>();
+  if (osd_uuid.use_count() > 1)
+    osd_uuid = std::make_shared<mempool::osdmap::vector<uuid_d>>();
+  if (crush.use_count() > 1)
+    crush = std::make_shared<CrushWrapper>();
+}
+
 void OSDMap::set_max_osd(int m)
 {
   int o = max_osd;
@@ -1344,6 +1366,9 @@ void OSDMap::set_max_osd(int m)
   }
   osd_info.resize(m);
   osd_xinfo.resize(m);
+  _unshare(osd_addrs);
+  _unshare(osd_uuid);
+  _unshare(osd_primary_affinity);
   osd_addrs->client_addrs.resize(m);
   osd_addrs->cluster_addrs.resize(m);
   osd_addrs->hb_back_addrs.resize(m);
@@ -1543,7 +1568,7 @@ uint64_t OSDMap::get_features(int entity_type, uint64_t *pmask) const
   }
   mask |= CEPH_FEATURES_CRUSH;
 
-  if (!pg_upmap.empty() || !pg_upmap_items.empty())
+  if (!pg_upmap->empty() || !pg_upmap_items->empty())
     features |= CEPH_FEATUREMASK_OSDMAP_PG_UPMAP;
   mask |= CEPH_FEATUREMASK_OSDMAP_PG_UPMAP;
 
@@ -1674,44 +1699,48 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
   if (o->epoch == n->epoch)
     return;
 
-  int diff = 0;
-
-  // do addrs match?
-  if (o->max_osd != n->max_osd)
-    diff++;
-  for (int i = 0; i < o->max_osd && i < n->max_osd; i++) {
-    if ( n->osd_addrs->client_addrs[i] &&  o->osd_addrs->client_addrs[i] &&
-	*n->osd_addrs->client_addrs[i] == *o->osd_addrs->client_addrs[i])
-      n->osd_addrs->client_addrs[i] = o->osd_addrs->client_addrs[i];
-    else
-      diff++;
-    if ( n->osd_addrs->cluster_addrs[i] &&  o->osd_addrs->cluster_addrs[i] &&
-	*n->osd_addrs->cluster_addrs[i] == *o->osd_addrs->cluster_addrs[i])
-      n->osd_addrs->cluster_addrs[i] = o->osd_addrs->cluster_addrs[i];
-    else
+  // do addrs match?  leave the entries alone if n still shares its
+  // table with some map.
+  if (o->osd_addrs != n->osd_addrs && n->osd_addrs.use_count() == 1) {
+    int diff = 0;
+    if (o->max_osd != n->max_osd)
       diff++;
-    if ( n->osd_addrs->hb_back_addrs[i] &&  o->osd_addrs->hb_back_addrs[i] &&
-	*n->osd_addrs->hb_back_addrs[i] == *o->osd_addrs->hb_back_addrs[i])
-      n->osd_addrs->hb_back_addrs[i] = o->osd_addrs->hb_back_addrs[i];
-    else
-      diff++;
-    if ( n->osd_addrs->hb_front_addrs[i] &&  o->osd_addrs->hb_front_addrs[i] &&
-	*n->osd_addrs->hb_front_addrs[i] == *o->osd_addrs->hb_front_addrs[i])
-      n->osd_addrs->hb_front_addrs[i] = o->osd_addrs->hb_front_addrs[i];
-    else
-      diff++;
-  }
-  if (diff == 0) {
-    // zoinks, no differences at all!
-    n->osd_addrs = o->osd_addrs;
+    for (int i = 0; i < o->max_osd && i < n->max_osd; i++) {
+      if ( n->osd_addrs->client_addrs[i] &&  o->osd_addrs->client_addrs[i] &&
+	  *n->osd_addrs->client_addrs[i] == *o->osd_addrs->client_addrs[i])
+	n->osd_addrs->client_addrs[i] = o->osd_addrs->client_addrs[i];
+      else
+	diff++;
+      if ( n->osd_addrs->cluster_addrs[i] &&  o->osd_addrs->cluster_addrs[i] &&
+	  *n->osd_addrs->cluster_addrs[i] == *o->osd_addrs->cluster_addrs[i])
+	n->osd_addrs->cluster_addrs[i] = o->osd_addrs->cluster_addrs[i];
+      else
+	diff++;
+      if ( n->osd_addrs->hb_back_addrs[i] &&  o->osd_addrs->hb_back_addrs[i] &&
+	  *n->osd_addrs->hb_back_addrs[i] == *o->osd_addrs->hb_back_addrs[i])
+	n->osd_addrs->hb_back_addrs[i] = o->osd_addrs->hb_back_addrs[i];
+      else
+	diff++;
+      if ( n->osd_addrs->hb_front_addrs[i] &&  o->osd_addrs->hb_front_addrs[i] &&
+	  *n->osd_addrs->hb_front_addrs[i] == *o->osd_addrs->hb_front_addrs[i])
+	n->osd_addrs->hb_front_addrs[i] = o->osd_addrs->hb_front_addrs[i];
+      else
+	diff++;
+    }
+    if (diff == 0) {
+      // zoinks, no differences at all!
+      n->osd_addrs = o->osd_addrs;
+    }
   }
 
-  // does crush match?
-  ceph::buffer::list oc, nc;
-  encode(*o->crush, oc, CEPH_FEATURES_SUPPORTED_DEFAULT);
-  encode(*n->crush, nc, CEPH_FEATURES_SUPPORTED_DEFAULT);
-  if (oc.contents_equal(nc)) {
-    n->crush = o->crush;
+  // does crush match?  (skip the encode if it is already shared)
+  if (o->crush != n->crush) {
+    ceph::buffer::list oc, nc;
+    encode(*o->crush, oc, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    encode(*n->crush, nc, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    if (oc.contents_equal(nc)) {
+      n->crush = o->crush;
+    }
   }
 
   // does pg_temp match?
@@ -1728,6 +1757,19 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
   if (o->osd_uuid->size() == n->osd_uuid->size() &&
       *o->osd_uuid == *n->osd_uuid)
     n->osd_uuid = o->osd_uuid;
+
+  // do primary affinities match?
+  if (o->osd_primary_affinity && n->osd_primary_affinity &&
+      *o->osd_primary_affinity == *n->osd_primary_affinity)
+    n->osd_primary_affinity = o->osd_primary_affinity;
+
+  // do upmaps match?
+  if (o->pg_upmap->size() == n->pg_upmap->size() &&
+      *o->pg_upmap == *n->pg_upmap)
+    n->pg_upmap = o->pg_upmap;
+  if (o->pg_upmap_items->size() == n->pg_upmap_items->size() &&
+      *o->pg_upmap_items == *n->pg_upmap_items)
+    n->pg_upmap_items = o->pg_upmap_items;
 }
 
 void OSDMap::clean_temps(CephContext *cct,
@@ -1813,10 +1855,10 @@ void OSDMap::clean_temps(CephContext *cct,
 
 void OSDMap::get_upmap_pgs(vector<pg_t> *upmap_pgs) const
 {
-  upmap_pgs->reserve(pg_upmap.size() + pg_upmap_items.size());
-  for (auto& p : pg_upmap)
+  upmap_pgs->reserve(pg_upmap->size() + pg_upmap_items->size());
+  for (auto& p : *pg_upmap)
     upmap_pgs->push_back(p.first);
-  for (auto& p : pg_upmap_items)
+  for (auto& p : *pg_upmap_items)
     upmap_pgs->push_back(p.first);
 }
 
@@ -1844,16 +1886,16 @@ bool OSDMap::check_pg_upmaps(
     }
     vector<int> raw, up;
     pg_to_raw_upmap(pg, &raw, &up);
-    auto i = pg_upmap.find(pg);
-    if (i != pg_upmap.end() && raw == i->second) {
+    auto i = pg_upmap->find(pg);
+    if (i != pg_upmap->end() && raw == i->second) {
       ldout(cct, 10) << " removing redundant pg_upmap "
                      << i->first << " " << i->second
                      << dendl;
       to_cancel->push_back(pg);
       continue;
     }
-    auto j = pg_upmap_items.find(pg);
-    if (j != pg_upmap_items.end()) {
+    auto j = pg_upmap_items->find(pg);
+    if (j != pg_upmap_items->end()) {
       mempool::osdmap::vector<pair<int,int>> newmap;
       for (auto& p : j->second) {
         if (std::find(raw.begin(), raw.end(), p.first) == raw.end()) {
@@ -1947,8 +1989,8 @@ void OSDMap::clean_pg_upmaps(
                      << dendl;
       pending_inc->new_pg_upmap.erase(i);
     }
-    auto j = pg_upmap.find(pg);
-    if (j != pg_upmap.end()) {
+    auto j = pg_upmap->find(pg);
+    if (j != pg_upmap->end()) {
       ldout(cct, 10) << __func__ << " cancel invalid pg_upmap entry "
                      << j->first << "->" << j->second
                      << dendl;
@@ -1962,8 +2004,8 @@ void OSDMap::clean_pg_upmaps(
                      << dendl;
       pending_inc->new_pg_upmap_items.erase(p);
     }
-    auto q = pg_upmap_items.find(pg);
-    if (q != pg_upmap_items.end()) {
+    auto q = pg_upmap_items->find(pg);
+    if (q != pg_upmap_items->end()) {
       ldout(cct, 10) << __func__ << " cancel invalid "
                      << "pg_upmap_items entry "
                      << q->first << "->" << q->second
@@ -2104,6 +2146,29 @@ int OSDMap::apply_incremental(const Incremental &inc)
     set_erasure_code_profile(profile.first, profile.second);
   }
   
+  // tables we may still share with the epoch we were copied from are
+  // cloned before they are touched.  crush is never modified in place;
+  // a new one is decoded below.
+  if (!inc.new_state.empty() || !inc.new_up_client.empty() ||
+      !inc.new_up_cluster.empty()) {
+    _unshare(osd_addrs);
+  }
+  if (!inc.new_state.empty() || !inc.new_uuid.empty()) {
+    _unshare(osd_uuid);
+  }
+  if (!inc.new_pg_temp.empty()) {
+    _unshare(pg_temp);
+  }
+  if (!inc.new_primary_temp.empty()) {
+    _unshare(primary_temp);
+  }
+  if (!inc.new_pg_upmap.empty() || !inc.old_pg_upmap.empty()) {
+    _unshare(pg_upmap);
+  }
+  if (!inc.new_pg_upmap_items.empty() || !inc.old_pg_upmap_items.empty()) {
+    _unshare(pg_upmap_items);
+  }
+
   // up/down
   for (const auto &state : inc.new_state) {
     const auto osd = state.first;
@@ -2187,16 +2252,16 @@ int OSDMap::apply_incremental(const Incremental &inc)
   }
 
   for (auto& p : inc.new_pg_upmap) {
-    pg_upmap[p.first] = p.second;
+    (*pg_upmap)[p.first] = p.second;
   }
   for (auto& pg : inc.old_pg_upmap) {
-    pg_upmap.erase(pg);
+    pg_upmap->erase(pg);
   }
   for (auto& p : inc.new_pg_upmap_items) {
-    pg_upmap_items[p.first] = p.second;
+    (*pg_upmap_items)[p.first] = p.second;
   }
   for (auto& pg : inc.old_pg_upmap_items) {
-    pg_upmap_items.erase(pg);
+    pg_upmap_items->erase(pg);
   }
 
   // blacklist
@@ -2389,8 +2454,8 @@ int OSDMap::_pick_primary(const vector<int>& osds) const
 void OSDMap::_apply_upmap(const pg_pool_t& pi, pg_t raw_pg, vector<int> *raw) const
 {
   pg_t pg = pi.raw_pg_to_pg(raw_pg);
-  auto p = pg_upmap.find(pg);
-  if (p != pg_upmap.end()) {
+  auto p = pg_upmap->find(pg);
+  if (p != pg_upmap->end()) {
     // make sure targets aren't marked out
     for (auto osd : p->second) {
       if (osd != CRUSH_ITEM_NONE && osd < max_osd && osd >= 0 &&
@@ -2403,8 +2468,8 @@ void OSDMap::_apply_upmap(const pg_pool_t& pi, pg_t raw_pg, vector<int> *raw) co
     // continue to check and apply pg_upmap_items if any
   }
 
-  auto q = pg_upmap_items.find(pg);
-  if (q != pg_upmap_items.end()) {
+  auto q = pg_upmap_items->find(pg);
+  if (q != pg_upmap_items->end()) {
     // NOTE: this approach does not allow a bidirectional swap,
     // e.g., [[1,2],[2,1]] applied to [0,1,2] -> [0,2,1].
     for (auto& r : q->second) {
@@ -2911,11 +2976,11 @@ void OSDMap::encode(ceph::buffer::list& bl, uint64_t features) const
     encode(erasure_code_profiles, bl);
 
     if (v >= 4) {
-      encode(pg_upmap, bl);
-      encode(pg_upmap_items, bl);
+      encode(*pg_upmap, bl);
+      encode(*pg_upmap_items, bl);
     } else {
-      ceph_assert(pg_upmap.empty());
-      ceph_assert(pg_upmap_items.empty());
+      ceph_assert(pg_upmap->empty());
+      ceph_assert(pg_upmap_items->empty());
     }
     if (v >= 6) {
       encode(crush_version, bl);
@@ -3159,6 +3224,10 @@ void OSDMap::decode(ceph::buffer::list::const_iterator& bl)
   size_t tail_offset = 0;
   ceph::buffer::list crc_front, crc_tail;
 
+  // everything below is decoded in place; don't scribble over tables
+  // we still share with another epoch.
+  _drop_shared_tables();
+
   DECODE_START_LEGACY_COMPAT_LEN(8, 7, 7, bl); // wrapper
   if (struct_v < 7) {
     bl.seek(start_offset);
@@ -3225,11 +3294,11 @@ void OSDMap::decode(ceph::buffer::list::const_iterator& bl)
     // version increased from 3 to 4 still in luminous, so same as above
     // applies.
     if (struct_v >= 4) {
-      decode(pg_upmap, bl);
-      decode(pg_upmap_items, bl);
+      decode(*pg_upmap, bl);
+      decode(*pg_upmap_items, bl);
     } else {
-      pg_upmap.clear();
-      pg_upmap_items.clear();
+      pg_upmap->clear();
+      pg_upmap_items->clear();
     }
     // again, version increased from 5 to 6 still in luminous, so above
     // applies.
@@ -3484,7 +3553,7 @@ void OSDMap::dump(Formatter *f) const
   f->close_section();
 
   f->open_array_section("pg_upmap");
-  for (auto& p : pg_upmap) {
+  for (auto& p : *pg_upmap) {
     f->open_object_section("mapping");
     f->dump_stream("pgid") << p.first;
     f->open_array_section("osds");
@@ -3496,7 +3565,7 @@ void OSDMap::dump(Formatter *f) const
   }
   f->close_section();
   f->open_array_section("pg_upmap_items");
-  for (auto& p : pg_upmap_items) {
+  for (auto& p : *pg_upmap_items) {
     f->open_object_section("mapping");
     f->dump_stream("pgid") << p.first;
     f->open_array_section("mappings");
@@ -3765,10 +3834,10 @@ void OSDMap::print(ostream& out) const
   print_osds(out);
   out << std::endl;
 
-  for (auto& p : pg_upmap) {
+  for (auto& p : *pg_upmap) {
     out << "pg_upmap " << p.first << " " << p.second << "\n";
   }
-  for (auto& p : pg_upmap_items) {
+  for (auto& p : *pg_upmap_items) {
     out << "pg_upmap_items " << p.first << " " << p.second << "\n";
   }
 
@@ -4705,8 +4774,8 @@ int OSDMap::calc_pg_upmaps(
       }
       // look for remaps we can un-remap
       for (auto pg : pgs) {
-	auto p = tmp.pg_upmap_items.find(pg);
-        if (p == tmp.pg_upmap_items.end())
+	auto p = tmp.pg_upmap_items->find(pg);
+        if (p == tmp.pg_upmap_items->end())
           continue;
         mempool::osdmap::vector<pair<int32_t,int32_t>> new_upmap_items;
         for (auto q : p->second) {
@@ -4745,8 +4814,8 @@ int OSDMap::calc_pg_upmaps(
 
       // try upmap
       for (auto pg : pgs) {
-        auto temp_it = tmp.pg_upmap.find(pg);
-        if (temp_it != tmp.pg_upmap.end()) {
+        auto temp_it = tmp.pg_upmap->find(pg);
+        if (temp_it != tmp.pg_upmap->end()) {
           // leave pg_upmap alone
           // it must be specified by admin since balancer does not
           // support pg_upmap yet
@@ -4758,14 +4827,14 @@ int OSDMap::calc_pg_upmaps(
         auto pg_pool_size = tmp.get_pg_pool_size(pg);
         mempool::osdmap::vector<pair<int32_t,int32_t>> new_upmap_items;
         set<int> existing;
-        auto it = tmp.pg_upmap_items.find(pg);
-        if (it != tmp.pg_upmap_items.end() &&
+        auto it = tmp.pg_upmap_items->find(pg);
+        if (it != tmp.pg_upmap_items->end() &&
             it->second.size() >= (size_t)pg_pool_size) {
           ldout(cct, 10) << " " << pg << " already has full-size pg_upmap_items "
                          << it->second << ", skipping"
                          << dendl;
           continue;
-        } else if (it != tmp.pg_upmap_items.end()) {
+        } else if (it != tmp.pg_upmap_items->end()) {
           ldout(cct, 10) << " " << pg << " already has pg_upmap_items "
                          << it->second
                          << dendl;
@@ -4838,8 +4907,8 @@ int OSDMap::calc_pg_upmaps(
       // look for remaps we can un-remap
       vector<pair<pg_t,
         mempool::osdmap::vector<pair<int32_t,int32_t>>>> candidates;
-      candidates.reserve(tmp.pg_upmap_items.size());
-      for (auto& i : tmp.pg_upmap_items) {
+      candidates.reserve(tmp.pg_upmap_items->size());
+      for (auto& i : *tmp.pg_upmap_items) {
         if (to_skip.count(i.first))
           continue;
         if (!only_pools.empty() && !only_pools.count(i.first.pool()))
@@ -4968,8 +5037,8 @@ int OSDMap::calc_pg_upmaps(
     deviation_osd = temp_deviation_osd;
     for (auto& i : to_unmap) {
       ldout(cct, 10) << " unmap pg " << i << dendl;
-      ceph_assert(tmp.pg_upmap_items.count(i));
-      tmp.pg_upmap_items.erase(i);
+      ceph_assert(tmp.pg_upmap_items->count(i));
+      tmp.pg_upmap_items->erase(i);
       pending_inc->old_pg_upmap_items.insert(i);
       ++num_changed;
     }
@@ -4977,7 +5046,7 @@ int OSDMap::calc_pg_upmaps(
       ldout(cct, 10) << " upmap pg " << i.first
                      << " new pg_upmap_items " << i.second
                      << dendl;
-      tmp.pg_upmap_items[i.first] = i.second;
+      (*tmp.pg_upmap_items)[i.first] = i.second;
       pending_inc->new_pg_upmap_items[i.first] = i.second;
       ++num_changed;
     }
@@ -565,8 +565,8 @@ private:
   std::shared_ptr< mempool::osdmap::vector<__u32> > osd_primary_affinity; ///< 16.16 fixed point, 0x10000 = baseline
 
   // remap (post-CRUSH, pre-up)
-  mempool::osdmap::map<pg_t,mempool::osdmap::vector<int32_t>> pg_upmap; ///< remap pg
-  mempool::osdmap::map<pg_t,mempool::osdmap::vector<std::pair<int32_t,int32_t>>> pg_upmap_items; ///< remap osds in up set
+  std::shared_ptr< mempool::osdmap::map<pg_t,mempool::osdmap::vector<int32_t>> > pg_upmap; ///< remap pg
+  std::shared_ptr< mempool::osdmap::map<pg_t,mempool::osdmap::vector<std::pair<int32_t,int32_t>>> > pg_upmap_items; ///< remap osds in up set
 
   mempool::osdmap::map<int64_t,pg_pool_t> pools;
   mempool::osdmap::map<int64_t,std::string> pool_name;
@@ -608,6 +608,15 @@ private:
 
   void _calc_up_osd_features();
 
+  /// clone a table that is still shared with another map before writing it
+  template<typename T>
+  static void _unshare(std::shared_ptr<T>& t) {
+    if (t && t.use_count() > 1) {
+      t = std::make_shared<T>(*t);
+    }
+  }
+  void _drop_shared_tables();
+
  public:
   bool have_crc() const { return crc_defined; }
   uint32_t get_crc() const { return crc; }
@@ -627,6 +636,8 @@ private:
 	     osd_addrs(std::make_shared<addrs_s>()),
 	     pg_temp(std::make_shared<PGTempMap>()),
 	     primary_temp(std::make_shared<mempool::osdmap::map<pg_t,int32_t>>()),
+	     pg_upmap(std::make_shared<mempool::osdmap::map<pg_t,mempool::osdmap::vector<int32_t>>>()),
+	     pg_upmap_items(std::make_shared<mempool::osdmap::map<pg_t,mempool::osdmap::vector<std::pair<int32_t,int32_t>>>>()),
 	     osd_uuid(std::make_shared<mempool::osdmap::vector<uuid_d>>()),
 	     cluster_snapshot_epoch(0),
 	     new_blacklist_entries(false),
@@ -652,6 +663,8 @@ public:
     primary_temp.reset(new mempool::osdmap::map<pg_t,int32_t>(*o.primary_temp));
     pg_temp.reset(new PGTempMap(*o.pg_temp));
     osd_uuid.reset(new mempool::osdmap::vector<uuid_d>(*o.osd_uuid));
+    pg_upmap.reset(new mempool::osdmap::map<pg_t,mempool::osdmap::vector<int32_t>>(*o.pg_upmap));
+    pg_upmap_items.reset(new mempool::osdmap::map<pg_t,mempool::osdmap::vector<std::pair<int32_t,int32_t>>>(*o.pg_upmap_items));
 
     if (o.osd_primary_affinity)
       osd_primary_affinity.reset(new mempool::osdmap::vector<__u32>(*o.osd_primary_affinity));
@@ -663,6 +676,19 @@ public:
     // allocate a new CrushWrapper, though.
   }
 
+  /**
+   * copy o, sharing the addrs, temp, upmap, uuid and primary affinity
+   * tables (and crush) with it rather than cloning them.
+   *
+   * apply_incremental() and decode() clone a shared table the first time
+   * they modify it, so a map built this way from the previous epoch only
+   * pays for what the incremental changed.  the caller must not modify
+   * the shared tables any other way.
+   */
+  void shared_copy_from(const OSDMap& o) {
+    *this = o;
+  }
+
   // map info
   const uuid_d& get_fsid() const { return fsid; }
   void set_fsid(uuid_d& f) { fsid = f; }
@@ -776,6 +802,8 @@ public:
       osd_primary_affinity.reset(
 	new mempool::osdmap::vector<__u32>(
 	  max_osd, CEPH_OSD_DEFAULT_PRIMARY_AFFINITY));
+    else
+      _unshare(osd_primary_affinity);
     (*osd_primary_affinity)[o] = w;
   }
   unsigned get_primary_affinity(int o) const {
@@ -1447,8 +1475,8 @@ public:
   int get_osds_by_bucket_name(const std::string &name, std::set<int> *osds) const;
 
   bool have_pg_upmaps(pg_t pg) const {
-    return pg_upmap.count(pg) ||
-      pg_upmap_items.count(pg);
+    return pg_upmap->count(pg) ||
+      pg_upmap_items->count(pg);
   }
 
   bool check_full(const set<pg_shard_t> &missing_on) const {
@@ -1157,10 +1157,15 @@ void PG::update_snap_map(
   const vector<pg_log_entry_t> &log_entries,
   ObjectStore::Transaction &t)
 {
+  OSDriver::OSTransaction _t(osdriver.get_transaction(&t));
+  // batched snap trims remove the mapping keys of many clones at once
+  bool batch = log_entries.size() > 1;
+  if (batch) {
+    snap_mapper.start_batch();
+  }
   for (vector<pg_log_entry_t>::const_iterator i = log_entries.begin();
        i != log_entries.end();
        ++i) {
-    OSDriver::OSTransaction _t(osdriver.get_transaction(&t));
     if (i->soid.snap < CEPH_MAXSNAP) {
       if (i->is_delete()) {
 	int r = snap_mapper.remove_oid(
@@ -1201,6 +1206,9 @@ void PG::update_snap_map(
       }
     }
   }
+  if (batch) {
+    snap_mapper.flush_batch(&_t);
+  }
 }
 
 /**
@@ -2419,10 +2427,13 @@ void PG::replica_scrub(
  */
 void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
 {
-  if (cct->_conf->osd_scrub_sleep > 0 &&
-      (scrubber.state == PG::Scrubber::NEW_CHUNK ||
+  double scrub_sleep = 0;
+  if ((scrubber.state == PG::Scrubber::NEW_CHUNK ||
        scrubber.state == PG::Scrubber::INACTIVE) &&
-       scrubber.needs_sleep) {
+      scrubber.needs_sleep) {
+    scrub_sleep = osd->get_scrub_sleep();
+  }
+  if (scrub_sleep > 0) {
     ceph_assert(!scrubber.sleeping);
     dout(20) << __func__ << " state is INACTIVE|NEW_CHUNK, sleeping" << dendl;
 
@@ -2452,7 +2463,7 @@ void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
           pg->unlock();
         });
     std::lock_guard l(osd->sleep_lock);
-    osd->sleep_timer.add_event_after(cct->_conf->osd_scrub_sleep,
+    osd->sleep_timer.add_event_after(scrub_sleep,
                                            scrub_requeue_callback);
     scrubber.sleeping = true;
     scrubber.sleep_start = ceph_clock_now();
@@ -2664,7 +2675,8 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	   */
 	  int min = std::max<int64_t>(3, cct->_conf->osd_scrub_chunk_min /
 				      scrubber.preempt_divisor);
-	  int max = std::max<int64_t>(min, cct->_conf->osd_scrub_chunk_max /
+	  int max = std::max<int64_t>(min, cct->_conf->osd_scrub_chunk_max *
+				      osd->get_scrub_chunk_scale() /
                                       scrubber.preempt_divisor);
           hobject_t start = scrubber.start;
 	  hobject_t candidate_end;
@@ -18,6 +18,7 @@
 
 #include "common/errno.h"
 #include "common/scrub_types.h"
+#include "include/crc32c.h"
 #include "ReplicatedBackend.h"
 #include "ScrubStore.h"
 #include "ECBackend.h"
@@ -1227,6 +1228,23 @@ out:
   }
 }
 
+uint32_t PGBackend::be_scrub_crc32c(uint32_t crc, const bufferlist &bl) const
+{
+  // deep scrub reads are stride sized and bypass the cache, so the
+  // per-buffer crc cache never hits; digest each extent directly
+  const bool split =
+    cct->_conf.get_val<bool>("osd_deep_scrub_crc32c_split");
+  for (auto &p : bl.buffers()) {
+    auto data = (const unsigned char*)p.c_str();
+    if (split) {
+      crc = ceph_crc32c_split(crc, data, p.length());
+    } else {
+      crc = ceph_crc32c(crc, data, p.length());
+    }
+  }
+  return crc;
+}
+
 void PGBackend::be_omap_checks(const map<pg_shard_t,ScrubMap*> &maps,
   const set<hobject_t> &master_set,
   omap_stat_t& omap_stats,
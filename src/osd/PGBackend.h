@@ -331,6 +331,7 @@ typedef std::shared_ptr<const OSDMap> OSDMapRef;
     */
    struct RecoveryHandle {
      bool cache_dont_need;
+     bool batched = false;  ///< packs several small objects, see RecoveryBatch
      map<pg_shard_t, vector<pair<hobject_t, eversion_t> > > deletes;
 
      RecoveryHandle(): cache_dont_need(false) {}
@@ -609,6 +610,8 @@ typedef std::shared_ptr<const OSDMap> OSDMapRef;
      ScrubMap &map,
      ScrubMapBuilder &pos,
      ScrubMap::object &o) = 0;
+   /// crc32c of a deep scrub read; same value as bufferhash(crc) << bl
+   uint32_t be_scrub_crc32c(uint32_t crc, const bufferlist &bl) const;
    void be_omap_checks(
      const map<pg_shard_t,ScrubMap*> &maps,
      const set<hobject_t> &master_set,
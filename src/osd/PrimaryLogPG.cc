@@ -3961,6 +3961,7 @@ void PrimaryLogPG::log_op_stats(const OpRequest& op,
   osd->logger->inc(l_osd_op_inb, inb);
   osd->logger->tinc(l_osd_op_lat, latency);
   osd->logger->tinc(l_osd_op_process_lat, process_latency);
+  osd->record_client_op_latency(latency);
 
   if (op.may_read() && op.may_write()) {
     osd->logger->inc(l_osd_op_rw);
@@ -4034,18 +4035,33 @@ void PrimaryLogPG::do_scan(
 
       BackfillInterval bi;
       bi.begin = m->begin;
+      vector<pair<hobject_t, sha1_digest_t>> matched;
       // No need to flush, there won't be any in progress writes occuring
       // past m->begin
-      scan_range(
-	cct->_conf->osd_backfill_scan_min,
-	cct->_conf->osd_backfill_scan_max,
-	&bi,
-	handle);
+      if (!m->range_digests.empty()) {
+	scan_range_digests(
+	  cct->_conf->osd_backfill_scan_min,
+	  cct->_conf->osd_backfill_scan_max,
+	  m->begin,
+	  m->digest_begin,
+	  m->range_digests,
+	  &bi,
+	  &matched,
+	  handle);
+      } else {
+	scan_range(
+	  cct->_conf->osd_backfill_scan_min,
+	  cct->_conf->osd_backfill_scan_max,
+	  &bi,
+	  handle);
+      }
       MOSDPGScan *reply = new MOSDPGScan(
 	MOSDPGScan::OP_SCAN_DIGEST,
 	pg_whoami,
 	get_osdmap_epoch(), m->query_epoch,
 	spg_t(info.pgid.pgid, get_primary().shard), bi.begin, bi.end);
+      reply->digest_begin = m->digest_begin;
+      reply->range_digests.swap(matched);
       encode(bi.objects, reply->get_data());
       osd->send_message_osd_cluster(reply, m->get_connection());
     }
@@ -4067,6 +4083,38 @@ void PrimaryLogPG::do_scan(
       bi.clear_objects();
       ::decode_noclear(bi.objects, p);
 
+      auto scan = backfill_digest_scans.find(from);
+      if (!m->range_digests.empty()) {
+	if (scan == backfill_digest_scans.end() ||
+	    scan->second.digest_begin != m->digest_begin) {
+	  // can't tell what the matched ranges hold, scan again
+	  dout(10) << __func__ << " no digest scan to osd." << from
+		   << " from " << m->digest_begin << ", rescanning" << dendl;
+	  bi.reset(m->begin);
+	} else {
+	  // the peer has exactly what we had in the matched ranges
+	  auto matched = m->range_digests.begin();
+	  hobject_t range_begin = scan->second.digest_begin;
+	  for (auto &r : scan->second.range_digests) {
+	    if (matched == m->range_digests.end())
+	      break;
+	    if (matched->first == r.first) {
+	      bi.objects.insert(
+		scan->second.objects.lower_bound(range_begin),
+		scan->second.objects.lower_bound(r.first));
+	      ++matched;
+	    }
+	    range_begin = r.first;
+	  }
+	  dout(10) << __func__ << " osd." << from << " matched "
+		   << m->range_digests.size() << "/"
+		   << scan->second.range_digests.size() << " ranges" << dendl;
+	}
+      }
+      if (scan != backfill_digest_scans.end()) {
+	backfill_digest_scans.erase(scan);
+      }
+
       if (waiting_on_backfill.erase(from)) {
 	if (waiting_on_backfill.empty()) {
 	  ceph_assert(
@@ -4192,7 +4240,6 @@ int PrimaryLogPG::trim_object(
   bool first, const hobject_t &coid, snapid_t snap_to_trim,
   PrimaryLogPG::OpContextUPtr *ctxp)
 {
-  *ctxp = NULL;
 
   // load clone info
   bufferlist bl;
@@ -4254,14 +4301,23 @@ int PrimaryLogPG::trim_object(
     }
   }
 
-  OpContextUPtr ctx = simple_opc_create(obc);
-  ctx->head_obc = head_obc;
+  // if the caller passes an op, this trim is added to it; the batch is
+  // only submitted while we are clean, so no replica needs to skip any
+  // of the objects in it
+  OpContextUPtr new_ctx;
+  OpContext *ctx = ctxp->get();
+  if (!ctx) {
+    new_ctx = simple_opc_create(obc);
+    new_ctx->head_obc = head_obc;
+    ctx = new_ctx.get();
+  }
 
   if (!ctx->lock_manager.get_snaptrimmer_write(
 	coid,
 	obc,
 	first)) {
-    close_op_ctx(ctx.release());
+    if (new_ctx)
+      close_op_ctx(new_ctx.release());
     dout(10) << __func__ << ": Unable to get a wlock on " << coid << dendl;
     return -ENOLCK;
   }
@@ -4270,12 +4326,19 @@ int PrimaryLogPG::trim_object(
 	head_oid,
 	head_obc,
 	first)) {
-    close_op_ctx(ctx.release());
+    if (new_ctx)
+      close_op_ctx(new_ctx.release());
     dout(10) << __func__ << ": Unable to get a wlock on " << head_oid << dendl;
     return -ENOLCK;
   }
 
-  ctx->at_version = get_next_version();
+  if (new_ctx) {
+    ctx->at_version = get_next_version();
+  } else {
+    ctx->at_version.version++;
+    ctx->op_t->add_obc(obc);
+    ctx->op_t->add_obc(head_obc);
+  }
 
   PGTransaction *t = ctx->op_t.get();
  
@@ -4332,7 +4395,7 @@ int PrimaryLogPG::trim_object(
 	pg_log_entry_t::DELETE,
 	coid,
 	ctx->at_version,
-	ctx->obs->oi.version,
+	obc->obs.oi.version,
 	0,
 	osd_reqid_t(),
 	ctx->mtime,
@@ -4462,7 +4525,8 @@ int PrimaryLogPG::trim_object(
     t->setattrs(head_oid, attrs);
   }
 
-  *ctxp = std::move(ctx);
+  if (new_ctx)
+    *ctxp = std::move(new_ctx);
   return 0;
 }
 
@@ -12179,6 +12243,7 @@ void PrimaryLogPG::_clear_recovery_state()
   recovering_oids.clear();
 #endif
   last_backfill_started = hobject_t();
+  backfill_digest_scans.clear();
   set<hobject_t>::iterator i = backfills_in_flight.begin();
   while (i != backfills_in_flight.end()) {
     ceph_assert(recovering.count(*i));
@@ -12606,6 +12671,41 @@ int PrimaryLogPG::prep_object_replica_deletes(
   return 1;
 }
 
+PrimaryLogPG::RecoveryBatch::RecoveryBatch(
+  CephContext *cct, const pg_pool_t &pool)
+{
+  // only ReplicatedBackend packs the pushes of several objects together
+  if (pool.is_replicated()) {
+    max_object_size = cct->_conf.get_val<Option::size_t>(
+      "osd_recovery_batch_max_object_size");
+    max_objects = cct->_conf.get_val<uint64_t>(
+      "osd_recovery_batch_max_objects");
+    max_bytes = cct->_conf.get_val<Option::size_t>(
+      "osd_recovery_batch_max_bytes");
+  }
+}
+
+uint64_t PrimaryLogPG::get_recovery_omap_bytes(
+  const RecoveryBatch &batch, const object_info_t &oi)
+{
+  if (!oi.is_omap() || !batch.is_small(oi)) {
+    return 0;
+  }
+  ObjectMap::ObjectMapIterator iter =
+    osd->store->get_omap_iterator(ch, ghobject_t(oi.soid));
+  if (!iter) {
+    // don't know, so don't batch it
+    return batch.max_object_size + 1;
+  }
+  uint64_t bytes = 0;
+  for (iter->seek_to_first();
+       iter->valid() && batch.is_small(oi, bytes);
+       iter->next()) {
+    bytes += iter->key().length() + iter->value().length();
+  }
+  return bytes;
+}
+
 int PrimaryLogPG::prep_object_replica_pushes(
   const hobject_t& soid, eversion_t v,
   PGBackend::RecoveryHandle *h,
@@ -12725,8 +12825,9 @@ uint64_t PrimaryLogPG::recover_replicas(uint64_t max, ThreadPool::TPHandle &hand
 
     // oldest first!
     const pg_missing_t &m(pm->second);
+    RecoveryBatch batch(cct, pool.info);
     for (map<version_t, hobject_t>::const_iterator p = m.get_rmissing().begin();
-	 p != m.get_rmissing().end() && started < max;
+	 p != m.get_rmissing().end() && (started < max || batch.has_room());
 	   ++p) {
       handle.reset_tp_timeout();
       const hobject_t soid(p->second);
@@ -12754,6 +12855,8 @@ uint64_t PrimaryLogPG::recover_replicas(uint64_t max, ThreadPool::TPHandle &hand
       }
 
       if (recovery_state.get_missing_loc().is_deleted(soid)) {
+	if (started >= max)
+	  break;
 	dout(10) << __func__ << ": " << soid << " is a delete, removing" << dendl;
 	map<hobject_t,pg_missing_item>::const_iterator r = m.get_items().find(soid);
 	started += prep_object_replica_deletes(soid, r->second.need, h, work_started);
@@ -12773,9 +12876,21 @@ uint64_t PrimaryLogPG::recover_replicas(uint64_t max, ThreadPool::TPHandle &hand
 	continue;
       }
 
+      ObjectContextRef obc = get_object_context(soid, false);
+      object_info_t oi;
+      if (obc) {
+	oi = obc->obs.oi;
+      }
+      uint64_t omap_bytes = get_recovery_omap_bytes(batch, oi);
+      if (started >= max && !batch.fits(oi, omap_bytes))
+	break;
+
       dout(10) << __func__ << ": recover_object_replicas(" << soid << ")" << dendl;
       map<hobject_t,pg_missing_item>::const_iterator r = m.get_items().find(soid);
-      started += prep_object_replica_pushes(soid, r->second.need, h, work_started);
+      if (prep_object_replica_pushes(soid, r->second.need, h, work_started)) {
+	started += batch.charge(oi, omap_bytes);
+	h->batched |= batch.objects > 1;
+      }
     }
   }
 
@@ -12907,7 +13022,8 @@ uint64_t PrimaryLogPG::recover_backfill(
   backfill_info.trim_to(last_backfill_started);
 
   PGBackend::RecoveryHandle *h = pgbackend->open_recovery_op();
-  while (ops < max) {
+  RecoveryBatch batch(cct, pool.info);
+  while (ops < max || batch.has_room()) {
     if (backfill_info.begin <= earliest_peer_backfill() &&
 	!backfill_info.extends_to_end() && backfill_info.empty()) {
       hobject_t next = backfill_info.end;
@@ -12919,6 +13035,20 @@ uint64_t PrimaryLogPG::recover_backfill(
 
     dout(20) << "   my backfill interval " << backfill_info << dendl;
 
+    if (ops >= max) {
+      // only filling the open batch, a scan would need an op of its own
+      bool need_scan = false;
+      for (auto &bt : get_backfill_targets()) {
+	BackfillInterval& pbi = peer_backfill_info[bt];
+	if (pbi.begin <= backfill_info.begin &&
+	    !pbi.extends_to_end() && pbi.empty()) {
+	  need_scan = true;
+	}
+      }
+      if (need_scan)
+	break;
+    }
+
     bool sent_scan = false;
     for (set<pg_shard_t>::const_iterator i = get_backfill_targets().begin();
 	 i != get_backfill_targets().end();
@@ -12935,6 +13065,7 @@ uint64_t PrimaryLogPG::recover_backfill(
 	  MOSDPGScan::OP_SCAN_GET_DIGEST, pg_whoami, e, get_last_peering_reset(),
 	  spg_t(info.pgid.pgid, bt.shard),
 	  pbi.end, hobject_t());
+	prep_backfill_digest_scan(bt, m);
 	osd->send_message_osd_cluster(bt.osd, m, get_osdmap_epoch());
 	ceph_assert(waiting_on_backfill.find(bt) == waiting_on_backfill.end());
 	waiting_on_backfill.insert(bt);
@@ -13029,6 +13160,9 @@ uint64_t PrimaryLogPG::recover_backfill(
       if (!need_ver_targs.empty() || !missing_targs.empty()) {
 	ObjectContextRef obc = get_object_context(backfill_info.begin, false);
 	ceph_assert(obc);
+	uint64_t omap_bytes = get_recovery_omap_bytes(batch, obc->obs.oi);
+	if (ops >= max && !batch.fits(obc->obs.oi, omap_bytes))
+	  break;
 	if (obc->get_recovery_read()) {
 	  if (!need_ver_targs.empty()) {
 	    dout(20) << " BACKFILL replacing " << check
@@ -13050,7 +13184,8 @@ uint64_t PrimaryLogPG::recover_backfill(
 	    dout(0) << __func__ << " Error " << r << " trying to backfill " << backfill_info.begin << dendl;
 	    break;
 	  }
-	  ops++;
+	  ops += batch.charge(obc->obs.oi, omap_bytes);
+	  h->batched |= batch.objects > 1;
 	} else {
 	  *work_started = true;
 	  dout(20) << "backfill blocking on " << backfill_info.begin
@@ -13307,31 +13442,161 @@ void PrimaryLogPG::scan_range(
 
   for (vector<hobject_t>::iterator p = ls.begin(); p != ls.end(); ++p) {
     handle.reset_tp_timeout();
-    ObjectContextRef obc;
-    if (is_primary())
-      obc = object_contexts.lookup(*p);
-    if (obc) {
-      bi->objects[*p] = obc->obs.oi.version;
-      dout(20) << "  " << *p << " " << obc->obs.oi.version << dendl;
-    } else {
-      bufferlist bl;
-      int r = pgbackend->objects_get_attr(*p, OI_ATTR, &bl);
+    eversion_t v;
+    if (get_scan_version(*p, &v))
+      bi->objects[*p] = v;
+  }
+}
 
-      /* If the object does not exist here, it must have been removed
-	 * between the collection_list_partial and here.  This can happen
-	 * for the first item in the range, which is usually last_backfill.
-	 */
-      if (r == -ENOENT)
-	continue;
+bool PrimaryLogPG::get_scan_version(const hobject_t &hoid, eversion_t *v)
+{
+  ObjectContextRef obc;
+  if (is_primary())
+    obc = object_contexts.lookup(hoid);
+  if (obc) {
+    *v = obc->obs.oi.version;
+  } else {
+    bufferlist bl;
+    int r = pgbackend->objects_get_attr(hoid, OI_ATTR, &bl);
 
-      ceph_assert(r >= 0);
-      object_info_t oi(bl);
-      bi->objects[*p] = oi.version;
-      dout(20) << "  " << *p << " " << oi.version << dendl;
+    /* If the object does not exist here, it must have been removed
+     * between the collection_list_partial and here.  This can happen
+     * for the first item in the range, which is usually last_backfill.
+     */
+    if (r == -ENOENT)
+      return false;
+
+    ceph_assert(r >= 0);
+    object_info_t oi(bl);
+    *v = oi.version;
+  }
+  dout(20) << "  " << hoid << " " << *v << dendl;
+  return true;
+}
+
+/*
+ * The digest covers names and versions only: every modification bumps
+ * the version, so equal versions imply equal size and content.
+ */
+static sha1_digest_t backfill_range_digest(
+  map<hobject_t, eversion_t>::const_iterator p,
+  map<hobject_t, eversion_t>::const_iterator end)
+{
+  bufferlist bl;
+  for (; p != end; ++p) {
+    encode(p->first, bl);
+    encode(p->second, bl);
+  }
+  return ceph::crypto::digest<ceph::crypto::SHA1>(bl);
+}
+
+void PrimaryLogPG::prep_backfill_digest_scan(pg_shard_t peer, MOSDPGScan *m)
+{
+  uint64_t per_range = cct->_conf.get_val<uint64_t>(
+    "osd_backfill_scan_digest_objects");
+  if (!per_range)
+    return;
+
+  // backfill_info must hold all of our objects from digest_begin on
+  hobject_t digest_begin = std::max(m->begin, backfill_info.begin);
+  if (digest_begin >= backfill_info.end)
+    return;
+
+  BackfillDigestScan &scan = backfill_digest_scans[peer];
+  scan = BackfillDigestScan();
+  scan.digest_begin = digest_begin;
+  scan.range_digests = make_range_digests(
+    backfill_info.objects, digest_begin, backfill_info.end, per_range);
+  scan.objects.insert(backfill_info.objects.lower_bound(digest_begin),
+		      backfill_info.objects.end());
+
+  dout(20) << __func__ << " osd." << peer << " " << digest_begin
+	   << "-" << backfill_info.end << " "
+	   << scan.range_digests.size() << " ranges" << dendl;
+  m->digest_begin = digest_begin;
+  m->range_digests = scan.range_digests;
+}
+
+vector<pair<hobject_t, sha1_digest_t>> PrimaryLogPG::make_range_digests(
+  const map<hobject_t, eversion_t> &objects,
+  const hobject_t &digest_begin,
+  const hobject_t &end,
+  uint64_t per_range)
+{
+  vector<pair<hobject_t, sha1_digest_t>> range_digests;
+  auto p = objects.lower_bound(digest_begin);
+  do {
+    auto range_begin = p;
+    for (uint64_t n = 0; n < per_range && p != objects.end(); ++n, ++p) ;
+    hobject_t bound = p == objects.end() ? end : p->first;
+    range_digests.emplace_back(bound, backfill_range_digest(range_begin, p));
+  } while (p != objects.end());
+  return range_digests;
+}
+
+void PrimaryLogPG::match_range_digests(
+  const hobject_t &digest_begin,
+  const vector<pair<hobject_t, sha1_digest_t>> &range_digests,
+  const hobject_t &end,
+  map<hobject_t, eversion_t> *objects,
+  vector<pair<hobject_t, sha1_digest_t>> *matched)
+{
+  auto p = objects->lower_bound(digest_begin);
+  for (auto &i : range_digests) {
+    if (i.first > end)
+      break;
+    auto range_begin = p;
+    while (p != objects->end() && p->first < i.first)
+      ++p;
+    if (backfill_range_digest(range_begin, p) == i.second) {
+      matched->push_back(i);
+      p = objects->erase(range_begin, p);
     }
   }
 }
 
+void PrimaryLogPG::scan_range_digests(
+  int min, int max,
+  const hobject_t &begin,
+  const hobject_t &digest_begin,
+  const vector<pair<hobject_t, sha1_digest_t>> &range_digests,
+  BackfillInterval *bi,
+  vector<pair<hobject_t, sha1_digest_t>> *matched,
+  ThreadPool::TPHandle &handle)
+{
+  ceph_assert(is_locked());
+  ceph_assert(!range_digests.empty());
+  bi->clear_objects();
+  bi->end = range_digests.back().first;
+  dout(10) << __func__ << " " << begin << "-" << bi->end
+	   << " digests from " << digest_begin << dendl;
+
+  // bounded like scan_range; whatever is past the listing is left for
+  // the next scan
+  vector<hobject_t> ls;
+  ls.reserve(max);
+  hobject_t next;
+  int r = pgbackend->objects_list_partial(begin, min, max, &ls, &next);
+  ceph_assert(r >= 0);
+  if (next < bi->end)
+    bi->end = next;
+  dout(10) << " got " << ls.size() << " items, end " << bi->end << dendl;
+
+  for (auto &hoid : ls) {
+    if (hoid >= bi->end)
+      break;
+    handle.reset_tp_timeout();
+    eversion_t v;
+    if (get_scan_version(hoid, &v))
+      bi->objects[hoid] = v;
+  }
+
+  match_range_digests(digest_begin, range_digests, bi->end, &bi->objects,
+		      matched);
+  dout(10) << " matched " << matched->size() << "/" << range_digests.size()
+	   << " ranges, " << bi->objects.size() << " items left" << dendl;
+}
+
 
 /** check_local
  * 
@@ -15187,8 +15452,14 @@ boost::statechart::result PrimaryLogPG::AwaitAsyncWork::react(const DoSnapWork&)
 
   ldout(pg->cct, 10) << "AwaitAsyncWork: trimming snap " << snap_to_trim << dendl;
 
+  // up to osd_pg_max_concurrent_snap_trims transactions, each trimming a
+  // batch of clones
+  unsigned batch_max = std::max<unsigned>(
+    1,
+    (unsigned)(pg->cct->_conf.get_val<uint64_t>("osd_snap_trim_batch_objects") *
+	       pg->osd->get_snap_trim_batch_scale()));
   vector<hobject_t> to_trim;
-  unsigned max = pg->cct->_conf->osd_pg_max_concurrent_snap_trims;
+  unsigned max = pg->cct->_conf->osd_pg_max_concurrent_snap_trims * batch_max;
   to_trim.reserve(max);
   int r = pg->snap_mapper.get_next_objects_to_trim(
     snap_to_trim,
@@ -15232,12 +15503,47 @@ boost::statechart::result PrimaryLogPG::AwaitAsyncWork::react(const DoSnapWork&)
   }
   ceph_assert(!to_trim.empty());
 
+  OpContextUPtr ctx;
+  vector<hobject_t> batch;
+  set<hobject_t> batch_heads;
+  auto submit_batch = [&]() {
+    if (!ctx) {
+      return;
+    }
+    ldout(pg->cct, 10) << "AwaitAsyncWork submitting " << batch.size()
+		       << " trims" << dendl;
+    in_flight.insert(batch.begin(), batch.end());
+    ctx->register_on_success(
+      [pg, batch, &in_flight]() {
+	for (auto &object : batch) {
+	  ceph_assert(in_flight.find(object) != in_flight.end());
+	  in_flight.erase(object);
+	}
+	if (in_flight.empty()) {
+	  if (pg->state_test(PG_STATE_SNAPTRIM_ERROR)) {
+	    pg->snap_trimmer_machine.process_event(Reset());
+	  } else {
+	    pg->snap_trimmer_machine.process_event(RepopsComplete());
+	  }
+	}
+      });
+    pg->simple_opc_submit(std::move(ctx));
+    batch.clear();
+    batch_heads.clear();
+  };
+
   for (auto &&object: to_trim) {
+    // one snapset update per head and op
+    if (batch.size() >= batch_max ||
+	batch_heads.count(object.get_head())) {
+      submit_batch();
+    }
     // Get next
     ldout(pg->cct, 10) << "AwaitAsyncWork react trimming " << object << dendl;
-    OpContextUPtr ctx;
-    int error = pg->trim_object(in_flight.empty(), object, snap_to_trim, &ctx);
+    int error = pg->trim_object(in_flight.empty() && batch.empty(), object,
+				snap_to_trim, &ctx);
     if (error) {
+      submit_batch();
       if (error == -ENOLCK) {
 	ldout(pg->cct, 10) << "could not get write lock on obj "
 			   << object << dendl;
@@ -15258,22 +15564,10 @@ boost::statechart::result PrimaryLogPG::AwaitAsyncWork::react(const DoSnapWork&)
       }
     }
 
-    in_flight.insert(object);
-    ctx->register_on_success(
-      [pg, object, &in_flight]() {
-	ceph_assert(in_flight.find(object) != in_flight.end());
-	in_flight.erase(object);
-	if (in_flight.empty()) {
-	  if (pg->state_test(PG_STATE_SNAPTRIM_ERROR)) {
-	    pg->snap_trimmer_machine.process_event(Reset());
-	  } else {
-	    pg->snap_trimmer_machine.process_event(RepopsComplete());
-	  }
-	}
-      });
-
-    pg->simple_opc_submit(std::move(ctx));
+    batch.push_back(object);
+    batch_heads.insert(object.get_head());
   }
+  submit_batch();
 
   return transit< WaitRepops >();
 }
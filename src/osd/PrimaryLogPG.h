@@ -41,6 +41,7 @@ class HitSet;
 struct TierAgentState;
 class MOSDOp;
 class MOSDOpReply;
+class MOSDPGScan;
 class OSDService;
 
 void intrusive_ptr_add_ref(PrimaryLogPG *pg);
@@ -1134,6 +1135,72 @@ protected:
   hobject_t last_backfill_started;
   bool new_backfill;
 
+  /// digest based scans in flight to backfill targets, see MOSDPGScan
+  struct BackfillDigestScan {
+    hobject_t digest_begin;
+    vector<pair<hobject_t, sha1_digest_t>> range_digests;
+    /// our objects in the digested ranges when the scan was sent
+    map<hobject_t, eversion_t> objects;
+  };
+  map<pg_shard_t, BackfillDigestScan> backfill_digest_scans;
+
+public:
+  /**
+   * RecoveryBatch
+   *
+   * Pushes of small objects are packed into batches which are charged as
+   * a single recovery op, so that they go out in one MOSDPGPush and are
+   * applied in one transaction on the target.  Objects up to
+   * osd_recovery_batch_max_object_size join the open batch until it
+   * holds osd_recovery_batch_max_objects or osd_recovery_batch_max_bytes,
+   * so the smaller the objects the more of them share an op.  The size
+   * of an omap object includes its omap keys and values, see
+   * get_recovery_omap_bytes().
+   */
+  struct RecoveryBatch {
+    uint64_t max_object_size = 0; ///< 0 if batching is off
+    uint64_t max_objects = 0;
+    uint64_t max_bytes = 0;
+    uint64_t objects = 0;
+    uint64_t bytes = 0;
+
+    RecoveryBatch(CephContext *cct, const pg_pool_t &pool);
+
+    uint64_t get_cost(const object_info_t &oi, uint64_t omap_bytes = 0) const {
+      return oi.size + omap_bytes;
+    }
+    bool is_small(const object_info_t &oi, uint64_t omap_bytes = 0) const {
+      return max_object_size && get_cost(oi, omap_bytes) <= max_object_size;
+    }
+    /// true if an object can still join the open batch
+    bool has_room() const {
+      return objects && objects < max_objects && bytes < max_bytes;
+    }
+    bool fits(const object_info_t &oi, uint64_t omap_bytes = 0) const {
+      return is_small(oi, omap_bytes) && has_room() &&
+	bytes + get_cost(oi, omap_bytes) <= max_bytes;
+    }
+    /// account for oi being pushed, returns the recovery ops to charge
+    uint64_t charge(const object_info_t &oi, uint64_t omap_bytes = 0) {
+      if (fits(oi, omap_bytes)) {
+	++objects;
+	bytes += get_cost(oi, omap_bytes);
+	return 0;
+      }
+      if (is_small(oi, omap_bytes)) {
+	objects = 1;
+	bytes = get_cost(oi, omap_bytes);
+      }
+      return 1;
+    }
+  };
+  /// omap bytes of an object that may be small enough to batch; reads
+  /// no further than it takes to tell that it isn't
+  uint64_t get_recovery_omap_bytes(const RecoveryBatch &batch,
+				   const object_info_t &oi);
+
+protected:
+
   int prep_object_replica_pushes(const hobject_t& soid, eversion_t v,
 				 PGBackend::RecoveryHandle *h,
 				 bool *work_started);
@@ -1290,6 +1357,51 @@ protected:
     ThreadPool::TPHandle &handle
     );
 
+  /// version of a listed object, false if it is gone by now
+  bool get_scan_version(const hobject_t &hoid, eversion_t *v);
+
+  /// add digests of backfill_info's objects past m->begin to a scan
+  void prep_backfill_digest_scan(pg_shard_t peer, MOSDPGScan *m);
+
+  /**
+   * scan the ranges of a digest based scan request
+   *
+   * Lists at most max objects of [begin, end of the last range) in one
+   * go; bi->end is pulled in if the listing stops short.  Objects in
+   * ranges whose digest matches are left out of bi and the range is
+   * added to matched instead.
+   */
+  void scan_range_digests(
+    int min, int max,
+    const hobject_t &begin,
+    const hobject_t &digest_begin,
+    const vector<pair<hobject_t, sha1_digest_t>> &range_digests,
+    BackfillInterval *bi,
+    vector<pair<hobject_t, sha1_digest_t>> *matched,
+    ThreadPool::TPHandle &handle);
+
+public:
+  /// split objects from digest_begin to end into ranges of per_range
+  static vector<pair<hobject_t, sha1_digest_t>> make_range_digests(
+    const map<hobject_t, eversion_t> &objects,
+    const hobject_t &digest_begin,
+    const hobject_t &end,
+    uint64_t per_range);
+  /**
+   * compare our objects against the digests of a scan request
+   *
+   * Only ranges which end at or before end are compared.  The objects of
+   * the ranges that match are removed from objects and the ranges are
+   * added to matched.
+   */
+  static void match_range_digests(
+    const hobject_t &digest_begin,
+    const vector<pair<hobject_t, sha1_digest_t>> &range_digests,
+    const hobject_t &end,
+    map<hobject_t, eversion_t> *objects,
+    vector<pair<hobject_t, sha1_digest_t>> *matched);
+protected:
+
   /// Update a hash range to reflect changes since the last scan
   void update_range(
     BackfillInterval *bi,        ///< [in,out] interval to update
@@ -1496,6 +1608,7 @@ public:
 
   void handle_backoff(OpRequestRef& op);
 
+  /// trim coid into *ctxp, creating the op if *ctxp is empty
   int trim_object(bool first, const hobject_t &coid, snapid_t snap_to_trim,
 		  OpContextUPtr *ctxp);
   void snap_trimmer(epoch_t e) override;
@@ -1659,7 +1772,7 @@ private:
 	}
       };
       auto *pg = context< SnapTrimmer >().pg;
-      float osd_snap_trim_sleep = pg->osd->osd->get_osd_snap_trim_sleep();
+      float osd_snap_trim_sleep = pg->osd->get_snap_trim_sleep();
       if (osd_snap_trim_sleep > 0) {
 	std::lock_guard l(pg->osd->sleep_lock);
 	wakeup = pg->osd->sleep_timer.add_event_after(
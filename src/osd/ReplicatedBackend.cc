@@ -22,6 +22,7 @@
 #include "common/EventTrace.h"
 #include "include/random.h"
 #include "include/util.h"
+#include "include/crc32c.h"
 #include "OSD.h"
 
 #define dout_context cct
@@ -113,7 +114,7 @@ void ReplicatedBackend::run_recovery_op(
   int priority)
 {
   RPGHandle *h = static_cast<RPGHandle *>(_h);
-  send_pushes(priority, h->pushes);
+  send_pushes(priority, h->pushes, h->batched);
   send_pulls(priority, h->pulls);
   send_recovery_deletes(priority, h->deletes);
   delete h;
@@ -593,6 +594,22 @@ void ReplicatedBackend::do_repop_reply(OpRequestRef op)
   }
 }
 
+// same value as hashing encode(key) and encode(value), without
+// copying every entry into a temporary bufferlist first
+static uint32_t omap_entry_crc32c(
+  uint32_t crc,
+  const string &key,
+  const bufferlist &value)
+{
+  ceph_le32 len;
+  len = key.length();
+  crc = ceph_crc32c(crc, (const unsigned char*)&len, sizeof(len));
+  crc = ceph_crc32c(crc, (const unsigned char*)key.data(), key.length());
+  len = value.length();
+  crc = ceph_crc32c(crc, (const unsigned char*)&len, sizeof(len));
+  return value.crc32c(crc);
+}
+
 int ReplicatedBackend::be_deep_scrub(
   const hobject_t &poid,
   ScrubMap &map,
@@ -633,7 +650,8 @@ int ReplicatedBackend::be_deep_scrub(
       return 0;
     }
     if (r > 0) {
-      pos.data_hash << bl;
+      pos.data_hash = bufferhash(
+	be_scrub_crc32c(pos.data_hash.digest(), bl));
     }
     pos.data_pos += r;
     if (r == cct->_conf->osd_deep_scrub_stride) {
@@ -688,11 +706,8 @@ int ReplicatedBackend::be_deep_scrub(
     pos.omap_bytes += iter->value().length();
     ++pos.omap_keys;
     --max;
-    // fixme: we can do this more efficiently.
-    bufferlist bl;
-    encode(iter->key(), bl);
-    encode(iter->value(), bl);
-    pos.omap_hash << bl;
+    pos.omap_hash = bufferhash(
+      omap_entry_crc32c(pos.omap_hash.digest(), iter->key(), iter->value()));
 
     iter->next();
 
@@ -1907,8 +1922,16 @@ void ReplicatedBackend::handle_push(
   }
 }
 
-void ReplicatedBackend::send_pushes(int prio, map<pg_shard_t, vector<PushOp> > &pushes)
+void ReplicatedBackend::send_pushes(int prio, map<pg_shard_t, vector<PushOp> > &pushes,
+				    bool batched)
 {
+  // batched recovery of small objects wants them all in one message
+  uint64_t max_pushes = cct->_conf->osd_max_push_objects;
+  if (batched) {
+    max_pushes = std::max(
+      max_pushes,
+      cct->_conf.get_val<uint64_t>("osd_recovery_batch_max_objects"));
+  }
   for (map<pg_shard_t, vector<PushOp> >::iterator i = pushes.begin();
        i != pushes.end();
        ++i) {
@@ -1931,7 +1954,7 @@ void ReplicatedBackend::send_pushes(int prio, map<pg_shard_t, vector<PushOp> > &
       for (;
            (j != i->second.end() &&
 	    cost < cct->_conf->osd_max_push_cost &&
-	    pushes < cct->_conf->osd_max_push_objects) ;
+	    pushes < max_pushes) ;
 	   ++j) {
 	dout(20) << __func__ << ": sending push " << *j
 		 << " to osd." << i->first << dendl;
@@ -253,7 +253,8 @@ private:
 			       bufferlist *data_usable);
   void _failed_pull(pg_shard_t from, const hobject_t &soid);
 
-  void send_pushes(int prio, map<pg_shard_t, vector<PushOp> > &pushes);
+  void send_pushes(int prio, map<pg_shard_t, vector<PushOp> > &pushes,
+		   bool batched = false);
   void prep_push_op_blank(const hobject_t& soid, PushOp *op);
   void send_pulls(
     int priority,
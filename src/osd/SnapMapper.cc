@@ -163,6 +163,82 @@ bool SnapMapper::check(const hobject_t &hoid) const
   return false;
 }
 
+string SnapMapper::get_owned_prefix(
+  const string &key, const hobject_t &oid) const
+{
+  // key is get_prefix(pool, snap) + shard_prefix + oid.to_str(); only
+  // this pg has keys under get_prefix(pool, snap) + one of prefixes
+  string tail = shard_prefix + oid.to_str();
+  ceph_assert(key.size() >= tail.size());
+  for (auto &p : prefixes) {
+    if (tail.compare(0, p.size(), p) == 0) {
+      return key.substr(0, key.size() - tail.size()) + p;
+    }
+  }
+  return string();
+}
+
+void SnapMapper::remove_mapping_keys(
+  const hobject_t &oid,
+  const set<string> &keys,
+  MapCacher::Transaction<std::string, bufferlist> *t)
+{
+  if (!batching) {
+    backend.remove_keys(keys, t);
+    return;
+  }
+  for (auto &k : keys) {
+    batch_removals[get_owned_prefix(k, oid)].insert(k);
+  }
+}
+
+void SnapMapper::set_mapping_keys(
+  const map<string, bufferlist> &keys,
+  MapCacher::Transaction<std::string, bufferlist> *t)
+{
+  if (batching) {
+    // a later set wins over an earlier deferred removal
+    for (auto &i : batch_removals) {
+      for (auto &k : keys) {
+	i.second.erase(k.first);
+      }
+    }
+  }
+  backend.set_keys(keys, t);
+}
+
+void SnapMapper::start_batch()
+{
+  ceph_assert(!batching);
+  ceph_assert(batch_removals.empty());
+  batching = true;
+}
+
+void SnapMapper::flush_batch(
+  MapCacher::Transaction<std::string, bufferlist> *t)
+{
+  ceph_assert(batching);
+  batching = false;
+  bool ranged = cct->_conf.get_val<bool>("osd_snap_mapper_range_delete");
+  for (auto &i : batch_removals) {
+    const string &prefix = i.first;
+    auto &keys = i.second;
+    if (keys.empty()) {
+      continue;
+    }
+    if (!ranged || prefix.empty() || keys.size() < 2) {
+      backend.remove_keys(keys, t);
+      continue;
+    }
+    string bound = prefix;
+    bound.back()++;
+    dout(20) << __func__ << " " << keys.size() << " keys under "
+	     << prefix << dendl;
+    backend.remove_keys_ranged(keys, bound, t);
+  }
+  batch_removals.clear();
+}
+
 int SnapMapper::get_snaps(
   const hobject_t &oid,
   object_snaps *out)
@@ -266,7 +342,7 @@ int SnapMapper::update_snaps(
       dout(20) << __func__ << " rm " << i << dendl;
     }
   }
-  backend.remove_keys(to_remove, t);
+  remove_mapping_keys(oid, to_remove, t);
   return 0;
 }
 
@@ -303,7 +379,7 @@ void SnapMapper::add_oid(
       dout(20) << __func__ << " set " << i.first << dendl;
     }
   }
-  backend.set_keys(to_add, t);
+  set_mapping_keys(to_add, t);
 }
 
 int SnapMapper::get_next_objects_to_trim(
@@ -313,6 +389,7 @@ int SnapMapper::get_next_objects_to_trim(
 {
   ceph_assert(out);
   ceph_assert(out->empty());
+  ceph_assert(!batching);
   int r = 0;
   for (set<string>::iterator i = prefixes.begin();
        i != prefixes.end() && out->size() < max && r == 0;
@@ -384,7 +461,7 @@ int SnapMapper::_remove_oid(
       dout(20) << __func__ << " rm " << i << dendl;
     }
   }
-  backend.remove_keys(to_remove, t);
+  remove_mapping_keys(oid, to_remove, t);
   return 0;
 }
 
@@ -53,6 +53,10 @@ public:
       const std::set<std::string> &to_remove) override {
       t->omap_rmkeys(cid, hoid, to_remove);
     }
+    void remove_range(
+      const std::string &first, const std::string &last) override {
+      t->omap_rmkeyrange(cid, hoid, first, last);
+    }
     void add_callback(
       Context *c) override {
       t->register_on_applied(c);
@@ -211,6 +215,22 @@ private:
 
   MapCacher::MapCacher<std::string, bufferlist> backend;
 
+  /// true between start_batch() and flush_batch()
+  bool batching = false;
+  /// mapping keys removed while batching, by the pg owned prefix they
+  /// fall under.  OBJ_ keys are read back by get_snaps and never deferred
+  std::map<std::string, std::set<std::string>> batch_removals;
+
+  std::string get_owned_prefix(
+    const std::string &key, const hobject_t &oid) const;
+  void remove_mapping_keys(
+    const hobject_t &oid,
+    const std::set<std::string> &keys,
+    MapCacher::Transaction<std::string, bufferlist> *t);
+  void set_mapping_keys(
+    const std::map<std::string, bufferlist> &keys,
+    MapCacher::Transaction<std::string, bufferlist> *t);
+
   static std::string get_legacy_prefix(snapid_t snap);
   std::string to_legacy_raw_key(
     const std::pair<snapid_t, hobject_t> &to_map);
@@ -310,6 +330,17 @@ public:
     MapCacher::Transaction<std::string, bufferlist> *t ///< [out] transaction
     );
 
+  /**
+   * Defer mapping key removals from the following add_oid/update_snaps/
+   * remove_oid calls until flush_batch(), which removes runs of adjacent
+   * keys with a single range delete.  All calls up to the flush must go
+   * into the same transaction.
+   */
+  void start_batch();
+  void flush_batch(
+    MapCacher::Transaction<std::string, bufferlist> *t ///< [out] transaction
+    );
+
   /// Returns first object with snap as a snap
   int get_next_objects_to_trim(
     snapid_t snap,              ///< [in] snap to check
@@ -2162,9 +2162,11 @@ private:
   bool ms_can_fast_dispatch_any() const override {
     return true;
   }
+  bool ms_fast_dispatch_by_type() const override { return true; }
   bool ms_can_fast_dispatch(const Message *m) const override {
     switch (m->get_type()) {
     case CEPH_MSG_OSD_OPREPLY:
+    case CEPH_MSG_OSD_BACKOFF:
     case CEPH_MSG_WATCH_NOTIFY:
       return true;
     default:
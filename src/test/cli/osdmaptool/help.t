@@ -31,4 +31,7 @@
      --dump <format>         displays the map in plain text when <format> is 'plain', 'json' if specified format is not supported
      --tree                  displays a tree of the map
      --test-crush [--range-first <first> --range-last <last>] map pgs to acting osds
+     --test-map-incrementals --range-first <first> --range-last <last>
+                             apply <mapdir>/inc_<e> to <mapdir>/<first> and report
+                             osdmap memory with and without table sharing
   [1]
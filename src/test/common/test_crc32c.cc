@@ -363,3 +363,101 @@ TEST(Crc32c, zeros_performance) {
 
 }
 
+
+TEST(Crc32c, Multi) {
+  const unsigned len = 64 * 1024;
+  unsigned char *a = (unsigned char *)malloc(len);
+  for (unsigned i = 0; i < len; i++)
+    a[i] = rand();
+  for (unsigned n = 1; n < 10; n++) {
+    for (int t = 0; t < 100; t++) {
+      uint32_t crc[10], expected[10];
+      unsigned char const *data[10];
+      unsigned length[10];
+      for (unsigned i = 0; i < n; i++) {
+	length[i] = rand() % (t < 50 ? 64 : len);
+	data[i] = (i == 3) ? nullptr : a + rand() % (len - length[i] + 1);
+	crc[i] = rand();
+	expected[i] = ceph_crc32c(crc[i], data[i], length[i]);
+      }
+      ceph_crc32c_multi(n, crc, data, length);
+      for (unsigned i = 0; i < n; i++)
+	ASSERT_EQ(expected[i], crc[i]);
+    }
+  }
+  free(a);
+}
+
+TEST(Crc32c, Split) {
+  const unsigned len = 1024 * 1024;
+  unsigned char *a = (unsigned char *)malloc(len);
+  for (unsigned i = 0; i < len; i++)
+    a[i] = rand();
+  for (int t = 0; t < 200; t++) {
+    unsigned l = t < 100 ? rand() % 65536 : rand() % len;
+    unsigned off = rand() % (len - l + 1);
+    uint32_t crc = rand();
+    ASSERT_EQ(ceph_crc32c(crc, a + off, l), ceph_crc32c_split(crc, a + off, l));
+  }
+  ASSERT_EQ(ceph_crc32c(5, nullptr, len), ceph_crc32c_split(5, nullptr, len));
+  free(a);
+}
+
+// deep scrub digests lots of small omap values and objects, and
+// osd_deep_scrub_stride sized chunks of larger ones
+TEST(Crc32c, multi_performance_compare) {
+  const unsigned count = 4 * 1024;
+  for (unsigned size : {64u, 256u, 1024u, 4096u}) {
+    unsigned char *a = (unsigned char *)malloc(count * size);
+    for (unsigned i = 0; i < count * size; i++)
+      a[i] = i & 0xff;
+    std::vector<uint32_t> single(count, -1), multi(count, -1);
+    std::vector<unsigned char const *> data(count);
+    std::vector<unsigned> length(count, size);
+    for (unsigned i = 0; i < count; i++)
+      data[i] = a + i * size;
+
+    utime_t start = ceph_clock_now();
+    for (int r = 0; r < 100; r++)
+      for (unsigned i = 0; i < count; i++)
+	single[i] = ceph_crc32c(single[i], data[i], length[i]);
+    utime_t end = ceph_clock_now();
+    float rate = (float)count * size * 100 / (1024*1024) / (float)(end - start);
+    std::cout << "size=" << size << " sequential = " << rate << " MB/sec"
+	      << std::endl;
+
+    start = ceph_clock_now();
+    for (int r = 0; r < 100; r++)
+      ceph_crc32c_multi(count, multi.data(), data.data(), length.data());
+    end = ceph_clock_now();
+    rate = (float)count * size * 100 / (1024*1024) / (float)(end - start);
+    std::cout << "size=" << size << " multi = " << rate << " MB/sec"
+	      << std::endl;
+    ASSERT_EQ(single, multi);
+    free(a);
+  }
+}
+
+TEST(Crc32c, split_performance_compare) {
+  const unsigned len = 512 * 1024;
+  unsigned char *a = (unsigned char *)malloc(len);
+  for (unsigned i = 0; i < len; i++)
+    a[i] = i & 0xff;
+  uint32_t single = -1, split = -1;
+
+  utime_t start = ceph_clock_now();
+  for (int r = 0; r < 2000; r++)
+    single = ceph_crc32c(single, a, len);
+  utime_t end = ceph_clock_now();
+  float rate = (float)len * 2000 / (1024*1024) / (float)(end - start);
+  std::cout << "stride=" << len << " single = " << rate << " MB/sec" << std::endl;
+
+  start = ceph_clock_now();
+  for (int r = 0; r < 2000; r++)
+    split = ceph_crc32c_split(split, a, len);
+  end = ceph_clock_now();
+  rate = (float)len * 2000 / (1024*1024) / (float)(end - start);
+  std::cout << "stride=" << len << " split = " << rate << " MB/sec" << std::endl;
+  ASSERT_EQ(single, split);
+  free(a);
+}
@@ -366,6 +366,59 @@ TEST_F(IsaErasureCodeTest, encode)
   }
 }
 
+TEST_F(IsaErasureCodeTest, parity_delta)
+{
+  // m = 1 is updated with a plain xor, m > 1 with the encode tables
+  const char *ms[] = { "1", "3" };
+  for (auto m : ms) {
+    ErasureCodeIsaDefault Isa(tcache);
+    ErasureCodeProfile profile;
+    profile["k"] = "4";
+    profile["m"] = m;
+    Isa.init(profile, &cerr);
+    EXPECT_TRUE(Isa.supports_parity_delta());
+
+    unsigned k = Isa.get_data_chunk_count();
+    unsigned n = Isa.get_chunk_count();
+    unsigned object_size = Isa.get_alignment() * k * 4;
+    set<int> want_to_encode;
+    for (unsigned i = 0; i < n; i++)
+      want_to_encode.insert(i);
+
+    bufferlist in;
+    bufferptr p(buffer::create_page_aligned(object_size));
+    for (unsigned i = 0; i < object_size; i++)
+      p[i] = i * 7 + 3;
+    in.push_back(p);
+    map<int, bufferlist> encoded;
+    EXPECT_EQ(0, Isa.encode(want_to_encode, in, &encoded));
+    unsigned length = encoded[0].length();
+
+    // overwrite part of the first and the last data chunks
+    bufferlist modified;
+    modified.append(in.c_str(), in.length());
+    for (unsigned i = 3; i < length / 2; i++)
+      modified.c_str()[i] ^= 0x5a;
+    for (unsigned i = (k - 1) * length; i < k * length; i++)
+      modified.c_str()[i] = 'X';
+    map<int, bufferlist> reencoded;
+    EXPECT_EQ(0, Isa.encode(want_to_encode, modified, &reencoded));
+
+    map<int, bufferptr> deltas;
+    for (unsigned i : { 0u, k - 1 }) {
+      Isa.encode_delta(bufferptr(encoded[i].c_str(), length),
+		       bufferptr(reencoded[i].c_str(), length),
+		       &deltas[i]);
+    }
+    map<int, bufferptr> coding;
+    for (unsigned i = k; i < n; i++)
+      coding[i] = bufferptr(encoded[i].c_str(), length);
+    EXPECT_EQ(0, Isa.apply_delta(deltas, coding));
+    for (unsigned i = k; i < n; i++)
+      EXPECT_EQ(0, memcmp(coding[i].c_str(), reencoded[i].c_str(), length));
+  }
+}
+
 TEST_F(IsaErasureCodeTest, sanity_check_k)
 {
   ErasureCodeIsaDefault Isa(tcache);
@@ -227,6 +227,78 @@ TYPED_TEST(ErasureCodeTest, minimum_to_decode)
   }
 }
 
+template <typename T>
+void check_parity_delta(T &jerasure)
+{
+  unsigned k = jerasure.get_data_chunk_count();
+  unsigned n = jerasure.get_chunk_count();
+  unsigned object_size = jerasure.get_alignment() * k * 4;
+  set<int> want_to_encode;
+  for (unsigned i = 0; i < n; i++)
+    want_to_encode.insert(i);
+
+  bufferlist in;
+  {
+    bufferptr p(buffer::create_page_aligned(object_size));
+    for (unsigned i = 0; i < object_size; i++)
+      p[i] = i * 7 + 3;
+    in.push_back(p);
+  }
+  map<int, bufferlist> encoded;
+  EXPECT_EQ(0, jerasure.encode(want_to_encode, in, &encoded));
+  unsigned length = encoded[0].length();
+
+  // overwrite part of the second data chunk
+  bufferlist modified;
+  modified.append(in.c_str(), in.length());
+  for (unsigned i = length + 5; i < 2 * length - 9; i++)
+    modified.c_str()[i] ^= 0x5a;
+  map<int, bufferlist> reencoded;
+  EXPECT_EQ(0, jerasure.encode(want_to_encode, modified, &reencoded));
+
+  map<int, bufferptr> deltas;
+  jerasure.encode_delta(bufferptr(encoded[1].c_str(), length),
+			bufferptr(reencoded[1].c_str(), length),
+			&deltas[1]);
+  map<int, bufferptr> coding;
+  for (unsigned i = k; i < n; i++)
+    coding[i] = bufferptr(encoded[i].c_str(), length);
+  EXPECT_EQ(0, jerasure.apply_delta(deltas, coding));
+  for (unsigned i = k; i < n; i++)
+    EXPECT_EQ(0, memcmp(coding[i].c_str(), reencoded[i].c_str(), length));
+}
+
+TYPED_TEST(ErasureCodeTest, parity_delta)
+{
+  TypeParam jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "3";
+  profile["m"] = "2";
+  profile["packetsize"] = "8";
+  jerasure.init(profile, &cerr);
+
+  if (!jerasure.supports_parity_delta()) {
+    map<int, bufferptr> in, out;
+    EXPECT_EQ(-EOPNOTSUPP, jerasure.apply_delta(in, out));
+    return;
+  }
+  check_parity_delta(jerasure);
+}
+
+TEST(ErasureCodeTest, parity_delta_w)
+{
+  const char *ws[] = { "8", "16", "32" };
+  for (auto w : ws) {
+    ErasureCodeJerasureReedSolomonVandermonde jerasure;
+    ErasureCodeProfile profile;
+    profile["k"] = "4";
+    profile["m"] = "3";
+    profile["w"] = w;
+    EXPECT_EQ(0, jerasure.init(profile, &cerr));
+    check_parity_delta(jerasure);
+  }
+}
+
 TEST(ErasureCodeTest, encode)
 {
   ErasureCodeJerasureReedSolomonVandermonde jerasure;
@@ -156,3 +156,87 @@ TEST(pgmap, dump_object_stat_sum_2)
   ASSERT_EQ(percentify(0), tbl.get(0, col++));
   ASSERT_EQ(stringify(byte_u_t(avail/pool.size)), tbl.get(0, col++));
 }
+
+namespace {
+  // a synthetic map shaped like a large cluster: 10 pools, 1000 osds,
+  // 3 replicas per pg
+  void make_pg_stat_updates(unsigned num_pgs, unsigned every, version_t seq,
+			    mempool::pgmap::map<pg_t,pg_stat_t> *updates) {
+    const unsigned num_pools = 10, num_osds = 1000;
+    for (unsigned i = 0; i < num_pgs; i += every) {
+      pg_t pgid(i / num_pools, i % num_pools + 1);
+      pg_stat_t& s = (*updates)[pgid];
+      s.reported_epoch = 10;
+      s.reported_seq = seq;
+      s.state = PG_STATE_ACTIVE | PG_STATE_CLEAN;
+      s.stats.sum.num_objects = 100 + seq;
+      s.stats.sum.num_bytes = (100 + seq) << 22;
+      s.stats.sum.num_object_copies = 3 * (100 + seq);
+      for (unsigned r = 0; r < 3; ++r) {
+	s.up.push_back((i + r * 337) % num_osds);
+      }
+      s.acting = s.up;
+      s.up_primary = s.acting_primary = s.up[0];
+    }
+  }
+}
+
+// apply a full report of every pg versus a report of only the changed
+// ones, as sent by the osds between full syncs.  This is a benchmark, run
+// it with --gtest_also_run_disabled_tests
+TEST(pgmap, DISABLED_apply_incremental_delta_perf)
+{
+  const unsigned num_pgs = 200000;
+  // ~1% of the pgs change between two reports
+  const unsigned changed_every = 100;
+
+  PGMap pg_map;
+  {
+    PGMap::Incremental inc;
+    inc.version = pg_map.version + 1;
+    make_pg_stat_updates(num_pgs, 1, 1, &inc.pg_stat_updates);
+    pg_map.apply_incremental(nullptr, inc);
+  }
+  ASSERT_EQ(num_pgs, pg_map.pg_stat.size());
+  PGMap delta_map = pg_map;
+
+  // the full report carries every pg, only some of which changed
+  PGMap::Incremental full;
+  full.version = pg_map.version + 1;
+  make_pg_stat_updates(num_pgs, 1, 1, &full.pg_stat_updates);
+  make_pg_stat_updates(num_pgs, changed_every, 2, &full.pg_stat_updates);
+  PGMap::Incremental delta;
+  delta.version = delta_map.version + 1;
+  make_pg_stat_updates(num_pgs, changed_every, 2, &delta.pg_stat_updates);
+
+  bufferlist full_bl, delta_bl;
+  encode(full.pg_stat_updates, full_bl);
+  encode(delta.pg_stat_updates, delta_bl);
+
+  auto start = ceph::mono_clock::now();
+  pg_map.apply_incremental(nullptr, full);
+  auto full_time = ceph::mono_clock::now() - start;
+  start = ceph::mono_clock::now();
+  delta_map.apply_incremental(nullptr, delta);
+  auto delta_time = ceph::mono_clock::now() - start;
+
+  std::cout << "full report:  " << full.pg_stat_updates.size() << " pgs, "
+	    << full_bl.length() << " bytes, applied in " << full_time
+	    << std::endl;
+  std::cout << "delta report: " << delta.pg_stat_updates.size() << " pgs, "
+	    << delta_bl.length() << " bytes, applied in " << delta_time
+	    << std::endl;
+
+  // both leave the map in the same state
+  ASSERT_EQ(pg_map.pg_stat.size(), delta_map.pg_stat.size());
+  ASSERT_EQ(pg_map.num_pg, delta_map.num_pg);
+  ASSERT_EQ(pg_map.pg_sum.stats.sum.num_objects,
+	    delta_map.pg_sum.stats.sum.num_objects);
+  ASSERT_EQ(pg_map.pg_sum.stats.sum.num_bytes,
+	    delta_map.pg_sum.stats.sum.num_bytes);
+  for (auto& p : delta.pg_stat_updates) {
+    ASSERT_EQ(p.second.get_version_pair(),
+	      pg_map.pg_stat[p.first].get_version_pair());
+  }
+  ASSERT_LT(delta_bl.length(), full_bl.length());
+}
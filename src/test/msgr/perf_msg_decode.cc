@@ -0,0 +1,215 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Heap allocations and time spent encoding and decoding the messages on
+ * the osd data path, per message type. Every operator new made by the
+ * measuring thread while a message is encoded, or while it is decoded
+ * with decode_message() and released again, is counted; allocations
+ * made while setting up the messages are not.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <functional>
+#include <new>
+#include <string>
+#include <iostream>
+
+using namespace std;
+
+#include "common/ceph_argparse.h"
+#include "common/ceph_time.h"
+#include "common/debug.h"
+#include "global/global_init.h"
+#include "messages/MOSDOp.h"
+#include "messages/MOSDOpReply.h"
+#include "messages/MOSDRepOp.h"
+
+static thread_local bool counting = false;
+static thread_local uint64_t allocs = 0;
+
+void *operator new(size_t size)
+{
+  if (counting)
+    ++allocs;
+  void *p = malloc(size);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+  free(p);
+}
+
+static void usage(const char *name) {
+  cerr << "Usage: " << name << " [iterations] [data bytes]" << std::endl;
+  cerr << "       [iterations]: number of round trips per message type" << std::endl;
+  cerr << "       [data bytes]: size of the data written by write ops" << std::endl;
+}
+
+struct AllocCase {
+  const char *name;
+  std::function<ceph::ref_t<Message>()> make;
+};
+
+// rbd sized names, too long for the small string optimization
+static const string OID = "rbd_data.10226b8b4567.0000000000000c1d";
+static const string NSPACE = "tenant-namespace-0001";
+
+static hobject_t make_hobj()
+{
+  return hobject_t(object_t(OID), "", CEPH_NOSNAP, 0x5a3c1d2e, 1, NSPACE);
+}
+
+static ceph::ref_t<MOSDOp> make_osd_op(bool write, uint32_t data_len)
+{
+  hobject_t hobj = make_hobj();
+  spg_t pgid(pg_t(hobj.get_hash(), hobj.pool));
+  auto m = ceph::make_message<MOSDOp>(
+    1, 1234, hobj, pgid, 42,
+    CEPH_OSD_FLAG_ONDISK | (write ? CEPH_OSD_FLAG_WRITE : CEPH_OSD_FLAG_READ),
+    CEPH_FEATURES_ALL);
+  if (write) {
+    bufferlist bl;
+    bl.append_zero(data_len);
+    m->write(0, data_len, bl);
+  } else {
+    m->read(0, data_len);
+  }
+  return m;
+}
+
+static void decode_one(CephContext *cct, Message *m)
+{
+  ceph_msg_header header = m->get_header();
+  ceph_msg_footer footer = m->get_footer();
+  bufferlist front = m->get_payload();
+  bufferlist middle = m->get_middle();
+  bufferlist data = m->get_data();
+
+  counting = true;
+  Message *d = decode_message(cct, 0, header, footer, front, middle, data,
+			      nullptr);
+  if (d) {
+    // the osd finishes these off in its op threads
+    if (d->get_type() == CEPH_MSG_OSD_OP)
+      static_cast<MOSDOp*>(d)->finish_decode();
+    else if (d->get_type() == MSG_OSD_REPOP)
+      static_cast<MOSDRepOp*>(d)->finish_decode();
+    d->put();
+  }
+  counting = false;
+  if (!d) {
+    cerr << " failed to decode " << m->get_type_name() << std::endl;
+    exit(1);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  if (args.size() < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int iterations = atoi(args[0]);
+  uint32_t data_len = atoi(args[1]);
+
+  const AllocCase cases[] = {
+    { "osd_op read", [&] { return make_osd_op(false, data_len); } },
+    { "osd_op write", [&] { return make_osd_op(true, data_len); } },
+    { "osd_op_reply", [&] {
+	auto req = make_osd_op(false, data_len);
+	auto m = ceph::make_message<MOSDOpReply>(req.get(), 0, 42, 0, false);
+	m->set_reply_versions(eversion_t(42, 7), 7);
+	return ceph::ref_t<Message>(m);
+      } },
+    { "osd_repop", [&] {
+	hobject_t hobj = make_hobj();
+	osd_reqid_t reqid(entity_name_t::CLIENT(4100), 1, 1234);
+	spg_t pgid(pg_t(hobj.get_hash(), hobj.pool));
+	auto m = ceph::make_message<MOSDRepOp>(
+	  reqid, pg_shard_t(0), pgid, hobj, CEPH_OSD_FLAG_ONDISK, 42, 40,
+	  5678, eversion_t(42, 7));
+	m->set_data(bufferlist());
+	return ceph::ref_t<Message>(m);
+      } },
+  };
+
+  cerr << " iterations " << iterations << std::endl;
+  cerr << " data bytes " << data_len << std::endl;
+
+  for (auto& c : cases) {
+    uint64_t enc_allocs = 0, dec_allocs = 0;
+    ceph::timespan enc_time = ceph::timespan::zero();
+    ceph::timespan dec_time = ceph::timespan::zero();
+    for (int n = 0; n < iterations; ++n) {
+      auto m = c.make();
+
+      allocs = 0;
+      auto start = ceph::mono_clock::now();
+      counting = true;
+      m->encode(CEPH_FEATURES_ALL, MSG_CRC_ALL);
+      counting = false;
+      enc_time += ceph::mono_clock::now() - start;
+      enc_allocs += allocs;
+
+      allocs = 0;
+      start = ceph::mono_clock::now();
+      decode_one(g_ceph_context, m.get());
+      dec_time += ceph::mono_clock::now() - start;
+      dec_allocs += allocs;
+    }
+    auto per_msg = [&](uint64_t v) {
+      return iterations ? (double)v / iterations : 0;
+    };
+    cerr << " " << c.name
+	 << ": encode " << per_msg(enc_allocs) << " allocs "
+	 << per_msg(std::chrono::nanoseconds(enc_time).count()) << "ns"
+	 << ", decode " << per_msg(dec_allocs) << " allocs "
+	 << per_msg(std::chrono::nanoseconds(dec_time).count()) << "ns"
+	 << " per message" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,163 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Frame level throughput of the msgr2 secure mode, without any sockets
+ * involved: MessageFrames are encrypted with the tx handler and the wire
+ * image is then decrypted segment by segment the same way ProtocolV2
+ * does it on receive.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <iostream>
+#include <boost/container/static_vector.hpp>
+
+using namespace std;
+
+#include "common/ceph_argparse.h"
+#include "common/debug.h"
+#include "common/Cycles.h"
+#include "global/global_init.h"
+#include "auth/Auth.h"
+#include "msg/async/frames_v2.h"
+
+using namespace ceph::msgr::v2;
+
+static void usage(const char *name) {
+  cerr << "Usage: " << name << " [data bytes] [front buffers] [frames]" << std::endl;
+  cerr << "       [data bytes]: size of the data segment of each frame" << std::endl;
+  cerr << "       [front buffers]: number of small buffers in the front segment" << std::endl;
+  cerr << "       [frames]: number of frames to encrypt and decrypt" << std::endl;
+}
+
+static ceph::bufferlist copy_to_segment(ceph::bufferlist::const_iterator& p,
+					uint32_t len, uint32_t alignment)
+{
+  // what the messenger would read from the socket: a fresh, aligned
+  // buffer per segment
+  ceph::bufferptr bp(ceph::buffer::create_aligned(len, alignment));
+  p.copy(len, bp.c_str());
+  ceph::bufferlist bl;
+  bl.push_back(std::move(bp));
+  return bl;
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  if (args.size() < 3) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  uint32_t data_len = atoi(args[0]);
+  int front_buffers = atoi(args[1]);
+  int frames = atoi(args[2]);
+
+  AuthConnectionMeta auth_meta;
+  auth_meta.con_mode = CEPH_CON_MODE_SECURE;
+  auth_meta.connection_secret.resize(
+    auth_meta.get_connection_secret_length());
+  for (size_t i = 0; i < auth_meta.connection_secret.size(); ++i) {
+    auth_meta.connection_secret[i] = rand();
+  }
+  // the receiving side swaps the nonces, just like the accepting peer
+  auto sender = ceph::crypto::onwire::rxtx_t::create_handler_pair(
+    g_ceph_context, auth_meta, false);
+  auto receiver = ceph::crypto::onwire::rxtx_t::create_handler_pair(
+    g_ceph_context, auth_meta, true);
+
+  ceph_msg_header2 header;
+  ::memset(&header, 0, sizeof(header));
+  ceph::bufferlist front, middle, data;
+  // lots of small buffers, the way encode() leaves the front
+  for (int i = 0; i < front_buffers; ++i) {
+    ceph::bufferptr bp(64);
+    bp.zero();
+    front.push_back(std::move(bp));
+  }
+  data.push_back(ceph::buffer::create_page_aligned(data_len));
+  data.zero();
+
+  cerr << " data bytes " << data_len << std::endl;
+  cerr << " front buffers " << front_buffers << std::endl;
+  cerr << " frames " << frames << std::endl;
+
+  Cycles::init();
+  uint64_t enc_cycles = 0, dec_cycles = 0, wire_bytes = 0;
+  for (int n = 0; n < frames; ++n) {
+    uint64_t start = Cycles::rdtsc();
+    auto wire = MessageFrame::Encode(header, front, middle, data)
+      .get_buffer(sender);
+    enc_cycles += Cycles::rdtsc() - start;
+    wire_bytes += wire.length();
+
+    const std::array<std::pair<uint32_t, uint32_t>, 4> segs = {{
+      { sizeof(header), segment_t::DEFAULT_ALIGNMENT },
+      { front.length(), segment_t::DEFAULT_ALIGNMENT },
+      { middle.length(), segment_t::DEFAULT_ALIGNMENT },
+      { data.length(), segment_t::PAGE_SIZE_ALIGNMENT },
+    }};
+    auto p = std::cbegin(wire);
+    auto preamble = copy_to_segment(p, FRAME_PREAMBLE_SIZE,
+				    segment_t::DEFAULT_ALIGNMENT);
+    std::array<ceph::bufferlist, 4> segments;
+    for (size_t i = 0; i < segs.size(); ++i) {
+      if (segs[i].first) {
+	segments[i] = copy_to_segment(p, segment_onwire_size(segs[i].first),
+				      segs[i].second);
+      }
+    }
+    auto epilogue = copy_to_segment(
+      p, FRAME_SECURE_EPILOGUE_SIZE + receiver.rx->get_extra_size_at_final(),
+      segment_t::DEFAULT_ALIGNMENT);
+
+    start = Cycles::rdtsc();
+    receiver.rx->reset_rx_handler();
+    preamble = receiver.rx->authenticated_decrypt_update(
+      std::move(preamble), segment_t::DEFAULT_ALIGNMENT);
+    for (size_t i = 0; i < segs.size(); ++i) {
+      if (segments[i].length()) {
+	segments[i] = receiver.rx->authenticated_decrypt_update(
+	  std::move(segments[i]), segs[i].second);
+      }
+    }
+    try {
+      epilogue = receiver.rx->authenticated_decrypt_update_final(
+	std::move(epilogue), segment_t::DEFAULT_ALIGNMENT);
+    } catch (ceph::crypto::onwire::MsgAuthError& e) {
+      cerr << " frame " << n << " failed authentication" << std::endl;
+      return 1;
+    }
+    dec_cycles += Cycles::rdtsc() - start;
+  }
+
+  auto report = [&](const char *what, uint64_t cycles) {
+    double us = Cycles::to_microseconds(cycles);
+    cerr << " " << what << " run time " << us << "us, "
+	 << (us ? wire_bytes / us : 0) << " MB/s, "
+	 << (us ? frames * 1000000.0 / us : 0) << " frames/s" << std::endl;
+  };
+  report("encrypt", enc_cycles);
+  report("decrypt", dec_cycles);
+  return 0;
+}
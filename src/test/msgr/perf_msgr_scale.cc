@@ -0,0 +1,416 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * How the messenger copes with many sessions. The server answers
+ * MOSDOps and reports, every interval, its session count, resident
+ * memory per session, served ops and how long an event posted to each
+ * worker waits before it runs. The client opens the given number of
+ * lossy client sessions, one messenger each like librados, and drives
+ * a closed loop of ops over the first few of them while the rest stay
+ * idle. Run them as separate processes so the server numbers only
+ * cover the server; every client messenger brings its own dispatch
+ * threads, so spread 10^5 sessions over several clients.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <limits>
+#include <map>
+
+using namespace std;
+
+#include "common/ceph_argparse.h"
+#include "common/ceph_mutex.h"
+#include "common/ceph_time.h"
+#include "common/debug.h"
+#include "global/global_init.h"
+#include "include/random.h"
+#include "msg/Messenger.h"
+#include "msg/async/AsyncMessenger.h"
+#include "msg/async/Stack.h"
+#include "messages/MOSDOp.h"
+#include "messages/MOSDOpReply.h"
+#include "auth/DummyAuth.h"
+
+static uint64_t get_rss_bytes()
+{
+  // second field: resident pages
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size = 0, resident = 0;
+  if (!(statm >> size >> resident))
+    return 0;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+static double to_us(ceph::timespan t)
+{
+  return std::chrono::duration<double, std::micro>(t).count();
+}
+
+/// latencies in power of two microsecond buckets
+struct LatencyHistogram {
+  std::atomic<uint64_t> buckets[40] = {};
+  std::atomic<uint64_t> count = {0};
+  std::atomic<uint64_t> sum_ns = {0};
+
+  void add(ceph::timespan t) {
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(t).count();
+    unsigned b = 0;
+    while (us && b < 39) {
+      us >>= 1;
+      ++b;
+    }
+    ++buckets[b];
+    ++count;
+    sum_ns += std::chrono::nanoseconds(t).count();
+  }
+  /// upper bound of the bucket holding the given percentile, in us
+  uint64_t percentile(double p) const {
+    uint64_t want = count * p / 100, seen = 0;
+    for (unsigned b = 0; b < 40; ++b) {
+      seen += buckets[b];
+      if (seen > want)
+	return b ? 1ull << b : 1;
+    }
+    return 1ull << 39;
+  }
+  double avg_us() const {
+    return count ? sum_ns / 1000.0 / count : 0;
+  }
+  void reset() {
+    for (auto& b : buckets)
+      b = 0;
+    count = 0;
+    sum_ns = 0;
+  }
+};
+
+class ScaleServer : public Dispatcher {
+  Messenger *msgr = nullptr;
+  DummyAuthClientServer dummy_auth;
+  std::atomic<int64_t> sessions = {0};
+  std::atomic<uint64_t> ops = {0};
+  LatencyHistogram loop_lat;
+
+  // measures how long an event waits in a worker's queue
+  class LoopProbe : public EventCallback {
+    LatencyHistogram *lat;
+    ceph::mono_time queued = ceph::mono_clock::now();
+   public:
+    explicit LoopProbe(LatencyHistogram *l) : lat(l) {}
+    void do_request(uint64_t id) override {
+      lat->add(ceph::mono_clock::now() - queued);
+      delete this;
+    }
+  };
+
+ public:
+  ScaleServer(const string &type)
+    : Dispatcher(g_ceph_context), dummy_auth(g_ceph_context) {
+    msgr = Messenger::create(g_ceph_context, type, entity_name_t::OSD(0), "server", 0, 0);
+    msgr->set_default_policy(Messenger::Policy::stateless_server(0));
+    dummy_auth.auth_registry.refresh_config();
+    msgr->set_auth_server(&dummy_auth);
+  }
+  ~ScaleServer() override {
+    msgr->shutdown();
+    msgr->wait();
+    delete msgr;
+  }
+
+  bool ms_can_fast_dispatch_any() const override { return true; }
+  bool ms_can_fast_dispatch(const Message *m) const override {
+    return m->get_type() == CEPH_MSG_OSD_OP;
+  }
+  void ms_fast_dispatch(Message *m) override {
+    MOSDOp *op = static_cast<MOSDOp*>(m);
+    op->finish_decode();
+    MOSDOpReply *reply = new MOSDOpReply(op, 0, 0, 0, false);
+    m->get_connection()->send_message(reply);
+    m->put();
+    ++ops;
+  }
+  void ms_handle_fast_connect(Connection *con) override {}
+  void ms_handle_fast_accept(Connection *con) override {
+    ++sessions;
+  }
+  bool ms_dispatch(Message *m) override {
+    m->put();
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) override {
+    --sessions;
+    return true;
+  }
+  void ms_handle_remote_reset(Connection *con) override {}
+  bool ms_handle_refused(Connection *con) override { return false; }
+  int ms_handle_authentication(Connection *con) override {
+    return 1;
+  }
+
+  int start(const string &bindaddr) {
+    entity_addr_t addr;
+    if (!addr.parse(bindaddr.c_str()))
+      return -EINVAL;
+    int r = msgr->bind(addr);
+    if (r < 0)
+      return r;
+    msgr->add_dispatcher_head(this);
+    return msgr->start();
+  }
+
+  void run(int interval) {
+    auto stack = static_cast<AsyncMessenger*>(msgr)->get_stack();
+    uint64_t base_rss = get_rss_bytes();
+    uint64_t last_ops = ops;
+    cerr << " baseline rss " << base_rss / 1024 << " KB" << std::endl;
+    while (true) {
+      loop_lat.reset();
+      for (unsigned i = 0; i < stack->get_num_worker(); ++i) {
+	auto w = stack->get_worker(i);
+	w->center.dispatch_event_external(new LoopProbe(&loop_lat));
+      }
+      sleep(interval);
+
+      int64_t n = sessions;
+      uint64_t rss = get_rss_bytes();
+      uint64_t cur_ops = ops;
+      cerr << " sessions " << n
+	   << " rss " << rss / 1024 << " KB";
+      if (n > 0 && rss > base_rss)
+	cerr << " (" << (rss - base_rss) / n << " bytes/session)";
+      cerr << " ops/s " << (cur_ops - last_ops) / interval
+	   << " loop latency avg " << loop_lat.avg_us() << "us max<="
+	   << loop_lat.percentile(100) << "us" << std::endl;
+      last_ops = cur_ops;
+    }
+  }
+};
+
+class ScaleClient : public Dispatcher {
+  // per active session state, hung off the connection
+  struct Session : public RefCountedObject {
+    ConnectionRef con;
+    ceph::mutex lock = ceph::make_mutex("ScaleClient::Session::lock");
+    std::map<ceph_tid_t, ceph::mono_time> inflight;
+    ceph_tid_t last_tid = 0;
+
+    explicit Session(ConnectionRef c) : RefCountedObject(g_ceph_context), con(c) {}
+  };
+
+  string type;
+  vector<Messenger*> msgrs;
+  vector<ConnectionRef> conns;
+  DummyAuthClientServer dummy_auth;
+  bufferlist data;
+  std::atomic<bool> stopping = {false};
+  std::atomic<uint64_t> completed = {0};
+  LatencyHistogram op_lat;
+
+  void send_op(Session *s) {
+    // caller holds s->lock
+    hobject_t hobj(object_t("scale-object"), "", CEPH_NOSNAP, 0, 1, "");
+    spg_t pgid(pg_t(0, 1));
+    auto m = new MOSDOp(0, ++s->last_tid, hobj, pgid, 0, 0, 0);
+    bufferlist bl(data);
+    m->write(0, bl.length(), bl);
+    s->inflight[s->last_tid] = ceph::mono_clock::now();
+    s->con->send_message(m);
+  }
+
+ public:
+  ScaleClient(const string &t, int msg_len)
+    : Dispatcher(g_ceph_context), type(t), dummy_auth(g_ceph_context) {
+    bufferptr ptr(msg_len);
+    memset(ptr.c_str(), 0, msg_len);
+    data.append(ptr);
+    dummy_auth.auth_registry.refresh_config();
+  }
+  ~ScaleClient() override {
+    for (auto& c : conns)
+      c->set_priv(nullptr);
+    conns.clear();
+    for (auto msgr : msgrs) {
+      msgr->shutdown();
+      msgr->wait();
+      delete msgr;
+    }
+  }
+
+  bool ms_can_fast_dispatch_any() const override { return true; }
+  bool ms_can_fast_dispatch(const Message *m) const override {
+    return m->get_type() == CEPH_MSG_OSD_OPREPLY;
+  }
+  void ms_fast_dispatch(Message *m) override {
+    auto priv = m->get_connection()->get_priv();
+    auto s = static_cast<Session*>(priv.get());
+    if (s) {
+      std::lock_guard l{s->lock};
+      auto p = s->inflight.find(m->get_tid());
+      if (p != s->inflight.end()) {
+	op_lat.add(ceph::mono_clock::now() - p->second);
+	s->inflight.erase(p);
+	++completed;
+	if (!stopping)
+	  send_op(s);
+      }
+    }
+    m->put();
+  }
+  void ms_handle_fast_connect(Connection *con) override {}
+  void ms_handle_fast_accept(Connection *con) override {}
+  bool ms_dispatch(Message *m) override {
+    m->put();
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) override { return true; }
+  void ms_handle_remote_reset(Connection *con) override {}
+  bool ms_handle_refused(Connection *con) override { return false; }
+  int ms_handle_authentication(Connection *con) override {
+    return 1;
+  }
+
+  int connect(const string &serveraddr, int connections) {
+    entity_addr_t addr;
+    if (!addr.parse(serveraddr.c_str()))
+      return -EINVAL;
+    addr.set_nonce(0);
+    entity_addrvec_t addrs(addr);
+    auto start = ceph::mono_clock::now();
+    for (int i = 0; i < connections; ++i) {
+      auto nonce = ceph::util::generate_random_number<uint32_t>(
+	1, std::numeric_limits<uint32_t>::max());
+      Messenger *msgr = Messenger::create(g_ceph_context, type, entity_name_t::CLIENT(-1), "client", nonce, 0);
+      msgr->set_default_policy(Messenger::Policy::lossy_client(0));
+      msgr->set_auth_client(&dummy_auth);
+      msgr->add_dispatcher_head(this);
+      msgr->start();
+      ConnectionRef con = msgr->connect_to_osd(addrs);
+      // make the session real even if it never carries an op
+      con->send_keepalive();
+      msgrs.push_back(msgr);
+      conns.push_back(con);
+      if ((i + 1) % 1000 == 0)
+	cerr << " opened " << i + 1 << " sessions in "
+	     << to_us(ceph::mono_clock::now() - start) / 1000000 << "s" << std::endl;
+    }
+
+    unsigned connected = 0;
+    auto deadline = ceph::mono_clock::now() + std::chrono::seconds(60);
+    while (ceph::mono_clock::now() < deadline) {
+      connected = 0;
+      for (auto& c : conns)
+	connected += c->is_connected();
+      if (connected == conns.size())
+	break;
+      usleep(100000);
+    }
+    cerr << " " << connected << "/" << conns.size() << " sessions connected in "
+	 << to_us(ceph::mono_clock::now() - start) / 1000000 << "s" << std::endl;
+    return connected == conns.size() ? 0 : -ETIMEDOUT;
+  }
+
+  void run(int active, int depth, int seconds) {
+    active = std::min<int>(active, conns.size());
+    vector<RefCountedPtr> sessions;
+    for (int i = 0; i < active; ++i) {
+      RefCountedPtr s{new Session(conns[i]), false};
+      conns[i]->set_priv(s);
+      sessions.push_back(s);
+    }
+    auto start = ceph::mono_clock::now();
+    for (auto& p : sessions) {
+      auto s = static_cast<Session*>(p.get());
+      std::lock_guard l{s->lock};
+      for (int d = 0; d < depth; ++d)
+	send_op(s);
+    }
+    sleep(seconds);
+    stopping = true;
+    auto elapsed = to_us(ceph::mono_clock::now() - start) / 1000000;
+
+    cerr << " " << conns.size() << " sessions, " << active << " active, depth "
+	 << depth << ": " << completed / elapsed << " ops/s, latency avg "
+	 << op_lat.avg_us() << "us p50<=" << op_lat.percentile(50)
+	 << "us p99<=" << op_lat.percentile(99) << "us" << std::endl;
+  }
+};
+
+void usage(const string &name) {
+  cerr << "Usage: " << name << " server [bind ip:port] [report interval s]" << std::endl;
+  cerr << "       " << name << " client [server ip:port] [sessions] [active] [depth] [seconds] [msg length]" << std::endl;
+  cerr << "       [sessions]: client sessions to open, one messenger each" << std::endl;
+  cerr << "       [active]: how many of them send ops, the rest stay idle" << std::endl;
+  cerr << "       [depth]: inflight ops per active session" << std::endl;
+  cerr << "       [seconds]: how long the active sessions send ops" << std::endl;
+  cerr << "       [msg length]: message data bytes" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  std::string public_msgr_type = g_ceph_context->_conf->ms_public_type.empty() ? g_ceph_context->_conf.get_val<std::string>("ms_type") : g_ceph_context->_conf->ms_public_type;
+
+  if (args.size() == 3 && string(args[0]) == "server") {
+    int interval = std::max(1, atoi(args[2]));
+    cerr << " using ms-public-type " << public_msgr_type << std::endl;
+    cerr << "       bind ip:port " << args[1] << std::endl;
+    cerr << "       report interval(s) " << interval << std::endl;
+    ScaleServer server(public_msgr_type);
+    int r = server.start(args[1]);
+    if (r < 0) {
+      cerr << " failed to start server: " << cpp_strerror(r) << std::endl;
+      return 1;
+    }
+    server.run(interval);
+    return 0;
+  }
+
+  if (args.size() == 7 && string(args[0]) == "client") {
+    int sessions = atoi(args[2]);
+    int active = atoi(args[3]);
+    int depth = atoi(args[4]);
+    int seconds = atoi(args[5]);
+    int len = atoi(args[6]);
+    cerr << " using ms-public-type " << public_msgr_type << std::endl;
+    cerr << "       server ip:port " << args[1] << std::endl;
+    cerr << "       sessions " << sessions << std::endl;
+    cerr << "       active " << active << std::endl;
+    cerr << "       depth " << depth << std::endl;
+    cerr << "       seconds " << seconds << std::endl;
+    cerr << "       message data bytes " << len << std::endl;
+    ScaleClient client(public_msgr_type, len);
+    if (client.connect(args[1], sessions) < 0) {
+      cerr << " not all sessions came up" << std::endl;
+      return 1;
+    }
+    client.run(active, depth, seconds);
+    return 0;
+  }
+
+  usage(argv[0]);
+  return 1;
+}
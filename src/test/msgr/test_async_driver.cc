@@ -31,6 +31,7 @@
 #include "msg/async/Event.h"
 
 #include <atomic>
+#include <thread>
 
 // We use epoll, kqueue, evport, select in descending order by performance.
 #if defined(__linux__)
@@ -330,6 +331,50 @@ TEST(EventCenterTest, DispatchTest) {
   worker2.join();
 }
 
+TEST(EventCenterTest, BusyPollTest) {
+  g_ceph_context->_conf.set_val("ms_async_busy_poll_us", "200000");
+  // don't let a busy test machine turn spinning off
+  g_ceph_context->_conf.set_val("ms_async_busy_poll_load_limit", "1000");
+  EventCenter center(g_ceph_context);
+  center.init(100, 3, "posix");
+  center.set_owner();
+  g_ceph_context->_conf.set_val("ms_async_busy_poll_us", "0");
+  g_ceph_context->_conf.set_val("ms_async_busy_poll_load_limit", "0.8");
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  EventCallbackRef e(new FakeEvent());
+  ASSERT_EQ(0, center.create_file_event(fds[0], EVENT_READABLE, e));
+
+  // an event arriving shortly after we start waiting is found by spinning
+  std::thread writer([&] {
+    usleep(1000);
+    ASSERT_EQ(1, write(fds[1], "x", 1));
+  });
+  EventCenter::wait_stats_t wait;
+  ASSERT_EQ(1, center.process_events(1000000, nullptr, &wait));
+  writer.join();
+  ASSERT_EQ(EventCenter::WAIT_SPIN_HIT, wait.result);
+  ASSERT_GT(wait.spun, ceph::timespan::zero());
+  char c;
+  ASSERT_EQ(1, read(fds[0], &c, 1));
+
+  // while nothing happens the spin window closes
+  int i = 0;
+  for (; i < 64; ++i) {
+    center.process_events(1000, nullptr, &wait);
+    ASSERT_EQ(EventCenter::WAIT_TIMEOUT, wait.result);
+    if (wait.spun == ceph::timespan::zero())
+      break;
+  }
+  ASSERT_LT(i, 64);
+
+  center.delete_file_event(fds[0], EVENT_READABLE);
+  ::close(fds[0]);
+  ::close(fds[1]);
+  delete e;
+}
+
 INSTANTIATE_TEST_SUITE_P(
   AsyncMessenger,
   EventDriverTest,
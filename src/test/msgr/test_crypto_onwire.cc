@@ -0,0 +1,233 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include "auth/Auth.h"
+#include "global/global_context.h"
+#include "msg/async/crypto_onwire.h"
+
+using ceph::crypto::onwire::MsgAuthError;
+using ceph::crypto::onwire::rxtx_t;
+
+static constexpr uint32_t TAG_LEN = 16;
+
+class CryptoOnWireTest : public ::testing::Test {
+public:
+  AuthConnectionMeta auth_meta;
+  rxtx_t sender, receiver, reference;
+
+  void SetUp() override {
+    auth_meta.con_mode = CEPH_CON_MODE_SECURE;
+    auth_meta.connection_secret.resize(
+      auth_meta.get_connection_secret_length());
+    for (size_t i = 0; i < auth_meta.connection_secret.size(); ++i) {
+      auth_meta.connection_secret[i] = rand();
+    }
+    sender = rxtx_t::create_handler_pair(g_ceph_context, auth_meta, false);
+    // the receiving side swaps the nonces, just like the accepting peer
+    receiver = rxtx_t::create_handler_pair(g_ceph_context, auth_meta, true);
+    // same key and nonces as the sender, fed with contiguous plaintext
+    reference = rxtx_t::create_handler_pair(g_ceph_context, auth_meta, false);
+  }
+
+  static ceph::bufferptr make_buffer(uint32_t len, char seed) {
+    ceph::bufferptr bp(len);
+    for (uint32_t i = 0; i < len; ++i) {
+      bp.c_str()[i] = seed + i * 7;
+    }
+    return bp;
+  }
+
+  // a contiguous copy that leaves the source's buffers alone
+  static ceph::bufferlist flatten(const ceph::bufferlist& bl) {
+    ceph::bufferptr bp(bl.length());
+    bl.cbegin().copy(bl.length(), bp.c_str());
+    ceph::bufferlist flat;
+    flat.push_back(std::move(bp));
+    return flat;
+  }
+
+  // encrypt plaintext as it is fragmented and check the result against
+  // the reference handler encrypting the same bytes in one piece
+  ceph::bufferlist encrypt(const ceph::bufferlist& plaintext) {
+    sender.tx->reset_tx_handler({plaintext.length()});
+    sender.tx->authenticated_encrypt_update(plaintext);
+    auto wire = sender.tx->authenticated_encrypt_final();
+
+    auto flat = flatten(plaintext);
+    reference.tx->reset_tx_handler({flat.length()});
+    reference.tx->authenticated_encrypt_update(flat);
+    auto expected = reference.tx->authenticated_encrypt_final();
+
+    EXPECT_EQ(plaintext.length() + TAG_LEN, wire.length());
+    EXPECT_TRUE(wire.contents_equal(expected));
+    return wire;
+  }
+};
+
+TEST_F(CryptoOnWireTest, mixed_buffers)
+{
+  // small buffers are batched into one cipher update, large ones are
+  // encrypted directly; mix them in every order
+  const std::vector<std::vector<uint32_t>> layouts = {
+    { 1 },
+    { 4096 },
+    { 17, 100, 3000 },
+    { 64, 4096, 64 },
+    { 8192 + 5, 13, 4095, 4097 },
+    { 4096, 4096 },
+    { 31, 33, 65536, 1, 2, 3, 16384, 4000 },
+  };
+  char seed = 0;
+  for (auto& layout : layouts) {
+    ceph::bufferlist plaintext;
+    for (auto len : layout) {
+      plaintext.push_back(make_buffer(len, ++seed));
+    }
+    auto expected = flatten(plaintext);
+
+    auto wire = encrypt(plaintext);
+    // the sender's buffers are left alone
+    ASSERT_TRUE(plaintext.contents_equal(expected));
+
+    ceph::bufferlist ciphertext, tag;
+    wire.splice(0, plaintext.length(), &ciphertext);
+    tag = std::move(wire);
+    receiver.rx->reset_rx_handler();
+    auto decrypted = receiver.rx->authenticated_decrypt_update(
+      std::move(ciphertext), 16);
+    ASSERT_NO_THROW(receiver.rx->authenticated_decrypt_update_final(
+      std::move(tag), 16));
+    ASSERT_TRUE(decrypted.contents_equal(expected));
+  }
+}
+
+TEST_F(CryptoOnWireTest, rx_buffers)
+{
+  const uint32_t len = 8192 + 48;
+  char seed = 0;
+  // how the ciphertext reaches the rx handler
+  enum { UNIQUE, SHARED, UNALIGNED, FRAGMENTED, TAIL_IN_FINAL };
+  for (int mode : { UNIQUE, SHARED, UNALIGNED, FRAGMENTED, TAIL_IN_FINAL }) {
+    ceph::bufferlist plaintext;
+    plaintext.push_back(make_buffer(100, ++seed));
+    plaintext.push_back(make_buffer(len - 100, ++seed));
+    auto wire = encrypt(plaintext);
+    auto wire_copy = flatten(wire);
+
+    ceph::bufferlist ciphertext, shared, decrypted;
+    const char *segment = nullptr;
+    switch (mode) {
+    case UNIQUE:
+    case SHARED:
+      {
+	// one aligned buffer, like the messenger reads a segment into
+	ceph::bufferptr bp(ceph::buffer::create_aligned(len, 4096));
+	wire.cbegin().copy(len, bp.c_str());
+	segment = bp.c_str();
+	ciphertext.push_back(bp);
+	if (mode == SHARED) {
+	  // somebody else still looks at the ciphertext
+	  shared.push_back(bp);
+	}
+      }
+      break;
+    case UNALIGNED:
+      {
+	ceph::bufferptr raw(ceph::buffer::create_aligned(len + 1, 4096));
+	wire.cbegin().copy(len, raw.c_str() + 1);
+	ciphertext.push_back(ceph::bufferptr(raw, 1, len));
+      }
+      break;
+    case FRAGMENTED:
+    case TAIL_IN_FINAL:
+      {
+	ceph::bufferlist copy;
+	copy.substr_of(wire_copy, 0, len);
+	copy.splice(0, 4096, &ciphertext);
+	ciphertext.append(copy);
+      }
+      break;
+    }
+    ceph::bufferlist tag;
+    tag.substr_of(wire_copy, len, TAG_LEN);
+
+    receiver.rx->reset_rx_handler();
+    if (mode == TAIL_IN_FINAL) {
+      // hand the last chunk of ciphertext in along with the tag
+      ceph::bufferlist head, tail;
+      ciphertext.splice(0, len - 48, &head);
+      tail.append(ciphertext);
+      tail.append(tag);
+      decrypted = receiver.rx->authenticated_decrypt_update(
+	std::move(head), 16);
+      ceph::bufferlist rest;
+      ASSERT_NO_THROW(rest = receiver.rx->authenticated_decrypt_update_final(
+	std::move(tail), 16));
+      decrypted.append(rest);
+    } else {
+      decrypted = receiver.rx->authenticated_decrypt_update(
+	std::move(ciphertext), mode == UNALIGNED ? 4096 : 16);
+      ASSERT_NO_THROW(receiver.rx->authenticated_decrypt_update_final(
+	std::move(tag), 16));
+    }
+    ASSERT_TRUE(decrypted.contents_equal(plaintext)) << "mode " << mode;
+    if (mode == UNIQUE) {
+      // decrypted in place
+      ASSERT_EQ(segment, decrypted.front().c_str());
+    }
+    if (mode == SHARED) {
+      // decrypting must not have touched the other reference
+      ASSERT_NE(segment, decrypted.front().c_str());
+      ceph::bufferlist expected;
+      expected.substr_of(wire_copy, 0, len);
+      ASSERT_TRUE(shared.contents_equal(expected));
+    }
+    if (mode == UNALIGNED) {
+      ASSERT_TRUE(decrypted.front().is_aligned(4096));
+    }
+  }
+}
+
+TEST_F(CryptoOnWireTest, authentication)
+{
+  ceph::bufferlist plaintext;
+  plaintext.push_back(make_buffer(64, 1));
+  plaintext.push_back(make_buffer(4096, 2));
+  const uint32_t len = plaintext.length();
+
+  // flip a bit in the ciphertext, then in the tag
+  for (uint32_t off : { 10u, 64u + 100u, len + 3 }) {
+    auto tampered = flatten(encrypt(plaintext));
+    tampered.c_str()[off] ^= 1;
+
+    ceph::bufferlist ciphertext, tag;
+    tampered.splice(0, len, &ciphertext);
+    tag = std::move(tampered);
+    receiver.rx->reset_rx_handler();
+    receiver.rx->authenticated_decrypt_update(std::move(ciphertext), 16);
+    ASSERT_THROW(receiver.rx->authenticated_decrypt_update_final(
+      std::move(tag), 16), MsgAuthError) << "offset " << off;
+  }
+
+  // a frame decrypted with the wrong nonce doesn't authenticate either
+  encrypt(plaintext);
+  auto wire = encrypt(plaintext);
+  ceph::bufferlist ciphertext, tag;
+  wire.splice(0, len, &ciphertext);
+  tag = std::move(wire);
+  receiver.rx->reset_rx_handler();
+  receiver.rx->authenticated_decrypt_update(std::move(ciphertext), 16);
+  ASSERT_THROW(receiver.rx->authenticated_decrypt_update_final(
+    std::move(tag), 16), MsgAuthError);
+}
@@ -21,9 +21,11 @@
 #include <time.h>
 #include <set>
 #include <list>
+#include <sys/socket.h>
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/ceph_argparse.h"
+#include "common/perf_counters_collection.h"
 #include "global/global_init.h"
 #include "msg/Dispatcher.h"
 #include "msg/msg_types.h"
@@ -873,6 +875,51 @@ TEST_P(MessengerTest, SimpleTest) {
   server_msgr->wait();
 }
 
+// asks the messenger to route fast dispatch by message type
+class TypeRoutedDispatcher : public FakeDispatcher {
+ public:
+  mutable std::atomic<unsigned> queries = {0};
+
+  explicit TypeRoutedDispatcher(bool s) : FakeDispatcher(s) {}
+  bool ms_fast_dispatch_by_type() const override { return true; }
+  bool ms_can_fast_dispatch(const Message *m) const override {
+    queries++;
+    return FakeDispatcher::ms_can_fast_dispatch(m);
+  }
+};
+
+TEST_P(MessengerTest, FastDispatchRouteTest) {
+  TypeRoutedDispatcher cli_dispatcher(false), srv_dispatcher(true);
+  entity_addr_t bind_addr;
+  bind_addr.parse("v2:127.0.0.1");
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  ConnectionRef conn = client_msgr->connect_to(server_msgr->get_mytype(),
+					       server_msgr->get_myaddrs());
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_EQ(conn->send_message(new MPing()), 0);
+    Mutex::Locker l(cli_dispatcher.lock);
+    while (!cli_dispatcher.got_new)
+      cli_dispatcher.cond.Wait(cli_dispatcher.lock);
+    cli_dispatcher.got_new = false;
+  }
+  ASSERT_EQ(20U, static_cast<Session*>(conn->get_priv().get())->get_count());
+  // the server receives and replies from its worker thread only, so the
+  // first ping is the only one it has to ask about
+  ASSERT_EQ(1U, srv_dispatcher.queries.load());
+  ASSERT_GE(2U, cli_dispatcher.queries.load());
+
+  client_msgr->shutdown();
+  client_msgr->wait();
+  server_msgr->shutdown();
+  server_msgr->wait();
+}
+
 TEST_P(MessengerTest, SimpleMsgr2Test) {
   FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
   entity_addr_t legacy_addr;
@@ -1929,6 +1976,201 @@ TEST_P(MessengerTest, SyntheticStressTest1) {
   test_msg.wait_for_done();
 }
 
+// sum of a messenger worker counter over all workers
+static uint64_t get_worker_counter(const string& name)
+{
+  uint64_t sum = 0;
+  g_ceph_context->get_perfcounters_collection()->with_counters(
+    [&](const PerfCountersCollectionImpl::CounterMap& by_path) {
+      for (auto& [path, ref] : by_path) {
+	if (path.compare(0, 23, "AsyncMessenger::Worker-") == 0 &&
+	    path.size() > name.size() &&
+	    path.compare(path.size() - name.size() - 1, string::npos,
+			 "." + name) == 0) {
+	  sum += ref.data->u64;
+	}
+      }
+    });
+  return sum;
+}
+
+// exercises MSG_ZEROCOPY sends over loopback with the posix stack; the
+// kernel copies anyway but still runs the completion path
+TEST_P(MessengerTest, SyntheticZeroCopyTest) {
+  if (string(GetParam()) != "async+posix") {
+    GTEST_SKIP() << "zero-copy send is only implemented by the posix stack";
+  }
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+  {
+    int sd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_LE(0, sd);
+    int on = 1;
+    int r = ::setsockopt(sd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on));
+    ::close(sd);
+    if (r < 0) {
+      GTEST_SKIP() << "the kernel doesn't support SO_ZEROCOPY";
+    }
+  }
+#else
+  GTEST_SKIP() << "built without MSG_ZEROCOPY";
+#endif
+  uint64_t zc_before = get_worker_counter("msgr_send_zerocopy");
+  uint64_t copied_before = get_worker_counter("msgr_send_zerocopy_copied");
+  g_ceph_context->_conf.set_val("ms_tcp_zerocopy", "true");
+  g_ceph_context->_conf.set_val("ms_tcp_zerocopy_min_size", "4096");
+  SyntheticWorkload test_msg(8, 32, GetParam(), 100,
+                             Messenger::Policy::stateful_server(0),
+                             Messenger::Policy::lossless_client(0));
+  for (int i = 0; i < 10; ++i) {
+    test_msg.generate_connection();
+  }
+  gen_type rng(time(NULL));
+  for (int i = 0; i < 2000; ++i) {
+    if (!(i % 10)) {
+      lderr(g_ceph_context) << "Op " << i << ": " << dendl;
+      test_msg.print_internal_state();
+    }
+    boost::uniform_int<> true_false(0, 99);
+    int val = true_false(rng);
+    if (val > 95) {
+      test_msg.generate_connection();
+    } else if (val > 90) {
+      test_msg.drop_connection();
+    } else if (val > 10) {
+      test_msg.send_message();
+    } else {
+      usleep(rand() % 1000 + 500);
+    }
+  }
+  test_msg.wait_for_done();
+  g_ceph_context->_conf.set_val("ms_tcp_zerocopy", "false");
+  g_ceph_context->_conf.set_val("ms_tcp_zerocopy_min_size", "65536");
+
+  // most messages are well over 4K, so sends took the zero-copy path
+  uint64_t zc = get_worker_counter("msgr_send_zerocopy") - zc_before;
+  ASSERT_GT(zc, 0u);
+  // every pinned buffer is released once its completion arrives, also
+  // for dropped connections, whose worker keeps reaping after close
+  for (int i = 0; i < 100 &&
+	 get_worker_counter("msgr_send_zerocopy_pending") > 0; ++i) {
+    usleep(100 * 1000);
+  }
+  ASSERT_EQ(0u, get_worker_counter("msgr_send_zerocopy_pending"));
+  // and over loopback the kernel reports that it copied them after all
+  uint64_t copied =
+    get_worker_counter("msgr_send_zerocopy_copied") - copied_before;
+  ASSERT_GT(copied, 0u);
+  ASSERT_LE(copied, zc);
+}
+
+// bursts of messages held back and written together
+TEST_P(MessengerTest, SyntheticCoalesceTest) {
+  const uint64_t budget_us = 2000;
+  uint64_t coalesced_before =
+    get_worker_counter("msgr_send_coalesced_messages");
+  g_ceph_context->_conf.set_val("ms_async_coalesce_latency_us",
+				std::to_string(budget_us));
+  g_ceph_context->_conf.set_val("ms_async_coalesce_max_bytes", "8192");
+  SyntheticWorkload test_msg(8, 32, GetParam(), 100,
+                             Messenger::Policy::stateful_server(0),
+                             Messenger::Policy::lossless_client(0));
+  for (int i = 0; i < 10; ++i) {
+    test_msg.generate_connection();
+  }
+  gen_type rng(time(NULL));
+  for (int i = 0; i < 2000; ++i) {
+    if (!(i % 10)) {
+      lderr(g_ceph_context) << "Op " << i << ": " << dendl;
+      test_msg.print_internal_state();
+    }
+    boost::uniform_int<> true_false(0, 99);
+    int val = true_false(rng);
+    if (val > 95) {
+      test_msg.generate_connection();
+    } else if (val > 92) {
+      test_msg.drop_connection();
+    } else if (val > 2) {
+      test_msg.send_message();
+    } else {
+      usleep(rand() % 1000 + 500);
+    }
+  }
+  test_msg.wait_for_done();
+  ASSERT_GT(get_worker_counter("msgr_send_coalesced_messages"),
+	    coalesced_before);
+
+  // a burst of pings is held back, but once it stops the last of them
+  // still goes out within the budget, on both sides of the round trip
+  FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
+  entity_addr_t bind_addr;
+  bind_addr.parse("v2:127.0.0.1");
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+  ConnectionRef conn = client_msgr->connect_to(server_msgr->get_mytype(),
+					       server_msgr->get_myaddrs());
+  ASSERT_EQ(conn->send_message(new MPing()), 0);
+  CHECK_AND_WAIT_TRUE(conn->get_priv() &&
+    static_cast<Session*>(conn->get_priv().get())->get_count() == 1);
+  auto session = static_cast<Session*>(conn->get_priv().get());
+  ASSERT_TRUE(session);
+  ASSERT_EQ(1u, session->get_count());
+
+  const uint64_t burst = 200;
+  for (uint64_t i = 0; i < burst; ++i) {
+    ASSERT_EQ(conn->send_message(new MPing()), 0);
+  }
+  auto last_sent = ceph::mono_clock::now();
+  CHECK_AND_WAIT_TRUE(session->get_count() == burst + 1);
+  uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+    ceph::mono_clock::now() - last_sent).count();
+  ASSERT_EQ(burst + 1, session->get_count());
+  // plus slack for the workers, the dispatchers and the polling above
+  ASSERT_LT(elapsed, 2 * budget_us + 100000);
+
+  server_msgr->shutdown();
+  client_msgr->shutdown();
+  server_msgr->wait();
+  client_msgr->wait();
+  g_ceph_context->_conf.set_val("ms_async_coalesce_latency_us", "0");
+  g_ceph_context->_conf.set_val("ms_async_coalesce_max_bytes", "65536");
+}
+
+// moves busy connections between workers while messages are in flight
+TEST_P(MessengerTest, SyntheticRebalanceTest) {
+  g_ceph_context->_conf.set_val("ms_async_rebalance_interval", "0.05");
+  g_ceph_context->_conf.set_val("ms_async_rebalance_threshold", "0");
+  SyntheticWorkload test_msg(8, 32, GetParam(), 100,
+                             Messenger::Policy::stateful_server(0),
+                             Messenger::Policy::lossless_client(0));
+  for (int i = 0; i < 10; ++i) {
+    test_msg.generate_connection();
+  }
+  gen_type rng(time(NULL));
+  for (int i = 0; i < 2000; ++i) {
+    if (!(i % 10)) {
+      lderr(g_ceph_context) << "Op " << i << ": " << dendl;
+      test_msg.print_internal_state();
+    }
+    boost::uniform_int<> true_false(0, 99);
+    int val = true_false(rng);
+    if (val > 95) {
+      test_msg.generate_connection();
+    } else if (val > 90) {
+      test_msg.drop_connection();
+    } else if (val > 10) {
+      test_msg.send_message();
+    } else {
+      usleep(rand() % 1000 + 500);
+    }
+  }
+  test_msg.wait_for_done();
+  g_ceph_context->_conf.set_val("ms_async_rebalance_interval", "0");
+  g_ceph_context->_conf.set_val("ms_async_rebalance_threshold", "0.2");
+}
+
 
 TEST_P(MessengerTest, SyntheticInjectTest) {
   uint64_t dispatch_throttle_bytes = g_ceph_context->_conf->ms_dispatch_throttle_bytes;
@@ -2216,6 +2458,9 @@ INSTANTIATE_TEST_SUITE_P(
   MessengerTest,
   ::testing::Values(
     "async+posix"
+#ifdef __linux__
+    , "async+shm"
+#endif
   )
 );
 
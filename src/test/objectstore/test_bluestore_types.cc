@@ -1569,6 +1569,20 @@ TEST(BlueStoreRepairer, StoreSpaceTracker)
   ASSERT_TRUE(bmap2.is_used(hoid, 0x3223b19ffff));
 }
 
+TEST(BlueStore, kv_pressure_throttle_ratio)
+{
+  // full throttles up to the start pressure
+  ASSERT_DOUBLE_EQ(1.0, BlueStore::kv_pressure_throttle_ratio(0, .5, .1));
+  ASSERT_DOUBLE_EQ(1.0, BlueStore::kv_pressure_throttle_ratio(.5, .5, .1));
+  // then shrinking linearly down to the min ratio at full pressure
+  ASSERT_DOUBLE_EQ(.55, BlueStore::kv_pressure_throttle_ratio(.75, .5, .1));
+  ASSERT_DOUBLE_EQ(.1, BlueStore::kv_pressure_throttle_ratio(1.0, .5, .1));
+  ASSERT_DOUBLE_EQ(.1, BlueStore::kv_pressure_throttle_ratio(1.5, .5, .1));
+  // a start of 1 never shrinks them
+  ASSERT_DOUBLE_EQ(1.0, BlueStore::kv_pressure_throttle_ratio(1.0, 1.0, .1));
+  ASSERT_DOUBLE_EQ(.4, BlueStore::kv_pressure_throttle_ratio(.6, 0, 0));
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -17,13 +17,18 @@
 #include <iostream>
 #include <time.h>
 #include <sys/mount.h>
+#include <atomic>
+#include <thread>
 #include "kv/KeyValueDB.h"
+#include "kv/RocksDBStore.h"
 #include "include/Context.h"
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
+#include "common/perf_counters.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/errno.h"
+#include "common/ceph_json.h"
 #include "include/stringify.h"
 #include <gtest/gtest.h>
 
@@ -50,9 +55,21 @@ public:
 
   void init() {
     cout << "Creating " << string(GetParam()) << "\n";
-    db.reset(KeyValueDB::create(g_ceph_context, string(GetParam()),
+    string type(GetParam());
+    // "memdb_skiplist" is memdb with its concurrent index
+    if (type == "memdb_skiplist") {
+      g_ceph_context->_conf.set_val("memdb_index_type", "skiplist");
+      type = "memdb";
+    } else {
+      g_ceph_context->_conf.set_val("memdb_index_type", "map");
+    }
+    db.reset(KeyValueDB::create(g_ceph_context, type,
 				"kv_test_temp_dir"));
   }
+
+  bool is_memdb() {
+    return string(GetParam()).compare(0, 5, "memdb") == 0;
+  }
   void fini() {
     db.reset(NULL);
   }
@@ -310,6 +327,261 @@ TEST_P(KVTest, RMRange) {
   fini();
 }
 
+TEST_P(KVTest, RMRangeBudget) {
+  // ranges above the threshold, and any range once the transaction used
+  // up its point deletes, become range deletes.  only a key range that
+  // gathered enough tombstones is compacted.
+  g_ceph_context->_conf.set_val("rocksdb_max_items_rmrange", "8");
+  g_ceph_context->_conf.set_val("rocksdb_max_items_rmrange_per_txn", "12");
+  g_ceph_context->_conf.set_val("rocksdb_tombstone_compact_threshold", "15");
+  init();
+  ASSERT_EQ(0, db->create_and_open(cout));
+  bufferlist value;
+  value.append("value");
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned o = 0; o < 7; ++o) {
+      for (unsigned i = 0; i < (o < 4 ? 10 : 5); ++i) {
+	t->set("prefix", stringify(o) + "." + stringify(i), value);
+      }
+      t->set("prefix", stringify(o) + "~", value);
+    }
+    db->submit_transaction_sync(t);
+  }
+  auto rm_object = [](KeyValueDB::Transaction t, unsigned o) {
+    t->rm_range_keys("prefix", stringify(o) + ".", stringify(o) + "~");
+  };
+  PerfCounters *logger = db->get_perf_counters();
+  bool rocksdb = string(GetParam()) == "rocksdb";
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    rm_object(t, 0);  // too large: range delete
+    rm_object(t, 4);  // 5 point deletes
+    rm_object(t, 5);  // 5 more
+    rm_object(t, 6);  // only 2 left in the budget: range delete
+    t->rmkeys_by_prefix("other");
+    db->submit_transaction_sync(t);
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    rm_object(t, 1);
+    db->submit_transaction_sync(t);
+  }
+  if (rocksdb) {
+    ASSERT_EQ(3u, logger->get(l_rocksdb_rmrange));
+    // 37 tombstones, but no single range has 15
+    ASSERT_EQ(0u, logger->get(l_rocksdb_compact_tombstones));
+  }
+  {
+    // joins the ranges of objects 0 and 1
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("prefix", "0.", "1~");
+    db->submit_transaction_sync(t);
+  }
+  if (rocksdb) {
+    ASSERT_EQ(1u, logger->get(l_rocksdb_compact_tombstones));
+  }
+  KeyValueDB::Iterator it = db->get_iterator("prefix");
+  it->seek_to_first();
+  vector<string> expected = { "1~" };
+  for (unsigned o = 2; o < 4; ++o) {
+    for (unsigned i = 0; i < 10; ++i) {
+      expected.push_back(stringify(o) + "." + stringify(i));
+    }
+    expected.push_back(stringify(o) + "~");
+  }
+  for (unsigned o = 4; o < 7; ++o) {
+    expected.push_back(stringify(o) + "~");
+  }
+  for (auto& k : expected) {
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ(k, it->key());
+    it->next();
+  }
+  ASSERT_FALSE(it->valid());
+  it.reset();
+  fini();
+  g_ceph_context->_conf.rm_val("rocksdb_max_items_rmrange");
+  g_ceph_context->_conf.rm_val("rocksdb_max_items_rmrange_per_txn");
+  g_ceph_context->_conf.rm_val("rocksdb_tombstone_compact_threshold");
+}
+
+TEST_P(KVTest, RMPrefixIterate) {
+  ASSERT_EQ(0, db->create_and_open(cout));
+  bufferlist value;
+  value.append("value");
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < 100; ++i) {
+      t->set("a", "key" + stringify(i), value);
+      t->set("b", "key" + stringify(i), value);
+      t->set("c", "key" + stringify(i), value);
+    }
+    db->submit_transaction_sync(t);
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkeys_by_prefix("b");
+    db->submit_transaction_sync(t);
+  }
+  {
+    KeyValueDB::Iterator it = db->get_iterator("b");
+    it->seek_to_first();
+    ASSERT_FALSE(it->valid());
+  }
+  {
+    KeyValueDB::Iterator it = db->get_iterator("a");
+    it->seek_to_last();
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ("key99", it->key());
+    ASSERT_EQ(0, it->prev());
+    ASSERT_EQ("key98", it->key());
+    it->upper_bound("key98");
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ("key99", it->key());
+    ASSERT_EQ(0, it->next());
+    ASSERT_FALSE(it->valid());
+  }
+  {
+    int n = 0;
+    KeyValueDB::WholeSpaceIterator it = db->get_wholespace_iterator();
+    for (it->seek_to_first(); it->valid(); it->next()) {
+      auto k = it->raw_key();
+      ASSERT_TRUE(k.first == "a" || k.first == "c");
+      ++n;
+    }
+    ASSERT_EQ(200, n);
+  }
+  if (string(GetParam()) == "memdb_skiplist") {
+    // an iterator survives removal of the key it is positioned on
+    KeyValueDB::Iterator it = db->get_iterator("c");
+    it->lower_bound("key10");
+    ASSERT_EQ("key10", it->key());
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("c", "key10", "key12");
+    db->submit_transaction_sync(t);
+    ASSERT_EQ(0, it->next());
+    ASSERT_EQ("key12", it->key());
+  }
+  fini();
+}
+
+TEST_P(KVTest, ConcurrentReadWrite) {
+  if (!is_memdb())
+    return;
+  ASSERT_EQ(0, db->create_and_open(cout));
+  const int nkeys = 2000;
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < nkeys; i += 2) {
+      bufferlist v;
+      v.append(stringify(i));
+      t->set("prefix", "key" + stringify(i), v);
+    }
+    db->submit_transaction_sync(t);
+  }
+  std::atomic<bool> stop = { false };
+  std::atomic<uint64_t> errors = { 0 };
+  auto reader = [&]() {
+    while (!stop) {
+      KeyValueDB::Iterator it = db->get_iterator("prefix");
+      string last;
+      for (it->seek_to_first(); it->valid(); it->next()) {
+	string k = it->key();
+	if (!last.empty() && k <= last) {
+	  ++errors;
+	}
+	if (_bl_to_str(it->value()) != k.substr(3)) {
+	  ++errors;
+	}
+	last = k;
+      }
+      bufferlist v;
+      if (db->get("prefix", "key0", &v) != 0 || _bl_to_str(v) != "0") {
+	++errors;
+      }
+    }
+  };
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back(reader);
+  }
+  for (int round = 0; round < 20; ++round) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 1; i < nkeys; i += 2) {
+      bufferlist v;
+      v.append(stringify(i));
+      t->set("prefix", "key" + stringify(i), v);
+    }
+    db->submit_transaction_sync(t);
+    t = db->get_transaction();
+    t->rm_range_keys("prefix", "key1", "key2");
+    for (int i = 3; i < nkeys; i += 2) {
+      t->rmkey("prefix", "key" + stringify(i));
+    }
+    db->submit_transaction_sync(t);
+  }
+  stop = true;
+  for (auto& th : readers) {
+    th.join();
+  }
+  ASSERT_EQ(0u, errors);
+  fini();
+}
+
+TEST_P(KVTest, BenchConcurrentGet) {
+  // small enough for the unit test run; it checks that readers stay
+  // correct next to a writer, the rate printed is only a rough hint
+  const int nkeys = 10000;
+  const int nthreads = 4;
+  const int gets_per_thread = 10000;
+  ASSERT_EQ(0, db->create_and_open(cout));
+  bufferlist data;
+  bufferptr bp(100);
+  bp.zero();
+  data.append(bp);
+  for (int i = 0; i < nkeys; i += 1000) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int j = i; j < i + 1000; ++j) {
+      t->set("prefix", "key" + stringify(j), data);
+    }
+    db->submit_transaction_sync(t);
+  }
+  std::atomic<bool> stop = { false };
+  std::thread writer([&]() {
+    int i = 0;
+    while (!stop) {
+      KeyValueDB::Transaction t = db->get_transaction();
+      t->set("prefix", "key" + stringify(i++ % nkeys), data);
+      db->submit_transaction(t);
+    }
+  });
+  utime_t start = ceph_clock_now();
+  std::vector<std::thread> readers;
+  for (int n = 0; n < nthreads; ++n) {
+    readers.emplace_back([&, n]() {
+      unsigned seed = n;
+      for (int i = 0; i < gets_per_thread; ++i) {
+	bufferlist v;
+	// every key exists from the start; the writer only rewrites them
+	ASSERT_EQ(0, db->get("prefix", "key" + stringify(rand_r(&seed) % nkeys), &v));
+	ASSERT_EQ(data.length(), v.length());
+      }
+    });
+  }
+  for (auto& th : readers) {
+    th.join();
+  }
+  utime_t dur = ceph_clock_now() - start;
+  stop = true;
+  writer.join();
+  cout << nthreads << " threads did " << nthreads * gets_per_thread
+       << " gets with a concurrent writer in " << dur << ", "
+       << (nthreads * gets_per_thread / (double)dur) << " gets/sec"
+       << std::endl;
+  fini();
+}
+
 TEST_P(KVTest, RocksDBColumnFamilyTest) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -366,6 +638,155 @@ TEST_P(KVTest, RocksDBColumnFamilyTest) {
   fini();
 }
 
+TEST_P(KVTest, RocksDBShardedColumnFamilyTest) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  ASSERT_EQ(0, RocksDBStore::parse_sharding_def("s(4) cf1=", &cfs));
+  ASSERT_EQ(2u, cfs.size());
+  ASSERT_EQ(4u, cfs[0].shard_cnt);
+  ASSERT_EQ("s(4) cf1", RocksDBStore::get_sharding_def(cfs));
+  {
+    std::vector<KeyValueDB::ColumnFamily> bad;
+    ASSERT_EQ(-EINVAL, RocksDBStore::parse_sharding_def("s(0)", &bad));
+    ASSERT_EQ(-EINVAL, RocksDBStore::parse_sharding_def("s(2,3-1)", &bad));
+  }
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist value;
+    value.append("value");
+    for (unsigned i = 0; i < 100; ++i) {
+      t->set("s", stringify(1000 + i), value);
+    }
+    t->set("cf1", "key", value);
+    t->set("prefix", "key", value);
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  fini();
+
+  auto check = [&](unsigned first, unsigned last) {
+    KeyValueDB::Iterator it = db->get_iterator("s");
+    unsigned i = first;
+    for (it->seek_to_first(); it->valid(); it->next(), ++i) {
+      ASSERT_EQ(stringify(1000 + i), it->key());
+    }
+    ASSERT_EQ(last, i);
+    // change direction in the middle of the range
+    it->lower_bound(stringify(1000 + first + 10));
+    it->prev();
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ(stringify(1000 + first + 9), it->key());
+    it->next();
+    it->next();
+    ASSERT_EQ(stringify(1000 + first + 11), it->key());
+    bufferlist v;
+    ASSERT_EQ(0, db->get("s", stringify(1000 + first), &v));
+    ASSERT_EQ("value", _bl_to_str(v));
+    ASSERT_EQ(-ENOENT, db->get("s", stringify(1000 + last), &v));
+    ASSERT_EQ(0, db->get("cf1", "key", &v));
+    ASSERT_EQ(0, db->get("prefix", "key", &v));
+  };
+
+  init();
+  ASSERT_EQ(0, db->open(cout, cfs));
+  check(0, 100);
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("s", stringify(1000), stringify(1020));
+    t->rmkey("s", stringify(1099));
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  check(20, 99);
+
+  cout << "reshard and reopen" << std::endl;
+  ASSERT_EQ(0, static_cast<RocksDBStore*>(db.get())->reshard(
+    "s(3,0-3) prefix", cout));
+  fini();
+  init();
+  cfs.clear();
+  ASSERT_EQ(0, RocksDBStore::parse_sharding_def("s(3,0-3) prefix", &cfs));
+  ASSERT_EQ(0, db->open(cout, cfs));
+  check(20, 99);
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkeys_by_prefix("s");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+    KeyValueDB::Iterator it = db->get_iterator("s");
+    it->seek_to_first();
+    ASSERT_FALSE(it->valid());
+  }
+  fini();
+}
+
+TEST_P(KVTest, RocksDBPrefixStats) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  g_ceph_context->_conf.set_val("rocksdb_collect_prefix_stats", "true");
+  init();
+  ASSERT_EQ(0, db->create_and_open(cout));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist value;
+    value.append("value");
+    t->set("a", "key1", value);
+    t->set("a", "key2", value);
+    t->rmkey("b", "key");
+    t->rm_range_keys("b", "k1", "k2");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  bufferlist v;
+  ASSERT_EQ(0, db->get("a", "key1", &v));
+  // a miss counts as a get of 0 bytes, for a single key and for a set
+  v.clear();
+  ASSERT_EQ(-ENOENT, db->get("a", "nokey", &v));
+  std::map<string, bufferlist> out;
+  ASSERT_EQ(0, db->get("a", std::set<string>{"key2", "nokey"}, &out));
+  ASSERT_EQ(1u, out.size());
+  KeyValueDB::Iterator it = db->get_iterator("a");
+  it->lower_bound("key2");
+  ASSERT_TRUE(it->valid());
+  it.reset();
+
+  JSONFormatter f;
+  f.open_object_section("stats");
+  static_cast<RocksDBStore*>(db.get())->dump_prefix_stats(&f);
+  f.close_section();
+  stringstream ss;
+  f.flush(ss);
+  cout << ss.str() << std::endl;
+  JSONParser parser;
+  ASSERT_TRUE(parser.parse(ss.str().c_str(), ss.str().size()));
+  JSONObj *stats = parser.find_obj("rocksdb_prefix_statistics");
+  ASSERT_TRUE(stats);
+  auto stat = [&](const char *prefix, const char *name) {
+    uint64_t val = UINT64_MAX;
+    JSONObj *p = stats->find_obj(prefix);
+    if (p) {
+      JSONDecoder::decode_json(name, val, p);
+    }
+    return val;
+  };
+  ASSERT_EQ(4u, stat("a", "gets"));
+  ASSERT_EQ(10u, stat("a", "get_bytes"));
+  ASSERT_EQ(2u, stat("a", "sets"));
+  ASSERT_EQ(0u, stat("a", "merges"));
+  ASSERT_EQ(18u, stat("a", "set_bytes"));
+  ASSERT_EQ(0u, stat("a", "rmkeys"));
+  ASSERT_EQ(0u, stat("a", "rm_ranges"));
+  ASSERT_EQ(1u, stat("a", "seeks"));
+  ASSERT_EQ(1u, stat("b", "rmkeys"));
+  ASSERT_EQ(1u, stat("b", "rm_ranges"));
+  ASSERT_EQ(0u, stat("b", "gets"));
+  // the seek rm_range_keys did internally is not the caller's
+  ASSERT_EQ(0u, stat("b", "seeks"));
+  fini();
+  g_ceph_context->_conf.set_val("rocksdb_collect_prefix_stats", "false");
+}
+
 TEST_P(KVTest, RocksDBIteratorTest) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -468,7 +889,7 @@ TEST_P(KVTest, RocksDBCFMerge) {
 INSTANTIATE_TEST_SUITE_P(
   KeyValueDB,
   KVTest,
-  ::testing::Values("leveldb", "rocksdb", "memdb"));
+  ::testing::Values("leveldb", "rocksdb", "memdb", "memdb_skiplist"));
 
 int main(int argc, char **argv) {
   vector<const char*> args;
@@ -0,0 +1,177 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "osd/PrimaryLogPG.h"
+#include "messages/MOSDPGScan.h"
+#include "global/global_context.h"
+#include "gtest/gtest.h"
+
+typedef vector<pair<hobject_t, sha1_digest_t>> range_digests_t;
+
+// one hash, so that objects sort by name
+static hobject_t make_hoid(const string& name)
+{
+  return hobject_t(object_t(name), "", CEPH_NOSNAP, 0, 1, "");
+}
+
+static hobject_t make_hoid(unsigned i)
+{
+  return make_hoid("obj" + stringify(i));
+}
+
+static map<hobject_t, eversion_t> make_objects(unsigned n)
+{
+  map<hobject_t, eversion_t> objects;
+  for (unsigned i = 0; i < n; ++i) {
+    objects[make_hoid(i)] = eversion_t(1, i + 1);
+  }
+  return objects;
+}
+
+TEST(BackfillDigest, ranges)
+{
+  auto objects = make_objects(10);
+  hobject_t end = hobject_t::get_max();
+  range_digests_t digests = PrimaryLogPG::make_range_digests(
+    objects, make_hoid(2), end, 3);
+  // 2-4, 5-7, 8-9
+  ASSERT_EQ(3u, digests.size());
+  ASSERT_EQ(make_hoid(5), digests[0].first);
+  ASSERT_EQ(make_hoid(8), digests[1].first);
+  ASSERT_EQ(end, digests[2].first);
+}
+
+TEST(BackfillDigest, all_match)
+{
+  auto objects = make_objects(10);
+  range_digests_t digests = PrimaryLogPG::make_range_digests(
+    objects, make_hoid(2), hobject_t::get_max(), 3);
+  range_digests_t matched;
+  PrimaryLogPG::match_range_digests(make_hoid(2), digests,
+				    hobject_t::get_max(), &objects, &matched);
+  ASSERT_EQ(digests, matched);
+  // only what precedes the digested ranges is left
+  ASSERT_EQ(2u, objects.size());
+  ASSERT_EQ(make_hoid(1), objects.rbegin()->first);
+}
+
+TEST(BackfillDigest, mismatch)
+{
+  auto primary = make_objects(10);
+  range_digests_t digests = PrimaryLogPG::make_range_digests(
+    primary, make_hoid(0), hobject_t::get_max(), 3);
+  ASSERT_EQ(4u, digests.size());
+
+  // a newer version in the second range, a missing object in the last
+  auto peer = primary;
+  peer[make_hoid(4)] = eversion_t(2, 1);
+  peer.erase(make_hoid(9));
+  range_digests_t matched;
+  PrimaryLogPG::match_range_digests(make_hoid(0), digests,
+				    hobject_t::get_max(), &peer, &matched);
+  ASSERT_EQ(2u, matched.size());
+  ASSERT_EQ(digests[0], matched[0]);
+  ASSERT_EQ(digests[2], matched[1]);
+  // the objects of the ranges that differ are listed
+  map<hobject_t, eversion_t> expected;
+  expected[make_hoid(3)] = eversion_t(1, 4);
+  expected[make_hoid(4)] = eversion_t(2, 1);
+  expected[make_hoid(5)] = eversion_t(1, 6);
+  ASSERT_EQ(expected, peer);
+
+  // an extra object on the peer doesn't match either
+  peer = primary;
+  peer[make_hoid("obj1a")] = eversion_t(1, 1);
+  matched.clear();
+  PrimaryLogPG::match_range_digests(make_hoid(0), digests,
+				    hobject_t::get_max(), &peer, &matched);
+  ASSERT_EQ(3u, matched.size());
+  ASSERT_EQ(4u, peer.size());
+}
+
+TEST(BackfillDigest, truncated)
+{
+  auto primary = make_objects(10);
+  range_digests_t digests = PrimaryLogPG::make_range_digests(
+    primary, make_hoid(0), hobject_t::get_max(), 3);
+
+  // a bounded listing stopped at 7: ranges past it are not compared
+  auto peer = primary;
+  peer.erase(peer.lower_bound(make_hoid(7)), peer.end());
+  range_digests_t matched;
+  PrimaryLogPG::match_range_digests(make_hoid(0), digests, make_hoid(7),
+				    &peer, &matched);
+  ASSERT_EQ(2u, matched.size());
+  ASSERT_EQ(digests[1], matched[1]);
+  ASSERT_EQ(1u, peer.size());
+  ASSERT_EQ(make_hoid(6), peer.begin()->first);
+}
+
+static MOSDPGScan *encode_decode(MOSDPGScan *m, uint64_t features)
+{
+  bufferlist bl;
+  encode_message(m, features, bl);
+  m->put();
+  auto p = bl.cbegin();
+  Message *d = decode_message(g_ceph_context, 0, p);
+  EXPECT_TRUE(d);
+  EXPECT_EQ(MSG_OSD_PG_SCAN, d->get_type());
+  return static_cast<MOSDPGScan*>(d);
+}
+
+TEST(MOSDPGScan, encode_digests)
+{
+  spg_t pgid(pg_t(1, 1), shard_id_t::NO_SHARD);
+  range_digests_t digests = PrimaryLogPG::make_range_digests(
+    make_objects(10), make_hoid(2), hobject_t::get_max(), 3);
+  auto m = new MOSDPGScan(MOSDPGScan::OP_SCAN_GET_DIGEST, pg_shard_t(1),
+			  10, 9, pgid, make_hoid(0), hobject_t());
+  m->digest_begin = make_hoid(2);
+  m->range_digests = digests;
+  auto d = encode_decode(m, CEPH_FEATURES_ALL);
+  ASSERT_EQ(3, d->get_header().version);
+  // peers that don't know the digests can still decode the request
+  ASSERT_EQ(2, d->get_header().compat_version);
+  ASSERT_EQ((__u32)MOSDPGScan::OP_SCAN_GET_DIGEST, d->op);
+  ASSERT_EQ(make_hoid(0), d->begin);
+  ASSERT_EQ(make_hoid(2), d->digest_begin);
+  ASSERT_EQ(digests, d->range_digests);
+  d->put();
+}
+
+TEST(MOSDPGScan, decode_v2)
+{
+  // a v2 message, as sent by peers without digest scans
+  spg_t pgid(pg_t(1, 1), shard_id_t::NO_SHARD);
+  bufferlist payload;
+  encode((__u32)MOSDPGScan::OP_SCAN_GET_DIGEST, payload);
+  encode((epoch_t)10, payload);
+  encode((epoch_t)9, payload);
+  encode(pgid.pgid, payload);
+  encode(make_hoid(0), payload);
+  encode(hobject_t(), payload);
+  encode(pg_shard_t(1), payload);
+  encode(pgid.shard, payload);
+
+  auto m = ceph::make_message<MOSDPGScan>();
+  ceph_msg_header header = m->get_header();
+  header.version = 2;
+  m->set_header(header);
+  m->set_payload(payload);
+  m->decode_payload();
+  ASSERT_EQ((__u32)MOSDPGScan::OP_SCAN_GET_DIGEST, m->op);
+  ASSERT_EQ(10u, m->map_epoch);
+  ASSERT_EQ(make_hoid(0), m->begin);
+  ASSERT_EQ(pg_shard_t(1), m->from);
+  // no digests means a plain listing
+  ASSERT_TRUE(m->range_digests.empty());
+}
@@ -17,6 +17,8 @@
 #include <errno.h>
 #include <signal.h>
 #include "osd/ECBackend.h"
+#include "erasure-code/jerasure/ErasureCodeJerasure.h"
+#include "global/global_context.h"
 #include "gtest/gtest.h"
 
 TEST(ECUtil, stripe_info_t)
@@ -58,3 +60,125 @@ TEST(ECUtil, stripe_info_t)
             make_pair((uint64_t)0, 2*swidth));
 }
 
+struct DeltaDpp : public DoutPrefixProvider {
+  std::ostream& gen_prefix(std::ostream& out) const override { return out; }
+  CephContext *get_cct() const override { return g_ceph_context; }
+  unsigned get_subsys() const override { return ceph_subsys_osd; }
+};
+
+TEST(ECTransaction, parity_delta)
+{
+  DeltaDpp dpp;
+  auto jerasure = new ErasureCodeJerasureReedSolomonVandermonde;
+  ErasureCodeProfile profile;
+  profile["k"] = "4";
+  profile["m"] = "2";
+  ASSERT_EQ(0, jerasure->init(profile, &cerr));
+  ErasureCodeInterfaceRef ec_impl(jerasure);
+  ASSERT_TRUE(ec_impl->supports_parity_delta());
+
+  const uint64_t chunk_size = 4096;
+  ECUtil::stripe_info_t sinfo(4, 4 * chunk_size);
+  const uint64_t stripe_width = sinfo.get_stripe_width();
+  set<int> want;
+  for (int i = 0; i < 6; ++i) {
+    want.insert(i);
+  }
+
+  // a two stripe object
+  bufferlist old_data;
+  for (uint64_t i = 0; i < 2 * stripe_width; ++i) {
+    old_data.append((char)(i * 13 + 1));
+  }
+  map<int, bufferlist> old_chunks;
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec_impl, old_data, want, &old_chunks));
+
+  hobject_t h = hobject_t(object_t("obj"), "", CEPH_NOSNAP, 0, 1, "")
+    .make_temp_hobject("delta");
+  ECUtil::HashInfoRef hinfo(new ECUtil::HashInfo(6));
+  hinfo->set_total_chunk_size_clear_hash(2 * chunk_size);
+  hinfo->set_projected_total_logical_size(sinfo, 2 * stripe_width);
+
+  // a small overwrite within the second data chunk of the second stripe
+  const uint64_t off = stripe_width + chunk_size + 10;
+  bufferlist update;
+  update.append(string(100, 'x'));
+  PGTransactionUPtr t(new PGTransaction);
+  t->write(h, off, update.length(), update, 0);
+
+  auto plan = ECTransaction::get_write_plan(
+    sinfo,
+    std::move(t),
+    [&](const hobject_t &i) {
+      return hinfo;
+    },
+    &dpp,
+    2);
+  ASSERT_TRUE(plan.to_read.empty());
+  ASSERT_TRUE(plan.will_write[h].empty());
+  ASSERT_EQ(1u, plan.delta_stripes[h].size());
+  ASSERT_EQ(set<int>{1}, plan.delta_stripes[h][stripe_width]);
+
+  // the chunks read back from every shard for that stripe
+  map<hobject_t, map<uint64_t, map<int, bufferlist>>> delta_chunks;
+  for (auto &&i : old_chunks) {
+    delta_chunks[h][stripe_width][i.first].substr_of(
+      i.second, chunk_size, chunk_size);
+  }
+  map<shard_id_t, ObjectStore::Transaction> trans;
+  for (int i = 0; i < 6; ++i) {
+    trans[shard_id_t(i)];
+  }
+  vector<pg_log_entry_t> entries;
+  map<hobject_t, extent_map> written;
+  set<hobject_t> temp_added, temp_removed;
+  ECTransaction::generate_transactions(
+    plan,
+    ec_impl,
+    pg_t(),
+    sinfo,
+    map<hobject_t, extent_map>(),
+    delta_chunks,
+    entries,
+    &written,
+    &trans,
+    &temp_added,
+    &temp_removed,
+    &dpp);
+  ASSERT_TRUE(written[h].empty());
+
+  bufferlist new_data;
+  new_data.substr_of(old_data, 0, off);
+  new_data.append(update);
+  bufferlist tail;
+  tail.substr_of(old_data, off + update.length(),
+		 old_data.length() - off - update.length());
+  new_data.append(tail);
+  map<int, bufferlist> new_chunks;
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec_impl, new_data, want, &new_chunks));
+
+  // only the modified data chunk and the coding chunks are written
+  for (auto &&i : trans) {
+    int shard = i.first;
+    unsigned writes = 0;
+    for (auto p = i.second.begin(); p.have_op(); ) {
+      auto op = p.decode_op();
+      if (op->op == ObjectStore::Transaction::OP_WRITE) {
+	bufferlist bl;
+	p.decode_bl(bl);
+	ASSERT_EQ(chunk_size, (uint64_t)op->off);
+	ASSERT_EQ(chunk_size, bl.length());
+	bufferlist expected;
+	expected.substr_of(new_chunks[shard], chunk_size, chunk_size);
+	ASSERT_TRUE(bl.contents_equal(expected)) << "shard " << shard;
+	++writes;
+      } else {
+	ASSERT_EQ(ObjectStore::Transaction::OP_SETATTR, op->op);
+	p.decode_string();
+	bufferlist bl;
+	p.decode_bl(bl);
+      }
+    }
+    ASSERT_EQ((shard == 1 || shard >= 4) ? 1u : 0u, writes) << "shard " << shard;
+  }
+}
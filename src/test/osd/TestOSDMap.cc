@@ -1397,6 +1397,65 @@ TEST_F(OSDMapTest, BUG_40104) {
   }
 }
 
+TEST_F(OSDMapTest, SharedCopyFrom) {
+  set_up_map();
+
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, my_rep_pool));
+  vector<int> up, acting;
+  int up_primary, acting_primary;
+  osdmap.pg_to_up_acting_osds(pgid, &up, &up_primary,
+                              &acting, &acting_primary);
+  ASSERT_EQ(3u, acting.size());
+
+  bufferlist before;
+  osdmap.encode(before, CEPH_FEATURES_SUPPORTED_DEFAULT);
+
+  OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+  inc.fsid = osdmap.get_fsid();
+  vector<int> new_acting = {acting[2], acting[1], acting[0]};
+  inc.new_pg_temp[pgid] = mempool::osdmap::vector<int>(
+    new_acting.begin(), new_acting.end());
+  inc.new_pg_upmap_items[osdmap.raw_pg_to_pg(pg_t(1, my_rep_pool))] =
+    mempool::osdmap::vector<pair<int32_t,int32_t>>({{0, 1}});
+  inc.new_primary_affinity[1] = CEPH_OSD_DEFAULT_PRIMARY_AFFINITY / 2;
+  inc.new_state[2] = CEPH_OSD_UP;
+
+  OSDMap shared;
+  shared.shared_copy_from(osdmap);
+  ASSERT_EQ(0, shared.apply_incremental(inc));
+  OSDMap deep;
+  deep.deepish_copy_from(osdmap);
+  ASSERT_EQ(0, deep.apply_incremental(inc));
+
+  // the source map is untouched...
+  bufferlist after;
+  osdmap.encode(after, CEPH_FEATURES_SUPPORTED_DEFAULT);
+  ASSERT_TRUE(before.contents_equal(after));
+  ASSERT_FALSE(osdmap.is_down(2));
+  ASSERT_FALSE(osdmap.have_pg_upmaps(
+    osdmap.raw_pg_to_pg(pg_t(1, my_rep_pool))));
+
+  // ...and the shared copy ends up where a private one does
+  bufferlist sbl, dbl;
+  shared.encode(sbl, CEPH_FEATURES_SUPPORTED_DEFAULT);
+  deep.encode(dbl, CEPH_FEATURES_SUPPORTED_DEFAULT);
+  ASSERT_TRUE(sbl.contents_equal(dbl));
+  ASSERT_TRUE(shared.is_down(2));
+  shared.pg_to_up_acting_osds(pgid, &up, &up_primary,
+                              &acting, &acting_primary);
+  ASSERT_EQ(new_acting, acting);
+
+  // decoding over a shared copy replaces its tables rather than
+  // overwriting the source's
+  OSDMap reloaded;
+  reloaded.shared_copy_from(shared);
+  reloaded.decode(before);
+  ASSERT_TRUE(shared.is_down(2));
+  ASSERT_FALSE(reloaded.is_down(2));
+  ASSERT_TRUE(shared.have_pg_upmaps(
+    osdmap.raw_pg_to_pg(pg_t(1, my_rep_pool))));
+}
+
 TEST(PGTempMap, basic)
 {
   PGTempMap m;
@@ -142,6 +142,87 @@ TEST(TestOSDScrub, scrub_time_permit) {
 
 }
 
+TEST(TestOSDScrub, adaptive_sleep) {
+  AdaptiveSleep s;
+  uint64_t ops = 0;
+  // slow clients: jump to max / 64, then double every tick up to max
+  s.update(++ops, .2, .1, 1.0);
+  ASSERT_DOUBLE_EQ(1.0 / 64, s.get());
+  s.update(++ops, .2, .1, 1.0);
+  ASSERT_DOUBLE_EQ(1.0 / 32, s.get());
+  for (int i = 0; i < 10; ++i)
+    s.update(++ops, .2, .1, 1.0);
+  ASSERT_DOUBLE_EQ(1.0, s.get());
+  ASSERT_DOUBLE_EQ(0, s.get_scale(1.0));
+  // reading doesn't move it
+  ASSERT_DOUBLE_EQ(1.0, s.get());
+  ASSERT_DOUBLE_EQ(1.0, s.get());
+
+  // fast clients: halve every tick
+  s.update(++ops, .05, .1, 1.0);
+  ASSERT_DOUBLE_EQ(.5, s.get());
+  ASSERT_DOUBLE_EQ(.5, s.get_scale(1.0));
+  // no client op since the last tick is idle, even with a stale average
+  s.update(ops, .2, .1, 1.0);
+  ASSERT_DOUBLE_EQ(.25, s.get());
+  // and it drops to 0 below max / 64
+  for (int i = 0; i < 4; ++i)
+    s.update(ops, .2, .1, 1.0);
+  ASSERT_DOUBLE_EQ(1.0 / 64, s.get());
+  s.update(ops, .2, .1, 1.0);
+  ASSERT_DOUBLE_EQ(0, s.get());
+  ASSERT_DOUBLE_EQ(1, s.get_scale(1.0));
+
+  // turning the target off resets it at once
+  for (int i = 0; i < 10; ++i)
+    s.update(++ops, .2, .1, 1.0);
+  ASSERT_DOUBLE_EQ(1.0, s.get());
+  s.update(++ops, .2, 0, 1.0);
+  ASSERT_DOUBLE_EQ(0, s.get());
+}
+
+TEST(TestOSD, write_op_cost) {
+  // no pressure or no scale leaves the cost alone
+  ASSERT_EQ(1000, OSD::write_op_cost(1000, 1.0, 0));
+  ASSERT_EQ(1000, OSD::write_op_cost(1000, 0, 1.0));
+  // 1 + scale * pressure
+  ASSERT_EQ(1500, OSD::write_op_cost(1000, 1.0, .5));
+  ASSERT_EQ(2000, OSD::write_op_cost(1000, 1.0, 1.0));
+  ASSERT_EQ(5000, OSD::write_op_cost(1000, 4.0, 1.0));
+}
+
+TEST(TestOSD, pg_stats_acks) {
+  PGStatsAcks acks;
+  pg_t a(1, 1), b(2, 1), c(3, 1);
+  // nothing acked: every pg is reported
+  ASSERT_TRUE(acks.need_report(a, {10, 5}));
+  ASSERT_TRUE(acks.need_report(b, {10, 7}));
+
+  // the ack lists (reported_seq, reported_epoch)
+  acks.ack({{a, {5, 10}}});
+  ASSERT_FALSE(acks.need_report(a, {10, 5}));
+  // sent but not acknowledged yet, e.g. dropped by the mgr
+  ASSERT_TRUE(acks.need_report(b, {10, 7}));
+  // republished since the ack
+  ASSERT_TRUE(acks.need_report(a, {10, 6}));
+  ASSERT_TRUE(acks.need_report(a, {11, 5}));
+
+  acks.ack({{a, {6, 10}}, {b, {7, 10}}, {c, {1, 10}}});
+  ASSERT_FALSE(acks.need_report(a, {10, 6}));
+  ASSERT_FALSE(acks.need_report(b, {10, 7}));
+  ASSERT_EQ(3u, acks.size());
+
+  // pgs no longer reported here are forgotten, so they are sent again
+  // if they come back
+  acks.prune({a, b});
+  ASSERT_EQ(2u, acks.size());
+  ASSERT_TRUE(acks.need_report(c, {10, 1}));
+
+  // a new mgr session starts over
+  acks.clear();
+  ASSERT_TRUE(acks.need_report(a, {10, 6}));
+}
+
 // Local Variables:
 // compile-command: "cd ../.. ; make unittest_osdscrub ; ./unittest_osdscrub --log-to-stderr=true  --debug-osd=20 # --gtest_filter=*.* "
 // End:
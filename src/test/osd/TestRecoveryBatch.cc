@@ -0,0 +1,127 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "osd/PrimaryLogPG.h"
+#include "global/global_context.h"
+#include "gtest/gtest.h"
+
+typedef PrimaryLogPG::RecoveryBatch RecoveryBatch;
+
+class RecoveryBatchTest : public ::testing::Test {
+public:
+  pg_pool_t pool;
+
+  void SetUp() override {
+    pool.type = pg_pool_t::TYPE_REPLICATED;
+    g_ceph_context->_conf.set_val("osd_recovery_batch_max_object_size", "4096");
+    g_ceph_context->_conf.set_val("osd_recovery_batch_max_objects", "4");
+    g_ceph_context->_conf.set_val("osd_recovery_batch_max_bytes", "10000");
+  }
+  void TearDown() override {
+    g_ceph_context->_conf.rm_val("osd_recovery_batch_max_object_size");
+    g_ceph_context->_conf.rm_val("osd_recovery_batch_max_objects");
+    g_ceph_context->_conf.rm_val("osd_recovery_batch_max_bytes");
+  }
+
+  static object_info_t make_oi(uint64_t size, bool omap = false) {
+    object_info_t oi;
+    oi.size = size;
+    if (omap) {
+      oi.set_flag(object_info_t::FLAG_OMAP);
+    }
+    return oi;
+  }
+};
+
+TEST_F(RecoveryBatchTest, disabled)
+{
+  g_ceph_context->_conf.set_val("osd_recovery_batch_max_object_size", "0");
+  RecoveryBatch batch(g_ceph_context, pool);
+  object_info_t oi = make_oi(10);
+  ASSERT_FALSE(batch.is_small(oi));
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_FALSE(batch.fits(oi));
+    ASSERT_EQ(1u, batch.charge(oi));
+    ASSERT_FALSE(batch.has_room());
+  }
+}
+
+TEST_F(RecoveryBatchTest, erasure_coded)
+{
+  pool.type = pg_pool_t::TYPE_ERASURE;
+  RecoveryBatch batch(g_ceph_context, pool);
+  object_info_t oi = make_oi(10);
+  ASSERT_EQ(1u, batch.charge(oi));
+  ASSERT_FALSE(batch.has_room());
+}
+
+TEST_F(RecoveryBatchTest, max_objects)
+{
+  RecoveryBatch batch(g_ceph_context, pool);
+  object_info_t oi = make_oi(100);
+  // nothing to join before the first object opens a batch
+  ASSERT_FALSE(batch.has_room());
+  ASSERT_FALSE(batch.fits(oi));
+  ASSERT_EQ(1u, batch.charge(oi));
+  for (unsigned i = 1; i < 4; ++i) {
+    ASSERT_TRUE(batch.has_room());
+    ASSERT_TRUE(batch.fits(oi));
+    ASSERT_EQ(0u, batch.charge(oi));
+  }
+  ASSERT_EQ(4u, batch.objects);
+  ASSERT_EQ(400u, batch.bytes);
+  ASSERT_FALSE(batch.has_room());
+  ASSERT_FALSE(batch.fits(oi));
+  // a full batch is followed by a new one
+  ASSERT_EQ(1u, batch.charge(oi));
+  ASSERT_EQ(1u, batch.objects);
+  ASSERT_EQ(100u, batch.bytes);
+}
+
+TEST_F(RecoveryBatchTest, max_bytes)
+{
+  RecoveryBatch batch(g_ceph_context, pool);
+  ASSERT_EQ(1u, batch.charge(make_oi(4000)));
+  ASSERT_EQ(0u, batch.charge(make_oi(4000)));
+  // 8000 + 4000 would exceed the byte limit, a smaller one still fits
+  ASSERT_TRUE(batch.has_room());
+  ASSERT_FALSE(batch.fits(make_oi(4000)));
+  ASSERT_TRUE(batch.fits(make_oi(2000)));
+  ASSERT_EQ(0u, batch.charge(make_oi(2000)));
+  ASSERT_EQ(10000u, batch.bytes);
+  ASSERT_FALSE(batch.has_room());
+}
+
+TEST_F(RecoveryBatchTest, large_and_omap)
+{
+  RecoveryBatch batch(g_ceph_context, pool);
+  ASSERT_EQ(1u, batch.charge(make_oi(100)));
+  // a large object gets an op of its own and leaves the batch open
+  object_info_t large = make_oi(4097);
+  ASSERT_FALSE(batch.is_small(large));
+  ASSERT_FALSE(batch.fits(large));
+  ASSERT_EQ(1u, batch.charge(large));
+  ASSERT_EQ(1u, batch.objects);
+  ASSERT_EQ(100u, batch.bytes);
+  // omap keys and values count towards the size
+  object_info_t omap = make_oi(0, true);
+  ASSERT_EQ(2000u, batch.get_cost(omap, 2000));
+  ASSERT_TRUE(batch.fits(omap, 2000));
+  ASSERT_EQ(0u, batch.charge(omap, 2000));
+  ASSERT_EQ(2100u, batch.bytes);
+  // an empty object holding a large omap, e.g. a bucket index shard
+  ASSERT_FALSE(batch.is_small(omap, 4097));
+  ASSERT_FALSE(batch.fits(omap, 4097));
+  ASSERT_EQ(1u, batch.charge(omap, 4097));
+  ASSERT_EQ(2u, batch.objects);
+  ASSERT_EQ(2100u, batch.bytes);
+}
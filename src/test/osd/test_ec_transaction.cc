@@ -122,3 +122,61 @@ TEST(ectransaction, many_writes)
   ASSERT_EQ(0u, plan.to_read.size());
   ASSERT_EQ(1u, plan.will_write.size());
 }
+
+TEST(ectransaction, delta_stripes)
+{
+  hobject_t h;
+  ECUtil::stripe_info_t sinfo(4, 16384);
+  ECUtil::HashInfoRef hinfo(new ECUtil::HashInfo(6));
+  hinfo->set_total_chunk_size_clear_hash(3 * 4096);
+  auto get_hinfo = [&](const hobject_t &i) {
+    hinfo->set_projected_total_logical_size(sinfo, 3 * 16384);
+    return hinfo;
+  };
+  bufferlist a, b;
+  a.append_zero(512);
+  b.append_zero(8192);
+
+  {
+    // two small writes to different stripes, each within a chunk
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 100, a.length(), a, 0);
+    t->write(h, 16384 + 3 * 4096, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, 2);
+    generic_derr << "delta_stripes " << plan.delta_stripes << dendl;
+
+    ASSERT_EQ(0u, plan.to_read.size());
+    ASSERT_EQ(2u, plan.delta_stripes[h].size());
+    ASSERT_EQ(set<int>{0}, plan.delta_stripes[h][0]);
+    ASSERT_EQ(set<int>{3}, plan.delta_stripes[h][16384]);
+    ASSERT_TRUE(plan.will_write[h].empty());
+  }
+
+  {
+    // a write spanning three chunks is too wide, so the whole object
+    // falls back to rmw
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 100, a.length(), a, 0);
+    t->write(h, 16384 + 2048, b.length(), b, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, 2);
+    generic_derr << "to_read " << plan.to_read << dendl;
+
+    ASSERT_EQ(0u, plan.delta_stripes.size());
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_EQ(2u * 16384, plan.to_read[h].size());
+    ASSERT_EQ(plan.to_read, plan.will_write);
+
+    // and a delta plan can be reverted into the same rmw plan
+    PGTransactionUPtr t2(new PGTransaction);
+    t2->write(h, 100, a.length(), a, 0);
+    auto plan2 = ECTransaction::get_write_plan(
+      sinfo, std::move(t2), get_hinfo, &dpp, 2);
+    ASSERT_EQ(1u, plan2.delta_stripes.size());
+    plan2.revert_delta_stripes(sinfo);
+    ASSERT_EQ(0u, plan2.delta_stripes.size());
+    ASSERT_EQ(16384u, plan2.to_read[h].size());
+    ASSERT_EQ(plan2.to_read, plan2.will_write);
+  }
+}
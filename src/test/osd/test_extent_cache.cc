@@ -278,3 +278,83 @@ TEST(extentcache, write_write_overlap2)
 
   c.release_write_pin(pin3);
 }
+
+TEST(extentcache, retained)
+{
+  hobject_t oid;
+  hobject_t oid2(sobject_t("foo", CEPH_NOSNAP));
+
+  ExtentCache c;
+  c.set_retain_limit(25);
+  {
+    ExtentCache::write_pin pin;
+    c.open_write_pin(pin);
+    auto to_write = iset_from_vector({{0, 10}, {20, 10}});
+    auto must_read = c.reserve_extents_for_rmw(
+      oid, pin, to_write, extent_set());
+    ASSERT_TRUE(must_read.empty());
+    c.present_rmw_update(oid, pin, imap_from_iset(to_write));
+    c.release_write_pin(pin);
+  }
+  ASSERT_EQ(20u, c.get_retained_bytes());
+  ASSERT_TRUE(c.is_retained(oid, iset_from_vector({{0, 10}, {22, 4}})));
+  ASSERT_FALSE(c.is_retained(oid, iset_from_vector({{0, 30}})));
+  ASSERT_FALSE(c.is_retained(oid2, iset_from_vector({{0, 10}})));
+
+  {
+    // retained extents don't need to be read again
+    ExtentCache::write_pin pin;
+    c.open_write_pin(pin);
+    auto to_read = iset_from_vector({{0, 10}, {10, 10}});
+    auto to_write = iset_from_vector({{0, 20}});
+    auto must_read = c.reserve_extents_for_rmw(
+      oid, pin, to_write, to_read);
+    ASSERT_EQ(must_read, iset_from_vector({{10, 10}}));
+    ASSERT_EQ(10u, c.get_retained_bytes());
+    ASSERT_FALSE(c.is_retained(oid, iset_from_vector({{0, 10}})));
+
+    auto pending_read = to_read;
+    pending_read.subtract(must_read);
+    auto pending = c.get_remaining_extents_for_rmw(
+      oid, pin, pending_read);
+    ASSERT_FALSE(pending.empty());
+
+    c.present_rmw_update(oid, pin, imap_from_iset(to_write));
+    c.release_write_pin(pin);
+  }
+  // lru trims the oldest extent, {20, 10}
+  ASSERT_EQ(20u, c.get_retained_bytes());
+  ASSERT_TRUE(c.is_retained(oid, iset_from_vector({{0, 20}})));
+  ASSERT_FALSE(c.is_retained(oid, iset_from_vector({{20, 10}})));
+
+  {
+    ExtentCache::write_pin pin;
+    c.open_write_pin(pin);
+    auto to_write = iset_from_vector({{0, 10}});
+    c.reserve_extents_for_rmw(oid2, pin, to_write, extent_set());
+    c.present_rmw_update(oid2, pin, imap_from_iset(to_write));
+    c.release_write_pin(pin);
+  }
+  ASSERT_EQ(20u, c.get_retained_bytes());
+  ASSERT_TRUE(c.is_retained(oid, iset_from_vector({{10, 10}})));
+  ASSERT_TRUE(c.is_retained(oid2, iset_from_vector({{0, 10}})));
+
+  c.invalidate_retained(oid);
+  ASSERT_EQ(10u, c.get_retained_bytes());
+  ASSERT_FALSE(c.is_retained(oid, iset_from_vector({{10, 10}})));
+  ASSERT_TRUE(c.is_retained(oid2, iset_from_vector({{0, 10}})));
+
+  c.clear_retained();
+  ASSERT_EQ(0u, c.get_retained_bytes());
+
+  c.set_retain_limit(0);
+  {
+    ExtentCache::write_pin pin;
+    c.open_write_pin(pin);
+    auto to_write = iset_from_vector({{0, 10}});
+    c.reserve_extents_for_rmw(oid, pin, to_write, extent_set());
+    c.present_rmw_update(oid, pin, imap_from_iset(to_write));
+    c.release_write_pin(pin);
+  }
+  ASSERT_EQ(0u, c.get_retained_bytes());
+}
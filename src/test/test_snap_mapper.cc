@@ -52,6 +52,14 @@ class PausyAsyncMap : public MapCacher::StoreDriver<string, bufferlist> {
       }
     }
   };
+  struct RemoveRange : public _Op {
+    string first, last;
+    RemoveRange(const string &first, const string &last)
+      : first(first), last(last) {}
+    void operate(map<string, bufferlist> *store) override {
+      store->erase(store->lower_bound(first), store->lower_bound(last));
+    }
+  };
   struct Insert : public _Op {
     map<string, bufferlist> to_insert;
     explicit Insert(const map<string, bufferlist> &to_insert) : to_insert(to_insert) {}
@@ -83,6 +91,9 @@ public:
     void remove_keys(const set<string> &r) override {
       ops.push_back(Op(new Remove(r)));
     }
+    void remove_range(const string &first, const string &last) override {
+      ops.push_back(Op(new RemoveRange(first, last)));
+    }
     void add_callback(Context *c) override {
       callbacks.push_back(Op(new Callback(c)));
     }
@@ -321,6 +332,24 @@ public:
       driver->submit(&t);
     }
   }
+  void remove_ranged() {
+    size_t remove_size = random_num();
+    set<string> to_remove;
+    for (size_t i = 0; i < remove_size ; ++i) {
+      to_remove.insert(*rand_choose(names));
+    }
+    for (set<string>::iterator i = to_remove.begin();
+	 i != to_remove.end();
+	 ++i) {
+      truth.erase(*i);
+    }
+    {
+      // names are lower case letters only
+      PausyAsyncMap::Transaction t;
+      cache->remove_keys_ranged(to_remove, "{", &t);
+      driver->submit(&t);
+    }
+  }
   void get() {
     set<string> to_get;
     size_t get_size = random_num();
@@ -418,7 +447,7 @@ TEST_F(MapCacherTest, Random)
     if (!(i % 50)) {
       std::cout << "On iteration " << i << std::endl;
     }
-    switch (rand() % 4) {
+    switch (rand() % 5) {
     case 0:
       get();
       break;
@@ -431,6 +460,9 @@ TEST_F(MapCacherTest, Random)
     case 3:
       remove();
       break;
+    case 4:
+      remove_ranged();
+      break;
     }
   }
 }
@@ -511,8 +543,12 @@ public:
     set<hobject_t> hobjects = snap->second;
 
     vector<hobject_t> hoids;
+    bool batch = rand() % 2;
     while (mapper->get_next_objects_to_trim(
 	     snap->first, rand() % 5 + 1, &hoids) == 0) {
+      PausyAsyncMap::Transaction bt;
+      if (batch)
+	mapper->start_batch();
       for (auto &&hoid: hoids) {
 	ceph_assert(!hoid.is_max());
 	ceph_assert(hobjects.count(hoid));
@@ -524,7 +560,13 @@ public:
 	set<snapid_t> old_snaps(j->second);
 	j->second.erase(snap->first);
 
-	{
+	if (batch) {
+	  mapper->update_snaps(
+	    hoid,
+	    j->second,
+	    &old_snaps,
+	    &bt);
+	} else {
 	  PausyAsyncMap::Transaction t;
 	  mapper->update_snaps(
 	    hoid,
@@ -538,6 +580,10 @@ public:
 	}
 	hoid = hobject_t::get_max();
       }
+      if (batch) {
+	mapper->flush_batch(&bt);
+	driver->submit(&bt);
+      }
       hoids.clear();
     }
     ceph_assert(hobjects.empty());
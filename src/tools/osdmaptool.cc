@@ -58,6 +58,9 @@ void usage()
   cout << "   --dump <format>         displays the map in plain text when <format> is 'plain', 'json' if specified format is not supported" << std::endl;
   cout << "   --tree                  displays a tree of the map" << std::endl;
   cout << "   --test-crush [--range-first <first> --range-last <last>] map pgs to acting osds" << std::endl;
+  cout << "   --test-map-incrementals --range-first <first> --range-last <last>" << std::endl;
+  cout << "                           apply <mapdir>/inc_<e> to <mapdir>/<first> and report" << std::endl;
+  cout << "                           osdmap memory with and without table sharing" << std::endl;
   exit(1);
 }
 
@@ -146,6 +149,7 @@ int main(int argc, const char **argv)
   std::set<std::string> upmap_pools;
   int64_t pg_num = -1;
   bool test_map_pgs_dump_all = false;
+  bool test_map_incrementals = false;
 
   std::string val;
   std::ostringstream err;
@@ -201,6 +205,8 @@ int main(int argc, const char **argv)
       test_map_pgs_dump = true;
     } else if (ceph_argparse_flag(args, i, "--test-map-pgs-dump-all", (char*)NULL)) {
       test_map_pgs_dump_all = true;
+    } else if (ceph_argparse_flag(args, i, "--test-map-incrementals", (char*)NULL)) {
+      test_map_incrementals = true;
     } else if (ceph_argparse_flag(args, i, "--test-random", (char*)NULL)) {
       test_random = true;
     } else if (ceph_argparse_flag(args, i, "--clobber", (char*)NULL)) {
@@ -253,6 +259,92 @@ int main(int argc, const char **argv)
   }
   fn = args[0];
 
+  if (test_map_incrementals) {
+    if (range_first < 0 || range_last < range_first) {
+      cerr << me << ": --test-map-incrementals needs --range-first and --range-last"
+	   << std::endl;
+      exit(1);
+    }
+    auto read = [&](const string& s, bufferlist *bl) {
+      string error;
+      int r = bl->read_file(s.c_str(), &error);
+      if (r < 0) {
+	cerr << "unable to read " << s << ": " << cpp_strerror(r) << std::endl;
+	exit(1);
+      }
+    };
+    bufferlist base_bl;
+    read(fn + "/" + std::to_string(range_first), &base_bl);
+    vector<OSDMap::Incremental> incs;
+    for (int i = range_first + 1; i <= range_last; i++) {
+      bufferlist bl;
+      read(fn + "/inc_" + std::to_string(i), &bl);
+      incs.emplace_back();
+      auto p = bl.cbegin();
+      incs.back().decode(p);
+    }
+
+    // every epoch decoded into a map of its own, as if each were
+    // rebuilt from its full encoding
+    vector<bufferlist> full(incs.size() + 1);
+    full[0] = base_bl;
+    {
+      OSDMap m;
+      m.decode(base_bl);
+      for (unsigned i = 0; i < incs.size(); i++) {
+	int r = m.apply_incremental(incs[i]);
+	ceph_assert(r == 0);
+	m.encode(full[i + 1], incs[i].encode_features | CEPH_FEATURE_RESERVED);
+      }
+    }
+    size_t bytes = mempool::osdmap::allocated_bytes();
+    size_t items = mempool::osdmap::allocated_items();
+    {
+      vector<std::unique_ptr<OSDMap>> maps;
+      for (auto& bl : full) {
+	maps.emplace_back(new OSDMap);
+	maps.back()->decode(bl);
+      }
+      cout << "independent: " << maps.size() << " maps, "
+	   << mempool::osdmap::allocated_bytes() - bytes << " bytes, "
+	   << mempool::osdmap::allocated_items() - items << " items"
+	   << std::endl;
+    }
+
+    // each epoch built from the previous one, sharing unchanged tables
+    bytes = mempool::osdmap::allocated_bytes();
+    items = mempool::osdmap::allocated_items();
+    {
+      vector<std::unique_ptr<OSDMap>> maps;
+      maps.emplace_back(new OSDMap);
+      maps.back()->decode(base_bl);
+      int bad_crc = 0;
+      for (auto& inc : incs) {
+	OSDMap *o = new OSDMap;
+	o->shared_copy_from(*maps.back());
+	int r = o->apply_incremental(inc);
+	ceph_assert(r == 0);
+	if (inc.have_crc) {
+	  bufferlist fbl;
+	  o->encode(fbl, inc.encode_features | CEPH_FEATURE_RESERVED);
+	  if (o->get_crc() != inc.full_crc) {
+	    ++bad_crc;
+	  }
+	}
+	maps.emplace_back(o);
+      }
+      cout << "shared: " << maps.size() << " maps, "
+	   << mempool::osdmap::allocated_bytes() - bytes << " bytes, "
+	   << mempool::osdmap::allocated_items() - items << " items"
+	   << std::endl;
+      if (bad_crc) {
+	cerr << bad_crc << " epochs did not match the expected crc" << std::endl;
+	exit(1);
+      }
+    }
+    exit(0);
+  }
+
   if (range_first >= 0 && range_last >= 0) {
     set<OSDMap*> maps;
     OSDMap *prev = NULL;